@@ -1,4 +1,5 @@
-#include <cstdlib> /* EXIT_SUCCESS */
+#include <cstdlib> /* EXIT_SUCCESS, atoi */
+#include <cstring> /* strcmp */
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
@@ -40,48 +41,48 @@ class MySystem : wyre::System {
         time += dt;
         
 #if DEMO == CUBES
-        wyre::Transform& cube_transform = engine.ecs.get_component<wyre::Transform>(cube);
-        wyre::Mesh& cube_mesh = engine.ecs.get_component<wyre::Mesh>(cube);
-        // cube_transform.rotation *= glm::angleAxis(glm::radians(1.0f), glm::vec3(0, 1, 0));
-        // cube_transform.position.z = -1.0f + cos(time) * 0.5f;
-        // cube_transform.position.y = 2.0f + sin(time) * 1.0f;
-        // cube_mesh.material = glm::vec3(0.5f * cos(6.283f * (time * 0.2f + glm::vec3(0.0f, -0.33333f, 0.33333f))) + 0.5f) * 8.0f;
+        // engine.ecs.patch_component<wyre::Transform>(cube, [&](wyre::Transform& cube_transform) {
+        //     cube_transform.rotation *= glm::angleAxis(glm::radians(1.0f), glm::vec3(0, 1, 0));
+        //     cube_transform.position.z = -1.0f + cos(time) * 0.5f;
+        //     cube_transform.position.y = 2.0f + sin(time) * 1.0f;
+        // });
+        // engine.ecs.patch_component<wyre::Mesh>(cube, [&](wyre::Mesh& cube_mesh) {
+        //     cube_mesh.material = glm::vec3(0.5f * cos(6.283f * (time * 0.2f + glm::vec3(0.0f, -0.33333f, 0.33333f))) + 0.5f) * 8.0f;
+        // });
 #endif
 
 #if DEMO == TEST
-        wyre::Transform& cube_transform = engine.ecs.get_component<wyre::Transform>(cube);
-        wyre::Mesh& cube_mesh = engine.ecs.get_component<wyre::Mesh>(cube);
-
-        cube_transform.position.z = -6.75f + sin(time);
+        engine.ecs.patch_component<wyre::Transform>(cube, [&](wyre::Transform& cube_transform) { cube_transform.position.z = -6.75f + sin(time); });
 #endif
 
-        wyre::Transform& camera_transform = engine.ecs.get_component<wyre::Transform>(engine.active_camera);
-        
-        /* Rotate the camera */
-        const float rotate_speed = dt * 1.0f;
-        if (engine.input.is_key_held(wyre::KEY_LEFT)) phi -= rotate_speed;
-        if (engine.input.is_key_held(wyre::KEY_RIGHT)) phi += rotate_speed;
-        if (engine.input.is_key_held(wyre::KEY_UP)) theta += rotate_speed;
-        if (engine.input.is_key_held(wyre::KEY_DOWN)) theta -= rotate_speed;
-
-        /* Update camera rotation */
-        glm::mat4 rot = glm::rotate(glm::mat4(1.0f), theta, glm::vec3(1, 0, 0));
-        rot *= glm::rotate(glm::mat4(1.0f), phi, glm::vec3(0, 1, 0));
-        camera_transform.rotation = rot;
-
-        /* Get forward and right vectors */
-        const glm::vec3 forward = glm::vec4(0, 0, 1, 1) * rot;
-        const glm::vec3 up = glm::vec3(0, 1, 0);
-        const glm::vec3 right = glm::cross(forward, up);
-
-        /* Move the camera */
-        const float move_speed = dt * 2.0f;
-        if (engine.input.is_key_held(wyre::KEY_W)) camera_transform.position += forward * move_speed;
-        if (engine.input.is_key_held(wyre::KEY_A)) camera_transform.position -= right * move_speed;
-        if (engine.input.is_key_held(wyre::KEY_S)) camera_transform.position -= forward * move_speed;
-        if (engine.input.is_key_held(wyre::KEY_D)) camera_transform.position += right * move_speed;
-        if (engine.input.is_key_held(wyre::KEY_SPACE)) camera_transform.position += up * move_speed;
-        if (engine.input.is_key_held(wyre::KEY_LSHIFT)) camera_transform.position -= up * move_speed;
+        /* Transforms are read-only through `get_component`, they are changed with `patch_component` */
+        engine.ecs.patch_component<wyre::Transform>(engine.active_camera, [&](wyre::Transform& camera_transform) {
+            /* Rotate the camera */
+            const float rotate_speed = dt * 1.0f;
+            if (engine.input.is_key_held(wyre::KEY_LEFT)) phi -= rotate_speed;
+            if (engine.input.is_key_held(wyre::KEY_RIGHT)) phi += rotate_speed;
+            if (engine.input.is_key_held(wyre::KEY_UP)) theta += rotate_speed;
+            if (engine.input.is_key_held(wyre::KEY_DOWN)) theta -= rotate_speed;
+
+            /* Update camera rotation */
+            glm::mat4 rot = glm::rotate(glm::mat4(1.0f), theta, glm::vec3(1, 0, 0));
+            rot *= glm::rotate(glm::mat4(1.0f), phi, glm::vec3(0, 1, 0));
+            camera_transform.rotation = rot;
+
+            /* Get forward and right vectors */
+            const glm::vec3 forward = glm::vec4(0, 0, 1, 1) * rot;
+            const glm::vec3 up = glm::vec3(0, 1, 0);
+            const glm::vec3 right = glm::cross(forward, up);
+
+            /* Move the camera */
+            const float move_speed = dt * 2.0f;
+            if (engine.input.is_key_held(wyre::KEY_W)) camera_transform.position += forward * move_speed;
+            if (engine.input.is_key_held(wyre::KEY_A)) camera_transform.position -= right * move_speed;
+            if (engine.input.is_key_held(wyre::KEY_S)) camera_transform.position -= forward * move_speed;
+            if (engine.input.is_key_held(wyre::KEY_D)) camera_transform.position += right * move_speed;
+            if (engine.input.is_key_held(wyre::KEY_SPACE)) camera_transform.position += up * move_speed;
+            if (engine.input.is_key_held(wyre::KEY_LSHIFT)) camera_transform.position -= up * move_speed;
+        });
 
         // if (time > 5.0f) {
         //     engine.logger.info("five seconds passed.");
@@ -138,8 +139,23 @@ void add_dragon_big(wyre::WyreEngine& engine, glm::vec3 pos, const float angle =
 int main(int argc, char* argv[]) {
     wyre::WyreEngine engine(wyre::LogLevel::INFO);
 
+    /* Command line options: "--headless" renders offscreen, "--frames <n>" stops after n frames, "--smoke" only smoke tests a headless frame */
+    bool headless = false, smoke = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--headless") == 0) headless = true;
+        else if (strcmp(argv[i], "--smoke") == 0) headless = smoke = true;
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) engine.frame_limit = (uint32_t)atoi(argv[++i]);
+    }
+
     /* Init engine resources */
-    if (engine.init() == false) return EXIT_FAILURE;
+    if (engine.init(headless) == false) return EXIT_FAILURE;
+
+    /* The smoke test needs no scene, it checks the device renders & reads back a frame */
+    if (smoke) {
+        const bool passed = engine.smoke();
+        if (engine.destroy() == false) return EXIT_FAILURE;
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
     /* Register my game system */
     engine.ecs.register_system<MySystem>();
@@ -0,0 +1,183 @@
+#include <cstdlib>    /* EXIT_SUCCESS, EXIT_FAILURE */
+#include <cstdio>     /* printf, fprintf */
+#include <chrono>     /* timing */
+#include <cstring>    /* strcmp */
+#include <filesystem> /* std::filesystem::exists */
+#include <random>     /* std::mt19937 */
+#include <vector>
+
+#include <wyre/core/components/mesh.h>
+#include <wyre/core/scene/bvh.h>
+#include <wyre/core/scene/bvh-analyze.h>
+#include <wyre/core/system/log.h>
+#include <wyre/core/system/thread-pool.h>
+
+using namespace std::chrono;
+
+/* Number of rays traced to measure the traversal cost, the ray set is the same for every run. */
+constexpr uint32_t RAY_COUNT = 1u << 16u;
+/* Seed of the random ray set. */
+constexpr uint32_t RAY_SEED = 1234u;
+
+/** @brief Builder configuration to analyze. */
+struct BuilderConfig {
+    const char* name = nullptr;
+    wyre::scene::Builder builder = wyre::scene::Builder::BINNED_SAH;
+    bool spatial_splits = false;
+};
+
+/** @brief Builder configurations, every available builder. */
+const BuilderConfig BUILDERS[] = {
+    {"binned_sah", wyre::scene::Builder::BINNED_SAH, false},
+    {"sbvh", wyre::scene::Builder::BINNED_SAH, true},
+    {"lbvh", wyre::scene::Builder::LBVH, false},
+    {"ploc", wyre::scene::Builder::PLOC, false},
+};
+
+/** @brief Analysis of one build. */
+struct BuildResult {
+    const BuilderConfig* config = nullptr;
+    double build_ms = 0.0;
+    wyre::scene::BvhAnalysis analysis {};
+};
+
+/** @brief Append the triangles of a mesh to a triangle list. */
+void flatten(std::vector<wyre::Triangle>& triangles, std::vector<wyre::Normals>& normals, const wyre::Mesh& mesh) {
+    for (size_t i = 0; i < mesh.tri_count; ++i) {
+        const uint32_t i0 = mesh.indices.empty() ? (uint32_t)(i * 3 + 0) : mesh.indices[i * 3 + 0];
+        const uint32_t i1 = mesh.indices.empty() ? (uint32_t)(i * 3 + 1) : mesh.indices[i * 3 + 1];
+        const uint32_t i2 = mesh.indices.empty() ? (uint32_t)(i * 3 + 2) : mesh.indices[i * 3 + 2];
+        triangles.emplace_back(mesh.vertices[i0], mesh.vertices[i1], mesh.vertices[i2], mesh.material);
+        normals.emplace_back(mesh.normals[i0], mesh.normals[i1], mesh.normals[i2]);
+    }
+}
+
+/** @returns Random rays starting inside the bounds of a triangle list, with a fixed seed. */
+std::vector<wyre::scene::Ray> random_rays(const std::vector<wyre::Triangle>& triangles) {
+    wyre::AABB bounds {};
+    for (const wyre::Triangle& tri : triangles) bounds.grow(tri.get_aabb());
+
+    std::mt19937 rng(RAY_SEED);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::vector<wyre::scene::Ray> rays {};
+    for (uint32_t i = 0u; i < RAY_COUNT; ++i) {
+        const glm::vec3 origin = glm::mix(bounds.min, bounds.max, glm::vec3(unit(rng), unit(rng), unit(rng)));
+        rays.emplace_back(origin, glm::normalize(glm::vec3(normal(rng), normal(rng), normal(rng))));
+    }
+    return rays;
+}
+
+/** @brief Write an array of counts as JSON. */
+void write_json_array(FILE* file, const uint32_t* values, const size_t count) {
+    fprintf(file, "[");
+    for (size_t i = 0; i < count; ++i) fprintf(file, i > 0 ? ", %u" : "%u", values[i]);
+    fprintf(file, "]");
+}
+
+/** @brief Write a string as a JSON string, escaping quotes, backslashes & control characters. (e.g. in Windows paths) */
+void write_json_string(FILE* file, const char* str) {
+    fputc('"', file);
+    for (const char* c = str; *c != '\0'; ++c) {
+        if (*c == '"' || *c == '\\') fprintf(file, "\\%c", *c);
+        else if ((unsigned char)*c < 0x20u) fprintf(file, "\\u%04x", (unsigned)*c);
+        else fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+/** @brief Write the analysis results as JSON, so they can be compared between runs. */
+void write_json(FILE* file, const char* model, const uint32_t tri_count, const std::vector<BuildResult>& results) {
+    fprintf(file, "{\n  \"model\": ");
+    write_json_string(file, model);
+    fprintf(file, ",\n  \"triangles\": %u,\n  \"rays\": %u,\n  \"builds\": [\n", tri_count, RAY_COUNT);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BuildResult& result = results[i];
+        const wyre::scene::BvhAnalysis& a = result.analysis;
+        fprintf(file, "    {\n      \"builder\": \"%s\",\n      \"build_ms\": %.3f,\n", result.config->name, result.build_ms);
+        fprintf(file, "      \"nodes\": %u,\n      \"leaves\": %u,\n      \"prim_refs\": %u,\n", a.node_count, a.leaf_count, a.prim_refs);
+        fprintf(file, "      \"sah\": %.4f,\n      \"overlap\": %.4f,\n      \"empty_space\": %.4f,\n", a.sah, a.overlap, a.empty_space);
+        fprintf(file, "      \"max_leaf_size\": %u,\n      \"leaf_sizes\": ", a.max_leaf_size);
+        write_json_array(file, a.leaf_sizes, wyre::scene::BvhAnalysis::LEAF_SIZE_BUCKETS);
+        fprintf(file, ",\n      \"avg_leaf_depth\": %.3f,\n      \"leaf_depths\": ", a.avg_leaf_depth);
+        write_json_array(file, a.leaf_depths.data(), a.leaf_depths.size());
+        fprintf(file, ",\n      \"avg_nodes_visited\": %.3f,\n      \"avg_tris_tested\": %.3f\n", a.avg_nodes, a.avg_tris);
+        fprintf(file, i + 1u < results.size() ? "    },\n" : "    }\n");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+int main(int argc, char* argv[]) {
+    wyre::WyreEngine engine(wyre::LogLevel::INFO);
+
+    /* Usage: wyre-example-bvh-analyze [model.glb] [--meshes <count>] [--json <file>] */
+    const char* model = "assets/models/dragon_800k.glb";
+    const char* json_path = nullptr;
+    size_t mesh_count = 1u;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) json_path = argv[++i];
+        else if (strcmp(argv[i], "--meshes") == 0 && i + 1 < argc) mesh_count = std::max(1, atoi(argv[++i]));
+        else model = argv[i];
+    }
+    if (std::filesystem::exists(model) == false) {
+        engine.logger.error("model not found at '%s'.", model);
+        return EXIT_FAILURE;
+    }
+
+    /* Load the model (the engine is only used for file loading) */
+    std::vector<wyre::Triangle> triangles {};
+    std::vector<wyre::Normals> normals {};
+    for (size_t i = 0; i < mesh_count; ++i) flatten(triangles, normals, wyre::Mesh(engine.files, model, glm::vec3(-1.0f), i));
+    const uint32_t count = (uint32_t)triangles.size();
+    const std::vector<wyre::scene::Ray> rays = random_rays(triangles);
+
+    std::vector<BuildResult> results {};
+    wyre::ThreadPool pool {};
+    for (const BuilderConfig& config : BUILDERS) {
+        wyre::scene::BuildParams params {};
+        params.pool = &pool;
+        params.builder = config.builder;
+        params.spatial_splits = config.spatial_splits;
+
+        BuildResult result {};
+        result.config = &config;
+        const auto start = high_resolution_clock::now();
+        wyre::scene::Bvh bvh(triangles.data(), normals.data(), count, params);
+        result.build_ms = (double)duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1e3;
+
+        result.analysis = wyre::scene::analyze(bvh);
+        wyre::scene::analyze_traversal(result.analysis, bvh, rays.data(), (uint32_t)rays.size(), &pool);
+        results.push_back(std::move(result));
+        bvh.release();
+    }
+
+    printf("\n--- BVH analysis, %s (%u triangles, %u random rays) ---\n", model, count, RAY_COUNT);
+    printf("%-12s %10s %8s %8s %8s %8s %8s %9s %9s %10s %10s\n", "builder", "build (ms)", "nodes", "sah", "overlap", "empty", "leaf avg", "depth avg",
+           "depth max", "nodes/ray", "tris/ray");
+    for (const BuildResult& result : results) {
+        const wyre::scene::BvhAnalysis& a = result.analysis;
+        printf("%-12s %10.2f %8u %8.2f %8.2f %7.1f%% %8.2f %9.2f %9zu %10.2f %10.2f\n", result.config->name, result.build_ms, a.node_count, a.sah,
+               a.overlap, a.empty_space * 100.0f, a.leaf_count > 0u ? (float)a.prim_refs / a.leaf_count : 0.0f, a.avg_leaf_depth,
+               a.leaf_depths.empty() ? 0u : a.leaf_depths.size() - 1u, a.avg_nodes, a.avg_tris);
+    }
+
+    printf("\n--- Leaf size histogram (leaves with 1 .. %u+ primitives) ---\n", wyre::scene::BvhAnalysis::LEAF_SIZE_BUCKETS);
+    for (const BuildResult& result : results) {
+        printf("%-12s", result.config->name);
+        for (const uint32_t leaves : result.analysis.leaf_sizes) printf(" %7u", leaves);
+        printf("\n");
+    }
+
+    if (json_path) {
+        FILE* file = fopen(json_path, "w");
+        if (file == nullptr) {
+            engine.logger.error("failed to open '%s' for writing.", json_path);
+            return EXIT_FAILURE;
+        }
+        write_json(file, model, count, results);
+        fclose(file);
+        engine.logger.info("wrote analysis to '%s'.", json_path);
+    }
+
+    return EXIT_SUCCESS;
+}
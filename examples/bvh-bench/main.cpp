@@ -0,0 +1,716 @@
+#include <cstdlib>    /* EXIT_SUCCESS */
+#include <cstdio>     /* printf */
+#include <chrono>     /* timing */
+#include <cstring>    /* memcmp */
+#include <filesystem> /* std::filesystem::exists, std::filesystem::remove_all */
+#include <random>     /* std::mt19937 */
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp> /* glm::translate, glm::scale */
+
+#if defined(_WIN32) || defined(_WIN64)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h> /* GetProcessMemoryInfo */
+#else
+#include <sys/resource.h> /* getrusage */
+#endif
+
+#include <wyre/core/components/mesh.h>
+#include <wyre/core/scene/bvh.h>
+#include <wyre/core/scene/bvh-wide.h>
+#include <wyre/core/scene/bvh-binning.h>
+#include <wyre/core/scene/bvh-cache.h>
+#include <wyre/core/scene/bvh-traverse.h>
+#include <wyre/core/system/log.h>
+#include <wyre/core/system/mapped-file.h>
+#include <wyre/core/system/thread-pool.h>
+
+using namespace std::chrono;
+
+/* Number of times each build is repeated, the fastest build is reported. */
+constexpr int REPEATS = 5;
+/* Number of primitives binned per kernel measurement. */
+constexpr size_t KERNEL_PRIMS = 1u << 24u;
+/* Kernel results are written here, so the compiler can't optimize the kernels away. */
+volatile uint32_t kernel_sink = 0u;
+/* Number of random rays traced to measure traversal steps. */
+constexpr uint32_t STEP_RAYS = 1u << 16u;
+/* Time budget of the reinsertion optimization, in milliseconds. */
+constexpr float OPTIMIZE_MS = 500.0f;
+/* Resolution of the primary rays traced by the CPU traversal benchmark. */
+constexpr uint32_t PRIMARY_RES = 256u;
+/* Directory the BVH cache benchmark stores its files in. (removed afterwards) */
+constexpr const char* CACHE_DIR = "cache/bvh-bench";
+
+/** @brief Benchmark scene, a flattened list of triangles. */
+struct BenchScene {
+    const char* name = nullptr;
+    std::vector<wyre::Triangle> triangles {};
+    std::vector<wyre::Normals> normals {};
+};
+
+/** @brief Append the triangles of a mesh to a benchmark scene. */
+void flatten(BenchScene& scene, const wyre::Mesh& mesh, const glm::mat4& model = glm::mat4(1.0f)) {
+    const glm::mat3 normal_model = glm::transpose(glm::inverse(glm::mat3(model)));
+    const auto vertex = [&](const uint32_t i) { return glm::vec3(model * glm::vec4(mesh.vertices[i], 1.0f)); };
+    const auto normal = [&](const uint32_t i) { return glm::normalize(normal_model * mesh.normals[i]); };
+    for (size_t i = 0; i < mesh.tri_count; ++i) {
+        const uint32_t i0 = mesh.indices.empty() ? (uint32_t)(i * 3 + 0) : mesh.indices[i * 3 + 0];
+        const uint32_t i1 = mesh.indices.empty() ? (uint32_t)(i * 3 + 1) : mesh.indices[i * 3 + 1];
+        const uint32_t i2 = mesh.indices.empty() ? (uint32_t)(i * 3 + 2) : mesh.indices[i * 3 + 2];
+        scene.triangles.emplace_back(vertex(i0), vertex(i1), vertex(i2), mesh.material);
+        scene.normals.emplace_back(normal(i0), normal(i1), normal(i2));
+    }
+}
+
+/** @brief Load the box scene from the basic example, with its long & thin floor slab triangles. */
+bool load_box_scene(wyre::WyreEngine& engine, BenchScene& scene) {
+    const char* path = "assets/models/box.glb";
+    if (std::filesystem::exists(path) == false) return false;
+
+    /* Position & scale of the boxes, the same as `add_cube` calls in the basic example */
+    const glm::vec3 boxes[][2] = {
+        {{0.0f, -0.5f, 0.0f}, {128.0f, 1.0f, 128.0f}}, /* floor */
+        {{0.0f, 2.5f, -2.0f}, {5.0f, 5.0f, 1.0f}},      {{0.0f, 2.5f, 2.0f}, {5.0f, 5.0f, 1.0f}},
+        {{-3.0f, 2.5f, 0.0f}, {1.0f, 5.0f, 5.0f}},      {{0.0f, 2.0f, 0.0f}, {0.5f, 0.5f, 0.5f}},
+        {{-6.6f, 1.75f, 3.5f}, {0.5f, 0.5f, 0.5f}},     {{-6.6f, 1.75f, -3.5f}, {0.5f, 0.5f, 0.5f}},
+        {{6.6f, 1.75f, 3.5f}, {0.5f, 0.5f, 0.5f}},      {{6.6f, 1.75f, -3.5f}, {0.5f, 0.5f, 0.5f}},
+        {{6.6f, 7.0f, -8.5f}, {5.0f, 5.0f, 1.0f}},      {{6.6f, 7.0f, -6.5f}, {0.5f, 0.5f, 0.5f}},
+    };
+
+    const wyre::Mesh box(engine.files, path);
+    scene.name = "boxes";
+    for (const auto& [pos, scale] : boxes) {
+        flatten(scene, box, glm::scale(glm::translate(glm::mat4(1.0f), pos), scale));
+    }
+    return true;
+}
+
+/** @brief Load a benchmark scene from a GLTF model, returns false if the model doesn't exist. */
+bool load_scene(wyre::WyreEngine& engine, BenchScene& scene, const char* name, const char* path, const size_t mesh_count = 1u) {
+    if (std::filesystem::exists(path) == false) {
+        engine.logger.warn("skipping '%s', model not found at '%s'.", name, path);
+        return false;
+    }
+
+    scene.name = name;
+    for (size_t i = 0; i < mesh_count; ++i) {
+        flatten(scene, wyre::Mesh(engine.files, path, glm::vec3(-1.0f), i));
+    }
+    return true;
+}
+
+/** @returns The peak resident memory of the process so far. (in megabytes) */
+double peak_rss() {
+#if defined(_WIN32) || defined(_WIN64)
+    PROCESS_MEMORY_COUNTERS counters {};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return (double)counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return (double)usage.ru_maxrss / 1024.0; /* ru_maxrss is in kilobytes */
+#endif
+}
+
+/** @brief Random rays starting inside the bounds of a scene. */
+struct StepRays {
+    std::vector<wyre::scene::Ray> rays {};
+
+    explicit StepRays(const BenchScene& scene) {
+        wyre::AABB bounds {};
+        for (const wyre::Triangle& tri : scene.triangles) bounds.grow(tri.get_aabb());
+
+        std::mt19937 rng(1234u);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::normal_distribution<float> normal(0.0f, 1.0f);
+        for (uint32_t i = 0u; i < STEP_RAYS; ++i) {
+            const glm::vec3 origin = glm::mix(bounds.min, bounds.max, glm::vec3(unit(rng), unit(rng), unit(rng)));
+            rays.emplace_back(origin, glm::normalize(glm::vec3(normal(rng), normal(rng), normal(rng))));
+        }
+    }
+};
+
+/** @brief Traversal statistics of a BVH. */
+struct TraversalStats {
+    double avg_steps = 0.0;
+    /* Sum of the hit distances, to check that different builds find the same hits. */
+    double hit_sum = 0.0;
+};
+
+/** @returns The traversal statistics of a BVH, using a set of random rays. */
+TraversalStats measure_steps(const wyre::scene::Bvh& bvh, const StepRays& rays) {
+    TraversalStats stats {};
+    wyre::scene::RayCounters counters {};
+    for (const wyre::scene::Ray& ray : rays.rays) {
+        const wyre::scene::Hit hit = wyre::scene::intersect(bvh, ray, counters);
+        if (hit.is_hit()) stats.hit_sum += hit.t;
+    }
+    stats.avg_steps = (double)counters.nodes / STEP_RAYS;
+    return stats;
+}
+
+/** @returns The traversal statistics & ray throughput of a tracing function, using a set of random rays. (in millions of rays per second) */
+template <typename F>
+TraversalStats measure_rays(const StepRays& rays, double& mrays, F&& trace) {
+    TraversalStats stats {};
+    double best = 1e30;
+    for (int r = 0; r < REPEATS; ++r) {
+        TraversalStats run {};
+        wyre::scene::RayCounters counters {};
+        const auto start = high_resolution_clock::now();
+        for (const wyre::scene::Ray& ray : rays.rays) {
+            const wyre::scene::Hit hit = trace(ray, counters);
+            if (hit.is_hit()) run.hit_sum += hit.t;
+        }
+        best = std::min(best, (double)duration_cast<microseconds>(high_resolution_clock::now() - start).count());
+        run.avg_steps = (double)counters.nodes / STEP_RAYS;
+        stats = run;
+    }
+    mrays = STEP_RAYS / best;
+    return stats;
+}
+
+/** @returns The primary rays of a camera looking at the center of a scene, in row major order. (coherent) */
+std::vector<wyre::scene::Ray> primary_rays(const BenchScene& scene) {
+    wyre::AABB bounds {};
+    for (const wyre::Triangle& tri : scene.triangles) bounds.grow(tri.get_aabb());
+    const glm::vec3 center = (bounds.min + bounds.max) * 0.5f, extent = bounds.max - bounds.min;
+    const glm::vec3 eye = center + glm::vec3(0.3f, 0.4f, 1.0f) * glm::length(extent);
+    const glm::vec3 forward = glm::normalize(center - eye);
+    const glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f))), up = glm::cross(right, forward);
+
+    std::vector<wyre::scene::Ray> rays {};
+    for (uint32_t y = 0u; y < PRIMARY_RES; ++y) {
+        for (uint32_t x = 0u; x < PRIMARY_RES; ++x) {
+            const glm::vec2 uv = (glm::vec2(x, y) + 0.5f) / (float)PRIMARY_RES * 2.0f - 1.0f;
+            rays.emplace_back(eye, glm::normalize(forward * 1.5f + right * uv.x * 0.6f + up * uv.y * 0.6f));
+        }
+    }
+    return rays;
+}
+
+/** @returns The throughput of the fastest out of a number of ray batches. (in millions of rays per second) */
+template <typename F>
+double time_rays(const size_t count, F&& trace) {
+    double best = 1e30;
+    for (int i = 0; i < REPEATS; ++i) {
+        const auto start = high_resolution_clock::now();
+        trace();
+        best = std::min(best, (double)duration_cast<microseconds>(high_resolution_clock::now() - start).count());
+    }
+    return (double)count / std::max(best, 1.0);
+}
+
+/** @brief Time the fastest out of a number of BVH builds. (in milliseconds) */
+double time_build(const BenchScene& scene, const wyre::scene::BuildParams& params) {
+    double best = 1e30;
+    for (int i = 0; i < REPEATS; ++i) {
+        wyre::scene::Bvh bvh {};
+        const auto start = high_resolution_clock::now();
+        bvh.build(scene.triangles.data(), scene.normals.data(), (uint32_t)scene.triangles.size(), params);
+        const auto end = high_resolution_clock::now();
+        best = std::min(best, (double)duration_cast<microseconds>(end - start).count() / 1e3);
+        bvh.release();
+    }
+    return best;
+}
+
+/** @brief Benchmark scene primitives, in the SoA layout used by the binning kernels. */
+struct KernelInput {
+    std::vector<float> centroid[3] {}, bmin[3] {}, bmax[3] {};
+    wyre::scene::BinInput in {};
+    wyre::AABB cbounds {};
+};
+
+/** @brief Prepare the binning kernel input of a benchmark scene. */
+void prepare_kernel_input(KernelInput& input, const BenchScene& scene) {
+    for (const wyre::Triangle& prim : scene.triangles) {
+        const glm::vec3 centroid = prim.get_centroid();
+        const wyre::AABB aabb = prim.get_aabb();
+        for (uint32_t a = 0u; a < 3u; ++a) {
+            input.centroid[a].push_back(centroid[a]);
+            input.bmin[a].push_back(aabb.min[a]);
+            input.bmax[a].push_back(aabb.max[a]);
+        }
+        input.cbounds.grow(centroid);
+    }
+    for (uint32_t a = 0u; a < 3u; ++a) {
+        input.in.centroid[a] = input.centroid[a].data();
+        input.in.bmin[a] = input.bmin[a].data();
+        input.in.bmax[a] = input.bmax[a].data();
+    }
+}
+
+/** @brief Binning kernel as it was before the SIMD kernels. (AABB per bin, scalar) */
+template <uint32_t BINS>
+void bin_prims_previous(const wyre::scene::BinInput& in, const uint32_t count, const glm::vec3& cmin, const glm::vec3& scale) {
+    struct Bin {
+        wyre::AABB aabb {};
+        uint32_t prim_count = 0u;
+    } bins[3][BINS] {};
+    for (uint32_t prim = 0u; prim < count; ++prim) {
+        const glm::vec3 prim_min = glm::vec3(in.bmin[0][prim], in.bmin[1][prim], in.bmin[2][prim]);
+        const glm::vec3 prim_max = glm::vec3(in.bmax[0][prim], in.bmax[1][prim], in.bmax[2][prim]);
+        for (uint32_t a = 0u; a < 3u; ++a) {
+            const int bin_idx = (int)fminf(BINS - 1u, (float)((in.centroid[a][prim] - cmin[a]) * scale[a]));
+            bins[a][bin_idx].prim_count++;
+            bins[a][bin_idx].aabb.grow(prim_min);
+            bins[a][bin_idx].aabb.grow(prim_max);
+        }
+    }
+    kernel_sink = bins[0][0].prim_count;
+}
+
+/** @brief Time a binning kernel, over `KERNEL_PRIMS` primitives. (in millions of primitives per second) */
+template <typename F>
+double time_kernel(const uint32_t prim_count, F&& kernel) {
+    const size_t runs = std::max<size_t>(1u, KERNEL_PRIMS / prim_count);
+    double best = 1e30;
+    for (int i = 0; i < REPEATS; ++i) {
+        const auto start = high_resolution_clock::now();
+        for (size_t r = 0; r < runs; ++r) kernel();
+        const auto end = high_resolution_clock::now();
+        best = std::min(best, (double)duration_cast<microseconds>(end - start).count());
+    }
+    return (double)(runs * prim_count) / best;
+}
+
+/** @brief Measure the binning kernels with a given bin count, on a benchmark scene. */
+template <uint32_t BINS>
+void bench_kernel(const BenchScene& scene, const KernelInput& input) {
+    const uint32_t count = (uint32_t)scene.triangles.size();
+    const glm::vec3 cmin = input.cbounds.min;
+    const glm::vec3 scale = (float)BINS / (input.cbounds.max - input.cbounds.min);
+
+    /* Make sure the SIMD kernel produces the same bins as the scalar kernel */
+    wyre::scene::Bins<BINS> simd_bins {}, scalar_bins {};
+    wyre::scene::bin_prims(simd_bins, input.in, 0u, count, cmin, scale);
+    wyre::scene::bin_prims_scalar(scalar_bins, input.in, 0u, count, cmin, scale);
+    bool match = true;
+    for (uint32_t a = 0u; a < 3u; ++a) {
+        for (uint32_t b = 0u; b < BINS; ++b) {
+            const wyre::AABB simd = simd_bins.aabb(a, b), scalar = scalar_bins.aabb(a, b);
+            match &= simd_bins.count[a][b] == scalar_bins.count[a][b] && simd.min == scalar.min && simd.max == scalar.max;
+        }
+    }
+
+    const double previous = time_kernel(count, [&]() { bin_prims_previous<BINS>(input.in, count, cmin, scale); });
+    const double scalar = time_kernel(count, [&]() {
+        wyre::scene::Bins<BINS> bins {};
+        wyre::scene::bin_prims_scalar(bins, input.in, 0u, count, cmin, scale);
+        kernel_sink = bins.count[0][0];
+    });
+    const double simd = time_kernel(count, [&]() {
+        wyre::scene::Bins<BINS> bins {};
+        wyre::scene::bin_prims(bins, input.in, 0u, count, cmin, scale);
+        kernel_sink = bins.count[0][0];
+    });
+    printf("%-10s %6u %14.1f %14.1f %14.1f %9.2fx %7s\n", scene.name, BINS, previous, scalar, simd, simd / previous, match ? "yes" : "NO");
+}
+
+int main() {
+    wyre::WyreEngine engine(wyre::LogLevel::INFO);
+
+    /* Load the benchmark scenes (the engine is only used for file loading) */
+    std::vector<BenchScene> scenes {};
+    BenchScene scene {};
+    if (load_scene(engine, scene, "box", "assets/models/box.glb")) scenes.push_back(std::move(scene));
+    scene = {};
+    if (load_box_scene(engine, scene)) scenes.push_back(std::move(scene));
+    scene = {};
+    if (load_scene(engine, scene, "sphere", "assets/models/sphere.glb")) scenes.push_back(std::move(scene));
+    scene = {};
+    if (load_scene(engine, scene, "mitsuba", "assets/models/mitsuba_knob.glb", 2u)) scenes.push_back(std::move(scene));
+    scene = {};
+    if (load_scene(engine, scene, "sponza", "assets/models/sponza_66k.glb")) scenes.push_back(std::move(scene));
+    scene = {};
+    if (load_scene(engine, scene, "dragon", "assets/models/dragon_800k.glb")) scenes.push_back(std::move(scene));
+
+    /* Thread counts to measure scaling with */
+    std::vector<uint32_t> thread_counts {1u};
+    const uint32_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (uint32_t t = 2u; t < max_threads; t *= 2u) thread_counts.push_back(t);
+    if (max_threads > 1u) thread_counts.push_back(max_threads);
+
+    printf("\n--- BVH build time (best of %i) ---\n", REPEATS);
+    printf("%-10s %10s %8s %12s %10s %14s\n", "scene", "triangles", "threads", "build (ms)", "speedup", "peak rss (mb)");
+    for (const BenchScene& bench : scenes) {
+        /* Single threaded baseline (no thread pool) */
+        const double baseline = time_build(bench, {});
+        printf("%-10s %10zu %8s %12.2f %9.2fx %14.1f\n", bench.name, bench.triangles.size(), "-", baseline, 1.0, peak_rss());
+
+        for (const uint32_t threads : thread_counts) {
+            wyre::ThreadPool pool(threads);
+            wyre::scene::BuildParams params {};
+            params.pool = &pool;
+            const double ms = time_build(bench, params);
+            printf("%-10s %10zu %8u %12.2f %9.2fx %14.1f\n", bench.name, bench.triangles.size(), threads, ms, baseline / ms, peak_rss());
+        }
+    }
+
+#if WYRE_BINNING_AVX2
+    const char* isa = wyre::scene::has_avx2() ? "avx2" : "scalar fallback";
+#elif WYRE_BINNING_NEON
+    const char* isa = "neon";
+#else
+    const char* isa = "scalar fallback";
+#endif
+    printf("\n--- SAH binning kernel, %s (best of %i, Mprims/s) ---\n", isa, REPEATS);
+    printf("%-10s %6s %14s %14s %14s %10s %7s\n", "scene", "bins", "previous", "scalar", "simd", "speedup", "match");
+    for (const BenchScene& bench : scenes) {
+        KernelInput input {};
+        prepare_kernel_input(input, bench);
+        bench_kernel<8u>(bench, input);
+        bench_kernel<16u>(bench, input);
+        bench_kernel<32u>(bench, input);
+    }
+
+    printf("\n--- Spatial splits (SBVH, %.0f%% reference budget) ---\n", wyre::scene::BuildParams {}.spatial_budget * 100.0f);
+    printf("%-10s %10s %10s %10s %10s %11s %10s %10s %11s %12s %6s\n", "scene", "triangles", "refs", "sah", "sah sbvh", "improvement", "steps", "steps sbvh",
+           "reduction", "build (ms)", "match");
+    for (const BenchScene& bench : scenes) {
+        const StepRays rays(bench);
+        const uint32_t count = (uint32_t)bench.triangles.size();
+
+        wyre::scene::Bvh object_bvh {}, spatial_bvh {};
+        object_bvh.build(bench.triangles.data(), bench.normals.data(), count);
+        wyre::scene::BuildParams params {};
+        params.spatial_splits = true;
+        const auto start = high_resolution_clock::now();
+        spatial_bvh.build(bench.triangles.data(), bench.normals.data(), count, params);
+        const double ms = (double)duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1e3;
+
+        const double object_sah = object_bvh.sah, spatial_sah = spatial_bvh.sah;
+        const TraversalStats object_steps = measure_steps(object_bvh, rays), spatial_steps = measure_steps(spatial_bvh, rays);
+        const bool match = fabs(object_steps.hit_sum - spatial_steps.hit_sum) <= 1e-4 * std::max(1.0, object_steps.hit_sum);
+        printf("%-10s %10u %10u %10.2f %10.2f %10.1f%% %10.1f %10.1f %10.1f%% %12.2f %6s\n", bench.name, count, spatial_bvh.prim_count, object_sah, spatial_sah,
+               (1.0 - spatial_sah / object_sah) * 100.0, object_steps.avg_steps, spatial_steps.avg_steps, (1.0 - spatial_steps.avg_steps / object_steps.avg_steps) * 100.0,
+               ms, match ? "yes" : "NO");
+        object_bvh.release();
+        spatial_bvh.release();
+    }
+
+    printf("\n--- Triangle intersection (single threaded, best of %i) ---\n", REPEATS);
+    printf("%-10s %10s %14s %14s %10s %14s %14s %10s %6s\n", "scene", "triangles", "Mtests vert", "Mtests xform", "speedup", "Mrays vert", "Mrays xform",
+           "speedup", "match");
+    for (const BenchScene& bench : scenes) {
+        const StepRays rays(bench);
+        const uint32_t count = (uint32_t)bench.triangles.size();
+        wyre::ThreadPool pool {};
+        wyre::scene::BuildParams params {};
+        params.pool = &pool;
+        wyre::scene::Bvh verts(bench.triangles.data(), bench.normals.data(), count, params);
+        params.tri_layout = wyre::scene::TriLayout::TRANSFORMS;
+        wyre::scene::Bvh bvh(bench.triangles.data(), bench.normals.data(), count, params);
+
+        /* Raw triangle tests, every ray against a run of nearby triangles in the BVH primitive order */
+        constexpr uint32_t TESTS_PER_RAY = 64u;
+        const auto time_tests = [&](auto&& test) {
+            double best = 1e30, hit_sum = 0.0;
+            for (int r = 0; r < REPEATS; ++r) {
+                hit_sum = 0.0;
+                const auto start = high_resolution_clock::now();
+                for (uint32_t i = 0u; i < STEP_RAYS; ++i) {
+                    const uint32_t first = (i * 2654435761u) % (bvh.prim_count - std::min(bvh.prim_count, TESTS_PER_RAY) + 1u);
+                    for (uint32_t p = first; p < std::min(first + TESTS_PER_RAY, bvh.prim_count); ++p) {
+                        const wyre::scene::Hit hit = test(p, rays.rays[i]);
+                        if (hit.is_hit()) hit_sum += hit.t;
+                    }
+                }
+                best = std::min(best, (double)duration_cast<microseconds>(high_resolution_clock::now() - start).count());
+            }
+            kernel_sink = kernel_sink + (uint32_t)hit_sum;
+            return std::pair<double, double>((double)STEP_RAYS * std::min(bvh.prim_count, TESTS_PER_RAY) / best, hit_sum);
+        };
+        const auto vert_tests = time_tests([&](const uint32_t p, const wyre::scene::Ray& ray) { return wyre::scene::intersect(bvh.prims[p], ray); });
+        const auto xform_tests = time_tests([&](const uint32_t p, const wyre::scene::Ray& ray) { return wyre::scene::intersect(bvh.gpu_tris[p], ray); });
+
+        /* Full traversal of the GPU nodes, with either primitive layout */
+        double vert_mrays = 0.0, xform_mrays = 0.0;
+        const TraversalStats a = measure_rays(rays, vert_mrays, [&](const wyre::scene::Ray& ray, wyre::scene::RayCounters& counters) {
+            return wyre::scene::intersect_gpu(verts, ray, counters);
+        });
+        const TraversalStats b = measure_rays(rays, xform_mrays, [&](const wyre::scene::Ray& ray, wyre::scene::RayCounters& counters) {
+            return wyre::scene::intersect_gpu(bvh, ray, counters);
+        });
+        const bool match = fabs(a.hit_sum - b.hit_sum) <= 1e-4 * std::max(1.0, a.hit_sum) &&
+                           fabs(vert_tests.second - xform_tests.second) <= 1e-4 * std::max(1.0, vert_tests.second);
+        printf("%-10s %10u %14.1f %14.1f %9.2fx %14.2f %14.2f %9.2fx %6s\n", bench.name, count, vert_tests.first, xform_tests.first,
+               xform_tests.first / vert_tests.first, vert_mrays, xform_mrays, xform_mrays / vert_mrays, match ? "yes" : "NO");
+        verts.release();
+        bvh.release();
+    }
+
+    printf("\n--- Reinsertion optimization (%.0f ms budget, single threaded traversal, best of %i) ---\n", OPTIMIZE_MS, REPEATS);
+    printf("%-10s %10s %10s %10s %11s %13s %10s %10s %10s %10s %6s\n", "scene", "triangles", "sah", "sah opt", "improvement", "reinsertions",
+           "opt (ms)", "Mrays/s", "Mrays opt", "speedup", "match");
+    for (const BenchScene& bench : scenes) {
+        const StepRays rays(bench);
+        const uint32_t count = (uint32_t)bench.triangles.size();
+        wyre::ThreadPool pool {};
+        wyre::scene::BuildParams params {};
+        params.pool = &pool;
+        wyre::scene::Bvh binned(bench.triangles.data(), bench.normals.data(), count, params);
+        params.optimize_ms = OPTIMIZE_MS;
+        wyre::scene::Bvh optimized(bench.triangles.data(), bench.normals.data(), count, params);
+        const wyre::scene::Bvh::OptimizeStats& stats = optimized.optimize_stats;
+
+        double binned_mrays = 0.0, optimized_mrays = 0.0;
+        const TraversalStats a = measure_rays(rays, binned_mrays, [&](const wyre::scene::Ray& ray, wyre::scene::RayCounters& counters) {
+            return wyre::scene::intersect(binned, ray, counters);
+        });
+        const TraversalStats b = measure_rays(rays, optimized_mrays, [&](const wyre::scene::Ray& ray, wyre::scene::RayCounters& counters) {
+            return wyre::scene::intersect(optimized, ray, counters);
+        });
+        const bool match = fabs(a.hit_sum - b.hit_sum) <= 1e-4 * std::max(1.0, a.hit_sum);
+        printf("%-10s %10u %10.2f %10.2f %10.1f%% %13u %10.1f %10.2f %10.2f %9.2fx %6s\n", bench.name, count, stats.sah_before, stats.sah_after,
+               (1.0 - stats.sah_after / stats.sah_before) * 100.0, stats.reinsertions, stats.ms, binned_mrays, optimized_mrays, optimized_mrays / binned_mrays,
+               match ? "yes" : "NO");
+        binned.release();
+        optimized.release();
+    }
+
+    printf("\n--- Refit (first half of the triangles moved by 10%% of the scene extent) ---\n");
+    printf("%-10s %10s %12s %12s %10s %10s\n", "scene", "triangles", "build (ms)", "refit (ms)", "speedup", "sah drift");
+    for (const BenchScene& bench : scenes) {
+        const uint32_t count = (uint32_t)bench.triangles.size();
+        wyre::ThreadPool pool {};
+        wyre::scene::BuildParams params {};
+        params.pool = &pool;
+        const double build_ms = time_build(bench, params);
+
+        /* Move the first half of the triangles, like an animated mesh instance */
+        wyre::scene::Bvh bvh(bench.triangles.data(), bench.normals.data(), count, params);
+        const wyre::scene::Bvh::Node& root = bvh.nodes[bvh.root_idx];
+        const glm::vec3 offset((root.max.x - root.min.x) * 0.1f, 0.0f, 0.0f);
+        std::vector<wyre::Triangle> moved = bench.triangles;
+        for (uint32_t i = 0u; i < count / 2u; ++i) moved[i].v0 += offset, moved[i].v1 += offset, moved[i].v2 += offset;
+
+        double refit_ms = 1e30;
+        for (int i = 0; i < REPEATS; ++i) {
+            const auto start = high_resolution_clock::now();
+            bvh.refit(moved.data(), bench.normals.data(), &pool);
+            refit_ms = std::min(refit_ms, (double)duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1e3);
+        }
+        printf("%-10s %10u %12.2f %12.2f %9.2fx %10.3f\n", bench.name, count, build_ms, refit_ms, build_ms / std::max(refit_ms, 1e-3), bvh.sah_drift());
+        bvh.release();
+    }
+
+    printf("\n--- GPU node order (single threaded traversal, %u node treelets, best of %i) ---\n", wyre::scene::BuildParams {}.treelet_size, REPEATS);
+    printf("%-10s %10s %14s %14s %10s %6s\n", "scene", "nodes", "depth first", "treelets", "speedup", "match");
+    for (const BenchScene& bench : scenes) {
+        const StepRays rays(bench);
+        const uint32_t count = (uint32_t)bench.triangles.size();
+        wyre::ThreadPool pool {};
+        wyre::scene::BuildParams params {};
+        params.pool = &pool;
+        wyre::scene::Bvh depth_first(bench.triangles.data(), bench.normals.data(), count, params);
+        params.node_order = wyre::scene::NodeOrder::TREELETS;
+        wyre::scene::Bvh treelets(bench.triangles.data(), bench.normals.data(), count, params);
+
+        double depth_first_mrays = 0.0, treelet_mrays = 0.0;
+        const TraversalStats a = measure_rays(rays, depth_first_mrays, [&](const wyre::scene::Ray& ray, wyre::scene::RayCounters& counters) {
+            return wyre::scene::intersect_gpu(depth_first, ray, counters);
+        });
+        const TraversalStats b = measure_rays(rays, treelet_mrays, [&](const wyre::scene::Ray& ray, wyre::scene::RayCounters& counters) {
+            return wyre::scene::intersect_gpu(treelets, ray, counters);
+        });
+        const bool match = a.hit_sum == b.hit_sum && a.avg_steps == b.avg_steps;
+        printf("%-10s %10u %14.2f %14.2f %9.2fx %6s\n", bench.name, depth_first.nodes_used, depth_first_mrays, treelet_mrays, treelet_mrays / depth_first_mrays,
+               match ? "yes" : "NO");
+        depth_first.release();
+        treelets.release();
+    }
+
+    printf("\n--- Wide BVH (single threaded traversal, best of %i) ---\n", REPEATS);
+    printf("%-10s %8s %10s %10s %13s %10s %12s %6s\n", "scene", "width", "nodes", "steps", "collapse (ms)", "Mrays/s", "vs binary", "match");
+    for (const BenchScene& bench : scenes) {
+        const StepRays rays(bench);
+        const uint32_t count = (uint32_t)bench.triangles.size();
+        wyre::scene::Bvh bvh(bench.triangles.data(), bench.normals.data(), count);
+
+        double binary_mrays = 0.0;
+        const TraversalStats binary = measure_rays(rays, binary_mrays, [&](const wyre::scene::Ray& ray, wyre::scene::RayCounters& counters) {
+            return wyre::scene::intersect_gpu(bvh, ray, counters);
+        });
+        printf("%-10s %8u %10u %10.1f %13s %10.2f %11.2fx %6s\n", bench.name, 2u, bvh.nodes_used, binary.avg_steps, "-", binary_mrays, 1.0, "yes");
+
+        const auto bench_wide = [&]<uint32_t N>(wyre::scene::WideBvh<N>& wide) {
+            const auto start = high_resolution_clock::now();
+            wide.collapse(bvh);
+            const double ms = (double)duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1e3;
+
+            double mrays = 0.0;
+            const TraversalStats stats = measure_rays(rays, mrays, [&](const wyre::scene::Ray& ray, wyre::scene::RayCounters& counters) {
+                return wyre::scene::intersect_gpu(wide, bvh, ray, counters);
+            });
+            const bool match = fabs(binary.hit_sum - stats.hit_sum) <= 1e-4 * std::max(1.0, binary.hit_sum);
+            printf("%-10s %8u %10u %10.1f %13.2f %10.2f %11.2fx %6s\n", bench.name, N, wide.nodes_used, stats.avg_steps, ms, mrays, mrays / binary_mrays, match ? "yes" : "NO");
+            wide.release();
+        };
+        wyre::scene::Bvh4 bvh4 {};
+        wyre::scene::Bvh8 bvh8 {};
+        bench_wide(bvh4);
+        bench_wide(bvh8);
+        bvh.release();
+    }
+
+    printf("\n--- Fast rebuild (best of %i, single threaded traversal) ---\n", REPEATS);
+    printf("%-10s %10s %11s %8s %12s %10s %10s %10s %6s\n", "scene", "triangles", "builder", "threads", "build (ms)", "sah", "Mrays/s", "vs binned", "match");
+    for (const BenchScene& bench : scenes) {
+        const StepRays rays(bench);
+        const uint32_t count = (uint32_t)bench.triangles.size();
+        wyre::ThreadPool pool {};
+        double binned_mrays = 0.0, binned_hits = 0.0;
+        const std::pair<wyre::scene::Builder, const char*> builders[] = {
+            {wyre::scene::Builder::BINNED_SAH, "binned sah"}, {wyre::scene::Builder::LBVH, "lbvh"}, {wyre::scene::Builder::PLOC, "ploc"}};
+        for (const auto& [builder, name] : builders) {
+            wyre::scene::BuildParams params {};
+            params.pool = &pool;
+            params.builder = builder;
+            const double ms = time_build(bench, params);
+            wyre::scene::Bvh bvh(bench.triangles.data(), bench.normals.data(), count, params);
+
+            double mrays = 0.0;
+            const TraversalStats stats = measure_rays(rays, mrays, [&](const wyre::scene::Ray& ray, wyre::scene::RayCounters& counters) {
+                return wyre::scene::intersect(bvh, ray, counters);
+            });
+            if (builder == wyre::scene::Builder::BINNED_SAH) binned_mrays = mrays, binned_hits = stats.hit_sum;
+            const bool match = fabs(binned_hits - stats.hit_sum) <= 1e-4 * std::max(1.0, binned_hits);
+            printf("%-10s %10u %11s %8u %12.2f %10.2f %10.2f %9.2fx %6s\n", bench.name, count, name, pool.size(), ms, bvh.sah, mrays, mrays / binned_mrays,
+                   match ? "yes" : "NO");
+            bvh.release();
+        }
+    }
+
+    printf("\n--- BVH cache (build & collapse like the scene BLASes, warm = key + memory mapped load) ---\n");
+    printf("%-10s %10s %10s %10s %10s %10s %12s %10s %6s\n", "scene", "triangles", "file (mb)", "key (ms)", "cold (ms)", "warm (ms)", "touched (ms)", "speedup", "match");
+    std::filesystem::remove_all(CACHE_DIR);
+    for (const BenchScene& bench : scenes) {
+        const uint32_t count = (uint32_t)bench.triangles.size();
+        const wyre::scene::BvhCache cache(CACHE_DIR);
+        wyre::ThreadPool pool {};
+        wyre::scene::BuildParams params {};
+        params.pool = &pool;
+        params.node_order = wyre::scene::NodeOrder::TREELETS;
+        const auto ms_since = [](const auto start) { return (double)duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1e3; };
+
+        /* Cold start, the cache is empty */
+        auto start = high_resolution_clock::now();
+        const uint64_t key = wyre::scene::BvhCache::key(bench.triangles.data(), bench.normals.data(), count, params, wyre::scene::BvhLayout::WIDE);
+        const double key_ms = ms_since(start);
+        wyre::scene::Bvh built {};
+        wyre::scene::Bvh8 built_wide {};
+        const bool hit = cache.load(key, built, &built_wide);
+        built.build(bench.triangles.data(), bench.normals.data(), count, params);
+        built_wide.collapse(built);
+        const bool stored = cache.store(key, built, &built_wide).is_ok();
+        const double cold_ms = ms_since(start);
+
+        /* Warm start, the arrays are mapped from the cache file */
+        start = high_resolution_clock::now();
+        const uint64_t warm_key = wyre::scene::BvhCache::key(bench.triangles.data(), bench.normals.data(), count, params, wyre::scene::BvhLayout::WIDE);
+        wyre::scene::Bvh loaded {};
+        wyre::scene::Bvh8 loaded_wide {};
+        const bool loaded_ok = cache.load(warm_key, loaded, &loaded_wide);
+        const double warm_ms = ms_since(start);
+
+        /* Touch every page the GPU packer reads, which is when the mapped pages are actually read */
+        uint32_t sink = 0u;
+        const auto touch = [&](const void* data, const size_t size) {
+            for (size_t i = 0; data && i < size; i += 4096u) sink += ((const uint8_t*)data)[i];
+        };
+        touch(loaded.gpu_nodes, sizeof(wyre::scene::Bvh::GPUNode) * loaded.nodes_used);
+        touch(loaded.prims, sizeof(wyre::Triangle) * loaded.prim_count);
+        touch(loaded.norms, sizeof(wyre::Normals) * loaded.prim_count);
+        kernel_sink = sink;
+        const double touched_ms = ms_since(start);
+
+        bool match = hit == false && stored && loaded_ok && loaded.nodes_used == built.nodes_used && loaded_wide.nodes_used == built_wide.nodes_used;
+        match = match && memcmp(loaded.gpu_nodes, built.gpu_nodes, sizeof(wyre::scene::Bvh::GPUNode) * built.nodes_used) == 0;
+        match = match && memcmp(loaded.prims, built.prims, sizeof(wyre::Triangle) * built.prim_count) == 0;
+        match = match && memcmp(loaded_wide.nodes, built_wide.nodes, sizeof(wyre::scene::Bvh8::Node) * built_wide.nodes_used) == 0;
+        const double file_mb = loaded.mapping ? (double)loaded.mapping->get_size() / (1024.0 * 1024.0) : 0.0;
+        printf("%-10s %10u %10.1f %10.2f %10.2f %10.2f %12.2f %9.1fx %6s\n", bench.name, count, file_mb, key_ms, cold_ms, warm_ms, touched_ms,
+               cold_ms / std::max(touched_ms, 1e-3), match ? "yes" : "NO");
+        built.release(), built_wide.release();
+        loaded.release(), loaded_wide.release();
+    }
+    std::filesystem::remove_all(CACHE_DIR);
+
+    printf("\n--- CPU traversal (best of %i, random & %ux%u primary rays) ---\n", REPEATS, PRIMARY_RES, PRIMARY_RES);
+    printf("%-10s %10s %8s %14s %8s %10s %8s %6s\n", "scene", "triangles", "rays", "query", "threads", "Mrays/s", "hits", "match");
+    for (const BenchScene& bench : scenes) {
+        const uint32_t count = (uint32_t)bench.triangles.size();
+        wyre::ThreadPool pool {};
+        wyre::scene::BuildParams params {};
+        params.pool = &pool;
+        wyre::scene::Bvh bvh(bench.triangles.data(), bench.normals.data(), count, params);
+
+        const StepRays step_rays(bench);
+        std::vector<wyre::scene::Ray> random = step_rays.rays;
+        const struct {
+            const char* name;
+            std::vector<wyre::scene::Ray> rays;
+            bool coherent;
+        } ray_sets[] = {{"random", std::move(random), false}, {"primary", primary_rays(bench), true}};
+
+        for (const auto& [set_name, rays, coherent] : ray_sets) {
+            const uint32_t ray_count = (uint32_t)rays.size();
+            std::vector<wyre::scene::Hit> hits(ray_count);
+            double expected_sum = -1.0;
+            uint32_t expected_count = 0u;
+            const auto report = [&](const char* query, const uint32_t threads, const double mrays, const bool any_hit) {
+                double hit_sum = 0.0;
+                uint32_t hit_count = 0u;
+                for (uint32_t i = 0u; i < ray_count; ++i) {
+                    if (hits[i].is_hit()) hit_sum += hits[i].t, hit_count++;
+                }
+                /* The first query (single rays) is the reference of the others */
+                if (expected_sum < 0.0) expected_sum = hit_sum, expected_count = hit_count;
+                /* SIMD rounding differs slightly, rays grazing a triangle edge might hit a different triangle (or none) */
+                const bool match = any_hit ? abs((int)hit_count - (int)expected_count) <= (int)(ray_count / 10000u)
+                                           : fabs(hit_sum - expected_sum) <= 1e-4 * std::max(1.0, expected_sum);
+                printf("%-10s %10u %8s %14s %8u %10.2f %7.1f%% %6s\n", bench.name, count, set_name, query, threads, mrays, 100.0 * hit_count / ray_count,
+                       match ? "yes" : "NO");
+            };
+
+            /* Single rays */
+            double mrays = time_rays(ray_count, [&]() {
+                for (uint32_t i = 0u; i < ray_count; ++i) hits[i] = wyre::scene::intersect(bvh, rays[i]);
+            });
+            report("single", 1u, mrays, false);
+
+            /* Ray packets, consecutive rays are traced together */
+            const auto bench_packets = [&]<uint32_t N>() {
+                const double packet_mrays = time_rays(ray_count, [&]() {
+                    for (uint32_t first = 0u; first < ray_count; first += N) {
+                        wyre::scene::RayPacket<N> packet {};
+                        wyre::scene::HitPacket<N> packet_hits {};
+                        for (uint32_t l = 0u; l < N; ++l) packet.set(l, rays[first + l]);
+                        wyre::scene::intersect(bvh, packet, packet_hits);
+                        for (uint32_t l = 0u; l < N; ++l) hits[first + l] = packet_hits.get(l);
+                    }
+                });
+                report(N == 4u ? "packet 4" : "packet 8", 1u, packet_mrays, false);
+            };
+            bench_packets.template operator()<4u>();
+            bench_packets.template operator()<8u>();
+
+            /* Ray streams over the thread pool, the primary rays are coherent enough for packets */
+            wyre::scene::TraceParams trace_params {};
+            trace_params.packets = coherent;
+            mrays = time_rays(ray_count, [&]() { wyre::scene::trace(bvh, rays.data(), hits.data(), ray_count, trace_params, &pool); });
+            report(trace_params.packets ? "stream packets" : "stream", pool.size(), mrays, false);
+
+            trace_params.any_hit = true;
+            mrays = time_rays(ray_count, [&]() { wyre::scene::trace(bvh, rays.data(), hits.data(), ray_count, trace_params, &pool); });
+            report("stream any hit", pool.size(), mrays, true);
+        }
+        bvh.release();
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -44,7 +44,7 @@ class Assets {
 template <typename T, typename... Args>
 inline std::shared_ptr<T> Assets::load(const std::string_view path, Args&&... args) {
     /* Use the hashed path as the asset id */
-    const auto id = std::hash<std::string>()(path);
+    const auto id = std::hash<std::string_view>()(path);
 
     /* Check if the asset is already loaded */
     auto asset = get<T>(id);
@@ -60,7 +60,7 @@ inline std::shared_ptr<T> Assets::load(const std::string_view path, Args&&... ar
 template <typename T, typename... Args>
 inline std::shared_ptr<T> Assets::create(const std::string_view name, Args&&... args) {
     /* Use the hashed name as the asset id */
-    const auto id = std::hash<std::string>()(name);
+    const auto id = std::hash<std::string_view>()(name);
 
     /* Check if the asset already exists */
     auto asset = get<T>(id);
@@ -1,5 +1,7 @@
 #include "mesh.h"
 
+#include <atomic> /* std::atomic */
+
 #include <fastgltf/core.hpp>
 #include <fastgltf/tools.hpp>
 #include <fastgltf/types.hpp>
@@ -25,6 +27,11 @@ struct TriMesh {
 
 /* TODO: Loading & storing of meshes should be done using Assets!!! */
 
+uint64_t Mesh::next_geometry_version() {
+    static std::atomic<uint64_t> version {0u};
+    return version.fetch_add(1u, std::memory_order_relaxed) + 1u;
+}
+
 Mesh::Mesh(const Triangle* triangles, const size_t triangle_count) {
     /* Create vertex array */
     vertices = std::vector<glm::vec3>(triangle_count * 3);
@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <glm/glm.hpp>
 
@@ -20,12 +21,21 @@ struct Mesh {
     glm::vec3 material {};
     /* Number of triangles. */
     size_t tri_count = 0u;
+    /* Unique to the geometry of this mesh, changing the material keeps it. (copies of a mesh share it) */
+    uint64_t geometry_version = next_geometry_version();
 
     Mesh() = default;
     /** @brief Create a mesh from raw triangle data. */
     Mesh(const Triangle* triangles, const size_t triangle_count);
     /** @brief Load a GLTF model from disk. */
     Mesh(const Files& files, const std::string& path, const glm::vec3 mat = glm::vec3(-1.0f), const size_t mesh_idx = 0u);
+
+    /** @brief Mark the geometry as changed, after modifying the vertices, normals or indices in place. */
+    inline void geometry_changed() { geometry_version = next_geometry_version(); }
+
+   private:
+    /** @returns A new geometry version, which no other geometry has. */
+    static uint64_t next_geometry_version();
 };
 
 }  // namespace wyre
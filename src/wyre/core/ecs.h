@@ -2,18 +2,30 @@
 
 #include <entt/entity/registry.hpp> /* entt::registry */
 
+#include <type_traits> /* std::is_same_v, std::is_const_v */
+#include <utility>     /* std::as_const */
+
 #include "ecs-system.h" /* wyre::System */
 #include "wyre/result.h" /* Result<T> */
 
 namespace wyre {
 
 class WyreEngine;
+struct Mesh;
+struct Transform;
 
 /**
  * @brief ECS entity instance.
  */
 using Entity = entt::entity;
 
+/*
+ * Components whose changes are tracked through the registry signals, (e.g. by the scene BVH) they are only changed with `patch_component`.
+ * Casting away the const of `get_component`, or modifying them through `registry` directly, skips the update signal & leaves the BVH stale.
+ */
+template <typename T>
+constexpr bool is_tracked_component = std::is_same_v<T, Mesh> || std::is_same_v<T, Transform>;
+
 /**
  * @brief Manager for Entities, Components, & Systems.
  */
@@ -68,18 +80,41 @@ class ECS {
 
     /**
      * @brief Get a component of type attached to an entity.
+     * Tracked components (meshes & transforms) are read-only, they are changed with `patch_component`.
      */
     template <typename T>
-    T& get_component(const Entity entity) {
-        return registry.get<T>(entity);
+    decltype(auto) get_component(const Entity entity) {
+        if constexpr (is_tracked_component<T>) {
+            static_assert(std::is_const_v<std::remove_reference_t<decltype(std::as_const(registry).get<T>(entity))>>, "tracked components must be read-only.");
+            return std::as_const(registry).get<T>(entity);
+        } else {
+            return registry.get<T>(entity);
+        }
     }
 
     /**
-     * @brief Get a component of type attached to an entity.
+     * @brief Modify a component of an entity in place, notifying the listeners of its changes. (e.g. the scene BVH)
+     * This is the required mutation path of tracked components (meshes & transforms), `get_component` returns them read-only.
+     * e.g. `ecs.patch_component<Transform>(entity, [&](Transform& t) { t.position.z += dz; });`
+     * 
+     * @param entity Entity instance the component is attached to.
+     * @param func Functions invoked with the component, which modify it.
+     * 
+     * @return The component instance.
+     */
+    template <typename T, typename... Func>
+    decltype(auto) patch_component(const Entity entity, Func&&... func) {
+        return registry.patch<T>(entity, std::forward<Func>(func)...);
+    }
+
+    /**
+     * @brief Get a component of type attached to an entity. (null if it has none)
+     * Tracked components (meshes & transforms) are read-only, they are changed with `patch_component`.
      */
     template <typename T>
-    T* try_get_component(const Entity entity) {
-        return registry.try_get<T>(entity);
+    auto* try_get_component(const Entity entity) {
+        if constexpr (is_tracked_component<T>) return std::as_const(registry).try_get<T>(entity);
+        else return registry.try_get<T>(entity);
     }
     
     /**
@@ -13,7 +13,8 @@
  * Result<void> destroy();
  */
 
-#if defined(_WIN32) || defined(_WIN64)
+/* Windows & Linux share the SDL & Vulkan platform layer */
+#if defined(_WIN32) || defined(_WIN64) || defined(__linux__)
 #include "wyre/platform/vulkan/device.h"
 #else
 #error "platform is not supported."
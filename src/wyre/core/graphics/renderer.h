@@ -7,7 +7,8 @@
  * class Renderer : wyre::System;
  */
 
-#if defined(_WIN32) || defined(_WIN64)
+/* Windows & Linux share the SDL & Vulkan platform layer */
+#if defined(_WIN32) || defined(_WIN64) || defined(__linux__)
 #include "wyre/platform/vulkan/renderer.h"
 #else
 #error "platform is not supported."
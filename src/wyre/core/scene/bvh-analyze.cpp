@@ -0,0 +1,96 @@
+/**
+ * @file scene/bvh-analyze.cpp
+ * @brief BVH quality & traversal cost metrics.
+ */
+#include "bvh-analyze.h"
+
+#include <algorithm> /* std::min, std::max */
+#include <atomic>    /* std::atomic */
+#include <utility>   /* std::pair */
+
+namespace wyre::scene {
+
+/** @returns Half the surface area of an AABB. */
+inline float half_area(const glm::vec3& min, const glm::vec3& max) {
+    const glm::vec3 e = max - min;
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+/** @returns The volume of an AABB, zero if it's empty. */
+inline float volume(const glm::vec3& min, const glm::vec3& max) {
+    const glm::vec3 e = glm::max(max - min, glm::vec3(0.0f));
+    return e.x * e.y * e.z;
+}
+
+BvhAnalysis analyze(const Bvh& bvh) {
+    BvhAnalysis analysis {};
+    if (bvh.nodes == nullptr || bvh.nodes_used == 0u) return analysis;
+
+    const Bvh::Node& root = bvh.nodes[bvh.root_idx];
+    const float root_area = half_area(root.min, root.max);
+    double cost = 0.0, overlap = 0.0, empty_space = 0.0, depth_sum = 0.0;
+    uint32_t volume_nodes = 0u;
+
+    /* Walk the tree depth first, with the depth of every node */
+    std::vector<std::pair<uint32_t, uint32_t>> stack {{bvh.root_idx, 0u}};
+    while (stack.empty() == false) {
+        const auto [node_idx, depth] = stack.back();
+        stack.pop_back();
+        const Bvh::Node& node = bvh.nodes[node_idx];
+        const float area = half_area(node.min, node.max);
+        analysis.node_count++;
+
+        if (node.is_leaf()) {
+            cost += (double)area * node.prim_count;
+            analysis.leaf_count++;
+            analysis.prim_refs += node.prim_count;
+            analysis.leaf_sizes[std::min(node.prim_count, BvhAnalysis::LEAF_SIZE_BUCKETS) - 1u]++;
+            analysis.max_leaf_size = std::max(analysis.max_leaf_size, node.prim_count);
+            if (analysis.leaf_depths.size() <= depth) analysis.leaf_depths.resize(depth + 1u, 0u);
+            analysis.leaf_depths[depth]++;
+            depth_sum += depth;
+            continue;
+        }
+        cost += area;
+
+        const Bvh::Node& left = bvh.nodes[node.left_first];
+        const Bvh::Node& right = bvh.nodes[node.left_first + 1u];
+        const glm::vec3 omin = glm::max(left.min, right.min), omax = glm::min(left.max, right.max);
+        const bool overlapping = omin.x <= omax.x && omin.y <= omax.y && omin.z <= omax.z;
+        if (overlapping) overlap += half_area(omin, omax);
+
+        /* Volume of the node not covered by the union of its children */
+        const float node_volume = volume(node.min, node.max);
+        if (node_volume > 0.0f) {
+            const float covered = volume(left.min, left.max) + volume(right.min, right.max) - (overlapping ? volume(omin, omax) : 0.0f);
+            empty_space += std::max(0.0f, 1.0f - covered / node_volume);
+            volume_nodes++;
+        }
+
+        stack.emplace_back(node.left_first, depth + 1u);
+        stack.emplace_back(node.left_first + 1u, depth + 1u);
+    }
+
+    analysis.sah = root_area > 0.0f ? (float)(cost / root_area) : 0.0f;
+    analysis.overlap = root_area > 0.0f ? (float)(overlap / root_area) : 0.0f;
+    analysis.empty_space = volume_nodes > 0u ? (float)(empty_space / volume_nodes) : 0.0f;
+    analysis.avg_leaf_depth = analysis.leaf_count > 0u ? (float)(depth_sum / analysis.leaf_count) : 0.0f;
+    return analysis;
+}
+
+void analyze_traversal(BvhAnalysis& analysis, const Bvh& bvh, const Ray* rays, const uint32_t count, ThreadPool* pool) {
+    std::atomic<uint64_t> nodes = 0u, tris = 0u;
+    const auto trace_range = [&](const uint32_t begin, const uint32_t end) {
+        RayCounters counters {};
+        for (uint32_t i = begin; i < end; ++i) intersect(bvh, rays[i], counters);
+        nodes += counters.nodes, tris += counters.tris;
+    };
+    if (pool) pool->parallel_for(count, 1024u, trace_range);
+    else trace_range(0u, count);
+
+    analysis.ray_count = count;
+    analysis.avg_nodes = count > 0u ? (float)((double)nodes / count) : 0.0f;
+    analysis.avg_tris = count > 0u ? (float)((double)tris / count) : 0.0f;
+}
+
+}  // namespace wyre::scene
@@ -0,0 +1,52 @@
+/**
+ * @file scene/bvh-analyze.h
+ * @brief BVH quality & traversal cost metrics, for tuning the builders.
+ */
+#pragma once
+
+#include <cstdint> /* uint32_t */
+#include <vector>  /* std::vector */
+
+#include "bvh.h"
+#include "bvh-traverse.h"
+
+namespace wyre::scene {
+
+/**
+ * @brief Quality metrics of a built BVH, only the nodes reachable from the root are counted.
+ */
+struct BvhAnalysis {
+    /* Leaves larger than this share the last bucket of the leaf size histogram. */
+    static constexpr uint32_t LEAF_SIZE_BUCKETS = 16u;
+
+    /* Number of nodes, and how many of them are leaves. */
+    uint32_t node_count = 0u, leaf_count = 0u;
+    /* Number of primitive references in the leaves. (more than the primitives with spatial splits) */
+    uint32_t prim_refs = 0u;
+    /* SAH cost, with a traversal & intersection cost of 1. */
+    float sah = 0.0f;
+
+    /* Number of leaves of each size, the first bucket holds the leaves with a single primitive. */
+    uint32_t leaf_sizes[LEAF_SIZE_BUCKETS] {};
+    uint32_t max_leaf_size = 0u;
+    /* Number of leaves at each depth, the root is at depth 0. */
+    std::vector<uint32_t> leaf_depths {};
+    float avg_leaf_depth = 0.0f;
+
+    /* Surface area of the overlap between siblings, summed over the interior nodes, relative to the root. */
+    float overlap = 0.0f;
+    /* Average fraction of the volume of an interior node which is not covered by its children. (flat nodes are skipped) */
+    float empty_space = 0.0f;
+
+    /* Traversal cost per ray, of the last measured ray set. (see `analyze_traversal`) */
+    uint32_t ray_count = 0u;
+    float avg_nodes = 0.0f, avg_tris = 0.0f;
+};
+
+/** @returns The quality metrics of a BVH, without the traversal cost. */
+BvhAnalysis analyze(const Bvh& bvh);
+
+/** @brief Measure the traversal cost of a BVH, by tracing a set of rays. (closest hit, using the thread pool if any) */
+void analyze_traversal(BvhAnalysis& analysis, const Bvh& bvh, const Ray* rays, const uint32_t count, ThreadPool* pool = nullptr);
+
+}  // namespace wyre::scene
@@ -0,0 +1,290 @@
+/**
+ * @file scene/bvh-binning.h
+ * @brief SAH binning kernels, with AVX2 & NEON code paths and a scalar fallback.
+ * The AVX2 kernels are compiled for AVX2 on their own, and picked at runtime on CPUs which support it.
+ */
+#pragma once
+
+#include <algorithm> /* std::min, std::max */
+#include <cmath>     /* fminf */
+#include <cstdint>   /* uint32_t */
+
+#include <glm/glm.hpp>
+
+#include "aabb.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define WYRE_BINNING_AVX2 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h> /* __cpuid, __cpuidex */
+/* MSVC emits AVX2 intrinsics without an architecture flag */
+#define WYRE_TARGET_AVX2
+#else
+#define WYRE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#include <arm_neon.h>
+#define WYRE_BINNING_NEON 1
+#endif
+
+namespace wyre::scene {
+
+/**
+ * @brief SAH bins of all 3 axes.
+ * @tparam BINS Number of bins per axis. (8, 16 or 32)
+ */
+template <uint32_t BINS>
+struct Bins {
+    static_assert(BINS == 8u || BINS == 16u || BINS == 32u, "bin count must be 8, 16 or 32.");
+
+    /* Bin bounds, laid out as (min.xyz, pad, max.xyz, pad) for SIMD min/max. */
+    alignas(32) float bounds[3][BINS][8];
+    uint32_t count[3][BINS];
+
+    Bins() {
+        for (uint32_t a = 0u; a < 3u; ++a) {
+            for (uint32_t b = 0u; b < BINS; ++b) {
+                for (uint32_t i = 0u; i < 4u; ++i) bounds[a][b][i] = 1e30f, bounds[a][b][i + 4u] = -1e30f;
+                count[a][b] = 0u;
+            }
+        }
+    }
+
+    /** @returns The bounds of a bin as an AABB. */
+    inline AABB aabb(const uint32_t axis, const uint32_t bin) const {
+        const float* b = bounds[axis][bin];
+        return AABB(glm::vec3(b[0], b[1], b[2]), glm::vec3(b[4], b[5], b[6]));
+    }
+
+    /** @brief Merge another set of bins into these bins. */
+    inline void merge(const Bins& other) {
+        for (uint32_t a = 0u; a < 3u; ++a) {
+            for (uint32_t b = 0u; b < BINS; ++b) {
+                for (uint32_t i = 0u; i < 3u; ++i) {
+                    bounds[a][b][i] = std::min(bounds[a][b][i], other.bounds[a][b][i]);
+                    bounds[a][b][i + 4u] = std::max(bounds[a][b][i + 4u], other.bounds[a][b][i + 4u]);
+                }
+                count[a][b] += other.count[a][b];
+            }
+        }
+    }
+};
+
+/**
+ * @brief Primitive data input of the binning kernels, in SoA layout.
+ */
+struct BinInput {
+    const float* centroid[3] {};
+    const float* bmin[3] {};
+    const float* bmax[3] {};
+};
+
+/** @returns The binning kernel input of a list of SoA primitive references. */
+template <typename Refs>
+inline BinInput bin_input(const Refs& refs) {
+    BinInput in {};
+    for (uint32_t a = 0u; a < 3u; ++a) {
+        in.centroid[a] = refs.centroid[a].data();
+        in.bmin[a] = refs.bmin[a].data();
+        in.bmax[a] = refs.bmax[a].data();
+    }
+    return in;
+}
+
+/** @returns The centroid bounds of primitives [first, last). (scalar) */
+inline AABB centroid_bounds_scalar(const BinInput& in, const uint32_t first, const uint32_t last) {
+    AABB aabb {};
+    for (uint32_t p = first; p < last; ++p) {
+        aabb.grow(glm::vec3(in.centroid[0][p], in.centroid[1][p], in.centroid[2][p]));
+    }
+    return aabb;
+}
+
+/** @returns The bin index of a centroid coordinate. (NaN maps to the last bin, like the SIMD paths) */
+template <uint32_t BINS>
+inline uint32_t bin_index(const float c, const float cmin, const float scale) {
+    return (uint32_t)fminf(BINS - 1u, (c - cmin) * scale);
+}
+
+/** @brief Bin primitives [first, last) into the bins of all 3 axes, in a single pass. (scalar) */
+template <uint32_t BINS>
+inline void bin_prims_scalar(Bins<BINS>& bins, const BinInput& in, const uint32_t first, const uint32_t last, const glm::vec3& cmin, const glm::vec3& scale) {
+    for (uint32_t p = first; p < last; ++p) {
+        /* Load the primitive once, the bins could alias the input as far as the compiler knows */
+        const float box[6] = {in.bmin[0][p], in.bmin[1][p], in.bmin[2][p], in.bmax[0][p], in.bmax[1][p], in.bmax[2][p]};
+        uint32_t idx[3];
+        for (uint32_t a = 0u; a < 3u; ++a) idx[a] = bin_index<BINS>(in.centroid[a][p], cmin[a], scale[a]);
+
+        for (uint32_t a = 0u; a < 3u; ++a) {
+            float* b = bins.bounds[a][idx[a]];
+            for (uint32_t i = 0u; i < 3u; ++i) {
+                b[i] = std::min(b[i], box[i]);
+                b[i + 4u] = std::max(b[i + 4u], box[i + 3u]);
+            }
+            bins.count[a][idx[a]]++;
+        }
+    }
+}
+
+#if WYRE_BINNING_AVX2
+
+/** @returns True if the CPU (and OS) support AVX2, checked once. */
+inline bool has_avx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    static const bool avx2 = []() {
+        int info[4];
+        __cpuid(info, 1);
+        const bool os_ymm = ((info[2] >> 27) & 1) && (_xgetbv(0) & 6u) == 6u; /* OSXSAVE, and the YMM state is enabled */
+        __cpuidex(info, 7, 0);
+        return os_ymm && ((info[1] >> 5) & 1);
+    }();
+#else
+    static const bool avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+#endif
+    return avx2;
+}
+
+/** @returns The centroid bounds of primitives [first, last). (AVX2) */
+WYRE_TARGET_AVX2 inline AABB centroid_bounds_avx2(const BinInput& in, const uint32_t first, const uint32_t last) {
+    __m256 vmin[3], vmax[3];
+    for (uint32_t a = 0u; a < 3u; ++a) vmin[a] = _mm256_set1_ps(1e30f), vmax[a] = _mm256_set1_ps(-1e30f);
+
+    uint32_t p = first;
+    for (; p + 8u <= last; p += 8u) {
+        for (uint32_t a = 0u; a < 3u; ++a) {
+            const __m256 c = _mm256_loadu_ps(in.centroid[a] + p);
+            vmin[a] = _mm256_min_ps(vmin[a], c);
+            vmax[a] = _mm256_max_ps(vmax[a], c);
+        }
+    }
+
+    /* Reduce the lanes, and handle the remaining primitives */
+    AABB aabb = centroid_bounds_scalar(in, p, last);
+    alignas(32) float lmin[3][8], lmax[3][8];
+    for (uint32_t a = 0u; a < 3u; ++a) {
+        _mm256_store_ps(lmin[a], vmin[a]);
+        _mm256_store_ps(lmax[a], vmax[a]);
+    }
+    for (uint32_t l = 0u; l < 8u; ++l) {
+        aabb.min = glm::min(aabb.min, glm::vec3(lmin[0][l], lmin[1][l], lmin[2][l]));
+        aabb.max = glm::max(aabb.max, glm::vec3(lmax[0][l], lmax[1][l], lmax[2][l]));
+    }
+    return aabb;
+}
+
+/** @brief Bin primitives [first, last) into the bins of all 3 axes, in a single pass. (AVX2) */
+template <uint32_t BINS>
+WYRE_TARGET_AVX2 inline void bin_prims_avx2(Bins<BINS>& bins, const BinInput& in, const uint32_t first, const uint32_t last, const glm::vec3& cmin, const glm::vec3& scale) {
+    const __m256 limit = _mm256_set1_ps((float)(BINS - 1u));
+    __m256 vcmin[3], vscale[3];
+    for (uint32_t a = 0u; a < 3u; ++a) vcmin[a] = _mm256_set1_ps(cmin[a]), vscale[a] = _mm256_set1_ps(scale[a]);
+
+    uint32_t p = first;
+    alignas(32) uint32_t idx[3][8];
+    for (; p + 8u <= last; p += 8u) {
+        /* Bin indices of 8 primitives, for all 3 axes */
+        for (uint32_t a = 0u; a < 3u; ++a) {
+            const __m256 f = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(in.centroid[a] + p), vcmin[a]), vscale[a]);
+            /* NaN returns the second operand, matching `fminf` */
+            _mm256_store_si256((__m256i*)idx[a], _mm256_cvttps_epi32(_mm256_min_ps(f, limit)));
+        }
+
+        /* Grow the bins, min in the lower half & max in the upper half */
+        for (uint32_t l = 0u; l < 8u; ++l) {
+            const uint32_t i = p + l;
+            const __m256 box = _mm256_setr_ps(in.bmin[0][i], in.bmin[1][i], in.bmin[2][i], 0.0f, in.bmax[0][i], in.bmax[1][i], in.bmax[2][i], 0.0f);
+            for (uint32_t a = 0u; a < 3u; ++a) {
+                float* b = bins.bounds[a][idx[a][l]];
+                const __m256 v = _mm256_load_ps(b);
+                _mm256_store_ps(b, _mm256_blend_ps(_mm256_min_ps(v, box), _mm256_max_ps(v, box), 0xF0));
+                bins.count[a][idx[a][l]]++;
+            }
+        }
+    }
+    bin_prims_scalar(bins, in, p, last, cmin, scale);
+}
+
+/** @returns The centroid bounds of primitives [first, last). (AVX2 if supported) */
+inline AABB centroid_bounds(const BinInput& in, const uint32_t first, const uint32_t last) {
+    return has_avx2() ? centroid_bounds_avx2(in, first, last) : centroid_bounds_scalar(in, first, last);
+}
+
+/** @brief Bin primitives [first, last) into the bins of all 3 axes, in a single pass. (AVX2 if supported) */
+template <uint32_t BINS>
+inline void bin_prims(Bins<BINS>& bins, const BinInput& in, const uint32_t first, const uint32_t last, const glm::vec3& cmin, const glm::vec3& scale) {
+    if (has_avx2()) bin_prims_avx2(bins, in, first, last, cmin, scale);
+    else bin_prims_scalar(bins, in, first, last, cmin, scale);
+}
+
+#elif WYRE_BINNING_NEON
+
+/** @returns The centroid bounds of primitives [first, last). (NEON) */
+inline AABB centroid_bounds(const BinInput& in, const uint32_t first, const uint32_t last) {
+    float32x4_t vmin[3], vmax[3];
+    for (uint32_t a = 0u; a < 3u; ++a) vmin[a] = vdupq_n_f32(1e30f), vmax[a] = vdupq_n_f32(-1e30f);
+
+    uint32_t p = first;
+    for (; p + 4u <= last; p += 4u) {
+        for (uint32_t a = 0u; a < 3u; ++a) {
+            const float32x4_t c = vld1q_f32(in.centroid[a] + p);
+            vmin[a] = vminq_f32(vmin[a], c);
+            vmax[a] = vmaxq_f32(vmax[a], c);
+        }
+    }
+
+    /* Reduce the lanes, and handle the remaining primitives */
+    AABB aabb = centroid_bounds_scalar(in, p, last);
+    aabb.min = glm::min(aabb.min, glm::vec3(vminvq_f32(vmin[0]), vminvq_f32(vmin[1]), vminvq_f32(vmin[2])));
+    aabb.max = glm::max(aabb.max, glm::vec3(vmaxvq_f32(vmax[0]), vmaxvq_f32(vmax[1]), vmaxvq_f32(vmax[2])));
+    return aabb;
+}
+
+/** @brief Bin primitives [first, last) into the bins of all 3 axes, in a single pass. (NEON) */
+template <uint32_t BINS>
+inline void bin_prims(Bins<BINS>& bins, const BinInput& in, const uint32_t first, const uint32_t last, const glm::vec3& cmin, const glm::vec3& scale) {
+    const float32x4_t limit = vdupq_n_f32((float)(BINS - 1u));
+
+    uint32_t p = first;
+    uint32_t idx[3][4];
+    for (; p + 4u <= last; p += 4u) {
+        /* Bin indices of 4 primitives, for all 3 axes */
+        for (uint32_t a = 0u; a < 3u; ++a) {
+            const float32x4_t f = vmulq_n_f32(vsubq_f32(vld1q_f32(in.centroid[a] + p), vdupq_n_f32(cmin[a])), scale[a]);
+            /* `vminnm` returns the number if one operand is NaN, matching `fminf` */
+            vst1q_u32(idx[a], vcvtq_u32_f32(vminnmq_f32(f, limit)));
+        }
+
+        /* Grow the bins */
+        for (uint32_t l = 0u; l < 4u; ++l) {
+            const uint32_t i = p + l;
+            const float lo[4] = {in.bmin[0][i], in.bmin[1][i], in.bmin[2][i], 0.0f};
+            const float hi[4] = {in.bmax[0][i], in.bmax[1][i], in.bmax[2][i], 0.0f};
+            const float32x4_t box_min = vld1q_f32(lo), box_max = vld1q_f32(hi);
+            for (uint32_t a = 0u; a < 3u; ++a) {
+                float* b = bins.bounds[a][idx[a][l]];
+                vst1q_f32(b, vminq_f32(vld1q_f32(b), box_min));
+                vst1q_f32(b + 4u, vmaxq_f32(vld1q_f32(b + 4u), box_max));
+                bins.count[a][idx[a][l]]++;
+            }
+        }
+    }
+    bin_prims_scalar(bins, in, p, last, cmin, scale);
+}
+
+#else
+
+/** @returns The centroid bounds of primitives [first, last). (scalar fallback) */
+inline AABB centroid_bounds(const BinInput& in, const uint32_t first, const uint32_t last) {
+    return centroid_bounds_scalar(in, first, last);
+}
+
+/** @brief Bin primitives [first, last) into the bins of all 3 axes, in a single pass. (scalar fallback) */
+template <uint32_t BINS>
+inline void bin_prims(Bins<BINS>& bins, const BinInput& in, const uint32_t first, const uint32_t last, const glm::vec3& cmin, const glm::vec3& scale) {
+    bin_prims_scalar(bins, in, first, last, cmin, scale);
+}
+
+#endif
+
+}  // namespace wyre::scene
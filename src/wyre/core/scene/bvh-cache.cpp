@@ -0,0 +1,177 @@
+#include "bvh-cache.h"
+
+#include "wyre/core/system/mapped-file.h" /* MappedFile */
+
+#include <bit>        /* std::bit_cast */
+#include <cstdio>     /* fopen, fwrite */
+#include <cstring>    /* memcpy */
+#include <filesystem> /* std::filesystem */
+
+namespace wyre::scene {
+
+/* Cache file magic number. ("WBVH") */
+constexpr uint32_t CACHE_MAGIC = 0x48564257u;
+/* Alignment of the cache file sections. */
+constexpr uint64_t SECTION_ALIGN = 64u;
+
+/* Arrays stored in a cache file, in file order. */
+enum Section : uint32_t { NODES, GPU_NODES, PRIMS, NORMS, PRIM_INDICES, GPU_TRIS, WIDE_NODES, SECTION_COUNT };
+
+/* Cache file header, followed by the sections. */
+struct CacheHeader {
+    uint32_t magic = CACHE_MAGIC, version = 0u;
+    uint64_t key = 0u;
+    uint32_t nodes_used = 0u, prim_count = 0u, root_idx = 0u, size = 0u, wide_nodes_used = 0u;
+    uint32_t node_order = 0u, treelet_size = 0u, tri_layout = 0u;
+    float build_sah = 0.0f, sah = 0.0f;
+    /* Byte offset & size of each section, relative to the start of the file. (size 0 if not stored) */
+    uint64_t offsets[SECTION_COUNT] {}, sizes[SECTION_COUNT] {};
+};
+
+/** @brief Hash a range of 32 bit words. (FNV-1a) */
+inline void hash_words(uint64_t& hash, const void* data, const size_t bytes) {
+    const uint32_t* words = (const uint32_t*)data;
+    const size_t count = bytes / sizeof(uint32_t);
+    for (size_t i = 0; i < count; ++i) hash = (hash ^ words[i]) * 0x100000001b3ull;
+    hash = (hash ^ count) * 0x100000001b3ull;
+}
+
+uint64_t BvhCache::key(const Triangle* prims, const Normals* norms, const uint32_t prim_count, const BuildParams& params, const BvhLayout layout) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash_words(hash, prims, sizeof(Triangle) * prim_count);
+    hash_words(hash, norms, sizeof(Normals) * prim_count);
+
+    const uint32_t settings[] = {VERSION,
+                                 (uint32_t)params.builder,
+                                 params.builder == Builder::PLOC ? params.ploc_radius : 0u,
+                                 params.bins,
+                                 params.spatial_splits,
+                                 params.spatial_splits ? std::bit_cast<uint32_t>(params.spatial_budget) : 0u,
+                                 (uint32_t)params.node_order,
+                                 params.treelet_size,
+                                 params.optimize_ms > 0.0f,
+                                 (uint32_t)params.tri_layout,
+                                 (uint32_t)layout};
+    hash_words(hash, settings, sizeof(settings));
+    return hash;
+}
+
+std::string BvhCache::path_of(const uint64_t key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bvh", (unsigned long long)key);
+    return (std::filesystem::path(directory) / name).string();
+}
+
+bool BvhCache::load(const uint64_t key, Bvh& bvh, Bvh8* wide) const {
+    MappedFile* file = new MappedFile();
+    if (file->open(path_of(key)).is_err() || file->get_size() < sizeof(CacheHeader)) {
+        delete file;
+        return false;
+    }
+
+    /* Validate the header, and that every section lies within the file */
+    const std::byte* data = file->get_data();
+    const CacheHeader& header = *(const CacheHeader*)data;
+    bool valid = header.magic == CACHE_MAGIC && header.version == VERSION && header.key == key;
+    valid &= header.prim_count > 0u && header.nodes_used > 2u;
+    valid &= header.sizes[NODES] == sizeof(Bvh::Node) * header.nodes_used;
+    valid &= header.sizes[GPU_NODES] == sizeof(Bvh::GPUNode) * header.nodes_used;
+    valid &= header.sizes[PRIMS] == sizeof(Triangle) * header.prim_count;
+    valid &= header.sizes[NORMS] == sizeof(Normals) * header.prim_count;
+    valid &= header.sizes[PRIM_INDICES] == sizeof(uint32_t) * header.prim_count;
+    valid &= header.sizes[GPU_TRIS] == 0u || header.sizes[GPU_TRIS] == sizeof(TriangleTransform) * header.prim_count;
+    valid &= header.sizes[WIDE_NODES] == sizeof(Bvh8::Node) * header.wide_nodes_used;
+    valid &= wide == nullptr || header.wide_nodes_used > 0u;
+    for (uint32_t s = 0u; s < SECTION_COUNT; ++s) {
+        valid &= header.offsets[s] % SECTION_ALIGN == 0u && header.offsets[s] + header.sizes[s] <= file->get_size();
+    }
+    if (valid == false) {
+        delete file;
+        return false;
+    }
+
+    /* Point the arrays into the mapped file */
+    const auto section = [&](const Section s) { return header.sizes[s] ? (void*)(data + header.offsets[s]) : nullptr; };
+    bvh.release();
+    bvh.mapping = file;
+    bvh.nodes = (Bvh::Node*)section(NODES);
+    bvh.gpu_nodes = (Bvh::GPUNode*)section(GPU_NODES);
+    bvh.prims = (Triangle*)section(PRIMS);
+    bvh.norms = (Normals*)section(NORMS);
+    bvh.prim_indices = (uint32_t*)section(PRIM_INDICES);
+    bvh.gpu_tris = (TriangleTransform*)section(GPU_TRIS);
+    bvh.nodes_used = header.nodes_used, bvh.prim_count = header.prim_count;
+    bvh.root_idx = header.root_idx, bvh.size = header.size;
+    bvh.node_order = (NodeOrder)header.node_order, bvh.treelet_size = header.treelet_size;
+    bvh.tri_layout = (TriLayout)header.tri_layout;
+    bvh.build_sah = header.build_sah, bvh.sah = header.sah;
+    bvh.optimize_stats = {};
+    bvh.version++;
+
+    /* Wide nodes are freed like any other wide BVH, so they are copied */
+    if (wide) {
+        wide->release();
+        wide->nodes = (Bvh8::Node*)aligned_malloc(header.sizes[WIDE_NODES], 64);
+        memcpy(wide->nodes, section(WIDE_NODES), header.sizes[WIDE_NODES]);
+        wide->nodes_used = header.wide_nodes_used;
+    }
+    return true;
+}
+
+Result<void> BvhCache::store(const uint64_t key, const Bvh& bvh, const Bvh8* wide) const {
+    if (bvh.nodes == nullptr || bvh.gpu_nodes == nullptr || bvh.prims == nullptr || bvh.prim_indices == nullptr) {
+        return Err("bvh cache can't store an empty bvh.");
+    }
+
+    CacheHeader header {};
+    header.version = VERSION, header.key = key;
+    header.nodes_used = bvh.nodes_used, header.prim_count = bvh.prim_count;
+    header.root_idx = bvh.root_idx, header.size = bvh.size;
+    header.wide_nodes_used = wide ? wide->nodes_used : 0u;
+    header.node_order = (uint32_t)bvh.node_order, header.treelet_size = bvh.treelet_size;
+    header.tri_layout = (uint32_t)bvh.tri_layout;
+    header.build_sah = bvh.build_sah, header.sah = bvh.sah;
+
+    /* Lay out the sections after the header */
+    const void* sections[SECTION_COUNT] = {bvh.nodes, bvh.gpu_nodes, bvh.prims, bvh.norms, bvh.prim_indices, bvh.gpu_tris, wide ? wide->nodes : nullptr};
+    header.sizes[NODES] = sizeof(Bvh::Node) * bvh.nodes_used;
+    header.sizes[GPU_NODES] = sizeof(Bvh::GPUNode) * bvh.nodes_used;
+    header.sizes[PRIMS] = sizeof(Triangle) * bvh.prim_count;
+    header.sizes[NORMS] = sizeof(Normals) * bvh.prim_count;
+    header.sizes[PRIM_INDICES] = sizeof(uint32_t) * bvh.prim_count;
+    header.sizes[GPU_TRIS] = bvh.gpu_tris ? sizeof(TriangleTransform) * bvh.prim_count : 0u;
+    header.sizes[WIDE_NODES] = wide ? sizeof(Bvh8::Node) * wide->nodes_used : 0u;
+    uint64_t offset = sizeof(CacheHeader);
+    for (uint32_t s = 0u; s < SECTION_COUNT; ++s) {
+        offset = (offset + SECTION_ALIGN - 1u) & ~(SECTION_ALIGN - 1u);
+        header.offsets[s] = offset;
+        offset += header.sizes[s];
+    }
+
+    /* Write to a temporary file first, so a cache file is never partially written */
+    std::error_code ec {};
+    std::filesystem::create_directories(directory, ec);
+    const std::string path = path_of(key), temp_path = path + ".tmp";
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (file == nullptr) return Err("failed to open bvh cache file '%s'.", temp_path.c_str());
+
+    bool ok = fwrite(&header, sizeof(CacheHeader), 1u, file) == 1u;
+    const std::byte padding[SECTION_ALIGN] {};
+    uint64_t written = sizeof(CacheHeader);
+    for (uint32_t s = 0u; s < SECTION_COUNT && ok; ++s) {
+        ok &= fwrite(padding, 1u, header.offsets[s] - written, file) == header.offsets[s] - written;
+        if (header.sizes[s]) ok &= fwrite(sections[s], 1u, header.sizes[s], file) == header.sizes[s];
+        written = header.offsets[s] + header.sizes[s];
+    }
+    ok &= fclose(file) == 0;
+    if (ok == false) {
+        std::filesystem::remove(temp_path, ec);
+        return Err("failed to write bvh cache file '%s'.", temp_path.c_str());
+    }
+
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) return Err("failed to write bvh cache file '%s'.", path.c_str());
+    return Ok();
+}
+
+}  // namespace wyre::scene
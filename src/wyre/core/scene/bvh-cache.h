@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string> /* std::string */
+
+#include "bvh.h"
+#include "bvh-wide.h"
+
+#include "wyre/result.h" /* Result<T> */
+
+namespace wyre::scene {
+
+/**
+ * @brief On-disk cache of built BVHs, keyed on a hash of their build input & settings.
+ * Every array is stored in a 64 byte aligned section, loading memory maps the file,
+ * and points the arrays of the BVH straight into the mapped file. (pages are only read once touched)
+ */
+class BvhCache {
+    /* File format version, files of other versions are rebuilt. */
+    static constexpr uint32_t VERSION = 2u;
+
+    /* Directory the cache files are stored in. */
+    std::string directory {};
+
+    /** @returns The path of the cache file for a key. */
+    std::string path_of(const uint64_t key) const;
+
+   public:
+    explicit BvhCache(std::string directory) : directory(std::move(directory)) {}
+
+    /**
+     * @returns The cache key of a build. (hash of the primitives, normals & every setting that changes the result)
+     * The thread pool & optimization time budget are not part of the key, the first build with a key is kept.
+     */
+    static uint64_t key(const Triangle* prims, const Normals* norms, const uint32_t prim_count, const BuildParams& params, const BvhLayout layout);
+
+    /**
+     * @brief Load a BVH from the cache, its arrays are memory mapped. (and copied once the BVH is modified)
+     * @param wide Wide BVH to load alongside, if the cached BVH was collapsed. (optional)
+     * @returns False if there's no valid cache file for the key.
+     */
+    bool load(const uint64_t key, Bvh& bvh, Bvh8* wide = nullptr) const;
+
+    /** @brief Store a BVH in the cache, and optionally its collapsed wide BVH. */
+    Result<void> store(const uint64_t key, const Bvh& bvh, const Bvh8* wide = nullptr) const;
+};
+
+}  // namespace wyre::scene
@@ -0,0 +1,440 @@
+/**
+ * @file scene/bvh-lbvh.cpp
+ * @brief Fast Morton code build modes of the BVH. (LBVH & PLOC)
+ *
+ * Based on "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees" by Karras 2012,
+ * and "Parallel Locally-Ordered Clustering for Bounding Volume Hierarchy Construction" by Meister & Bittner 2018.
+ */
+#include "bvh.h"
+
+#include <algorithm> /* std::min, std::max, std::swap */
+#include <bit>       /* std::countl_zero */
+#include <cstdlib>   /* std::abs */
+
+namespace wyre::scene {
+
+/* Number of bits per axis of the Morton codes. */
+constexpr uint32_t MORTON_BITS = 10u;
+/* Number of key bits sorted per radix sort pass. */
+constexpr uint32_t RADIX_BITS = 8u;
+constexpr uint32_t RADIX_SIZE = 1u << RADIX_BITS;
+/* Number of chunks per thread, for the chunked parallel passes. */
+constexpr uint32_t CHUNKS_PER_THREAD = 4u;
+/* Number of subtrees per thread, which the cluster tree is written out as in parallel. */
+constexpr uint32_t SUBTREES_PER_THREAD = 16u;
+
+/* Maximum number of primitives per leaf, small clusters are collapsed into a leaf when that lowers their SAH cost. */
+constexpr uint32_t MAX_LEAF_SIZE = 8u;
+
+/* Internal node of the intermediate cluster tree, the cluster ids below the primitive count are the primitives in Morton order. */
+struct Cluster {
+    uint32_t left = 0u, right = 0u;
+    /* Number of primitives below the cluster, and number of BVH nodes it is written out as. */
+    uint32_t leaves = 0u, nodes = 0u;
+    AABB bounds {};
+    /* SAH cost of the cluster subtree. (weighted by half areas, like `Bvh::eval_tree_sah`) */
+    float cost = 0.0f;
+    /* Depth of the cluster in the tree, clusters at the maximum depth are written out as leaves. */
+    uint32_t depth = 0u;
+};
+
+/**
+ * @brief Execute `func(chunk, begin, end)` over a range split into a fixed number of chunks,
+ * so the results of each chunk can be combined in order afterwards.
+ */
+template <typename F>
+static void for_chunks(ThreadPool* pool, const uint32_t count, const uint32_t chunks, F&& func) {
+    const uint32_t chunk_size = (count + chunks - 1u) / chunks;
+    const auto run = [&](const uint32_t begin, const uint32_t end) {
+        for (uint32_t c = begin; c < end; ++c) func(c, std::min(c * chunk_size, count), std::min((c + 1u) * chunk_size, count));
+    };
+    if (pool) pool->parallel_for(chunks, 1u, run);
+    else run(0u, chunks);
+}
+
+/** @returns A 10 bit integer with 2 zero bits inserted after every bit. */
+inline uint32_t expand_bits(uint32_t v) {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+/** @returns The 30 bit Morton code of a point, normalized to the [0, 1] range. */
+inline uint32_t morton_code(const glm::vec3& p) {
+    const float scale = (float)(1u << MORTON_BITS);
+    const glm::uvec3 q = glm::uvec3(glm::clamp(p * scale, glm::vec3(0.0f), glm::vec3(scale - 1.0f)));
+    return (expand_bits(q.x) << 2u) | (expand_bits(q.y) << 1u) | expand_bits(q.z);
+}
+
+/** @brief Sort key & value pairs by their key, with a parallel least significant digit radix sort. */
+static void radix_sort(ThreadPool* pool, const uint32_t chunks, std::vector<uint32_t>& keys, std::vector<uint32_t>& values, const uint32_t key_bits) {
+    const uint32_t count = (uint32_t)keys.size();
+    std::vector<uint32_t> keys_out(count), values_out(count);
+    std::vector<uint32_t> offsets(chunks * RADIX_SIZE);
+    for (uint32_t shift = 0u; shift < key_bits; shift += RADIX_BITS) {
+        /* Count the digits of each chunk */
+        for_chunks(pool, count, chunks, [&](const uint32_t c, const uint32_t begin, const uint32_t end) {
+            uint32_t* histogram = &offsets[c * RADIX_SIZE];
+            std::fill(histogram, histogram + RADIX_SIZE, 0u);
+            for (uint32_t i = begin; i < end; ++i) histogram[(keys[i] >> shift) & (RADIX_SIZE - 1u)]++;
+        });
+
+        /* Each chunk writes a digit after the same digit of all previous chunks, keeping the sort stable */
+        uint32_t sum = 0u;
+        for (uint32_t d = 0u; d < RADIX_SIZE; ++d) {
+            for (uint32_t c = 0u; c < chunks; ++c) {
+                const uint32_t n = offsets[c * RADIX_SIZE + d];
+                offsets[c * RADIX_SIZE + d] = sum;
+                sum += n;
+            }
+        }
+
+        /* Scatter the pairs to their sorted position */
+        for_chunks(pool, count, chunks, [&](const uint32_t c, const uint32_t begin, const uint32_t end) {
+            uint32_t* offset = &offsets[c * RADIX_SIZE];
+            for (uint32_t i = begin; i < end; ++i) {
+                const uint32_t dst = offset[(keys[i] >> shift) & (RADIX_SIZE - 1u)]++;
+                keys_out[dst] = keys[i];
+                values_out[dst] = values[i];
+            }
+        });
+        std::swap(keys, keys_out);
+        std::swap(values, values_out);
+    }
+}
+
+/** @returns Half the surface area of the union of two AABBs. */
+inline float merged_half_area(const AABB& a, const AABB& b) {
+    const glm::vec3 e = glm::max(a.max, b.max) - glm::min(a.min, b.min);
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+/**
+ * @returns True if neighbour `j` of cluster `i` is preferred over its current best, when both make equally large clusters.
+ * Prefers the even / odd partner of a cluster, so runs of identical clusters merge in pairs instead of a chain, and then the lowest index.
+ */
+inline bool better_tie(const uint32_t i, const uint32_t j, const uint32_t best) {
+    if (best == (i ^ 1u)) return false;
+    return j == (i ^ 1u) || j < best;
+}
+
+/**
+ * @brief Build the cluster tree over the sorted Morton codes, every internal cluster is created independently. (Karras 2012)
+ * @returns The root cluster.
+ */
+static uint32_t build_lbvh(ThreadPool* pool, const std::vector<uint32_t>& codes, std::vector<Cluster>& clusters) {
+    const int n = (int)codes.size();
+
+    /* Length of the common prefix of two codes, the index breaks ties between duplicate codes */
+    const auto delta = [&](const int i, const int j) -> int {
+        if (j < 0 || j >= n) return -1;
+        if (codes[i] == codes[j]) return 32 + std::countl_zero((uint32_t)(i ^ j));
+        return std::countl_zero(codes[i] ^ codes[j]);
+    };
+
+    const auto internal = [&](const uint32_t begin, const uint32_t end) {
+        for (int i = (int)begin; i < (int)end; ++i) {
+            /* Direction of the range covered by this cluster */
+            const int d = delta(i, i + 1) > delta(i, i - 1) ? 1 : -1;
+
+            /* Find the other end of the range, with an exponential & binary search */
+            const int min_delta = delta(i, i - d);
+            int max_length = 2;
+            while (delta(i, i + max_length * d) > min_delta) max_length *= 2;
+            int length = 0;
+            for (int t = max_length / 2; t >= 1; t /= 2) {
+                if (delta(i, i + (length + t) * d) > min_delta) length += t;
+            }
+            const int j = i + length * d;
+
+            /* Find the split, where the common prefix of the range ends */
+            const int node_delta = delta(i, j);
+            int s = 0;
+            for (int div = 2, t = (length + 1) / 2;; div *= 2, t = (length + div - 1) / div) {
+                if (delta(i, i + (s + t) * d) > node_delta) s += t;
+                if (t <= 1) break;
+            }
+            const int split = i + s * d + std::min(d, 0);
+
+            /* Children at the ends of the range are primitives, the others are internal clusters */
+            Cluster& cluster = clusters[i];
+            cluster.left = std::min(i, j) == split ? split : n + split;
+            cluster.right = std::max(i, j) == split + 1 ? split + 1 : n + split + 1;
+            cluster.leaves = std::abs(j - i) + 1;
+        }
+    };
+    if (pool) pool->parallel_for((uint32_t)(n - 1), 1u << 12u, internal);
+    else internal(0u, n - 1);
+    return n > 1 ? n : 0u;
+}
+
+/**
+ * @brief Build the cluster tree bottom-up, by repeatedly merging the clusters which are each other's nearest neighbour,
+ * searching within a radius along the Morton curve. (Meister & Bittner 2018)
+ * @returns The root cluster.
+ */
+static uint32_t build_ploc(ThreadPool* pool, const uint32_t chunks, const uint32_t radius, std::vector<AABB>& active, std::vector<Cluster>& clusters) {
+    const uint32_t n = (uint32_t)active.size();
+
+    /* Active clusters in Morton order, their bounds are stored alongside for locality */
+    std::vector<uint32_t> ids(n), next_ids(n), nearest(n);
+    std::vector<AABB> next_active(n);
+    for (uint32_t i = 0u; i < n; ++i) ids[i] = i;
+    std::vector<uint32_t> kept(chunks), merged(chunks);
+
+    uint32_t count = n, next_cluster = n;
+    while (count > 1u) {
+        /* Find the nearest neighbour of every cluster, the one which makes the smallest merged cluster */
+        /* (each pair is only evaluated once per chunk, the chunks overlap their neighbours by the search radius) */
+        for_chunks(pool, count, chunks, [&](const uint32_t, const uint32_t begin, const uint32_t end) {
+            if (begin == end) return;
+            const uint32_t lo = begin > radius ? begin - radius : 0u, hi = std::min(end + radius, count);
+            std::vector<float> best_area(hi - lo, 1e30f);
+            std::vector<uint32_t> best(hi - lo, ~0u);
+            const auto offer = [&](const uint32_t i, const uint32_t j, const float area) {
+                float& best_i = best_area[i - lo];
+                if (area < best_i || (area == best_i && better_tie(i, j, best[i - lo]))) best_i = area, best[i - lo] = j;
+            };
+            for (uint32_t i = lo; i < end; ++i) {
+                for (uint32_t j = i + 1u; j <= std::min(i + radius, hi - 1u); ++j) {
+                    const float area = merged_half_area(active[i], active[j]);
+                    offer(i, j, area);
+                    offer(j, i, area);
+                }
+            }
+            for (uint32_t i = begin; i < end; ++i) nearest[i] = best[i - lo];
+        });
+
+        /* Mutual nearest neighbours merge, the first of the two keeps the slot of the merged cluster */
+        for_chunks(pool, count, chunks, [&](const uint32_t c, const uint32_t begin, const uint32_t end) {
+            kept[c] = merged[c] = 0u;
+            for (uint32_t i = begin; i < end; ++i) {
+                const bool mutual = nearest[nearest[i]] == i;
+                kept[c] += mutual == false || i < nearest[i];
+                merged[c] += mutual && i < nearest[i];
+            }
+        });
+        uint32_t kept_sum = 0u, merged_sum = next_cluster;
+        for (uint32_t c = 0u; c < chunks; ++c) {
+            const uint32_t k = kept[c], m = merged[c];
+            kept[c] = kept_sum, merged[c] = merged_sum;
+            kept_sum += k, merged_sum += m;
+        }
+
+        /* Compact the remaining clusters, keeping their Morton order */
+        for_chunks(pool, count, chunks, [&](const uint32_t c, const uint32_t begin, const uint32_t end) {
+            uint32_t dst = kept[c], cluster_idx = merged[c];
+            for (uint32_t i = begin; i < end; ++i) {
+                const uint32_t j = nearest[i];
+                const bool mutual = nearest[j] == i;
+                if (mutual && i > j) continue;
+                if (mutual) {
+                    Cluster& cluster = clusters[cluster_idx - n];
+                    cluster.left = ids[i], cluster.right = ids[j];
+                    cluster.leaves = (ids[i] < n ? 1u : clusters[ids[i] - n].leaves) + (ids[j] < n ? 1u : clusters[ids[j] - n].leaves);
+                    next_ids[dst] = cluster_idx++;
+                    next_active[dst++] = AABB(glm::min(active[i].min, active[j].min), glm::max(active[i].max, active[j].max));
+                } else {
+                    next_ids[dst] = ids[i];
+                    next_active[dst++] = active[i];
+                }
+            }
+        });
+        std::swap(ids, next_ids);
+        std::swap(active, next_active);
+        count = kept_sum, next_cluster = merged_sum;
+    }
+    return ids[0];
+}
+
+void Bvh::build_morton(const BuildParams& params) {
+    ThreadPool* pool = (params.pool && params.pool->size() > 1u) ? params.pool : nullptr;
+    const uint32_t chunks = pool ? pool->size() * CHUNKS_PER_THREAD : 1u;
+    BuildData& data = build_data;
+    const uint32_t n = prim_count;
+
+    /* Bounds of the primitive centroids, the Morton codes are relative to them */
+    std::vector<AABB> chunk_bounds(chunks);
+    for_chunks(pool, n, chunks, [&](const uint32_t c, const uint32_t begin, const uint32_t end) {
+        AABB aabb {};
+        for (uint32_t i = begin; i < end; ++i) aabb.grow(glm::vec3(data.centroid[0][i], data.centroid[1][i], data.centroid[2][i]));
+        chunk_bounds[c] = aabb;
+    });
+    AABB cbounds {};
+    for (const AABB& aabb : chunk_bounds) cbounds.grow(aabb);
+    const glm::vec3 cmin = cbounds.min, inv_extent = 1.0f / glm::max(cbounds.max - cbounds.min, glm::vec3(1e-30f));
+
+    /* Sort the primitives along the Morton curve */
+    std::vector<uint32_t> codes(n), order(n);
+    const auto encode = [&](const uint32_t begin, const uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            codes[i] = morton_code((glm::vec3(data.centroid[0][i], data.centroid[1][i], data.centroid[2][i]) - cmin) * inv_extent);
+            order[i] = i;
+        }
+    };
+    if (pool) pool->parallel_for(n, 1u << 13u, encode);
+    else encode(0u, n);
+    radix_sort(pool, chunks, codes, order, MORTON_BITS * 3u);
+
+    /* Gather the primitive bounds & indices in Morton order, the primitives are the first clusters */
+    std::vector<AABB> leaf_bounds(n);
+    std::vector<uint32_t> leaf_indices(n);
+    const auto gather = [&](const uint32_t begin, const uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            const uint32_t r = order[i];
+            leaf_bounds[i] = AABB(glm::vec3(data.bmin[0][r], data.bmin[1][r], data.bmin[2][r]), glm::vec3(data.bmax[0][r], data.bmax[1][r], data.bmax[2][r]));
+            leaf_indices[i] = data.indices[r];
+        }
+    };
+    if (pool) pool->parallel_for(n, 1u << 13u, gather);
+    else gather(0u, n);
+
+    /* Build the cluster tree */
+    std::vector<Cluster> clusters(n - 1u);
+    uint32_t root = 0u;
+    if (params.builder == Builder::PLOC) {
+        std::vector<AABB> active = leaf_bounds;
+        root = build_ploc(pool, chunks, std::max(params.ploc_radius, 1u), active, clusters);
+    } else {
+        root = build_lbvh(pool, codes, clusters);
+    }
+    const auto leaves_of = [&](const uint32_t c) { return c < n ? 1u : clusters[c - n].leaves; };
+    const auto nodes_of = [&](const uint32_t c) { return c < n ? 1u : clusters[c - n].nodes; };
+
+    /* Split off the top of the tree into subtrees, which are processed in parallel */
+    /* (subtrees are never smaller than a leaf & start above the maximum depth, so the top of the tree is never collapsed) */
+    const uint32_t subtree_leaves = pool ? std::max(n / (pool->size() * SUBTREES_PER_THREAD), MAX_LEAF_SIZE) : n;
+    const auto is_top = [&](const uint32_t c) { return c >= n && clusters[c - n].leaves > subtree_leaves && clusters[c - n].depth + 1u < MAX_BUILD_DEPTH; };
+    std::vector<uint32_t> top {}, subtrees {};
+    std::vector<uint32_t> stack {root};
+    while (stack.empty() == false) {
+        const uint32_t c = stack.back();
+        stack.pop_back();
+        if (is_top(c) == false) {
+            if (c >= n) subtrees.push_back(c);
+            continue;
+        }
+        top.push_back(c);
+        for (const uint32_t child : {clusters[c - n].left, clusters[c - n].right}) {
+            if (child >= n) clusters[child - n].depth = clusters[c - n].depth + 1u;
+            stack.push_back(child);
+        }
+    }
+
+    /*
+     * Fit the clusters bottom-up, collapsing small clusters into a leaf if that is cheaper than splitting them.
+     * Clusters at the maximum depth are collapsed into a leaf however many primitives they hold, so the tree never gets deeper than `MAX_BUILD_DEPTH`.
+     * (PLOC can cluster a long chain of primitives, and LBVH splits runs of equal Morton codes by index)
+     */
+    const auto fit = [&](const uint32_t c) {
+        Cluster& cluster = clusters[c - n];
+        const AABB& left = cluster.left < n ? leaf_bounds[cluster.left] : clusters[cluster.left - n].bounds;
+        const AABB& right = cluster.right < n ? leaf_bounds[cluster.right] : clusters[cluster.right - n].bounds;
+        cluster.bounds = AABB(glm::min(left.min, right.min), glm::max(left.max, right.max));
+        const glm::vec3 e = cluster.bounds.max - cluster.bounds.min;
+        const float area = e.x * e.y + e.y * e.z + e.z * e.x;
+
+        const auto cost_of = [&](const uint32_t child, const AABB& aabb) {
+            if (child >= n) return clusters[child - n].cost;
+            const glm::vec3 ce = aabb.max - aabb.min;
+            return ce.x * ce.y + ce.y * ce.z + ce.z * ce.x;
+        };
+        const float split_cost = area + cost_of(cluster.left, left) + cost_of(cluster.right, right);
+        const float leaf_cost = area * cluster.leaves;
+        if (cluster.depth + 1u >= MAX_BUILD_DEPTH || (cluster.leaves <= MAX_LEAF_SIZE && leaf_cost <= split_cost)) {
+            cluster.cost = leaf_cost, cluster.nodes = 1u;
+        } else {
+            cluster.cost = split_cost, cluster.nodes = 1u + nodes_of(cluster.left) + nodes_of(cluster.right);
+        }
+    };
+    const auto fit_subtree = [&](const uint32_t c, std::vector<uint32_t>& order) {
+        /* Order the clusters top-down passing on their depth, then fit them in reverse (iterative, the cluster tree can be deep) */
+        order.assign(1u, c);
+        for (uint32_t i = 0u; i < order.size(); ++i) {
+            const Cluster& cluster = clusters[order[i] - n];
+            for (const uint32_t child : {cluster.left, cluster.right}) {
+                if (child < n) continue;
+                clusters[child - n].depth = cluster.depth + 1u;
+                order.push_back(child);
+            }
+        }
+        for (auto it = order.rbegin(); it != order.rend(); ++it) fit(*it);
+    };
+    const auto fit_subtrees = [&](const uint32_t begin, const uint32_t end) {
+        std::vector<uint32_t> order {};
+        for (uint32_t i = begin; i < end; ++i) fit_subtree(subtrees[i], order);
+    };
+    if (pool) pool->parallel_for((uint32_t)subtrees.size(), 1u, fit_subtrees);
+    else fit_subtrees(0u, (uint32_t)subtrees.size());
+    for (auto it = top.rbegin(); it != top.rend(); ++it) fit(*it); /* (parents were split off before their children) */
+
+    /*
+     * Write out the cluster tree in the node layout of the other builders, children are stored in pairs after their parent.
+     * The node count of every cluster is known, so every subtree knows its slots up front.
+     */
+    struct Subtree {
+        uint32_t cluster, slot, region, first;
+    };
+    std::vector<uint32_t> indices(n);
+    const auto gather_leaves = [&](const uint32_t c, uint32_t first, std::vector<uint32_t>& gather) {
+        gather.assign(1u, c);
+        while (gather.empty() == false) {
+            const uint32_t i = gather.back();
+            gather.pop_back();
+            if (i < n) {
+                indices[first++] = leaf_indices[i];
+                continue;
+            }
+            gather.push_back(clusters[i - n].right);
+            gather.push_back(clusters[i - n].left);
+        }
+    };
+    const auto emit = [&](const auto& self, const Subtree& task, const bool recurse, std::vector<uint32_t>& gather) -> void {
+        Node& node = nodes[task.slot];
+        if (task.cluster < n) {
+            node.min = leaf_bounds[task.cluster].min, node.max = leaf_bounds[task.cluster].max;
+            node.left_first = task.first, node.prim_count = 1u;
+            indices[task.first] = leaf_indices[task.cluster];
+            return;
+        }
+        const Cluster& cluster = clusters[task.cluster - n];
+        node.min = cluster.bounds.min, node.max = cluster.bounds.max;
+        if (cluster.nodes == 1u) {
+            node.left_first = task.first, node.prim_count = cluster.leaves;
+            gather_leaves(task.cluster, task.first, gather);
+            return;
+        }
+        node.left_first = task.region, node.prim_count = 0u;
+        if (recurse == false) return;
+        self(self, {cluster.left, task.region, task.region + 2u, task.first}, true, gather);
+        self(self, {cluster.right, task.region + 1u, task.region + 1u + nodes_of(cluster.left), task.first + leaves_of(cluster.left)}, true, gather);
+    };
+
+    /* Write out the top of the tree, and gather the subtrees below it */
+    std::vector<Subtree> tasks {}, task_stack {{root, root_idx, 2u, 0u}};
+    while (task_stack.empty() == false) {
+        const Subtree task = task_stack.back();
+        task_stack.pop_back();
+        if (is_top(task.cluster) == false) {
+            tasks.push_back(task);
+            continue;
+        }
+        const Cluster& cluster = clusters[task.cluster - n];
+        emit(emit, task, false, stack);
+        task_stack.push_back({cluster.left, task.region, task.region + 2u, task.first});
+        task_stack.push_back({cluster.right, task.region + 1u, task.region + 1u + nodes_of(cluster.left), task.first + leaves_of(cluster.left)});
+    }
+    const auto emit_subtrees = [&](const uint32_t begin, const uint32_t end) {
+        std::vector<uint32_t> gather {};
+        for (uint32_t i = begin; i < end; ++i) emit(emit, tasks[i], true, gather);
+    };
+    if (pool) pool->parallel_for((uint32_t)tasks.size(), 1u, emit_subtrees);
+    else emit_subtrees(0u, (uint32_t)tasks.size());
+
+    data.indices = std::move(indices);
+    nodes_used = nodes_of(root) + 1u;
+}
+
+}  // namespace wyre::scene
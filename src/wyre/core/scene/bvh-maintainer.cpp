@@ -1,5 +1,5 @@
 /**
- * @file pipelines/scene-bvh.cpp
+ * @file scene/bvh-maintainer.cpp
  * @brief Scene BVH Maintainer.
  */
 #include "bvh-maintainer.h"
@@ -9,55 +9,404 @@
 #include "wyre/core/components/mesh.h"
 #include "wyre/core/components/transform.h"
 
+#include <algorithm> /* std::upper_bound, std::min */
+#include <memory>    /* std::make_unique */
+#include <unordered_map> /* std::unordered_map */
+#include <unordered_set> /* std::unordered_set */
+#include <utility>   /* std::exchange */
+#include <vector>    /* std::erase_if */
+
 namespace wyre {
 
 using namespace scene;
 
+/* Minimum number of triangles per thread pool task, when flattening meshes. */
+constexpr uint32_t FLATTEN_GRAIN = 4096u;
+
+/** @brief Flatten a range of the triangles of a mesh, in object space. (instances apply their transform while tracing) */
+static void flatten_range(const Mesh& mesh, const uint32_t first, const uint32_t last, Triangle* triangles, Normals* normals) {
+    const bool indexed = mesh.indices.empty() == false;
+    for (uint32_t i = first; i < last; ++i) {
+        glm::vec3 v[3], n[3];
+        for (uint32_t k = 0u; k < 3u; ++k) {
+            const uint32_t index = indexed ? mesh.indices[i * 3u + k] : i * 3u + k;
+            v[k] = mesh.vertices[index];
+            n[k] = glm::normalize(mesh.normals[index]);
+        }
+        triangles[i] = Triangle(v[0], v[1], v[2], mesh.material);
+        normals[i] = Normals(n[0], n[1], n[2]);
+    }
+}
+
+/**
+ * @brief Flatten the triangles of meshes in object space, in parallel.
+ * @param offsets Prefix sum of the triangle counts, the range of each mesh in the output. (mesh count + 1 entries, null meshes are empty)
+ */
+static void flatten(const Mesh* const* meshes, const uint32_t* offsets, const uint32_t mesh_count, Triangle* triangles, Normals* normals,
+                    ThreadPool& pool) {
+    pool.parallel_for(offsets[mesh_count], FLATTEN_GRAIN, [&](const uint32_t begin, const uint32_t end) {
+        /* Find the mesh of the first triangle, tasks can span several meshes */
+        uint32_t m = (uint32_t)(std::upper_bound(offsets, offsets + mesh_count + 1u, begin) - offsets) - 1u;
+        for (uint32_t i = begin; i < end; i = offsets[++m]) {
+            while (offsets[m + 1u] <= i) m++;
+            const uint32_t first = offsets[m], last = std::min(end, offsets[m + 1u]);
+            flatten_range(*meshes[m], i - first, last - first, triangles + first, normals + first);
+        }
+    });
+}
+
+/** @brief Hash a buffer of 32 bit words. (FNV-1a) */
+template <typename T>
+inline void hash_words(uint64_t& hash, const std::vector<T>& data) {
+    const uint32_t* words = (const uint32_t*)data.data();
+    const size_t count = data.size() * sizeof(T) / sizeof(uint32_t);
+    for (size_t i = 0; i < count; ++i) hash = (hash ^ words[i]) * 0x100000001b3ull;
+    hash = (hash ^ count) * 0x100000001b3ull;
+}
+
+/** @returns A hash of the geometry of a mesh. */
+static uint64_t hash_geometry(const Mesh& mesh) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash_words(hash, mesh.vertices);
+    hash_words(hash, mesh.normals);
+    hash_words(hash, mesh.indices);
+    return hash;
+}
+
+/** @returns True if two transforms are exactly the same. */
+inline bool same_transform(const Transform& a, const Transform& b) {
+    return a.position == b.position && a.scale == b.scale && a.rotation == b.rotation;
+}
+
+SceneBvhMaintainer::~SceneBvhMaintainer() {
+    untrack();
+    if (blas_build) pool.wait(blas_build->group);
+    for (Blas& blas : blases) blas.bvh.release();
+    tlas.release();
+}
+
 void SceneBvhMaintainer::maintain(ECS& ecs) {
-    if (bvh.prims != nullptr) return;
+    /* Everything is new to a registry which wasn't tracked yet */
+    if (registry != &ecs.registry) track(ecs.registry);
+    /* BLASes finished in the background are added to the scene by a rebuild */
+    if (poll_blas_build()) structure_changed = true;
+    if (structure_changed) return rebuild(ecs);
+    if (dirty.empty()) return;
+
+    /* Update the instances which moved, or changed material */
+    uint32_t moved = 0u;
+    bool changed = false;
+    for (const uint32_t i : dirty) {
+        Instance& instance = instances[i];
+        const uint32_t changes = std::exchange(instance.changes, 0u);
+        const auto [mesh, transform] = ecs.registry.get<const Mesh, const Transform>(instance.entity);
+
+        /* Meshes with new geometry need another BLAS (material changes keep the geometry version, and its hash) */
+        if (changes & MESH_CHANGED) {
+            const auto known = geometry_hashes.find(mesh.geometry_version);
+            if (mesh.tri_count == 0u || known == geometry_hashes.end() || known->second != blases[instance.blas].hash) return rebuild(ecs);
+        }
+
+        const bool same = same_transform(instance.transform, transform);
+        if (same && instance.material == mesh.material) continue;
+        instance.transform = transform;
+        instance.material = mesh.material;
+        update_instance(i);
+        moved += !same, changed = true;
+    }
+
+    /* Rebuild the TLAS quickly if many instances moved */
+    bool rebuilt = false;
+    if (moved > 0u && moved >= fast_rebuild_fraction * instances.size()) {
+        rebuild_tlas(Builder::PLOC);
+        moved = 0u, rebuilt = true;
+    }
+
+    /* Refit the TLAS, and schedule a full rebuild once its quality degraded too much */
+    if (moved > 0u && rebuild_scheduled == false) {
+        tlas.refit(instance_bounds.data());
+        if (tlas.sah_drift() > 1.0f + rebuild_threshold) rebuild_scheduled = true;
+    }
+    if (rebuild_scheduled) rebuild_tlas(), rebuilt = true;
+
+    /* Rebuilds re-order all GPU instances, otherwise only the changed ones are written */
+    if (rebuilt) {
+        pack_instances();
+    } else if (changed) {
+        for (const uint32_t i : dirty) pack_instance(i);
+        instance_version++;
+    }
+    dirty.clear();
+}
+
+void SceneBvhMaintainer::track(entt::registry& new_registry) {
+    untrack();
+    registry = &new_registry;
+    registry->on_construct<Mesh>().connect<&SceneBvhMaintainer::on_structure>(*this);
+    registry->on_destroy<Mesh>().connect<&SceneBvhMaintainer::on_structure>(*this);
+    registry->on_construct<Transform>().connect<&SceneBvhMaintainer::on_structure>(*this);
+    registry->on_destroy<Transform>().connect<&SceneBvhMaintainer::on_structure>(*this);
+    registry->on_update<Transform>().connect<&SceneBvhMaintainer::on_transform>(*this);
+    registry->on_update<Mesh>().connect<&SceneBvhMaintainer::on_mesh>(*this);
+    structure_changed = true;
+}
+
+void SceneBvhMaintainer::untrack() {
+    if (registry == nullptr) return;
+    registry->on_construct<Mesh>().disconnect(this);
+    registry->on_destroy<Mesh>().disconnect(this);
+    registry->on_construct<Transform>().disconnect(this);
+    registry->on_destroy<Transform>().disconnect(this);
+    registry->on_update<Transform>().disconnect(this);
+    registry->on_update<Mesh>().disconnect(this);
+    registry = nullptr;
+}
+
+void SceneBvhMaintainer::on_structure(entt::registry& changed_registry, const Entity entity) {
+    /* Only entities with both a mesh & transform are instances (during destruction the component is still there) */
+    if (changed_registry.all_of<Mesh, Transform>(entity)) structure_changed = true;
+}
+
+void SceneBvhMaintainer::on_transform(entt::registry& changed_registry, const Entity entity) {
+    mark_dirty(changed_registry, entity, TRANSFORM_CHANGED);
+}
+
+void SceneBvhMaintainer::on_mesh(entt::registry& changed_registry, const Entity entity) {
+    mark_dirty(changed_registry, entity, MESH_CHANGED);
+}
+
+void SceneBvhMaintainer::mark_dirty(entt::registry& changed_registry, const Entity entity, const uint32_t change) {
+    if (structure_changed) return;
+    const uint32_t e = (uint32_t)entt::to_entity(entity);
+    const uint32_t index = e < entity_instances.size() ? entity_instances[e] : NO_INSTANCE;
+
+    /* Mesh entities without an instance (e.g. without triangles) might have gained one */
+    if (index == NO_INSTANCE || instances[index].entity != entity) {
+        /* (while a BLAS build runs, they are all revisited by the rebuild once it finished) */
+        if (blas_build == nullptr && changed_registry.all_of<Mesh, Transform>(entity)) structure_changed = true;
+        return;
+    }
+
+    Instance& instance = instances[index];
+    if (instance.changes == 0u) dirty.push_back(index);
+    instance.changes |= change;
+}
 
+void SceneBvhMaintainer::rebuild(ECS& ecs) {
     /* Create a group owning Mesh, which also gives us access to the Transform */
     const entt::basic_group mesh_group = ecs.registry.group<const Mesh>(entt::get<const Transform>);
-    
-    std::vector<Triangle> triangles{};
-    std::vector<Normals> normals{};
-    triangles.reserve(1024);
-    normals.reserve(1024);
 
-    /* Collect the triangles from all Mesh instances */
+    /* BLASes finished in the background are matched like the existing ones */
+    std::vector<Blas> old_blases = std::move(blases);
+    for (Blas& built : built_blases) old_blases.push_back(std::move(built));
+    built_blases.clear();
+
+    /* Only the hashes of the geometry which is still in the scene are kept */
+    std::unordered_map<uint64_t, uint64_t> old_hashes = std::move(geometry_hashes);
+    geometry_hashes.clear();
+
+    /* Match every mesh instance with the BLAS of its geometry */
+    std::unique_ptr<BlasBuild> build {};
+    std::unordered_set<uint64_t> new_versions {};
+    blases.clear();
+    instances.clear();
     for (auto&& [entity, mesh, transform] : mesh_group.each()) {
-        const glm::mat4 model = transform.get_model();
-
-        /* If there's no indices, just read the vertex array directly */
-        if (mesh.indices.empty()) {
-            for (size_t i = 0; i < mesh.tri_count; ++i) {
-                const glm::vec3 v0 = model * glm::vec4(mesh.vertices[i * 3 + 0], 1.0f);
-                const glm::vec3 v1 = model * glm::vec4(mesh.vertices[i * 3 + 1], 1.0f);
-                const glm::vec3 v2 = model * glm::vec4(mesh.vertices[i * 3 + 2], 1.0f);
-                triangles.emplace_back(v0, v1, v2, mesh.material);
-                const glm::vec3 n0 = glm::normalize(glm::vec3(model * glm::vec4(mesh.normals[i * 3 + 0], 0.0f)));
-                const glm::vec3 n1 = glm::normalize(glm::vec3(model * glm::vec4(mesh.normals[i * 3 + 1], 0.0f)));
-                const glm::vec3 n2 = glm::normalize(glm::vec3(model * glm::vec4(mesh.normals[i * 3 + 2], 0.0f)));
-                normals.emplace_back(n0, n1, n2);
+        if (mesh.tri_count == 0u) continue;
+
+        /* Find an existing BLAS with the same geometry, geometry which wasn't hashed yet is new */
+        uint32_t blas = (uint32_t)blases.size();
+        const auto old_hash = old_hashes.find(mesh.geometry_version);
+        if (old_hash != old_hashes.end()) {
+            const uint64_t hash = old_hash->second;
+            geometry_hashes.insert(*old_hash);
+            blas = 0u;
+            while (blas < blases.size() && blases[blas].hash != hash) blas++;
+            if (blas == blases.size()) {
+                uint32_t old = 0u;
+                while (old < old_blases.size() && (old_blases[old].hash != hash || old_blases[old].bvh.prims == nullptr)) old++;
+                if (old < old_blases.size()) {
+                    blases.push_back(std::move(old_blases[old]));
+                    old_blases[old] = {};
+                }
             }
+        }
+
+        /* Or copy the mesh into a build, its instances are added once the build finished */
+        /* (new geometry waits for a running build to finish, which triggers another rebuild) */
+        if (blas == blases.size()) {
+            if (blas_build) continue;
+            if (build == nullptr) build = std::make_unique<BlasBuild>();
+            if (new_versions.insert(mesh.geometry_version).second) build->meshes.push_back(mesh);
             continue;
         }
+        instances.push_back({entity, transform, mesh.material, blas});
+    }
+
+    /* Free the BLASes which are no longer used */
+    for (Blas& old_blas : old_blases) old_blas.bvh.release();
 
-        /* Use the indices array */
-        for (size_t i = 0; i < mesh.tri_count; ++i) {
-            const glm::vec3 v0 = model * glm::vec4(mesh.vertices[mesh.indices[i * 3 + 0]], 1.0f);
-            const glm::vec3 v1 = model * glm::vec4(mesh.vertices[mesh.indices[i * 3 + 1]], 1.0f);
-            const glm::vec3 v2 = model * glm::vec4(mesh.vertices[mesh.indices[i * 3 + 2]], 1.0f);
-            triangles.emplace_back(v0, v1, v2, mesh.material);
-            const glm::vec3 n0 = glm::normalize(glm::vec3(model * glm::vec4(mesh.normals[mesh.indices[i * 3 + 0]], 0.0f)));
-            const glm::vec3 n1 = glm::normalize(glm::vec3(model * glm::vec4(mesh.normals[mesh.indices[i * 3 + 1]], 0.0f)));
-            const glm::vec3 n2 = glm::normalize(glm::vec3(model * glm::vec4(mesh.normals[mesh.indices[i * 3 + 2]], 0.0f)));
-            normals.emplace_back(n0, n1, n2);
+    if (build) {
+        for (const Blas& blas : blases) build->known_hashes.push_back(blas.hash);
+        if (async_build == false) {
+            /* Build right away, and match the instances of the new geometry again */
+            build_blases(*build, pool);
+            finish_blas_build(*build);
+            build.reset();
+            return rebuild(ecs);
         }
+
+        /* Build in the background as a low priority task, so waiting on the pool never picks up the long build */
+        BlasBuild& background = *build;
+        pool.submit(background.group, [this, &background] { build_blases(background, pool); });
+        blas_build = std::move(build);
     }
 
-    /* Build a BVH over all the triangles in the scene */
-    bvh.build(triangles.data(), normals.data(), triangles.size());
+    /* Map the entities to their instances, for tracking changes */
+    entity_instances.clear();
+    for (uint32_t i = 0u; i < instances.size(); ++i) {
+        const uint32_t e = (uint32_t)entt::to_entity(instances[i].entity);
+        if (e >= entity_instances.size()) entity_instances.resize(e + 1u, NO_INSTANCE);
+        entity_instances[e] = i;
+    }
+    dirty.clear();
+    structure_changed = false;
+
+    /* Assign the BLAS offsets in the packed buffers */
+    blas_nodes = 0u, blas_prims = 0u;
+    for (Blas& blas : blases) {
+        blas.node_offset = blas_nodes, blas.prim_offset = blas_prims;
+        blas_nodes += blas.bvh.nodes_used;
+        blas_prims += blas.bvh.prim_count;
+    }
+    blas_version++;
+
+    /* Build the TLAS over the instances */
+    instance_bounds.resize(instances.size());
+    gpu_instances.resize(instances.size());
+    trace_instances.resize(instances.size());
+    for (uint32_t i = 0u; i < instances.size(); ++i) update_instance(i);
+    rebuild_tlas();
+    pack_instances();
+}
+
+void SceneBvhMaintainer::build_blases(BlasBuild& build, ThreadPool& workers) {
+    /* Hash the geometry of the meshes, meshes with the same geometry share a BLAS */
+    const uint32_t mesh_count = (uint32_t)build.meshes.size();
+    build.hashes.resize(mesh_count);
+    workers.parallel_for(mesh_count, 1u, [&](const uint32_t begin, const uint32_t end) {
+        for (uint32_t m = begin; m < end; ++m) build.hashes[m] = hash_geometry(build.meshes[m]);
+    });
+
+    /* Geometry which has a BLAS, in the scene or earlier in this build, isn't built again */
+    std::unordered_set<uint64_t> seen(build.known_hashes.begin(), build.known_hashes.end());
+    std::vector<const Mesh*> meshes {};
+    for (uint32_t m = 0u; m < mesh_count; ++m) {
+        if (seen.insert(build.hashes[m]).second == false) continue;
+        build.blases.emplace_back().hash = build.hashes[m];
+        meshes.push_back(&build.meshes[m]);
+    }
+
+    /* Flatten all meshes in object space at once, each into its own range */
+    const uint32_t blas_count = (uint32_t)meshes.size();
+    std::vector<uint32_t> offsets(blas_count + 1u, 0u);
+    for (uint32_t b = 0u; b < blas_count; ++b) offsets[b + 1u] = offsets[b] + (uint32_t)meshes[b]->tri_count;
+    std::vector<Triangle> triangles(offsets.back());
+    std::vector<Normals> normals(offsets.back());
+    flatten(meshes.data(), offsets.data(), blas_count, triangles.data(), normals.data(), workers);
+
+    BuildParams params {};
+    params.pool = &workers;
+    params.node_order = NodeOrder::TREELETS;
+    params.optimize_ms = blas_optimize_ms;
+    params.tri_layout = tri_layout;
+
+    for (uint32_t b = 0u; b < blas_count; ++b) {
+        const Triangle* tris = triangles.data() + offsets[b];
+        const Normals* norms = normals.data() + offsets[b];
+        const uint32_t tri_count = offsets[b + 1u] - offsets[b];
+        Blas& blas = build.blases[b];
+
+        /* Bounds of the BLAS, the instance bounds are transformed from these */
+        blas.bounds = {};
+        for (uint32_t i = 0u; i < tri_count; ++i) blas.bounds.grow(tris[i].get_aabb());
+
+        /* Load the BLAS from the cache, or build it in object space */
+        const uint64_t key = BvhCache::key(tris, norms, tri_count, params, BvhLayout::BINARY);
+        if (cache.load(key, blas.bvh)) continue;
+
+        blas.bvh.build(tris, norms, tri_count, params);
+        const Result<void> stored = cache.store(key, blas.bvh);
+        if (stored.is_err()) build.cache_errors.push_back(stored.unwrap_err());
+    }
+}
+
+void SceneBvhMaintainer::finish_blas_build(BlasBuild& build) {
+    for (const std::string& error : build.cache_errors) {
+        logger.log(LogGroup::SYSTEM, LogLevel::WARNING, "failed to cache blas: %s", error.c_str());
+    }
+    for (uint32_t m = 0u; m < build.meshes.size(); ++m) geometry_hashes[build.meshes[m].geometry_version] = build.hashes[m];
+    for (Blas& blas : build.blases) built_blases.push_back(std::move(blas));
+}
+
+bool SceneBvhMaintainer::poll_blas_build() {
+    if (blas_build == nullptr || blas_build->group.pending.load(std::memory_order_acquire) > 0u) return false;
+    finish_blas_build(*blas_build);
+    blas_build.reset();
+    return true;
+}
+
+void SceneBvhMaintainer::update_instance(const uint32_t index) {
+    const Instance& instance = instances[index];
+    const AABB& root = blases[instance.blas].bounds;
+    const glm::mat4 model = instance.transform.get_model();
+
+    /* Transform the corners of the BLAS bounds into world space */
+    AABB bounds {};
+    for (uint32_t c = 0u; c < 8u; ++c) {
+        const glm::vec3 corner((c & 1u) ? root.max.x : root.min.x, (c & 2u) ? root.max.y : root.min.y, (c & 4u) ? root.max.z : root.min.z);
+        bounds.grow(glm::vec3(model * glm::vec4(corner, 1.0f)));
+    }
+    instance_bounds[index] = bounds;
+}
+
+void SceneBvhMaintainer::rebuild_tlas(const Builder builder) {
+    rebuild_scheduled = false;
+    if (instances.empty()) return tlas.release();
+    BuildParams params {};
+    params.pool = &pool;
+    params.builder = builder;
+    tlas.build(instance_bounds.data(), (uint32_t)instances.size(), params);
+
+    /* Instances are packed in the primitive order of the TLAS */
+    instance_slots.resize(instances.size());
+    for (uint32_t i = 0u; i < tlas.prim_count; ++i) instance_slots[tlas.prim_indices[i]] = i;
+}
+
+void SceneBvhMaintainer::pack_instances() {
+    for (uint32_t i = 0u; i < tlas.prim_count; ++i) pack_instance(tlas.prim_indices[i]);
+    instance_version++;
+}
+
+void SceneBvhMaintainer::pack_instance(const uint32_t index) {
+    const Instance& instance = instances[index];
+    const glm::mat4 inv_model = glm::inverse(instance.transform.get_model());
+
+    /* Store the world to object transform as the rows of a 3x4 matrix */
+    GPUInstance& gpu_instance = gpu_instances[instance_slots[index]];
+    for (uint32_t r = 0u; r < 3u; ++r) {
+        gpu_instance.inv_model[r] = glm::vec4(inv_model[0][r], inv_model[1][r], inv_model[2][r], inv_model[3][r]);
+    }
+    gpu_instance.material = instance.material;
+    const Blas& blas = blases[instance.blas];
+    gpu_instance.blas_root = blas.node_offset;
+
+    TraceInstance& trace_instance = trace_instances[instance_slots[index]];
+    std::copy(gpu_instance.inv_model, gpu_instance.inv_model + 3u, trace_instance.inv_model);
+    trace_instance.blas = &blas.bvh;
+}
+
+Hit SceneBvhMaintainer::intersect(const Ray& ray, uint32_t& instance) const {
+    return scene::intersect(tlas, trace_instances.data(), ray, instance);
 }
 
 }  // namespace wyre
@@ -1,31 +1,216 @@
 /**
- * @file pipelines/scene-bvh.h
+ * @file scene/bvh-maintainer.h
  * @brief Scene BVH Maintainer.
  */
 #pragma once
 
+#include <memory> /* std::unique_ptr */
+#include <unordered_map> /* std::unordered_map */
+#include <vector> /* std::vector */
+
 #include "./bvh.h"
+#include "./bvh-cache.h"
+#include "./bvh-traverse.h"
+
+#include "wyre/core/ecs.h"                   /* Entity */
+#include "wyre/core/components/mesh.h"      /* Mesh */
+#include "wyre/core/components/transform.h" /* Transform */
 
 namespace wyre {
 
 class Logger;
-class ECS;
 
 /**
- * @brief Scene BVH Maintainer, keeps the scene BVH updated.
+ * @brief Scene BVH Maintainer, keeps the two-level scene BVH updated.
+ * Every unique mesh gets a bottom-level BVH (BLAS) in object space,
+ * and a top-level BVH (TLAS) is built over the world space bounds of all mesh instances.
  */
 class SceneBvhMaintainer {
     friend class Renderer;
+    friend class SceneBvhPacker;
+
+   public:
+    /* Mesh instance optimized for GPU ray tracing. */
+    struct GPUInstance {
+        /* World to object space transform. (rows of a 3x4 matrix) */
+        glm::vec4 inv_model[3];
+        /* Root node of the BLAS. */
+        glm::vec3 material; uint32_t blas_root;
+    };
+
+   private:
+    /* Bottom-level BVH of a unique mesh, in object space. */
+    struct Blas {
+        scene::Bvh bvh {};
+        /* Bounds of the BLAS. */
+        AABB bounds {};
+        /* Hash of the mesh geometry, meshes with the same geometry share a BLAS. */
+        uint64_t hash = 0u;
+        /* Offsets of this BLAS, in the packed node & primitive buffers. */
+        uint32_t node_offset = 0u, prim_offset = 0u;
+    };
+
+    /* Changes to the components of a mesh entity. */
+    enum Change : uint32_t {
+        TRANSFORM_CHANGED = 1u << 0u,
+        MESH_CHANGED = 1u << 1u,
+    };
+
+    /* Mesh instance, referencing a BLAS. */
+    struct Instance {
+        Entity entity {};
+        /* Transform & material the instance was last updated with. */
+        Transform transform {};
+        glm::vec3 material {};
+        uint32_t blas = 0u;
+        /* Changes since the last maintain, instances with changes are in the dirty list. */
+        uint32_t changes = 0u;
+    };
+
+    /* Instance index of an entity without an instance. */
+    static constexpr uint32_t NO_INSTANCE = ~0u;
+
+    /* BLASes of the meshes with new geometry, which are hashed, flattened & built together. (in the background with `async_build`) */
+    struct BlasBuild {
+        ThreadPool::TaskGroup group {ThreadPool::Priority::LOW};
+        /* Copies of the meshes, the build reads them while the scene keeps changing. (one per geometry version) */
+        std::vector<Mesh> meshes {};
+        /* Hashes of the BLASes the scene had when the build started, geometry which has one isn't built again. */
+        std::vector<uint64_t> known_hashes {};
+        /* Geometry hash of every mesh. */
+        std::vector<uint64_t> hashes {};
+        /* One BLAS per unique geometry which has none yet. */
+        std::vector<Blas> blases {};
+        /* Cache stores which failed during the build, logged once it finished. (the build may run on another thread) */
+        std::vector<std::string> cache_errors {};
+    };
+
+    /* Thread pool used for building the BVHs, background builds run as low priority tasks. */
+    /* (nothing waits on the background builds, so it needs at least one worker thread) */
+    ThreadPool pool {std::max(2u, std::thread::hardware_concurrency())};
+
+    std::vector<Blas> blases {};
+    std::vector<Instance> instances {};
 
-    scene::Bvh bvh {};
+    /* BLAS build running in the background. (null if none is running) */
+    std::unique_ptr<BlasBuild> blas_build {};
+    /* BLASes finished in the background, which are added to the scene by the next rebuild. */
+    std::vector<Blas> built_blases {};
 
-    SceneBvhMaintainer() = default;
-    ~SceneBvhMaintainer() = default;
+    /* Registry whose mesh entities are tracked, changes are reported through its component signals. */
+    entt::registry* registry = nullptr;
+    /* Instance index of every mesh entity, by entity index. */
+    std::vector<uint32_t> entity_instances {};
+    /* Hash of the geometry of every mesh geometry version in the scene, so meshes are only hashed when their geometry changed. */
+    /* (new geometry versions are hashed by the BLAS build) */
+    std::unordered_map<uint64_t, uint64_t> geometry_hashes {};
+    /* Instances which changed since the last maintain. */
+    std::vector<uint32_t> dirty {};
+    /* Set when mesh entities were added or removed, which requires a full rebuild. */
+    bool structure_changed = true;
+
+    /* World space bounds of all instances, the TLAS build input. */
+    std::vector<AABB> instance_bounds {};
+    /* Instances in the primitive order of the TLAS. */
+    std::vector<GPUInstance> gpu_instances {};
+    /* Index of every instance in the GPU instances. */
+    std::vector<uint32_t> instance_slots {};
+    /* GPU instances with their BLAS, for tracing the scene on the CPU. */
+    std::vector<scene::TraceInstance> trace_instances {};
+
+    /* Top-level BVH over all mesh instances. */
+    scene::Bvh tlas {};
+
+    Logger& logger;
+
+    /* On-disk cache of built BLASes, so static meshes are only built once. */
+    scene::BvhCache cache;
+
+    /* Primitive layout the BLASes are intersected with on the GPU. */
+    scene::TriLayout tri_layout = scene::TriLayout::VERTICES;
+
+    /* Total number of nodes & primitives of all BLASes. */
+    uint32_t blas_nodes = 0u, blas_prims = 0u;
+    /* Incremented every time the BLASes, or the instances change. */
+    uint32_t blas_version = 0u, instance_version = 0u;
+
+    /* Time budget for optimizing each new BLAS after its build, in milliseconds. (BLASes are static, so this pays off every frame) */
+    float blas_optimize_ms = 200.0f;
+    /* The TLAS is rebuilt once refitting increased its SAH cost by this fraction. */
+    float rebuild_threshold = 0.3f;
+    /* The TLAS is rebuilt with the fast PLOC builder instead of refitted, once this fraction of the instances moved in a frame. */
+    float fast_rebuild_fraction = 0.25f;
+    /* Set when the TLAS should be fully rebuilt, during the next maintain. */
+    bool rebuild_scheduled = false;
+    /* Build new BLASes in the background, while frames keep using the current ones. (their instances appear once built) */
+    bool async_build = true;
+
+    /** @param cache_dir Directory the built BLASes are cached in. */
+    explicit SceneBvhMaintainer(Logger& logger, std::string cache_dir, const scene::TriLayout tri_layout = scene::TriLayout::VERTICES)
+        : logger(logger), cache(std::move(cache_dir)), tri_layout(tri_layout) {}
+    ~SceneBvhMaintainer();
 
     /**
-     * @brief Maintain the scene BVH.
+     * @brief Maintain the scene BVH, only the entities which changed since the last maintain are visited.
+     * Moving meshes only refits the TLAS, BLASes are only built for new meshes,
+     * and the TLAS is only fully rebuilt if meshes were added or removed, or once its quality degraded too much.
+     * When many meshes moved, the TLAS is rebuilt with a fast builder instead, since refitting would degrade it quickly.
+     * Changes are tracked through the registry signals, so components have to be changed with `ECS::patch_component`.
      */
     void maintain(ECS& ecs);
+
+    /** @brief Start tracking the changes to the mesh entities of a registry. */
+    void track(entt::registry& new_registry);
+
+    /** @brief Stop tracking the changes to the mesh entities. */
+    void untrack();
+
+    /** @brief Registry signal, for mesh entities being added or removed. */
+    void on_structure(entt::registry& changed_registry, const Entity entity);
+
+    /** @brief Registry signals, for components of mesh entities being changed. */
+    void on_transform(entt::registry& changed_registry, const Entity entity);
+    void on_mesh(entt::registry& changed_registry, const Entity entity);
+
+    /** @brief Add a change to an entity, adding its instance to the dirty list. */
+    void mark_dirty(entt::registry& changed_registry, const Entity entity, const uint32_t change);
+
+    /**
+     * @brief Collect the mesh instances, and build the BLASes of the meshes with new geometry.
+     * Instances of new geometry are left out until its build finished, which triggers another rebuild.
+     * With `async_build` the new BLASes are built in the background, otherwise before this rebuild continues.
+     */
+    void rebuild(ECS& ecs);
+
+    /** @brief Hash & flatten the meshes of a build, and build their BLASes, or load them from the cache. */
+    void build_blases(BlasBuild& build, ThreadPool& workers);
+
+    /**
+     * @brief Hand the BLASes & geometry hashes of a finished build to the next rebuild.
+     * The cache stores which failed are logged. (failing to store only costs a rebuild next time)
+     */
+    void finish_blas_build(BlasBuild& build);
+
+    /** @returns True if a background BLAS build finished, and was handed to the next rebuild. */
+    bool poll_blas_build();
+
+    /** @brief Update the world space bounds & GPU data of an instance. */
+    void update_instance(const uint32_t index);
+
+    /** @brief Build the TLAS over all instances. */
+    void rebuild_tlas(const scene::Builder builder = scene::Builder::BINNED_SAH);
+
+    /** @brief Write the GPU instances, in the primitive order of the TLAS. */
+    void pack_instances();
+
+    /** @brief Write the GPU instance of a single instance. */
+    void pack_instance(const uint32_t index);
+
+    /**
+     * @brief Trace a ray through the scene on the CPU, the same way the ray tracing kernels trace the packed scene.
+     * @param instance Set to the GPU instance which was hit, the hit primitive indexes into its BLAS. (`scene::NO_HIT` on a miss)
+     */
+    scene::Hit intersect(const scene::Ray& ray, uint32_t& instance) const;
 };
 
 }  // namespace wyre
@@ -0,0 +1,238 @@
+/**
+ * @file scene/bvh-optimize.cpp
+ * @brief Post-build optimization of the BVH, by removing & reinserting inefficient nodes.
+ *
+ * Based on "Fast Insertion-Based Optimization of Bounding Volume Hierarchies" by Bittner et al. 2013.
+ */
+#include "bvh.h"
+
+#include <algorithm>  /* std::sort, std::push_heap, std::pop_heap */
+#include <cassert>    /* assert */
+#include <chrono>     /* std::chrono::steady_clock */
+#include <cstring>    /* memcpy */
+#include <functional> /* std::greater */
+#include <tuple>      /* std::tuple */
+
+namespace wyre::scene {
+
+/* The optimization stops once a sweep over all nodes improves the SAH cost by less than this fraction. */
+constexpr float REINSERT_MIN_GAIN = 1e-3f;
+
+/* Branch & bound search entry, the cost induced on the ancestors of a node by inserting below it. (cost, node, depth) */
+using InducedCost = std::tuple<float, uint32_t, uint32_t>;
+
+/** @returns Half the surface area of a node. */
+static float area_of(const Bvh::Node& node) {
+    const glm::vec3 e = node.max - node.min;
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+/** @returns Half the surface area of the union of two nodes. */
+static float merged_area(const Bvh::Node& a, const Bvh::Node& b) {
+    const glm::vec3 e = glm::max(a.max, b.max) - glm::min(a.min, b.min);
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+/**
+ * @returns How inefficient a node is, large nodes whose children are much smaller waste the most traversal steps.
+ * (the product of the area, sum & min measures of the paper)
+ */
+static float inefficiency(const Bvh::Node* nodes, const Bvh::Node& node) {
+    const float area = area_of(node);
+    if (node.is_leaf()) return area;
+    const float left = area_of(nodes[node.left_first]), right = area_of(nodes[node.left_first + 1u]);
+    return area * (area / std::max((left + right) * 0.5f, 1e-30f)) * (area / std::max(std::min(left, right), 1e-30f));
+}
+
+/** @brief Refit the bounds & height of an interior node & all its ancestors to their children. */
+static void refit_ancestors(Bvh::Node* nodes, const std::vector<uint32_t>& parents, std::vector<uint32_t>& heights, uint32_t i) {
+    for (; i != ~0u; i = parents[i]) {
+        Bvh::Node& node = nodes[i];
+        const Bvh::Node& left = nodes[node.left_first];
+        const Bvh::Node& right = nodes[node.left_first + 1u];
+        node.min = glm::min(left.min, right.min);
+        node.max = glm::max(left.max, right.max);
+        heights[i] = 1u + std::max(heights[node.left_first], heights[node.left_first + 1u]);
+    }
+}
+
+/** @brief Point the children of the node in a slot back to that slot, after the node moved. */
+static void adopt_children(const Bvh::Node* nodes, std::vector<uint32_t>& parents, const uint32_t i) {
+    if (nodes[i].is_leaf()) return;
+    parents[nodes[i].left_first] = parents[nodes[i].left_first + 1u] = i;
+}
+
+/** @returns The cost of inserting a detached node next to a node, the area of the new parent & the growth of its ancestors. */
+static float insertion_cost(const Bvh::Node* nodes, const std::vector<uint32_t>& parents, const uint32_t target, const Bvh::Node& node) {
+    float cost = merged_area(nodes[target], node);
+    for (uint32_t i = parents[target]; i != ~0u; i = parents[i]) cost += merged_area(nodes[i], node) - area_of(nodes[i]);
+    return cost;
+}
+
+/** @returns The depth of a node in the tree. */
+static uint32_t depth_of(const std::vector<uint32_t>& parents, uint32_t i) {
+    uint32_t depth = 0u;
+    for (; parents[i] != ~0u; i = parents[i]) depth++;
+    return depth;
+}
+
+/**
+ * @returns The node to insert a detached node next to, which increases the SAH cost of the tree the least.
+ * Uses a branch & bound search, the cost induced on the ancestors only grows deeper into the tree.
+ * Targets which would push either subtree below `Bvh::MAX_BUILD_DEPTH` are skipped, the fallback is where the node was removed.
+ */
+static uint32_t find_insertion(const Bvh::Node* nodes, const std::vector<uint32_t>& parents, const std::vector<uint32_t>& heights, const uint32_t root_idx,
+                               const Bvh::Node& node, const uint32_t height, const uint32_t fallback, std::vector<InducedCost>& heap) {
+    const float area = area_of(node);
+    float best_cost = insertion_cost(nodes, parents, fallback, node);
+    uint32_t best = fallback;
+
+    heap.clear();
+    heap.push_back(InducedCost(0.0f, root_idx, 0u));
+    while (heap.empty() == false) {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<InducedCost>());
+        const auto [induced, i, depth] = heap.back();
+        heap.pop_back();
+        if (induced + area >= best_cost) break;
+
+        /* Inserting here adds a parent node around both, which moves both one level down */
+        const Bvh::Node& candidate = nodes[i];
+        const float direct = merged_area(candidate, node);
+        const bool fits = depth + 1u + std::max(heights[i], height) < Bvh::MAX_BUILD_DEPTH;
+        if (fits && direct + induced < best_cost) best_cost = direct + induced, best = i;
+        if (candidate.is_leaf() || depth + 2u + height >= Bvh::MAX_BUILD_DEPTH) continue;
+
+        /* Inserting below this node grows it, and the new parent node costs at least the area of the inserted node */
+        const float child_induced = induced + direct - area_of(candidate);
+        if (child_induced + area >= best_cost) continue;
+        for (uint32_t c = 0u; c < 2u; ++c) {
+            heap.push_back(InducedCost(child_induced, candidate.left_first + c, depth + 1u));
+            std::push_heap(heap.begin(), heap.end(), std::greater<InducedCost>());
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Remove a node from the tree (its sibling replaces their parent), and insert it again where it costs the least.
+ * The removed node & its sibling free a pair of slots, which are re-used by the inserted node & the node it is inserted next to.
+ */
+static void reinsert(Bvh::Node* nodes, std::vector<uint32_t>& parents, std::vector<uint32_t>& heights, const uint32_t root_idx, const uint32_t i,
+                     std::vector<InducedCost>& heap) {
+    const uint32_t parent = parents[i];
+    if (parent == ~0u || parent == root_idx) return;
+    const uint32_t pair = nodes[parent].left_first;
+    const uint32_t sibling = pair == i ? pair + 1u : pair;
+
+    /* Remove the node, its sibling takes the place of their parent */
+    const Bvh::Node node = nodes[i];
+    const uint32_t height = heights[i];
+    nodes[parent] = nodes[sibling];
+    heights[parent] = heights[sibling];
+    adopt_children(nodes, parents, parent);
+    refit_ancestors(nodes, parents, heights, parents[parent]);
+
+    /* Insert the node next to the best target, the target slot becomes their parent */
+    const uint32_t target = find_insertion(nodes, parents, heights, root_idx, node, height, parent, heap);
+    nodes[pair] = nodes[target];
+    nodes[pair + 1u] = node;
+    heights[pair] = heights[target];
+    heights[pair + 1u] = height;
+    parents[pair] = parents[pair + 1u] = target;
+    adopt_children(nodes, parents, pair);
+    adopt_children(nodes, parents, pair + 1u);
+    nodes[target].left_first = pair;
+    nodes[target].prim_count = 0u;
+    refit_ancestors(nodes, parents, heights, target);
+    assert(depth_of(parents, pair) + std::max(heights[pair], height) < Bvh::MAX_DEPTH && "reinsertion made the bvh deeper than Bvh::MAX_DEPTH.");
+}
+
+/**
+ * @brief Re-order the nodes depth first, so child nodes are stored after their parent again. (refitting relies on it)
+ * @returns The number of nodes used.
+ */
+static uint32_t sort_nodes(Bvh::Node* nodes, const uint32_t root_idx, const uint32_t nodes_used) {
+    std::vector<Bvh::Node> sorted(nodes_used);
+    sorted[0] = nodes[root_idx];
+    uint32_t used = 2u;
+    std::vector<uint32_t> stack {0u};
+    while (stack.empty() == false) {
+        const uint32_t i = stack.back();
+        stack.pop_back();
+        if (sorted[i].is_leaf()) continue;
+        const uint32_t left_first = sorted[i].left_first;
+        sorted[used] = nodes[left_first];
+        sorted[used + 1u] = nodes[left_first + 1u];
+        sorted[i].left_first = used;
+        stack.push_back(used + 1u);
+        stack.push_back(used);
+        used += 2u;
+    }
+    memcpy(nodes, sorted.data(), sizeof(Bvh::Node) * used);
+    return used;
+}
+
+Bvh::OptimizeStats Bvh::optimize(const float budget_ms) {
+    using namespace std::chrono;
+    const auto start = steady_clock::now();
+    const auto elapsed_ms = [&]() { return (float)duration_cast<microseconds>(steady_clock::now() - start).count() / 1e3f; };
+
+    OptimizeStats stats {};
+    stats.sah_before = stats.sah_after = sah;
+    if (nodes == nullptr || root_idx != 0u || nodes_used < 6u) return stats;
+    own_arrays();
+    stats.sah_before = stats.sah_after = eval_tree_sah();
+
+    /* Parent of each node, (~0 for the root & unused nodes) */
+    std::vector<uint32_t> parents(nodes_used, ~0u);
+    for (uint32_t i = 0u; i < nodes_used; ++i) {
+        if (i == 1u || nodes[i].is_leaf()) continue;
+        parents[nodes[i].left_first] = parents[nodes[i].left_first + 1u] = i;
+    }
+
+    /* Height of the subtree below each node, reinsertions keep the tree within the maximum depth (children are stored after their parent) */
+    std::vector<uint32_t> heights(nodes_used, 0u);
+    for (uint32_t i = nodes_used; i-- > 0u;) {
+        if (i == 1u || nodes[i].is_leaf()) continue;
+        heights[i] = 1u + std::max(heights[nodes[i].left_first], heights[nodes[i].left_first + 1u]);
+    }
+
+    std::vector<std::pair<float, uint32_t>> candidates {};
+    std::vector<InducedCost> heap {};
+    float cost = stats.sah_before;
+    while (elapsed_ms() < budget_ms) {
+        /* Reinsert every node once per sweep, the most inefficient first, the children of the root can't be removed */
+        candidates.clear();
+        for (uint32_t i = 0u; i < nodes_used; ++i) {
+            if (parents[i] == ~0u || parents[i] == root_idx) continue;
+            candidates.emplace_back(inefficiency(nodes, nodes[i]), i);
+        }
+        std::sort(candidates.begin(), candidates.end(), std::greater<std::pair<float, uint32_t>>());
+
+        /* (earlier reinsertions move nodes, a slot is reinserted with whatever node it holds now) */
+        for (uint32_t c = 0u; c < candidates.size() && elapsed_ms() < budget_ms; ++c) {
+            reinsert(nodes, parents, heights, root_idx, candidates[c].second, heap);
+            stats.reinsertions++;
+        }
+
+        /* Stop once the tree converged */
+        const float new_cost = eval_tree_sah();
+        const bool converged = new_cost > cost * (1.0f - REINSERT_MIN_GAIN);
+        cost = new_cost;
+        if (converged) break;
+    }
+
+    /* Restore the node order, and convert the nodes for the GPU again (leaves became interior nodes & vice versa) */
+    nodes_used = sort_nodes(nodes, root_idx, nodes_used);
+    alloc_gpu_nodes();
+    if (gpu_indices) order_treelets(treelet_size);
+    convert_gpu_nodes();
+
+    build_sah = sah = stats.sah_after = eval_tree_sah();
+    stats.ms = elapsed_ms();
+    optimize_stats = stats;
+    version++;
+    return stats;
+}
+
+}  // namespace wyre::scene
@@ -0,0 +1,241 @@
+/**
+ * @file scene/bvh-spatial.cpp
+ * @brief Spatial split (SBVH) build mode of the BVH.
+ *
+ * Based on "Spatial Splits in Bounding Volume Hierarchies" by Stich et al. 2009.
+ */
+#include "bvh.h"
+
+#include <algorithm> /* std::min, std::clamp */
+
+namespace wyre::scene {
+
+/* Maximum number of spatial split bins per axis. */
+constexpr uint32_t SPATIAL_MAX_BINS = 32u;
+/* Spatial splits are only evaluated if the object split children overlap by more than this, relative to the root. */
+constexpr float SPATIAL_ALPHA = 1e-5f;
+/* Spatial splits are not evaluated past this depth. */
+constexpr uint32_t SPATIAL_MAX_DEPTH = 32u;
+
+/** @returns The bounds of a reference. */
+template <typename Refs>
+inline AABB ref_aabb(const Refs& refs, const uint32_t i) {
+    return AABB(glm::vec3(refs.bmin[0][i], refs.bmin[1][i], refs.bmin[2][i]), glm::vec3(refs.bmax[0][i], refs.bmax[1][i], refs.bmax[2][i]));
+}
+
+/** @returns The bounds of a list of references. */
+template <typename Refs>
+inline AABB refs_aabb(const Refs& refs) {
+    AABB aabb {};
+    for (uint32_t i = 0u; i < refs.size(); ++i) aabb.grow(ref_aabb(refs, i));
+    return aabb;
+}
+
+/**
+ * @brief Clip a triangle to a slab along an axis, within the bounds of its reference.
+ * @returns The bounds of the clipped triangle, or an empty AABB if nothing remains.
+ */
+static AABB clip_ref(const Triangle& tri, const AABB& ref, const int axis, const float lo, const float hi) {
+    const glm::vec3 v[3] = {tri.v0, tri.v1, tri.v2};
+    AABB aabb {};
+    for (uint32_t i = 0u; i < 3u; ++i) {
+        const glm::vec3& a = v[i];
+        const glm::vec3& b = v[(i + 1u) % 3u];
+        const float pa = a[axis], pb = b[axis];
+        if (pa >= lo && pa <= hi) aabb.grow(a);
+
+        /* Add the points where the edge crosses the slab planes */
+        for (const float plane : {lo, hi}) {
+            if ((pa < plane && pb > plane) || (pa > plane && pb < plane)) {
+                glm::vec3 p = glm::mix(a, b, (plane - pa) / (pb - pa));
+                p[axis] = plane;
+                aabb.grow(p);
+            }
+        }
+    }
+
+    /* Intersect with the reference, which can already be clipped */
+    const AABB clipped(glm::max(aabb.min, ref.min), glm::min(aabb.max, ref.max));
+    if (clipped.min.x > clipped.max.x || clipped.min.y > clipped.max.y || clipped.min.z > clipped.max.z) return AABB();
+    return clipped;
+}
+
+void Bvh::build_spatial(const BuildParams& params) {
+    BuildData& data = build_data;
+    data.spatial_budget = (uint32_t)(prim_count * params.spatial_budget);
+
+    /* Move the build data into the root references, leaf nodes append their references to it again */
+    PrimRefs refs = std::move(static_cast<PrimRefs&>(data));
+    data.PrimRefs::clear();
+
+    Node& root = nodes[root_idx];
+    data.root_area = AABB(root.min, root.max).area();
+    subdivide_spatial(root, refs, 0u);
+}
+
+float Bvh::find_spatial_split(const Node& node, const PrimRefs& refs, int& axis, float& t) const {
+    const BuildData& data = build_data;
+    const uint32_t bins = std::min(data.bins, SPATIAL_MAX_BINS);
+    float lowest_cost = 1e30f;
+
+    for (uint32_t a = 0u; a < 3u; ++a) {
+        const float nmin = node.min[a], nmax = node.max[a];
+        if (nmin >= nmax) continue;
+        const float bin_size = (nmax - nmin) / bins, inv_bin_size = bins / (nmax - nmin);
+        const auto bin_index = [&](const float x) { return (uint32_t)std::clamp((int)((x - nmin) * inv_bin_size), 0, (int)bins - 1); };
+
+        /* Count the references entering & exiting each bin, and grow the bins by the clipped references */
+        AABB bounds[SPATIAL_MAX_BINS] {};
+        uint32_t enter[SPATIAL_MAX_BINS] {}, exit[SPATIAL_MAX_BINS] {};
+        for (uint32_t r = 0u; r < refs.size(); ++r) {
+            const AABB ref = ref_aabb(refs, r);
+            const uint32_t first_bin = bin_index(ref.min[a]), last_bin = bin_index(ref.max[a]);
+            enter[first_bin]++, exit[last_bin]++;
+            if (first_bin == last_bin) {
+                bounds[first_bin].grow(ref);
+                continue;
+            }
+
+            const Triangle& tri = data.input[refs.indices[r]];
+            for (uint32_t b = first_bin; b <= last_bin; ++b) {
+                const float lo = nmin + bin_size * b, hi = b == bins - 1u ? nmax : lo + bin_size;
+                bounds[b].grow(clip_ref(tri, ref, a, lo, hi));
+            }
+        }
+
+        /* Gather data for the planes between the bins */
+        AABB l_aabbs[SPATIAL_MAX_BINS - 1u], r_aabbs[SPATIAL_MAX_BINS - 1u];
+        uint32_t l_counts[SPATIAL_MAX_BINS - 1u], r_counts[SPATIAL_MAX_BINS - 1u];
+        AABB l_aabb, r_aabb;
+        uint32_t l_sum = 0u, r_sum = 0u;
+        for (uint32_t i = 0u; i < bins - 1u; ++i) {
+            /* Left-side */
+            l_sum += enter[i];
+            l_counts[i] = l_sum;
+            l_aabb.grow(bounds[i]);
+            l_aabbs[i] = l_aabb;
+            /* Right-side */
+            r_sum += exit[bins - 1u - i];
+            r_counts[bins - 2u - i] = r_sum;
+            r_aabb.grow(bounds[bins - 1u - i]);
+            r_aabbs[bins - 2u - i] = r_aabb;
+        }
+
+        /* Calculate the SAH cost function for all planes */
+        for (uint32_t i = 0u; i < bins - 1u; ++i) {
+            if (l_counts[i] == 0u || r_counts[i] == 0u) continue;
+            const float plane_cost = l_counts[i] * l_aabbs[i].area() + r_counts[i] * r_aabbs[i].area();
+            if (plane_cost < lowest_cost) {
+                axis = a;
+                t = nmin + bin_size * (i + 1u);
+                lowest_cost = plane_cost;
+            }
+        }
+    }
+
+    return lowest_cost;
+}
+
+void Bvh::subdivide_spatial(Node& node, PrimRefs& refs, const uint32_t depth) {
+    BuildData& data = build_data;
+    const uint32_t count = refs.size();
+
+    /* Find the best object split, spatial splits are only evaluated if its children overlap (nodes at the maximum depth remain leaves) */
+    int axis = -1;
+    float t = 0.0f, split_cost = 1e30f;
+    bool spatial = false;
+    if (count > 2u && depth + 1u < MAX_BUILD_DEPTH) {
+        AABB children[2] {};
+        split_cost = find_object_split(refs, axis, t, children);
+
+        const AABB overlap(glm::max(children[0].min, children[1].min), glm::min(children[0].max, children[1].max));
+        const bool overlapping = overlap.min.x <= overlap.max.x && overlap.min.y <= overlap.max.y && overlap.min.z <= overlap.max.z;
+        if (data.spatial_budget > 0u && depth < SPATIAL_MAX_DEPTH && (axis < 0 || (overlapping && overlap.area() > SPATIAL_ALPHA * data.root_area))) {
+            int spatial_axis = -1;
+            float spatial_t = 0.0f;
+            const float spatial_cost = find_spatial_split(node, refs, spatial_axis, spatial_t);
+            if (spatial_cost < split_cost) {
+                axis = spatial_axis, t = spatial_t;
+                split_cost = spatial_cost;
+                spatial = true;
+            }
+        }
+    }
+
+    /* Partition the references, if the split is worth it */
+    const float parent_cost = count * AABB(node.min, node.max).area();
+    PrimRefs left {}, right {};
+    if (axis >= 0 && split_cost < parent_cost) {
+        /* Count the references on each side first, so the lists only allocate once */
+        uint32_t left_count = 0u, right_count = 0u;
+        for (uint32_t r = 0u; r < count; ++r) {
+            if (spatial == false) {
+                left_count += refs.centroid[axis][r] < t;
+            } else {
+                left_count += refs.bmin[axis][r] < t;
+                right_count += refs.bmax[axis][r] > t;
+            }
+        }
+        if (spatial == false) right_count = count - left_count;
+        left.reserve(left_count);
+        right.reserve(right_count);
+
+        for (uint32_t r = 0u; r < count; ++r) {
+            if (spatial == false) {
+                if (refs.centroid[axis][r] < t) left.push(refs, r);
+                else right.push(refs, r);
+                continue;
+            }
+
+            /* References which straddle the plane are split in two, if we're still within budget */
+            const AABB ref = ref_aabb(refs, r);
+            if (ref.max[axis] <= t) {
+                left.push(refs, r);
+            } else if (ref.min[axis] >= t) {
+                right.push(refs, r);
+            } else if (data.spatial_budget > 0u) {
+                const Triangle& tri = data.input[refs.indices[r]];
+                const AABB l = clip_ref(tri, ref, axis, ref.min[axis], t);
+                const AABB rr = clip_ref(tri, ref, axis, t, ref.max[axis]);
+                if (l.min.x == 1e30f) {
+                    right.push(refs, r);
+                } else if (rr.min.x == 1e30f) {
+                    left.push(refs, r);
+                } else {
+                    left.push(l, (l.min + l.max) * 0.5f, refs.indices[r]);
+                    right.push(rr, (rr.min + rr.max) * 0.5f, refs.indices[r]);
+                    data.spatial_budget--;
+                }
+            } else {
+                if (refs.centroid[axis][r] < t) left.push(refs, r);
+                else right.push(refs, r);
+            }
+        }
+    }
+
+    /* Otherwise make this node a leaf, appending its references to the build data */
+    if (left.size() == 0u || right.size() == 0u) {
+        node.left_first = data.size();
+        node.prim_count = count;
+        data.indices.insert(data.indices.end(), refs.indices.begin(), refs.indices.end());
+        return;
+    }
+    refs.clear();
+
+    /* Initialize the child nodes */
+    const uint32_t left_child_idx = nodes_used;
+    nodes_used += 2u;
+    Node& left_child = nodes[left_child_idx];
+    Node& right_child = nodes[left_child_idx + 1u];
+    const AABB left_aabb = refs_aabb(left), right_aabb = refs_aabb(right);
+    left_child.min = left_aabb.min, left_child.max = left_aabb.max;
+    right_child.min = right_aabb.min, right_child.max = right_aabb.max;
+    node.left_first = left_child_idx;
+    node.prim_count = 0u;
+
+    /* Continue subdiving recursively */
+    subdivide_spatial(left_child, left, depth + 1u);
+    subdivide_spatial(right_child, right, depth + 1u);
+}
+
+}  // namespace wyre::scene
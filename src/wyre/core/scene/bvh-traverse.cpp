@@ -0,0 +1,569 @@
+/**
+ * @file scene/bvh-traverse.cpp
+ * @brief CPU ray traversal of a BVH, with SSE & AVX2 code paths and a scalar fallback.
+ */
+#include "bvh-traverse.h"
+
+#include <algorithm> /* std::min, std::max */
+#include <bit>       /* std::bit_cast, std::popcount */
+#include <cassert>   /* assert */
+#include <cmath>     /* fabsf */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define WYRE_TRAVERSE_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WYRE_TRAVERSE_SSE 1
+#endif
+
+namespace wyre::scene {
+
+/* Traversal stack size, only the far child is pushed so a level of the tree pushes at most one node. (the builders cap the depth) */
+constexpr uint32_t STACK_SIZE = Bvh::MAX_DEPTH;
+/* Traversal stack size of wide BVHs, every level pushes all but one of its children. (collapsing never makes a tree deeper) */
+template <uint32_t N>
+constexpr uint32_t WIDE_STACK_SIZE = (N - 1u) * (Bvh::MAX_DEPTH - 1u) + 1u;
+/* Triangles closer to parallel to the ray than this are missed. */
+constexpr float PARALLEL_EPSILON = 0.0000001f;
+
+/**
+ * @brief SIMD lanes of N floats, comparisons return masks with all the bits of a lane set.
+ * The scalar fallback, specialized below for the available instruction sets.
+ */
+template <uint32_t N>
+struct Lanes {
+    float v[N];
+
+    static inline Lanes set1(const float x) {
+        Lanes r;
+        for (uint32_t i = 0u; i < N; ++i) r.v[i] = x;
+        return r;
+    }
+    static inline Lanes load(const float* p) {
+        Lanes r;
+        for (uint32_t i = 0u; i < N; ++i) r.v[i] = p[i];
+        return r;
+    }
+    inline void store(float* p) const {
+        for (uint32_t i = 0u; i < N; ++i) p[i] = v[i];
+    }
+};
+
+/** @returns A lane mask value. */
+inline float lane_mask(const bool set) { return std::bit_cast<float>(set ? ~0u : 0u); }
+
+template <uint32_t N, typename F>
+inline Lanes<N> lanes_map(const Lanes<N>& a, const Lanes<N>& b, F&& f) {
+    Lanes<N> r;
+    for (uint32_t i = 0u; i < N; ++i) r.v[i] = f(a.v[i], b.v[i]);
+    return r;
+}
+
+template <uint32_t N> inline Lanes<N> operator+(const Lanes<N>& a, const Lanes<N>& b) { return lanes_map(a, b, [](float x, float y) { return x + y; }); }
+template <uint32_t N> inline Lanes<N> operator-(const Lanes<N>& a, const Lanes<N>& b) { return lanes_map(a, b, [](float x, float y) { return x - y; }); }
+template <uint32_t N> inline Lanes<N> operator*(const Lanes<N>& a, const Lanes<N>& b) { return lanes_map(a, b, [](float x, float y) { return x * y; }); }
+template <uint32_t N> inline Lanes<N> operator/(const Lanes<N>& a, const Lanes<N>& b) { return lanes_map(a, b, [](float x, float y) { return x / y; }); }
+template <uint32_t N> inline Lanes<N> vmin(const Lanes<N>& a, const Lanes<N>& b) { return lanes_map(a, b, [](float x, float y) { return x < y ? x : y; }); }
+template <uint32_t N> inline Lanes<N> vmax(const Lanes<N>& a, const Lanes<N>& b) { return lanes_map(a, b, [](float x, float y) { return x > y ? x : y; }); }
+template <uint32_t N> inline Lanes<N> operator<(const Lanes<N>& a, const Lanes<N>& b) { return lanes_map(a, b, [](float x, float y) { return lane_mask(x < y); }); }
+template <uint32_t N> inline Lanes<N> operator<=(const Lanes<N>& a, const Lanes<N>& b) { return lanes_map(a, b, [](float x, float y) { return lane_mask(x <= y); }); }
+template <uint32_t N> inline Lanes<N> operator>(const Lanes<N>& a, const Lanes<N>& b) { return lanes_map(a, b, [](float x, float y) { return lane_mask(x > y); }); }
+template <uint32_t N> inline Lanes<N> operator>=(const Lanes<N>& a, const Lanes<N>& b) { return lanes_map(a, b, [](float x, float y) { return lane_mask(x >= y); }); }
+template <uint32_t N> inline Lanes<N> operator&(const Lanes<N>& a, const Lanes<N>& b) {
+    return lanes_map(a, b, [](float x, float y) { return std::bit_cast<float>(std::bit_cast<uint32_t>(x) & std::bit_cast<uint32_t>(y)); });
+}
+template <uint32_t N> inline Lanes<N> operator|(const Lanes<N>& a, const Lanes<N>& b) {
+    return lanes_map(a, b, [](float x, float y) { return std::bit_cast<float>(std::bit_cast<uint32_t>(x) | std::bit_cast<uint32_t>(y)); });
+}
+/** @returns `a` where the mask is set, otherwise `b`. */
+template <uint32_t N> inline Lanes<N> select(const Lanes<N>& mask, const Lanes<N>& a, const Lanes<N>& b) {
+    Lanes<N> r;
+    for (uint32_t i = 0u; i < N; ++i) r.v[i] = std::bit_cast<uint32_t>(mask.v[i]) ? a.v[i] : b.v[i];
+    return r;
+}
+template <uint32_t N> inline Lanes<N> vabs(const Lanes<N>& a) { return lanes_map(a, a, [](float x, float) { return fabsf(x); }); }
+/** @returns A bit mask of the set lanes. */
+template <uint32_t N> inline uint32_t movemask(const Lanes<N>& mask) {
+    uint32_t bits = 0u;
+    for (uint32_t i = 0u; i < N; ++i) bits |= (std::bit_cast<uint32_t>(mask.v[i]) >> 31u) << i;
+    return bits;
+}
+
+#if WYRE_TRAVERSE_SSE
+template <>
+struct Lanes<4u> {
+    __m128 v;
+
+    static inline Lanes set1(const float x) { return {_mm_set1_ps(x)}; }
+    static inline Lanes load(const float* p) { return {_mm_loadu_ps(p)}; }
+    inline void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline Lanes<4u> operator+(const Lanes<4u>& a, const Lanes<4u>& b) { return {_mm_add_ps(a.v, b.v)}; }
+inline Lanes<4u> operator-(const Lanes<4u>& a, const Lanes<4u>& b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline Lanes<4u> operator*(const Lanes<4u>& a, const Lanes<4u>& b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline Lanes<4u> operator/(const Lanes<4u>& a, const Lanes<4u>& b) { return {_mm_div_ps(a.v, b.v)}; }
+inline Lanes<4u> vmin(const Lanes<4u>& a, const Lanes<4u>& b) { return {_mm_min_ps(a.v, b.v)}; }
+inline Lanes<4u> vmax(const Lanes<4u>& a, const Lanes<4u>& b) { return {_mm_max_ps(a.v, b.v)}; }
+inline Lanes<4u> operator<(const Lanes<4u>& a, const Lanes<4u>& b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline Lanes<4u> operator<=(const Lanes<4u>& a, const Lanes<4u>& b) { return {_mm_cmple_ps(a.v, b.v)}; }
+inline Lanes<4u> operator>(const Lanes<4u>& a, const Lanes<4u>& b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+inline Lanes<4u> operator>=(const Lanes<4u>& a, const Lanes<4u>& b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+inline Lanes<4u> operator&(const Lanes<4u>& a, const Lanes<4u>& b) { return {_mm_and_ps(a.v, b.v)}; }
+inline Lanes<4u> operator|(const Lanes<4u>& a, const Lanes<4u>& b) { return {_mm_or_ps(a.v, b.v)}; }
+inline Lanes<4u> select(const Lanes<4u>& mask, const Lanes<4u>& a, const Lanes<4u>& b) {
+    return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))};
+}
+inline Lanes<4u> vabs(const Lanes<4u>& a) { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; }
+inline uint32_t movemask(const Lanes<4u>& mask) { return (uint32_t)_mm_movemask_ps(mask.v); }
+#endif
+
+#if WYRE_TRAVERSE_AVX2
+template <>
+struct Lanes<8u> {
+    __m256 v;
+
+    static inline Lanes set1(const float x) { return {_mm256_set1_ps(x)}; }
+    static inline Lanes load(const float* p) { return {_mm256_loadu_ps(p)}; }
+    inline void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline Lanes<8u> operator+(const Lanes<8u>& a, const Lanes<8u>& b) { return {_mm256_add_ps(a.v, b.v)}; }
+inline Lanes<8u> operator-(const Lanes<8u>& a, const Lanes<8u>& b) { return {_mm256_sub_ps(a.v, b.v)}; }
+inline Lanes<8u> operator*(const Lanes<8u>& a, const Lanes<8u>& b) { return {_mm256_mul_ps(a.v, b.v)}; }
+inline Lanes<8u> operator/(const Lanes<8u>& a, const Lanes<8u>& b) { return {_mm256_div_ps(a.v, b.v)}; }
+inline Lanes<8u> vmin(const Lanes<8u>& a, const Lanes<8u>& b) { return {_mm256_min_ps(a.v, b.v)}; }
+inline Lanes<8u> vmax(const Lanes<8u>& a, const Lanes<8u>& b) { return {_mm256_max_ps(a.v, b.v)}; }
+inline Lanes<8u> operator<(const Lanes<8u>& a, const Lanes<8u>& b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+inline Lanes<8u> operator<=(const Lanes<8u>& a, const Lanes<8u>& b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)}; }
+inline Lanes<8u> operator>(const Lanes<8u>& a, const Lanes<8u>& b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)}; }
+inline Lanes<8u> operator>=(const Lanes<8u>& a, const Lanes<8u>& b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+inline Lanes<8u> operator&(const Lanes<8u>& a, const Lanes<8u>& b) { return {_mm256_and_ps(a.v, b.v)}; }
+inline Lanes<8u> operator|(const Lanes<8u>& a, const Lanes<8u>& b) { return {_mm256_or_ps(a.v, b.v)}; }
+inline Lanes<8u> select(const Lanes<8u>& mask, const Lanes<8u>& a, const Lanes<8u>& b) { return {_mm256_blendv_ps(b.v, a.v, mask.v)}; }
+inline Lanes<8u> vabs(const Lanes<8u>& a) { return {_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)}; }
+inline uint32_t movemask(const Lanes<8u>& mask) { return (uint32_t)_mm256_movemask_ps(mask.v); }
+#endif
+
+/** @returns True if a ray hits a triangle within [tmin, tmax], and updates the hit & tmax. (Moller-Trumbore) */
+inline bool hit_triangle(const Triangle& tri, const glm::vec3& ro, const glm::vec3& rd, const float tmin, float& tmax, const uint32_t prim, Hit& hit) {
+    const glm::vec3 edge1 = tri.v1 - tri.v0, edge2 = tri.v2 - tri.v0, s = ro - tri.v0;
+    const glm::vec3 h = glm::cross(rd, edge2);
+    const float a = glm::dot(edge1, h);
+    if (fabsf(a) < PARALLEL_EPSILON) return false;
+    const float f = 1.0f / a, u = f * glm::dot(s, h);
+    if (u < 0.0f || u > 1.0f) return false;
+    const glm::vec3 q = glm::cross(s, edge1);
+    const float v = f * glm::dot(rd, q);
+    if (v < 0.0f || u + v > 1.0f) return false;
+    const float t = f * glm::dot(edge2, q);
+    if (t < tmin || t > tmax) return false;
+    tmax = t, hit = Hit {t, u, v, prim};
+    return true;
+}
+
+/** @returns True if a ray hits a pre-transformed triangle within [tmin, tmax], and updates the hit & tmax. (the same test as `ray_tri_xform` in the shaders) */
+inline bool hit_triangle(const TriangleTransform& tri, const glm::vec3& ro, const glm::vec3& rd, const float tmin, float& tmax, const uint32_t prim,
+                         Hit& hit) {
+    const float t = -(glm::dot(glm::vec3(tri.w), ro) + tri.w.w) / glm::dot(glm::vec3(tri.w), rd);
+    if (!(t >= tmin && t <= tmax)) return false;
+    const glm::vec3 p = ro + rd * t;
+    const float u = glm::dot(glm::vec3(tri.u), p) + tri.u.w;
+    if (u < 0.0f || u > 1.0f) return false;
+    const float v = glm::dot(glm::vec3(tri.v), p) + tri.v.w;
+    if (v < 0.0f || u + v > 1.0f) return false;
+    tmax = t, hit = Hit {t, u, v, prim};
+    return true;
+}
+
+/** @returns True if a BVH can be traversed, it needs nodes & triangles. (box BVHs have no primitives) */
+inline bool traversable(const Bvh& bvh) { return bvh.nodes != nullptr && bvh.prims != nullptr && bvh.prim_count > 0u; }
+
+/** @brief Push a node onto a traversal stack, which can't overflow as no tree is deeper than `Bvh::MAX_DEPTH`. */
+inline void push(uint32_t* stack, uint32_t& stack_ptr, const uint32_t node) {
+    assert(stack_ptr < STACK_SIZE && "bvh is deeper than Bvh::MAX_DEPTH.");
+    stack[stack_ptr++] = node;
+}
+
+/** @brief Ray data shared by every node & triangle test of a single ray traversal. */
+struct SingleRay {
+    glm::vec3 ro, rd, ird;
+    float tmin, tmax;
+#if WYRE_TRAVERSE_SSE
+    __m128 ro4, ird4;
+#endif
+
+    explicit SingleRay(const Ray& ray) : ro(ray.origin), rd(ray.dir), ird(1.0f / ray.dir), tmin(ray.tmin), tmax(ray.tmax) {
+#if WYRE_TRAVERSE_SSE
+        ro4 = _mm_setr_ps(ro.x, ro.y, ro.z, 0.0f), ird4 = _mm_setr_ps(ird.x, ird.y, ird.z, 0.0f);
+#endif
+    }
+
+    /** @returns The distance along the ray to a node, 1e30 on a miss. */
+    inline float slab(const Bvh::Node& node) const {
+#if WYRE_TRAVERSE_SSE
+        /* The 4th lane of the node bounds holds the child & primitive count bits, it's replaced by the ray interval */
+        const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+        const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.min.x), ro4), ird4);
+        const __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.max.x), ro4), ird4);
+        __m128 tnear = _mm_or_ps(_mm_and_ps(xyz, _mm_min_ps(t1, t2)), _mm_andnot_ps(xyz, _mm_set1_ps(tmin)));
+        __m128 tfar = _mm_or_ps(_mm_and_ps(xyz, _mm_max_ps(t1, t2)), _mm_andnot_ps(xyz, _mm_set1_ps(tmax)));
+        tnear = _mm_max_ps(tnear, _mm_shuffle_ps(tnear, tnear, _MM_SHUFFLE(2, 3, 0, 1)));
+        tnear = _mm_max_ps(tnear, _mm_shuffle_ps(tnear, tnear, _MM_SHUFFLE(1, 0, 3, 2)));
+        tfar = _mm_min_ps(tfar, _mm_shuffle_ps(tfar, tfar, _MM_SHUFFLE(2, 3, 0, 1)));
+        tfar = _mm_min_ps(tfar, _mm_shuffle_ps(tfar, tfar, _MM_SHUFFLE(1, 0, 3, 2)));
+        const float tn = _mm_cvtss_f32(tnear), tf = _mm_cvtss_f32(tfar);
+#else
+        const glm::vec3 t1 = (node.min - ro) * ird, t2 = (node.max - ro) * ird;
+        const glm::vec3 tnear = glm::min(t1, t2), tfar = glm::max(t1, t2);
+        const float tn = std::max(std::max(tnear.x, tnear.y), std::max(tnear.z, tmin));
+        const float tf = std::min(std::min(tfar.x, tfar.y), std::min(tfar.z, tmax));
+#endif
+        return tn <= tf ? tn : 1e30f;
+    }
+
+    /** @returns True if the ray hits a triangle closer than the current hit, and updates the hit. */
+    inline bool triangle(const Triangle& tri, const uint32_t prim, Hit& hit) { return hit_triangle(tri, ro, rd, tmin, tmax, prim, hit); }
+};
+
+/** @brief Traverse the BVH with a single ray, returns the closest (or any) hit. (counting the work with `COUNT`) */
+template <bool ANY_HIT, bool COUNT = false>
+Hit trace_single(const Bvh& bvh, const Ray& ray, RayCounters* counters = nullptr) {
+    Hit hit {};
+    if (traversable(bvh) == false) return hit;
+
+    SingleRay r(ray);
+    if (r.slab(bvh.nodes[bvh.root_idx]) == 1e30f) return hit;
+
+    uint32_t node_idx = bvh.root_idx, stack[STACK_SIZE], stack_ptr = 0u;
+    for (;;) {
+        const Bvh::Node& node = bvh.nodes[node_idx];
+        if constexpr (COUNT) counters->nodes++;
+        if (node.is_leaf()) {
+            for (uint32_t i = node.left_first; i < node.left_first + node.prim_count; ++i) {
+                if constexpr (COUNT) counters->tris++;
+                if (r.triangle(bvh.prims[i], i, hit) && ANY_HIT) return hit;
+            }
+        } else {
+            /* Visit the nearest child first, and the other child later */
+            const uint32_t left = node.left_first, right = node.left_first + 1u;
+            const float dist_l = r.slab(bvh.nodes[left]), dist_r = r.slab(bvh.nodes[right]);
+            const bool near_left = dist_l <= dist_r;
+            const float dist_near = near_left ? dist_l : dist_r, dist_far = near_left ? dist_r : dist_l;
+            if (dist_near != 1e30f) {
+                if (dist_far != 1e30f) push(stack, stack_ptr, near_left ? right : left);
+                node_idx = near_left ? left : right;
+                continue;
+            }
+        }
+        if (stack_ptr == 0u) break;
+        node_idx = stack[--stack_ptr];
+    }
+    return hit;
+}
+
+/** @brief Traverse the BVH with a packet of rays, returns a bit mask of the rays which hit. */
+template <uint32_t N, bool ANY_HIT>
+uint32_t trace_packet(const Bvh& bvh, const RayPacket<N>& packet, HitPacket<N>& hits) {
+    using L = Lanes<N>;
+    const uint32_t all = (1u << N) - 1u;
+
+    for (uint32_t i = 0u; i < N; ++i) hits.t[i] = 1e30f, hits.u[i] = 0.0f, hits.v[i] = 0.0f, hits.prim[i] = NO_HIT;
+    if (traversable(bvh) == false || (packet.mask & all) == 0u) return 0u;
+
+    alignas(32) float enabled[N];
+    for (uint32_t i = 0u; i < N; ++i) enabled[i] = lane_mask((packet.mask >> i) & 1u);
+
+    const L ox = L::load(packet.ox), oy = L::load(packet.oy), oz = L::load(packet.oz);
+    const L dx = L::load(packet.dx), dy = L::load(packet.dy), dz = L::load(packet.dz);
+    const L one = L::set1(1.0f), zero = L::set1(0.0f);
+    const L idx = one / dx, idy = one / dy, idz = one / dz;
+    const L tmin = L::load(packet.tmin);
+    L tmax = L::load(packet.tmax), active = L::load(enabled);
+    L t = L::set1(1e30f), u = zero, v = zero, prim = L::set1(std::bit_cast<float>(NO_HIT));
+    uint32_t hit_mask = 0u;
+
+    /* Ray packet to AABB slab test, returns the mask of the active rays which hit */
+    const auto slab = [&](const Bvh::Node& node, L& tnear) {
+        const L tx1 = (L::set1(node.min.x) - ox) * idx, tx2 = (L::set1(node.max.x) - ox) * idx;
+        const L ty1 = (L::set1(node.min.y) - oy) * idy, ty2 = (L::set1(node.max.y) - oy) * idy;
+        const L tz1 = (L::set1(node.min.z) - oz) * idz, tz2 = (L::set1(node.max.z) - oz) * idz;
+        tnear = vmax(vmax(vmin(tx1, tx2), vmin(ty1, ty2)), vmax(vmin(tz1, tz2), tmin));
+        const L tfar = vmin(vmin(vmax(tx1, tx2), vmax(ty1, ty2)), vmin(vmax(tz1, tz2), tmax));
+        return movemask((tnear <= tfar) & active);
+    };
+
+    /* Ray packet to triangle test, returns the mask of the active rays which hit closer than their current hit */
+    const auto triangle = [&](const Triangle& tri, const uint32_t index) {
+        const L v0x = L::set1(tri.v0.x), v0y = L::set1(tri.v0.y), v0z = L::set1(tri.v0.z);
+        const L e1x = L::set1(tri.v1.x - tri.v0.x), e1y = L::set1(tri.v1.y - tri.v0.y), e1z = L::set1(tri.v1.z - tri.v0.z);
+        const L e2x = L::set1(tri.v2.x - tri.v0.x), e2y = L::set1(tri.v2.y - tri.v0.y), e2z = L::set1(tri.v2.z - tri.v0.z);
+        const L hx = dy * e2z - dz * e2y, hy = dz * e2x - dx * e2z, hz = dx * e2y - dy * e2x;
+        const L a = e1x * hx + e1y * hy + e1z * hz;
+        const L f = one / a;
+        const L sx = ox - v0x, sy = oy - v0y, sz = oz - v0z;
+        const L hu = f * (sx * hx + sy * hy + sz * hz);
+        const L qx = sy * e1z - sz * e1y, qy = sz * e1x - sx * e1z, qz = sx * e1y - sy * e1x;
+        const L hv = f * (dx * qx + dy * qy + dz * qz);
+        const L ht = f * (e2x * qx + e2y * qy + e2z * qz);
+        const L hit = active & (vabs(a) >= L::set1(PARALLEL_EPSILON)) & (hu >= zero) & (hv >= zero) & (hu + hv <= one) & (ht >= tmin) &
+                      (ht <= tmax);
+        const uint32_t mask = movemask(hit);
+        if (mask == 0u) return 0u;
+        t = select(hit, ht, t), u = select(hit, hu, u), v = select(hit, hv, v);
+        prim = select(hit, L::set1(std::bit_cast<float>(index)), prim);
+        tmax = select(hit, ht, tmax);
+        return mask;
+    };
+
+    L tnear = zero;
+    if (slab(bvh.nodes[bvh.root_idx], tnear) != 0u) {
+        uint32_t node_idx = bvh.root_idx, stack[STACK_SIZE], stack_ptr = 0u;
+        for (;;) {
+            const Bvh::Node& node = bvh.nodes[node_idx];
+            if (node.is_leaf()) {
+                for (uint32_t i = node.left_first; i < node.left_first + node.prim_count; ++i) {
+                    const uint32_t mask = triangle(bvh.prims[i], i);
+                    hit_mask |= mask;
+                    if constexpr (ANY_HIT) {
+                        /* Rays stop at their first hit, the packet stops once all of them hit */
+                        if (mask == 0u) continue;
+                        alignas(32) float done[N];
+                        for (uint32_t l = 0u; l < N; ++l) done[l] = lane_mask(((hit_mask >> l) & 1u) == 0u);
+                        active = active & L::load(done);
+                        if (movemask(active) == 0u) break;
+                    }
+                }
+                if (ANY_HIT && movemask(active) == 0u) break;
+            } else {
+                const uint32_t left = node.left_first, right = node.left_first + 1u;
+                L near_l = zero, near_r = zero;
+                const uint32_t mask_l = slab(bvh.nodes[left], near_l), mask_r = slab(bvh.nodes[right], near_r);
+                if (mask_l != 0u && mask_r != 0u) {
+                    /* Visit the child which is nearest for most of the rays hitting both first */
+                    const uint32_t both = mask_l & mask_r;
+                    const bool near_left = std::popcount(movemask(near_l <= near_r) & both) * 2 >= std::popcount(both);
+                    push(stack, stack_ptr, near_left ? right : left);
+                    node_idx = near_left ? left : right;
+                    continue;
+                }
+                if (mask_l != 0u || mask_r != 0u) {
+                    node_idx = mask_l != 0u ? left : right;
+                    continue;
+                }
+            }
+            if (stack_ptr == 0u) break;
+            node_idx = stack[--stack_ptr];
+        }
+    }
+
+    alignas(32) float prims[N];
+    t.store(hits.t), u.store(hits.u), v.store(hits.v), prim.store(prims);
+    for (uint32_t i = 0u; i < N; ++i) hits.prim[i] = std::bit_cast<uint32_t>(prims[i]);
+    return hit_mask;
+}
+
+Hit intersect(const Bvh& bvh, const Ray& ray) { return trace_single<false>(bvh, ray); }
+
+bool occluded(const Bvh& bvh, const Ray& ray) { return trace_single<true>(bvh, ray).is_hit(); }
+
+Hit intersect(const Bvh& bvh, const Ray& ray, RayCounters& counters) { return trace_single<false, true>(bvh, ray, &counters); }
+
+template <uint32_t N>
+void intersect(const Bvh& bvh, const RayPacket<N>& packet, HitPacket<N>& hits) {
+    trace_packet<N, false>(bvh, packet, hits);
+}
+
+template <uint32_t N>
+uint32_t occluded(const Bvh& bvh, const RayPacket<N>& packet) {
+    HitPacket<N> hits;
+    return trace_packet<N, true>(bvh, packet, hits);
+}
+
+template void intersect<4u>(const Bvh& bvh, const RayPacket<4u>& packet, HitPacket<4u>& hits);
+template void intersect<8u>(const Bvh& bvh, const RayPacket<8u>& packet, HitPacket<8u>& hits);
+template uint32_t occluded<4u>(const Bvh& bvh, const RayPacket<4u>& packet);
+template uint32_t occluded<8u>(const Bvh& bvh, const RayPacket<8u>& packet);
+
+/** @returns The distance along a ray to an AABB within [tmin, tmax], 1e30 on a miss. */
+inline float slab(const glm::vec3& bmin, const glm::vec3& bmax, const SingleRay& r) {
+    const glm::vec3 t1 = (bmin - r.ro) * r.ird, t2 = (bmax - r.ro) * r.ird;
+    const glm::vec3 tnear = glm::min(t1, t2), tfar = glm::max(t1, t2);
+    const float tn = std::max(std::max(tnear.x, tnear.y), std::max(tnear.z, r.tmin));
+    const float tf = std::min(std::min(tfar.x, tfar.y), std::min(tfar.z, r.tmax));
+    return tn <= tf ? tn : 1e30f;
+}
+
+Hit intersect(const Triangle& tri, const Ray& ray) {
+    Hit hit {};
+    float tmax = ray.tmax;
+    hit_triangle(tri, ray.origin, ray.dir, ray.tmin, tmax, 0u, hit);
+    return hit;
+}
+
+Hit intersect(const TriangleTransform& tri, const Ray& ray) {
+    Hit hit {};
+    float tmax = ray.tmax;
+    hit_triangle(tri, ray.origin, ray.dir, ray.tmin, tmax, 0u, hit);
+    return hit;
+}
+
+Hit intersect_gpu(const Bvh& bvh, const Ray& ray, RayCounters& counters) {
+    Hit hit {};
+    if (bvh.gpu_nodes == nullptr || bvh.prims == nullptr || bvh.prim_count == 0u) return hit;
+    const bool xforms = bvh.tri_layout == TriLayout::TRANSFORMS && bvh.gpu_tris != nullptr;
+
+    SingleRay r(ray);
+    uint32_t node_idx = 0u, stack[STACK_SIZE], stack_ptr = 0u;
+    for (;;) {
+        const Bvh::GPUNode& node = bvh.gpu_nodes[node_idx];
+        counters.nodes++;
+        if (node.prim_count > 0u) {
+            for (uint32_t i = node.prim_index; i < node.prim_index + node.prim_count; ++i) {
+                counters.tris++;
+                if (xforms) hit_triangle(bvh.gpu_tris[i], r.ro, r.rd, r.tmin, r.tmax, i, hit);
+                else hit_triangle(bvh.prims[i], r.ro, r.rd, r.tmin, r.tmax, i, hit);
+            }
+        } else {
+            /* Both child bounds are stored in the parent, visit the nearest child first */
+            float dist_l = slab(node.lmin, node.lmax, r), dist_r = slab(node.rmin, node.rmax, r);
+            uint32_t near = node.left, far = node.right;
+            if (dist_l > dist_r) std::swap(dist_l, dist_r), std::swap(near, far);
+            if (dist_l != 1e30f) {
+                if (dist_r != 1e30f) push(stack, stack_ptr, far);
+                node_idx = near;
+                continue;
+            }
+        }
+        if (stack_ptr == 0u) break;
+        node_idx = stack[--stack_ptr];
+    }
+    return hit;
+}
+
+template <uint32_t N>
+Hit intersect_gpu(const WideBvh<N>& wide, const Bvh& bvh, const Ray& ray, RayCounters& counters) {
+    Hit hit {};
+    if (wide.nodes == nullptr || bvh.prims == nullptr || bvh.prim_count == 0u) return hit;
+
+    SingleRay r(ray);
+    uint32_t stack[WIDE_STACK_SIZE<N>], stack_ptr = 1u;
+    float stack_t[WIDE_STACK_SIZE<N>];
+    stack[0] = 0u, stack_t[0] = r.tmin;
+    while (stack_ptr > 0u) {
+        --stack_ptr;
+        if (stack_t[stack_ptr] > r.tmax) continue;
+        const typename WideBvh<N>::Node& node = wide.nodes[stack[stack_ptr]];
+        counters.nodes++;
+
+        uint32_t prim_index = node.prim_base, rank = 0u, hit_count = 0u, hit_nodes[N];
+        float hit_dists[N];
+        for (uint32_t slot = 0u; slot < N; ++slot) {
+            if (node.is_empty(slot)) continue;
+            const AABB aabb = node.child_aabb(slot);
+            const float dist = slab(aabb.min, aabb.max, r);
+
+            if (node.is_interior(slot)) {
+                /* Keep the intersected interior children sorted far to near */
+                if (dist != 1e30f) {
+                    uint32_t j = hit_count++;
+                    for (; j > 0u && hit_dists[j - 1u] < dist; --j) hit_dists[j] = hit_dists[j - 1u], hit_nodes[j] = hit_nodes[j - 1u];
+                    hit_dists[j] = dist, hit_nodes[j] = node.child_base + rank;
+                }
+                rank++;
+                continue;
+            }
+
+            if (dist != 1e30f) {
+                for (uint32_t i = prim_index; i < prim_index + node.meta[slot]; ++i) {
+                    counters.tris++;
+                    hit_triangle(bvh.prims[i], r.ro, r.rd, r.tmin, r.tmax, i, hit);
+                }
+            }
+            prim_index += node.meta[slot];
+        }
+        assert(stack_ptr + hit_count <= WIDE_STACK_SIZE<N> && "wide bvh is deeper than Bvh::MAX_DEPTH.");
+        for (uint32_t i = 0u; i < hit_count; ++i) stack[stack_ptr] = hit_nodes[i], stack_t[stack_ptr++] = hit_dists[i];
+    }
+    return hit;
+}
+
+template Hit intersect_gpu<4u>(const WideBvh<4u>& wide, const Bvh& bvh, const Ray& ray, RayCounters& counters);
+template Hit intersect_gpu<8u>(const WideBvh<8u>& wide, const Bvh& bvh, const Ray& ray, RayCounters& counters);
+
+Hit intersect(const Bvh& tlas, const TraceInstance* instances, const Ray& ray, uint32_t& instance) {
+    Hit hit {};
+    instance = NO_HIT;
+    if (tlas.nodes == nullptr || tlas.prim_count == 0u) return hit;
+
+    SingleRay r(ray);
+    if (r.slab(tlas.nodes[tlas.root_idx]) == 1e30f) return hit;
+
+    uint32_t node_idx = tlas.root_idx, stack[STACK_SIZE], stack_ptr = 0u;
+    for (;;) {
+        const Bvh::Node& node = tlas.nodes[node_idx];
+        if (node.is_leaf()) {
+            /* Trace the instances in object space, the hit distance is the same in both spaces */
+            for (uint32_t i = node.left_first; i < node.left_first + node.prim_count; ++i) {
+                const TraceInstance& inst = instances[i];
+                const glm::vec4 o(r.ro, 1.0f), d(r.rd, 0.0f);
+                const glm::vec3 inst_ro(glm::dot(inst.inv_model[0], o), glm::dot(inst.inv_model[1], o), glm::dot(inst.inv_model[2], o));
+                const glm::vec3 inst_rd(glm::dot(inst.inv_model[0], d), glm::dot(inst.inv_model[1], d), glm::dot(inst.inv_model[2], d));
+                const Hit inst_hit = trace_single<false>(*inst.blas, Ray(inst_ro, inst_rd, r.tmin, r.tmax));
+                if (inst_hit.is_hit() && inst_hit.t < r.tmax) hit = inst_hit, r.tmax = inst_hit.t, instance = i;
+            }
+        } else {
+            /* Visit the nearest child first, and the other child later */
+            const uint32_t left = node.left_first, right = node.left_first + 1u;
+            const float dist_l = r.slab(tlas.nodes[left]), dist_r = r.slab(tlas.nodes[right]);
+            const bool near_left = dist_l <= dist_r;
+            const float dist_near = near_left ? dist_l : dist_r, dist_far = near_left ? dist_r : dist_l;
+            if (dist_near != 1e30f) {
+                if (dist_far != 1e30f) push(stack, stack_ptr, near_left ? right : left);
+                node_idx = near_left ? left : right;
+                continue;
+            }
+        }
+        if (stack_ptr == 0u) break;
+        node_idx = stack[--stack_ptr];
+    }
+    return hit;
+}
+
+/** @brief Trace a range of a ray stream on the calling thread. */
+void trace_range(const Bvh& bvh, const Ray* rays, Hit* hits, const uint32_t begin, const uint32_t end, const TraceParams& params) {
+    if (params.packets == false) {
+        for (uint32_t i = begin; i < end; ++i) hits[i] = params.any_hit ? trace_single<true>(bvh, rays[i]) : trace_single<false>(bvh, rays[i]);
+        return;
+    }
+
+    /* Consecutive rays are grouped into packets, the last packet might not be full */
+    RayPacket<8u> packet;
+    HitPacket<8u> packet_hits;
+    for (uint32_t first = begin; first < end; first += 8u) {
+        const uint32_t count = std::min(8u, end - first);
+        packet.mask = 0u;
+        for (uint32_t l = 0u; l < 8u; ++l) packet.set(l, rays[first + std::min(l, count - 1u)]);
+        packet.mask = (1u << count) - 1u;
+        if (params.any_hit) trace_packet<8u, true>(bvh, packet, packet_hits);
+        else trace_packet<8u, false>(bvh, packet, packet_hits);
+        for (uint32_t l = 0u; l < count; ++l) hits[first + l] = packet_hits.get(l);
+    }
+}
+
+void trace(const Bvh& bvh, const Ray* rays, Hit* hits, const uint32_t count, const TraceParams& params, ThreadPool* pool) {
+    if (pool == nullptr) {
+        trace_range(bvh, rays, hits, 0u, count, params);
+        return;
+    }
+
+    /* Keep the batches a multiple of the packet size, so rays are never split across packets */
+    const uint32_t packets = (count + 7u) / 8u;
+    pool->parallel_for(packets, std::max(1u, params.grain / 8u), [&](const uint32_t begin, const uint32_t end) {
+        trace_range(bvh, rays, hits, begin * 8u, std::min(end * 8u, count), params);
+    });
+}
+
+}  // namespace wyre::scene
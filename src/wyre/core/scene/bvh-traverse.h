@@ -0,0 +1,148 @@
+/**
+ * @file scene/bvh-traverse.h
+ * @brief CPU ray traversal of a BVH, for single rays, ray packets & ray streams.
+ */
+#pragma once
+
+#include <cstdint> /* uint32_t */
+
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "bvh-wide.h"
+
+namespace wyre::scene {
+
+/** @brief Ray traced on the CPU, hits outside of the [tmin, tmax] interval are ignored. */
+struct Ray {
+    glm::vec3 origin {}; float tmin = 0.0f;
+    glm::vec3 dir {}; float tmax = 1e30f;
+
+    Ray() = default;
+    Ray(const glm::vec3& origin, const glm::vec3& dir, const float tmin = 0.0f, const float tmax = 1e30f)
+        : origin(origin), tmin(tmin), dir(dir), tmax(tmax) {}
+};
+
+/* Primitive index of a ray which didn't hit anything. */
+constexpr uint32_t NO_HIT = ~0u;
+
+/** @brief Ray hit, the primitive indexes into the BVH primitives. (`Bvh::prim_indices` maps it back to the build input) */
+struct Hit {
+    float t = 1e30f;
+    /* Barycentric coordinates of the hit, relative to the second & third vertex. */
+    float u = 0.0f, v = 0.0f;
+    uint32_t prim = NO_HIT;
+
+    /** @returns True if the ray hit a primitive. */
+    inline bool is_hit() const { return prim != NO_HIT; }
+};
+
+/**
+ * @brief Packet of rays in SoA layout, traced through the BVH together.
+ * Every node is tested against all rays at once, so packets only pay off for coherent rays. (e.g. primary rays)
+ */
+template <uint32_t N>
+struct RayPacket {
+    static_assert(N == 4u || N == 8u, "ray packets are either 4 or 8 wide.");
+
+    alignas(32) float ox[N], oy[N], oz[N];
+    alignas(32) float dx[N], dy[N], dz[N];
+    alignas(32) float tmin[N], tmax[N];
+    /* Bit mask of the rays in the packet which are traced. */
+    uint32_t mask = 0u;
+
+    /** @brief Set one ray of the packet, and enable it. */
+    inline void set(const uint32_t lane, const Ray& ray) {
+        ox[lane] = ray.origin.x, oy[lane] = ray.origin.y, oz[lane] = ray.origin.z;
+        dx[lane] = ray.dir.x, dy[lane] = ray.dir.y, dz[lane] = ray.dir.z;
+        tmin[lane] = ray.tmin, tmax[lane] = ray.tmax;
+        mask |= 1u << lane;
+    }
+};
+
+/** @brief Hits of a ray packet, in SoA layout. */
+template <uint32_t N>
+struct HitPacket {
+    alignas(32) float t[N], u[N], v[N];
+    alignas(32) uint32_t prim[N];
+
+    /** @returns The hit of one ray of the packet. */
+    inline Hit get(const uint32_t lane) const { return Hit {t[lane], u[lane], v[lane], prim[lane]}; }
+};
+
+/** @brief Traversal work done by rays, for measuring the traversal cost of a BVH. */
+struct RayCounters {
+    /* Number of nodes visited, and triangles intersected. */
+    uint64_t nodes = 0u, tris = 0u;
+};
+
+/** @brief Instance of a BLAS in a TLAS, traced in the object space of the instance. */
+struct TraceInstance {
+    /* World to object space transform. (rows of a 3x4 matrix, the same as the GPU instances) */
+    glm::vec4 inv_model[3] {};
+    const Bvh* blas = nullptr;
+};
+
+/** @brief Ray stream tracing parameters. */
+struct TraceParams {
+    /* Stop at the first hit found instead of the closest hit, for shadow & visibility rays. */
+    bool any_hit = false;
+    /* Trace the rays in 8 wide packets, consecutive rays should be coherent. */
+    bool packets = false;
+    /* Minimum number of rays per thread pool task. */
+    uint32_t grain = 1024u;
+};
+
+/** @returns The closest hit of a ray. */
+Hit intersect(const Bvh& bvh, const Ray& ray);
+
+/** @returns The closest hit of a ray, and adds the traversal work to the counters. (slightly slower) */
+Hit intersect(const Bvh& bvh, const Ray& ray, RayCounters& counters);
+
+/** @returns True if a ray hits any primitive. */
+bool occluded(const Bvh& bvh, const Ray& ray);
+
+/** @brief Find the closest hit of every ray in a packet. (disabled rays miss) */
+template <uint32_t N>
+void intersect(const Bvh& bvh, const RayPacket<N>& packet, HitPacket<N>& hits);
+
+/** @returns A bit mask of the rays in a packet which hit any primitive. */
+template <uint32_t N>
+uint32_t occluded(const Bvh& bvh, const RayPacket<N>& packet);
+
+/** @returns The hit of a ray with a single triangle, the primitive is 0 on a hit. (the triangle test of the traversal) */
+Hit intersect(const Triangle& tri, const Ray& ray);
+
+/** @returns The hit of a ray with a pre-transformed triangle, the primitive is 0 on a hit. */
+Hit intersect(const TriangleTransform& tri, const Ray& ray);
+
+/**
+ * @brief Traverse the GPU nodes of a BVH on the CPU, the same traversal as the ray tracing kernels.
+ * Intersects the pre-transformed triangles with the transforms layout, for measuring the GPU layouts.
+ * @returns The closest hit of a ray, and adds the traversal work to the counters.
+ */
+Hit intersect_gpu(const Bvh& bvh, const Ray& ray, RayCounters& counters);
+
+/**
+ * @brief Traverse a wide BVH on the CPU, over the primitives of the binary BVH it was collapsed from.
+ * @returns The closest hit of a ray, and adds the traversal work to the counters.
+ */
+template <uint32_t N>
+Hit intersect_gpu(const WideBvh<N>& wide, const Bvh& bvh, const Ray& ray, RayCounters& counters);
+
+/**
+ * @brief Trace a ray through a TLAS over BLAS instances, the CPU counterpart of `trace_bvh` in the ray tracing kernels.
+ * The ray is transformed into the object space of every instance it reaches, with the world to object transform of the instance.
+ * @param instances Instance of every TLAS primitive, in the primitive order of the TLAS.
+ * @param instance Set to the TLAS primitive of the hit instance, the hit primitive indexes into its BLAS. (`NO_HIT` on a miss)
+ * @returns The closest hit of the ray.
+ */
+Hit intersect(const Bvh& tlas, const TraceInstance* instances, const Ray& ray, uint32_t& instance);
+
+/**
+ * @brief Trace a stream of rays, split into batches over a thread pool. (on the calling thread without a pool)
+ * With `any_hit`, the hits are of any primitive along the ray, and not necessarily the closest one.
+ */
+void trace(const Bvh& bvh, const Ray* rays, Hit* hits, const uint32_t count, const TraceParams& params = {}, ThreadPool* pool = nullptr);
+
+}  // namespace wyre::scene
@@ -0,0 +1,165 @@
+#include "bvh-wide.h"
+
+#include <algorithm> /* std::clamp */
+#include <cmath>     /* std::frexp, std::ldexp */
+#include <vector>    /* std::vector */
+
+namespace wyre::scene {
+
+/** @returns Half the surface area of a BVH node. */
+inline float node_half_area(const Bvh::Node& node) {
+    const glm::vec3 e = node.max - node.min;
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+template <uint32_t N>
+AABB WideBvh<N>::Node::child_aabb(const uint32_t slot) const {
+    AABB aabb {};
+    for (uint32_t a = 0u; a < 3u; ++a) {
+        const float scale = std::ldexp(1.0f, (int)exponent[a] - 127);
+        aabb.min[a] = origin[a] + qlo[a][slot] * scale;
+        aabb.max[a] = origin[a] + qhi[a][slot] * scale;
+    }
+    return aabb;
+}
+
+/**
+ * @brief Split the leaves of a binary BVH which hold more primitives than fit in a wide leaf.
+ * Every leaf adds at most two nodes, so the nodes always fit in the space allocated by the build.
+ * Halving adds a level per split, the builders leave room for it below `Bvh::MAX_BUILD_DEPTH` so the tree stays within `Bvh::MAX_DEPTH`.
+ */
+static void split_large_leaves(Bvh& bvh, const uint32_t max_leaf_size) {
+    for (uint32_t i = 0u; i < bvh.nodes_used; ++i) {
+        Bvh::Node& node = bvh.nodes[i];
+        if (i == 1u || node.prim_count <= max_leaf_size) continue;
+
+        /* Split the primitive range in half, the primitives of large leaves usually can't be split spatially */
+        const uint32_t first = node.left_first, count = node.prim_count;
+        const uint32_t left_child_idx = bvh.nodes_used;
+        bvh.nodes_used += 2u;
+        for (uint32_t c = 0u; c < 2u; ++c) {
+            Bvh::Node& child = bvh.nodes[left_child_idx + c];
+            child.left_first = c == 0u ? first : first + count / 2u;
+            child.prim_count = c == 0u ? count / 2u : count - count / 2u;
+            AABB aabb {};
+            for (uint32_t p = child.left_first; p < child.left_first + child.prim_count; ++p) aabb.grow(bvh.prims[p].get_aabb());
+            child.min = aabb.min, child.max = aabb.max;
+        }
+        node.left_first = left_child_idx;
+        node.prim_count = 0u;
+    }
+}
+
+template <uint32_t N>
+void WideBvh<N>::collapse(Bvh& bvh) {
+    if (bvh.nodes == nullptr || bvh.prims == nullptr || bvh.prim_count == 0u) return;
+    bvh.own_arrays();
+    split_large_leaves(bvh, MAX_LEAF_SIZE);
+
+    /* Every wide node consumes at least one interior binary node */
+    const uint32_t max_nodes = std::max(1u, (bvh.nodes_used - 2u) / 2u);
+    aligned_free(nodes);
+    nodes = (Node*)aligned_malloc(sizeof(Node) * max_nodes, 64);
+    nodes_used = 1u;
+
+    /* New primitive order, every wide node appends the primitives of its leaf children */
+    std::vector<uint32_t> order {};
+    order.reserve(bvh.prim_count);
+
+    /* Binary node & the wide node it is collapsed into */
+    struct Task {
+        uint32_t binary, wide;
+    };
+    std::vector<Task> tasks {{bvh.root_idx, 0u}};
+    while (tasks.empty() == false) {
+        const Task task = tasks.back();
+        tasks.pop_back();
+
+        /* Keep opening the interior child with the largest surface area, until all slots are used */
+        uint32_t slots[N] {task.binary}, slot_count = 1u;
+        while (slot_count < N) {
+            int best = -1;
+            float best_area = -1.0f;
+            for (uint32_t s = 0u; s < slot_count; ++s) {
+                const Bvh::Node& child = bvh.nodes[slots[s]];
+                if (child.is_leaf()) continue;
+                const float area = node_half_area(child);
+                if (area > best_area) best = s, best_area = area;
+            }
+            if (best < 0) break;
+            const uint32_t left_first = bvh.nodes[slots[best]].left_first;
+            slots[best] = left_first;
+            slots[slot_count++] = left_first + 1u;
+        }
+
+        /* The quantization grid covers the children, with a power of two scale per axis */
+        AABB bounds {};
+        for (uint32_t s = 0u; s < slot_count; ++s) bounds.grow(AABB(bvh.nodes[slots[s]].min, bvh.nodes[slots[s]].max));
+        Node& node = nodes[task.wide];
+        node = {};
+        node.origin = bounds.min;
+        float inv_scale[3] {};
+        for (uint32_t a = 0u; a < 3u; ++a) {
+            int e = 0;
+            std::frexp(std::max((bounds.max[a] - bounds.min[a]) / (float)MAX_LEAF_SIZE, 1e-30f), &e);
+            e = std::clamp(e, -126, 127);
+            node.exponent[a] = (uint8_t)(e + 127);
+            inv_scale[a] = std::ldexp(1.0f, -e);
+        }
+
+        node.child_base = nodes_used;
+        node.prim_base = (uint32_t)order.size();
+        for (uint32_t s = 0u; s < slot_count; ++s) {
+            Bvh::Node& child = bvh.nodes[slots[s]];
+
+            /* Round outwards, so the quantized bounds are conservative */
+            for (uint32_t a = 0u; a < 3u; ++a) {
+                const float lo = std::floor((child.min[a] - node.origin[a]) * inv_scale[a]);
+                const float hi = std::ceil((child.max[a] - node.origin[a]) * inv_scale[a]);
+                node.qlo[a][s] = (uint8_t)std::clamp(lo, 0.0f, 255.0f);
+                node.qhi[a][s] = (uint8_t)std::clamp(hi, 0.0f, 255.0f);
+            }
+
+            if (child.is_leaf()) {
+                /* Append the leaf primitives, and point the binary leaf to their new location */
+                node.meta[s] = (uint8_t)child.prim_count;
+                for (uint32_t p = 0u; p < child.prim_count; ++p) order.push_back(child.left_first + p);
+                child.left_first = (uint32_t)order.size() - child.prim_count;
+            } else {
+                node.imask |= 1u << s;
+                tasks.push_back({slots[s], nodes_used++});
+            }
+        }
+    }
+
+    /* Re-order the primitives of the binary BVH, into the scratch blocks which then become the primitive arrays */
+    Triangle* prims = bvh.arena.alloc<Triangle>(Bvh::PRIMS_SCRATCH, bvh.prim_count);
+    Normals* norms = bvh.arena.alloc<Normals>(Bvh::NORMS_SCRATCH, bvh.prim_count);
+    uint32_t* prim_indices = bvh.arena.alloc<uint32_t>(Bvh::PRIM_INDICES_SCRATCH, bvh.prim_count);
+    for (uint32_t i = 0u; i < bvh.prim_count; ++i) {
+        prims[i] = bvh.prims[order[i]];
+        norms[i] = bvh.norms[order[i]];
+        prim_indices[i] = bvh.prim_indices[order[i]];
+    }
+    bvh.arena.swap(Bvh::PRIMS, Bvh::PRIMS_SCRATCH), bvh.prims = prims;
+    bvh.arena.swap(Bvh::NORMS, Bvh::NORMS_SCRATCH), bvh.norms = norms;
+    bvh.arena.swap(Bvh::PRIM_INDICES, Bvh::PRIM_INDICES_SCRATCH), bvh.prim_indices = prim_indices;
+    bvh.convert_gpu_tris();
+
+    /* Splitting leaves added nodes, and the binary leaves moved */
+    bvh.alloc_gpu_nodes();
+    if (bvh.gpu_indices) bvh.order_treelets(bvh.treelet_size);
+    bvh.convert_gpu_nodes();
+    bvh.version++;
+}
+
+template <uint32_t N>
+void WideBvh<N>::release() {
+    if (nodes) aligned_free(nodes), nodes = nullptr;
+    nodes_used = 0u;
+}
+
+template struct WideBvh<4u>;
+template struct WideBvh<8u>;
+
+}  // namespace wyre::scene
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+
+namespace wyre::scene {
+
+/**
+ * @brief Node layout of a BVH, part of the BVH cache key. (the wide layout re-orders the primitives of the binary BVH)
+ * Only the binary layout is traversed by the GPU ray tracing kernels, the wide layout is traversed on the CPU.
+ */
+enum class BvhLayout { BINARY = 0, WIDE = 1 };
+
+/**
+ * @brief Wide (N-ary) BVH, collapsed from a binary BVH, with compressed child bounds.
+ * Child bounds are quantized to 8 bits per axis, relative to the origin & power of two scale of their parent.
+ *
+ * Based on "Efficient Incoherent Ray Traversal on GPUs Through Compressed Wide BVHs" by Ylitie et al. 2017.
+ */
+template <uint32_t N>
+struct WideBvh {
+    static_assert(N == 4u || N == 8u, "wide BVHs are either 4 or 8 wide.");
+
+    /* Largest number of primitives a leaf can hold, leaf sizes are stored in 8 bits. */
+    static constexpr uint32_t MAX_LEAF_SIZE = 255u;
+
+    /* Wide BVH Node, with quantized child bounds. (also the GPU format) */
+    struct alignas(16) Node {
+        /* Minimum corner of the node, the origin of the quantized child bounds. */
+        glm::vec3 origin;
+        /* Biased exponent of the quantization scale, per axis. (float exponent bits) */
+        uint8_t exponent[3];
+        /* Bit mask of the interior node child slots. */
+        uint8_t imask;
+        /* Index of the first interior child node, the interior children are stored contiguously. */
+        uint32_t child_base;
+        /* Index of the first primitive, the leaf children store their primitives contiguously in slot order. */
+        uint32_t prim_base;
+        /* Number of primitives of each leaf child slot. (0 for interior & empty slots) */
+        uint8_t meta[N];
+        /* Quantized child bounds, per axis. */
+        uint8_t qlo[3][N], qhi[3][N];
+
+        /** @returns True if a child slot is an interior node. */
+        inline bool is_interior(const uint32_t slot) const { return (imask >> slot) & 1u; }
+        /** @returns True if a child slot is unused. */
+        inline bool is_empty(const uint32_t slot) const { return meta[slot] == 0u && is_interior(slot) == false; }
+        /** @returns The de-quantized bounds of a child slot. (conservative) */
+        AABB child_aabb(const uint32_t slot) const;
+    };
+
+    Node* nodes = nullptr;
+    uint32_t nodes_used = 0u;
+
+    WideBvh() = default;
+
+    /**
+     * @brief Collapse a binary BVH into a wide BVH.
+     * The primitives of the binary BVH are re-ordered (and its GPU nodes updated),
+     * so that the leaf primitives of every wide node are contiguous. Both layouts share the same primitives.
+     */
+    void collapse(Bvh& bvh);
+
+    /** @brief Free all memory owned by the wide BVH. */
+    void release();
+};
+
+using Bvh4 = WideBvh<4u>;
+using Bvh8 = WideBvh<8u>;
+
+}  // namespace wyre::scene
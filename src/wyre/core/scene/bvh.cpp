@@ -1,59 +1,457 @@
 #include "bvh.h"
+#include "bvh-binning.h"
+
+#include "wyre/core/system/mapped-file.h" /* MappedFile */
+
+#include <algorithm> /* std::push_heap, std::pop_heap */
+#include <atomic>    /* std::atomic_ref */
+#include <cassert>   /* assert */
+#include <cstring>   /* memcpy, memset */
+#include <utility>   /* std::exchange */
 
 namespace wyre::scene {
 
-Bvh::Bvh(const Triangle* prims, const Normals* norms, const uint32_t prim_count) { build(prims, norms, size); }
+/* Number of primitives per chunk, when processing a node in parallel. */
+constexpr uint32_t PARALLEL_GRAIN = 1u << 13u;
 
-/** @brief Refit a node to include a list of primitives. */
-inline void refit_node(Bvh::Node& node, const Triangle* prims) {
-    /* Reset the node bounds */
-    node.min = glm::vec3(1e30f);
-    node.max = glm::vec3(-1e30f);
+Bvh::Bvh(const Triangle* prims, const Normals* norms, const uint32_t prim_count, const BuildParams& params) {
+    build(prims, norms, prim_count, params);
+}
 
-    /* Refit to snuggly include all primitives */
-    for (uint32_t i = 0; i < node.prim_count; ++i) {
-        const Triangle& prim = prims[node.left_first + i];
+/** @brief Clear a vector, and release its memory. */
+template <typename T>
+inline void release_vector(std::vector<T>& v) {
+    std::vector<T>().swap(v);
+}
+
+void Bvh::PrimRefs::push(const AABB& aabb, const glm::vec3& c, const uint32_t index) {
+    for (uint32_t a = 0u; a < 3u; ++a) {
+        centroid[a].push_back(c[a]);
+        bmin[a].push_back(aabb.min[a]);
+        bmax[a].push_back(aabb.max[a]);
+    }
+    indices.push_back(index);
+}
 
-        node.min = glm::min(node.min, prim.v0);
-        node.min = glm::min(node.min, prim.v1);
-        node.min = glm::min(node.min, prim.v2);
-        node.max = glm::max(node.max, prim.v0);
-        node.max = glm::max(node.max, prim.v1);
-        node.max = glm::max(node.max, prim.v2);
+void Bvh::PrimRefs::push(const PrimRefs& refs, const uint32_t i) {
+    for (uint32_t a = 0u; a < 3u; ++a) {
+        centroid[a].push_back(refs.centroid[a][i]);
+        bmin[a].push_back(refs.bmin[a][i]);
+        bmax[a].push_back(refs.bmax[a][i]);
+    }
+    indices.push_back(refs.indices[i]);
+}
+
+void Bvh::PrimRefs::reserve(const uint32_t count) {
+    for (uint32_t a = 0u; a < 3u; ++a) {
+        centroid[a].reserve(count);
+        bmin[a].reserve(count), bmax[a].reserve(count);
     }
+    indices.reserve(count);
 }
 
-void Bvh::build(const Triangle* new_prims, const Normals* new_norms, const uint32_t _prim_count) {
+void Bvh::PrimRefs::clear() {
+    for (uint32_t a = 0u; a < 3u; ++a) {
+        release_vector(centroid[a]);
+        release_vector(bmin[a]), release_vector(bmax[a]);
+    }
+    release_vector(indices);
+}
+
+void Bvh::BuildData::clear() {
+    PrimRefs::clear();
+    release_vector(scratch), release_vector(scratch_dst);
+    release_vector(left_offsets), release_vector(right_offsets);
+    release_vector(treelet_roots), release_vector(treelet_border);
+    input = nullptr;
+}
+
+void Bvh::BuildData::reset() {
+    for (uint32_t a = 0u; a < 3u; ++a) {
+        centroid[a].clear();
+        bmin[a].clear(), bmax[a].clear();
+    }
+    indices.clear();
+    scratch.clear(), scratch_dst.clear();
+    input = nullptr;
+}
+
+void Bvh::PrimRefs::swap(const uint32_t i, const uint32_t j) {
+    for (uint32_t a = 0u; a < 3u; ++a) {
+        std::swap(centroid[a][i], centroid[a][j]);
+        std::swap(bmin[a][i], bmin[a][j]);
+        std::swap(bmax[a][i], bmax[a][j]);
+    }
+    std::swap(indices[i], indices[j]);
+}
+
+/** @brief Grow an AABB to include a range of primitive bounds. */
+inline void grow_prims(AABB& aabb, const float* const bmin[3], const float* const bmax[3], const uint32_t first, const uint32_t count) {
+    for (uint32_t i = first; i < first + count; ++i) {
+        aabb.grow(glm::vec3(bmin[0][i], bmin[1][i], bmin[2][i]));
+        aabb.grow(glm::vec3(bmax[0][i], bmax[1][i], bmax[2][i]));
+    }
+}
+
+void Bvh::build(const Triangle* new_prims, const Normals* new_norms, const uint32_t _prim_count, const BuildParams& build_params) {
     if (new_prims == nullptr || _prim_count == 0u || new_norms == nullptr) return;
-    prim_count = _prim_count;
+    if (mapping) release();
+
+    /* Spatial splits are only supported by the binned SAH builder */
+    BuildParams params = build_params;
+    params.spatial_splits &= params.builder == Builder::BINNED_SAH;
+    ThreadPool* pool = (params.pool && params.pool->size() > 1u) ? params.pool : nullptr;
+
+    /* Allocate space for the primitives, with spatial splits the final number of primitive references is only known after the build */
+    prims = nullptr, norms = nullptr;
+    if (params.spatial_splits == false) {
+        prims = arena.alloc<Triangle>(PRIMS, _prim_count);
+        norms = arena.alloc<Normals>(NORMS, _prim_count);
+    }
+
+    /* Pre-compute the primitive centroids & bounds once, in SoA layout */
+    prepare_build(_prim_count, params, [&](const uint32_t i, AABB& aabb, glm::vec3& centroid) {
+        aabb = new_prims[i].get_aabb();
+        centroid = new_prims[i].get_centroid();
+    });
+    build_hierarchy(params, new_prims);
+
+    /* Spatial splits can duplicate references */
+    if (params.spatial_splits) {
+        prims = arena.alloc<Triangle>(PRIMS, prim_count);
+        norms = arena.alloc<Normals>(NORMS, prim_count);
+    }
+
+    /* Permute the primitives into their final order, only once */
+    const BuildData& data = build_data;
+    const auto permute = [&](const uint32_t begin, const uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            prims[i] = new_prims[data.indices[i]];
+            norms[i] = new_norms[data.indices[i]];
+        }
+    };
+    if (pool) pool->parallel_for(prim_count, PARALLEL_GRAIN, permute);
+    else permute(0u, prim_count);
+    convert_gpu_tris(pool);
+
+    finish_build(params);
+}
+
+void Bvh::build(const AABB* bounds, const uint32_t count, const BuildParams& params) {
+    if (bounds == nullptr || count == 0u) return;
+    if (mapping) release();
+    prims = nullptr, norms = nullptr, gpu_tris = nullptr;
 
-    /* Allocate space for primitives and copy primitives over */
-    if (prims) delete[] prims;
-    if (norms) delete[] norms;
-    prims = new Triangle[prim_count]{};
-    norms = new Normals[prim_count]{};
-    memcpy(prims, new_prims, prim_count * sizeof(Triangle));
-    memcpy(norms, new_norms, prim_count * sizeof(Normals));
-    size = prim_count;
+    /* Boxes have nothing to clip, so they are always built using object splits */
+    BuildParams object_params = params;
+    object_params.spatial_splits = false;
+    prepare_build(count, object_params, [&](const uint32_t i, AABB& aabb, glm::vec3& centroid) {
+        aabb = bounds[i];
+        centroid = (aabb.min + aabb.max) * 0.5f;
+    });
+    build_hierarchy(object_params, nullptr);
+    finish_build(object_params);
+}
+
+template <typename GetRef>
+void Bvh::prepare_build(const uint32_t count, const BuildParams& params, const GetRef& get_ref) {
+    ThreadPool* pool = (params.pool && params.pool->size() > 1u) ? params.pool : nullptr;
+    prim_count = count;
+    size = count;
+    build_data.bins = params.bins;
+    node_order = params.node_order, treelet_size = params.treelet_size;
+    tri_layout = params.tri_layout;
+
+    /* Allocate space for the BVH nodes */
+    const uint32_t max_refs = params.spatial_splits ? count + (uint32_t)(count * params.spatial_budget) : count;
+    nodes = arena.alloc<Node>(NODES, max_refs * 2u);
+
+    BuildData& data = build_data;
+    for (uint32_t a = 0u; a < 3u; ++a) {
+        data.centroid[a].resize(count);
+        data.bmin[a].resize(count);
+        data.bmax[a].resize(count);
+    }
+    data.indices.resize(count);
+    const auto prepass = [&](const uint32_t begin, const uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            AABB aabb {};
+            glm::vec3 centroid {};
+            get_ref(i, aabb, centroid);
+            for (uint32_t a = 0u; a < 3u; ++a) {
+                data.centroid[a][i] = centroid[a];
+                data.bmin[a][i] = aabb.min[a];
+                data.bmax[a][i] = aabb.max[a];
+            }
+            data.indices[i] = i;
+        }
+    };
+    if (pool) pool->parallel_for(count, PARALLEL_GRAIN, prepass);
+    else prepass(0u, count);
+}
 
-    /* Allocate space for BVH nodes */
-    nodes = (Node*)_aligned_malloc(sizeof(Node) * size * 2, 64);
+void Bvh::build_hierarchy(const BuildParams& params, const Triangle* input) {
+    ThreadPool* pool = (params.pool && params.pool->size() > 1u) ? params.pool : nullptr;
+    BuildData& data = build_data;
 
     /* Initialize the root node */
     Node& root = nodes[root_idx];
     root.left_first = 0, root.prim_count = size;
     nodes_used = 2; /* Skip the second node, for better child node cache alignment */
-    refit_node(root, prims);
+    refit_node(root, pool);
+
+    if (params.spatial_splits) {
+        /* Begin the recursive subdivide, with spatial splits */
+        data.input = input;
+        build_spatial(params);
+        prim_count = data.size();
+    } else if (params.builder != Builder::BINNED_SAH) {
+        /* Cluster the primitives along a Morton curve */
+        build_morton(params);
+    } else if (pool) {
+        /* Scratch space for partitioning large nodes */
+        if (prim_count >= params.parallel_threshold) {
+            data.scratch.resize(prim_count);
+            data.scratch_dst.resize(prim_count);
+        }
+
+        /* Begin the task parallel subdivide */
+        ParallelBuild build {*this, params};
+        subdivide_parallel(root, build);
+        pool->wait(build.group);
+    } else {
+        /* Begin the recursive subdivide */
+        subdivide(root);
+    }
+}
 
-    /* Begin the recursive subdivide */
-    subdivide(root);
+void Bvh::finish_build(const BuildParams& params) {
+    /* Keep the final primitive order, for refitting (the build data keeps its capacity for the next build) */
+    BuildData& data = build_data;
+    prim_indices = arena.alloc<uint32_t>(PRIM_INDICES, prim_count);
+    memcpy(prim_indices, data.indices.data(), sizeof(uint32_t) * prim_count);
+    data.reset();
 
     /* Allocate space for GPU optimized nodes */
-    if (gpu_nodes) delete[] gpu_nodes;
-    gpu_nodes = new GPUNode[nodes_used]{};
+    alloc_gpu_nodes();
+    gpu_indices = nullptr;
+    if (node_order == NodeOrder::TREELETS) order_treelets(treelet_size);
+    convert_gpu_nodes();
 
-    /* Convert CPU nodes to GPU optimized format */
-    uint32_t alt_node = 0, node_ptr = 0, stack[128], stack_ptr = 0;
+    build_sah = sah = eval_tree_sah();
+    optimize_stats = {};
+    version++;
+
+    if (params.optimize_ms > 0.0f) optimize(params.optimize_ms);
+}
+
+float Bvh::refit(const Triangle* new_prims, const Normals* new_norms, ThreadPool* pool) {
+    if (new_prims == nullptr || new_norms == nullptr || prims == nullptr || prim_indices == nullptr) return sah;
+    if (pool && pool->size() <= 1u) pool = nullptr;
+    own_arrays();
+
+    /* Permute the new primitives into the order of the tree */
+    const auto permute = [&](const uint32_t begin, const uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            prims[i] = new_prims[prim_indices[i]];
+            norms[i] = new_norms[prim_indices[i]];
+        }
+    };
+    if (pool) pool->parallel_for(prim_count, PARALLEL_GRAIN, permute);
+    else permute(0u, prim_count);
+
+    convert_gpu_tris(pool);
+
+    /* (leaves of a spatial split build grow to their whole primitives again) */
+    return refit_nodes(pool, [&](const uint32_t p) { return prims[p].get_aabb(); });
+}
+
+float Bvh::refit(const AABB* bounds, ThreadPool* pool) {
+    if (bounds == nullptr || prim_indices == nullptr) return sah;
+    if (pool && pool->size() <= 1u) pool = nullptr;
+    own_arrays();
+    return refit_nodes(pool, [&](const uint32_t p) { return bounds[prim_indices[p]]; });
+}
+
+template <typename GetAABB>
+float Bvh::refit_nodes(ThreadPool* pool, const GetAABB& get_aabb) {
+    /* Refit the leaf nodes to their primitives */
+    const auto refit_leaves = [&](const uint32_t begin, const uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            Node& node = nodes[i];
+            if (i == 1u || node.is_leaf() == false) continue;
+            AABB aabb {};
+            for (uint32_t p = node.left_first; p < node.left_first + node.prim_count; ++p) aabb.grow(get_aabb(p));
+            node.min = aabb.min, node.max = aabb.max;
+        }
+    };
+    if (pool) pool->parallel_for(nodes_used, PARALLEL_GRAIN, refit_leaves);
+    else refit_leaves(0u, nodes_used);
+
+    /* Refit the interior nodes bottom-up, child nodes are always stored after their parent */
+    for (uint32_t i = nodes_used - 1u; i != ~0u; --i) {
+        Node& node = nodes[i];
+        if (i == 1u || node.is_leaf()) continue;
+        const Node& left = nodes[node.left_first];
+        const Node& right = nodes[node.left_first + 1u];
+        node.min = glm::min(left.min, right.min);
+        node.max = glm::max(left.max, right.max);
+    }
+
+    convert_gpu_nodes();
+    sah = eval_tree_sah();
+    version++;
+    return sah;
+}
+
+Bvh& Bvh::operator=(Bvh&& other) noexcept {
+    if (this == &other) return *this;
+    release();
+    nodes = std::exchange(other.nodes, nullptr);
+    root_idx = other.root_idx, nodes_used = std::exchange(other.nodes_used, 2u), size = other.size;
+    prims = std::exchange(other.prims, nullptr), norms = std::exchange(other.norms, nullptr);
+    prim_count = std::exchange(other.prim_count, 0u);
+    prim_indices = std::exchange(other.prim_indices, nullptr);
+    gpu_tris = std::exchange(other.gpu_tris, nullptr);
+    gpu_nodes = std::exchange(other.gpu_nodes, nullptr), gpu_indices = std::exchange(other.gpu_indices, nullptr);
+    build_sah = other.build_sah, sah = other.sah, version = other.version;
+    node_order = other.node_order, treelet_size = other.treelet_size, tri_layout = other.tri_layout;
+    optimize_stats = other.optimize_stats;
+    mapping = std::exchange(other.mapping, nullptr);
+    build_data = std::move(other.build_data);
+    arena = std::move(other.arena);
+    return *this;
+}
+
+void Bvh::release() {
+    /* Memory mapped arrays are freed by unmapping the file */
+    if (mapping) delete mapping, mapping = nullptr;
+    nodes = nullptr, prims = nullptr, norms = nullptr, prim_indices = nullptr;
+    gpu_nodes = nullptr, gpu_indices = nullptr, gpu_tris = nullptr;
+    arena.release();
+    build_data.clear();
+    nodes_used = 2u, prim_count = 0u;
+}
+
+void Bvh::trim() {
+    build_data.clear();
+    arena.release(PRIMS_SCRATCH), arena.release(NORMS_SCRATCH), arena.release(PRIM_INDICES_SCRATCH);
+}
+
+void Bvh::alloc_gpu_nodes() {
+    gpu_nodes = arena.alloc<GPUNode>(GPU_NODES, nodes_used);
+    memset(gpu_nodes, 0, sizeof(GPUNode) * nodes_used);
+}
+
+void Bvh::own_arrays() {
+    if (mapping == nullptr) return;
+
+    /* Copy a mapped array into its arena block */
+    const auto own = [&]<typename T>(const Array slot, T*& array, const uint32_t count, const uint32_t capacity) {
+        if (array == nullptr) return;
+        T* owned = arena.alloc<T>(slot, capacity);
+        memcpy(owned, array, sizeof(T) * count);
+        array = owned;
+    };
+    /* (with the same space as the build allocates, collapsing can split leaves) */
+    own(NODES, nodes, nodes_used, std::max(nodes_used, prim_count * 2u));
+    own(PRIMS, prims, prim_count, prim_count);
+    own(NORMS, norms, prim_count, prim_count);
+    own(PRIM_INDICES, prim_indices, prim_count, prim_count);
+    own(GPU_NODES, gpu_nodes, nodes_used, nodes_used);
+    own(GPU_TRIS, gpu_tris, prim_count, prim_count);
+    delete mapping, mapping = nullptr;
+
+    /* The node order is not stored, the GPU nodes have to be converted in the same order again */
+    if (node_order == NodeOrder::TREELETS && gpu_indices == nullptr) order_treelets(treelet_size);
+}
+
+/** @returns Half the surface area of an AABB. */
+inline float half_area(const glm::vec3& min, const glm::vec3& max) {
+    const glm::vec3 e = max - min;
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+float Bvh::eval_tree_sah() const {
+    /* Every node costs one traversal step, and every leaf one intersection per primitive */
+    float cost = 0.0f;
+    for (uint32_t i = 0u; i < nodes_used; ++i) {
+        if (i == 1u) continue;
+        const Node& node = nodes[i];
+        cost += half_area(node.min, node.max) * (node.is_leaf() ? node.prim_count : 1u);
+    }
+    const float root_area = half_area(nodes[root_idx].min, nodes[root_idx].max);
+    return root_area > 0.0f ? cost / root_area : 0.0f;
+}
+
+void Bvh::order_treelets(const uint32_t treelet_size) {
+    gpu_indices = arena.alloc<uint32_t>(GPU_INDICES, nodes_used);
+    for (uint32_t i = 0u; i < nodes_used; ++i) gpu_indices[i] = ~0u;
+
+    /* Interior nodes ordered by surface area, the probability of a ray visiting them (heaps in the build data, which keep their capacity) */
+    using AreaNode = std::pair<float, uint32_t>;
+    std::vector<AreaNode>& roots = build_data.treelet_roots;
+    std::vector<AreaNode>& border = build_data.treelet_border;
+    roots.clear(), border.clear();
+    const auto push_interior = [&](std::vector<AreaNode>& heap, const uint32_t i) {
+        if (nodes[i].is_leaf()) return;
+        heap.push_back(AreaNode(half_area(nodes[i].min, nodes[i].max), i));
+        std::push_heap(heap.begin(), heap.end());
+    };
+    const auto pop_top = [](std::vector<AreaNode>& heap) {
+        std::pop_heap(heap.begin(), heap.end());
+        const AreaNode top = heap.back();
+        heap.pop_back();
+        return top;
+    };
+    uint32_t next = 0u;
+    gpu_indices[root_idx] = next++;
+    push_interior(roots, root_idx);
+
+    while (roots.empty() == false) {
+        /* Grow a treelet from the most likely root, the nodes left on its border become new treelet roots */
+        border.push_back(pop_top(roots));
+        for (uint32_t size = 0u; size < treelet_size && border.empty() == false; size += 2u) {
+            /* Siblings are always placed next to each other, rays often visit both */
+            const uint32_t left_first = nodes[pop_top(border).second].left_first;
+            gpu_indices[left_first] = next++;
+            gpu_indices[left_first + 1u] = next++;
+            push_interior(border, left_first);
+            push_interior(border, left_first + 1u);
+        }
+        for (const AreaNode& node : border) {
+            roots.push_back(node);
+            std::push_heap(roots.begin(), roots.end());
+        }
+        border.clear();
+    }
+}
+
+void Bvh::convert_gpu_nodes() {
+    /* Convert CPU nodes to GPU optimized format, in treelet order */
+    if (gpu_indices) {
+        for (uint32_t i = 0u; i < nodes_used; ++i) {
+            if (gpu_indices[i] == ~0u) continue;
+            const Node& node = nodes[i];
+            GPUNode& gpu_node = gpu_nodes[gpu_indices[i]];
+            if (node.is_leaf()) {
+                gpu_node.prim_count = node.prim_count;
+                gpu_node.prim_index = node.left_first;
+                continue;
+            }
+            const Node& left = nodes[node.left_first];
+            const Node& right = nodes[node.left_first + 1];
+            gpu_node.lmin = left.min, gpu_node.rmin = right.min;
+            gpu_node.lmax = left.max, gpu_node.rmax = right.max;
+            gpu_node.left = gpu_indices[node.left_first];
+            gpu_node.right = gpu_indices[node.left_first + 1];
+            gpu_node.prim_count = 0u;
+        }
+        return;
+    }
+
+    /* Convert CPU nodes to GPU optimized format, each level of the tree pushes a parent & right child pair */
+    uint32_t alt_node = 0, node_ptr = 0, stack[MAX_DEPTH * 2u], stack_ptr = 0;
     for (;;) { /* Credit: <https://github.com/jbikker/tinybvh> */
         const Node& node = nodes[node_ptr];
         const unsigned idx = alt_node++;
@@ -71,45 +469,138 @@ void Bvh::build(const Triangle* new_prims, const Normals* new_norms, const uint3
         gpu_nodes[idx].lmin = left.min, gpu_nodes[idx].rmin = right.min;
         gpu_nodes[idx].lmax = left.max, gpu_nodes[idx].rmax = right.max;
         gpu_nodes[idx].left = alt_node; /* right will be filled when popped! */
+        assert(stack_ptr + 2u <= MAX_DEPTH * 2u && "bvh is deeper than Bvh::MAX_DEPTH.");
         stack[stack_ptr++] = idx;
         stack[stack_ptr++] = node.left_first + 1;
         node_ptr = node.left_first;
     }
 }
 
-void Bvh::subdivide(Node& node, const uint32_t depth) {
-    if (node.prim_count <= 2u) return;
+void Bvh::convert_gpu_tris(ThreadPool* pool) {
+    gpu_tris = nullptr;
+    if (tri_layout != TriLayout::TRANSFORMS || prims == nullptr) return;
+
+    gpu_tris = arena.alloc<TriangleTransform>(GPU_TRIS, prim_count);
+    const auto transform = [&](const uint32_t begin, const uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) gpu_tris[i] = TriangleTransform(prims[i]);
+    };
+    if (pool) pool->parallel_for(prim_count, PARALLEL_GRAIN, transform);
+    else transform(0u, prim_count);
+}
+
+void Bvh::refit_node(Node& node, ThreadPool* pool) const {
+    const BuildData& data = build_data;
+    const float* const bmin[3] = {data.bmin[0].data(), data.bmin[1].data(), data.bmin[2].data()};
+    const float* const bmax[3] = {data.bmax[0].data(), data.bmax[1].data(), data.bmax[2].data()};
+    AABB aabb {};
+
+    /* Refit to snuggly include all primitives */
+    if (pool && node.prim_count >= PARALLEL_GRAIN * 2u) {
+        std::mutex lock {};
+        pool->parallel_for(node.prim_count, PARALLEL_GRAIN, [&](const uint32_t begin, const uint32_t end) {
+            AABB local {};
+            grow_prims(local, bmin, bmax, node.left_first + begin, end - begin);
+            std::lock_guard<std::mutex> guard(lock);
+            aabb.grow(local);
+        });
+    } else {
+        grow_prims(aabb, bmin, bmax, node.left_first, node.prim_count);
+    }
+
+    node.min = aabb.min;
+    node.max = aabb.max;
+}
+
+bool Bvh::split(Node& node, ThreadPool* pool) {
+    if (node.prim_count <= 2u) return false;
+
+    /* Only use the thread pool for large nodes */
+    BuildData& data = build_data;
+    if (data.scratch.empty() || node.prim_count < PARALLEL_GRAIN * 2u) pool = nullptr;
 
     /* Determine split based on SAH */
     int split_axis = -1;
     float split_t = 0.0f;
-    const float split_cost = find_best_split(node, split_axis, split_t);
+    const float split_cost = find_best_split(node, split_axis, split_t, pool);
 
     /* Calculate parent node cost */
     const glm::vec3 e = node.max - node.min;
     const float parent_area = e.x * e.x + e.y * e.y + e.z * e.z;
     const float parent_cost = node.prim_count * parent_area;
-    if (split_cost >= parent_cost) return; /* Split would not be worth it */
+    if (split_cost >= parent_cost) return false; /* Split would not be worth it */
 
-    /* Determine which primitives lie on which side */
+    /* Determine which primitives lie on which side (only the build data is moved) */
+    const float* centroid = data.centroid[split_axis].data();
     uint32_t i = node.left_first;
-    uint32_t j = i + node.prim_count - 1u;
-    while (i <= j) {
-        if (prims[i].get_centroid()[split_axis] < split_t) {
-            i++;
-        } else {
-            std::swap(prims[i], prims[j]);
-            std::swap(norms[i], norms[j]);
-            j--;
+    if (pool) {
+        /* Count the left side primitives per chunk */
+        const uint32_t chunk_count = (node.prim_count + PARALLEL_GRAIN - 1u) / PARALLEL_GRAIN;
+        std::vector<uint32_t>& left_offsets = data.left_offsets;
+        std::vector<uint32_t>& right_offsets = data.right_offsets;
+        left_offsets.assign(chunk_count + 1u, 0u), right_offsets.assign(chunk_count + 1u, 0u);
+        pool->parallel_for(chunk_count, 1u, [&](const uint32_t begin, const uint32_t end) {
+            for (uint32_t c = begin; c < end; ++c) {
+                const uint32_t first = node.left_first + c * PARALLEL_GRAIN;
+                const uint32_t last = std::min(first + PARALLEL_GRAIN, node.left_first + node.prim_count);
+                uint32_t left = 0u;
+                for (uint32_t p = first; p < last; ++p) left += centroid[p] < split_t;
+                left_offsets[c + 1u] = left;
+                right_offsets[c + 1u] = (last - first) - left;
+            }
+        });
+
+        /* Prefix sum over the chunk counts */
+        for (uint32_t c = 0u; c < chunk_count; ++c) {
+            left_offsets[c + 1u] += left_offsets[c];
+            right_offsets[c + 1u] += right_offsets[c];
+        }
+        const uint32_t left_total = left_offsets[chunk_count];
+
+        /* Find the destination of each primitive (stable partition) */
+        uint32_t* dst = data.scratch_dst.data();
+        pool->parallel_for(chunk_count, 1u, [&](const uint32_t begin, const uint32_t end) {
+            for (uint32_t c = begin; c < end; ++c) {
+                const uint32_t first = node.left_first + c * PARALLEL_GRAIN;
+                const uint32_t last = std::min(first + PARALLEL_GRAIN, node.left_first + node.prim_count);
+                uint32_t l = node.left_first + left_offsets[c];
+                uint32_t r = node.left_first + left_total + right_offsets[c];
+                for (uint32_t p = first; p < last; ++p) dst[p] = centroid[p] < split_t ? l++ : r++;
+            }
+        });
+
+        /* Scatter each build data stream into the scratch space, and copy it back */
+        const auto scatter = [&](auto* stream) {
+            auto* scratch = (decltype(stream))data.scratch.data();
+            pool->parallel_for(node.prim_count, PARALLEL_GRAIN, [&](const uint32_t begin, const uint32_t end) {
+                for (uint32_t p = node.left_first + begin; p < node.left_first + end; ++p) scratch[dst[p]] = stream[p];
+            });
+            memcpy(stream + node.left_first, scratch + node.left_first, node.prim_count * sizeof(*stream));
+        };
+        for (uint32_t a = 0u; a < 3u; ++a) {
+            scatter(data.centroid[a].data());
+            scatter(data.bmin[a].data());
+            scatter(data.bmax[a].data());
+        }
+        scatter(data.indices.data());
+        i += left_total;
+    } else {
+        uint32_t j = i + node.prim_count - 1u;
+        while (i <= j) {
+            if (centroid[i] < split_t) {
+                i++;
+            } else {
+                data.swap(i, j);
+                j--;
+            }
         }
     }
 
     const uint32_t left_count = i - node.left_first;
-    if (left_count == 0u || left_count == node.prim_count) return;
+    if (left_count == 0u || left_count == node.prim_count) return false;
 
-    /* Initialize the child nodes */
-    const uint32_t left_child_idx = nodes_used++;
-    const uint32_t right_child_idx = nodes_used++;
+    /* Initialize the child nodes (atomic, other tasks may be allocating nodes) */
+    const uint32_t left_child_idx = std::atomic_ref<uint32_t>(nodes_used).fetch_add(2u, std::memory_order_relaxed);
+    const uint32_t right_child_idx = left_child_idx + 1u;
     nodes[left_child_idx].left_first = node.left_first;
     nodes[left_child_idx].prim_count = left_count;
     nodes[right_child_idx].left_first = i;
@@ -118,71 +609,132 @@ void Bvh::subdivide(Node& node, const uint32_t depth) {
     node.prim_count = 0u;
 
     /* Refit the child nodes */
-    refit_node(nodes[left_child_idx], prims);
-    refit_node(nodes[right_child_idx], prims);
+    refit_node(nodes[left_child_idx], pool);
+    refit_node(nodes[right_child_idx], pool);
+    return true;
+}
+
+void Bvh::subdivide(Node& node, const uint32_t depth) {
+    if (depth + 1u >= MAX_BUILD_DEPTH || split(node) == false) return;
 
     /* Continue subdiving recursively */
-    subdivide(nodes[left_child_idx], depth + 1u);
-    subdivide(nodes[right_child_idx], depth + 1u);
+    subdivide(nodes[node.left_first], depth + 1u);
+    subdivide(nodes[node.left_first + 1u], depth + 1u);
+}
+
+void Bvh::subdivide_parallel(Node& node, ParallelBuild& build, const uint32_t depth) {
+    const BuildParams& params = build.params;
+    ThreadPool& pool = *params.pool;
+
+    /* Small subtrees are built on a single thread */
+    if (node.prim_count < params.task_threshold) {
+        subdivide(node, depth);
+        return;
+    }
+
+    /* Large nodes parallelize their own binning & partitioning */
+    const bool parallel = node.prim_count >= params.parallel_threshold;
+    if (depth + 1u >= MAX_BUILD_DEPTH || split(node, parallel ? &pool : nullptr) == false) return;
+
+    /* Split off the child subtrees as independent tasks */
+    Node& left = nodes[node.left_first];
+    Node& right = nodes[node.left_first + 1u];
+    if (parallel) {
+        /* Keep large nodes on this thread, so the pool stays free for their binning */
+        subdivide_parallel(left, build, depth + 1u);
+        subdivide_parallel(right, build, depth + 1u);
+    } else {
+        const uint32_t left_idx = node.left_first;
+        pool.submit(build.group, [&build, left_idx, depth]() { build.bvh.subdivide_parallel(build.bvh.nodes[left_idx], build, depth + 1u); });
+        subdivide_parallel(right, build, depth + 1u);
+    }
 }
 
-float Bvh::find_best_split(const Node& node, int& axis, float& t) const {
+float Bvh::find_best_split(const Node& node, int& axis, float& t, ThreadPool* pool) const {
+    const BinInput in = bin_input(build_data);
+    const uint32_t first = node.left_first, last = node.left_first + node.prim_count;
+    switch (build_data.bins) {
+        case 16u: return find_best_split_binned<16u>(in, first, last, axis, t, pool, nullptr);
+        case 32u: return find_best_split_binned<32u>(in, first, last, axis, t, pool, nullptr);
+        default: return find_best_split_binned<8u>(in, first, last, axis, t, pool, nullptr);
+    }
+}
+
+float Bvh::find_object_split(const PrimRefs& refs, int& axis, float& t, AABB (&children)[2]) const {
+    const BinInput in = bin_input(refs);
+    switch (build_data.bins) {
+        case 16u: return find_best_split_binned<16u>(in, 0u, refs.size(), axis, t, nullptr, children);
+        case 32u: return find_best_split_binned<32u>(in, 0u, refs.size(), axis, t, nullptr, children);
+        default: return find_best_split_binned<8u>(in, 0u, refs.size(), axis, t, nullptr, children);
+    }
+}
+
+template <uint32_t BINS>
+float Bvh::find_best_split_binned(const BinInput& in, const uint32_t first, const uint32_t last, int& axis, float& t, ThreadPool* pool, AABB* children) const {
+    const uint32_t count = last - first;
     float lowest_cost = 1e30f;
 
-    struct Bin {
-        AABB aabb {};
-        uint32_t prim_count = 0u;
-    };
+    /* Get the min and max of all primitive centroids in the node */
+    AABB cbounds {};
+    if (pool) {
+        std::mutex lock {};
+        pool->parallel_for(count, PARALLEL_GRAIN, [&](const uint32_t begin, const uint32_t end) {
+            const AABB local = centroid_bounds(in, first + begin, first + end);
+            std::lock_guard<std::mutex> guard(lock);
+            cbounds.grow(local);
+        });
+    } else {
+        cbounds = centroid_bounds(in, first, last);
+    }
+
+    /* Populate the bins of all 3 axes in a single pass */
+    const glm::vec3 scale = (float)BINS / (cbounds.max - cbounds.min);
+    Bins<BINS> bins {};
+    if (pool) {
+        std::mutex lock {};
+        pool->parallel_for(count, PARALLEL_GRAIN, [&](const uint32_t begin, const uint32_t end) {
+            Bins<BINS> local {};
+            bin_prims(local, in, first + begin, first + end, cbounds.min, scale);
+
+            /* Merge the local bins */
+            std::lock_guard<std::mutex> guard(lock);
+            bins.merge(local);
+        });
+    } else {
+        bin_prims(bins, in, first, last, cbounds.min, scale);
+    }
 
-    constexpr uint32_t BINS = 8u;
     for (uint32_t a = 0u; a < 3u; ++a) {
-        /* Get the min and max of all primitives in the node */
-        float bmin = 1e30f, bmax = -1e30f;
-        for (uint32_t i = 0u; i < node.prim_count; ++i) {
-            const glm::vec3& prim_center = prims[node.left_first + i].get_centroid();
-            bmin = fminf(bmin, prim_center[a]);
-            bmax = fmaxf(bmax, prim_center[a]);
-        }
+        const float bmin = cbounds.min[a], bmax = cbounds.max[a];
         if (bmin == bmax) continue;
 
-        /* Populate the bins */
-        Bin bins[BINS];
-        float scale = (float)BINS / (bmax - bmin);
-        for (uint32_t i = 0u; i < node.prim_count; ++i) {
-            const Triangle& prim = prims[node.left_first + i];
-            const int bin_idx = (int)fminf(BINS - 1u, (float)((prim.get_centroid()[a] - bmin) * scale));
-            bins[bin_idx].prim_count++;
-            const AABB prim_bounds = prim.get_aabb();
-            bins[bin_idx].aabb.grow(prim_bounds.min);
-            bins[bin_idx].aabb.grow(prim_bounds.max);
-        }
-
         /* Gather data for the planes between the bins */
-        float l_areas[BINS - 1u], r_areas[BINS - 1u];
+        AABB l_aabbs[BINS - 1u], r_aabbs[BINS - 1u];
         uint32_t l_counts[BINS - 1u], r_counts[BINS - 1u];
         AABB l_aabb, r_aabb;
         uint32_t l_sum = 0u, r_sum = 0u;
         for (uint32_t i = 0u; i < BINS - 1u; ++i) {
             /* Left-side */
-            l_sum += bins[i].prim_count;
+            l_sum += bins.count[a][i];
             l_counts[i] = l_sum;
-            l_aabb.grow(bins[i].aabb);
-            l_areas[i] = l_aabb.area();
+            l_aabb.grow(bins.aabb(a, i));
+            l_aabbs[i] = l_aabb;
             /* Right-side */
-            r_sum += bins[BINS - 1u - i].prim_count;
+            r_sum += bins.count[a][BINS - 1u - i];
             r_counts[BINS - 2u - i] = r_sum;
-            r_aabb.grow(bins[BINS - 1u - i].aabb);
-            r_areas[BINS - 2u - i] = r_aabb.area();
+            r_aabb.grow(bins.aabb(a, BINS - 1u - i));
+            r_aabbs[BINS - 2u - i] = r_aabb;
         }
 
         /* Calculate the SAH cost function for all planes */
-        scale = (bmax - bmin) / BINS;
+        const float plane_scale = (bmax - bmin) / BINS;
         for (uint32_t i = 0u; i < BINS - 1u; ++i) {
-            const float plane_cost = l_counts[i] * l_areas[i] + r_counts[i] * r_areas[i];
+            const float plane_cost = l_counts[i] * l_aabbs[i].area() + r_counts[i] * r_aabbs[i].area();
             if (plane_cost < lowest_cost) {
                 axis = a;
-                t = bmin + scale * (i + 1u);
+                t = bmin + plane_scale * (i + 1u);
                 lowest_cost = plane_cost;
+                if (children) children[0] = l_aabbs[i], children[1] = r_aabbs[i];
             }
         }
     }
@@ -191,19 +743,21 @@ float Bvh::find_best_split(const Node& node, int& axis, float& t) const {
 }
 
 float Bvh::eval_sah(const Node& node, const int axis, const float t) const {
+    const BuildData& data = build_data;
     AABB left_aabb{}, right_aabb{};
     uint32_t left_count = 0, right_count = 0;
     for (uint32_t i = 0; i < node.prim_count; ++i) {
-        const Triangle& prim = prims[node.left_first + i];
-        const AABB aabb = prim.get_aabb();
-        if (prim.get_centroid()[axis] < t) {
+        const uint32_t prim = node.left_first + i;
+        const glm::vec3 prim_min = glm::vec3(data.bmin[0][prim], data.bmin[1][prim], data.bmin[2][prim]);
+        const glm::vec3 prim_max = glm::vec3(data.bmax[0][prim], data.bmax[1][prim], data.bmax[2][prim]);
+        if (data.centroid[axis][prim] < t) {
             left_count++;
-            left_aabb.grow(aabb.min);
-            left_aabb.grow(aabb.max);
+            left_aabb.grow(prim_min);
+            left_aabb.grow(prim_max);
         } else {
             right_count++;
-            right_aabb.grow(aabb.min);
-            right_aabb.grow(aabb.max);
+            right_aabb.grow(prim_min);
+            right_aabb.grow(prim_max);
         }
     }
     const float cost = left_count * left_aabb.area() + right_count * right_aabb.area();
@@ -1,18 +1,81 @@
 #pragma once
 
+#include <utility> /* std::pair */
+#include <vector>  /* std::vector */
+
 #include <glm/glm.hpp>
 
 #include "triangle.h"
 
+#include "wyre/core/system/arena.h"       /* Arena */
+#include "wyre/core/system/thread-pool.h" /* ThreadPool */
+
+namespace wyre {
+class MappedFile;
+}
+
 namespace wyre::scene {
 
 using Index = uint32_t;
 
+struct BinInput;
+template <uint32_t N>
+struct WideBvh;
+class BvhCache;
+
 struct Vertex {
     glm::vec3 pos;
     glm::vec2 uv;
 };
 
+/**
+ * @brief Memory order of the GPU optimized BVH nodes.
+ */
+enum class NodeOrder { DEPTH_FIRST, TREELETS };
+
+/**
+ * @brief Primitive layout intersected by the GPU ray tracing kernels.
+ * Transforms are emitted alongside the vertices, as an intersection-only stream.
+ */
+enum class TriLayout { VERTICES = 0, TRANSFORMS = 1 };
+
+/**
+ * @brief BVH construction algorithm.
+ * LBVH & PLOC sort the primitives along a Morton curve, which is much faster than binning,
+ * for rebuilding dynamic geometry every frame, at a lower tree quality. (PLOC recovers most of it)
+ */
+enum class Builder { BINNED_SAH, LBVH, PLOC };
+
+/**
+ * @brief BVH build parameters.
+ */
+struct BuildParams {
+    /* Thread pool to build on, the build is single threaded if null. */
+    ThreadPool* pool = nullptr;
+    /* Nodes with at least this many primitives are sub-divided in a separate task. */
+    uint32_t task_threshold = 1024u;
+    /* Nodes with at least this many primitives parallelize their binning & partitioning. */
+    uint32_t parallel_threshold = 1u << 16u;
+    /* Construction algorithm, the Morton code builders are meant for fast rebuilds of dynamic geometry. (they allocate their working memory per build) */
+    Builder builder = Builder::BINNED_SAH;
+    /* Number of SAH bins per axis (8, 16 or 32), more bins trade build speed for tree quality. */
+    uint32_t bins = 8u;
+    /* Neighbour search radius of PLOC along the Morton curve, a larger radius finds better clusters but is slower. */
+    uint32_t ploc_radius = 16u;
+    /* Use spatial splits (SBVH), duplicating references to primitives that straddle a split plane. (single threaded, binned SAH only, allocates per node) */
+    bool spatial_splits = false;
+    /* Maximum number of duplicated references, relative to the primitive count. */
+    float spatial_budget = 0.3f;
+    /* Order of the GPU nodes, treelets keep the nodes most likely to be visited close together in memory. */
+    NodeOrder node_order = NodeOrder::DEPTH_FIRST;
+    /* Number of nodes per treelet, when using the treelet node order. */
+    uint32_t treelet_size = 64u;
+    /* Time budget for optimizing the tree after the build, in milliseconds. (0 = disabled, meant for static geometry) */
+    float optimize_ms = 0.0f;
+    /* Primitive layout of the GPU, the transforms layout also emits pre-transformed triangles. */
+    TriLayout tri_layout = TriLayout::VERTICES;
+};
+
 /**
  * @brief Bounding Volume Hierarchy structure.
  */
@@ -35,6 +98,22 @@ struct Bvh {
         glm::vec3 rmax; uint32_t prim_count;
     };
 
+    /* Result of a post-build optimization. */
+    struct OptimizeStats {
+        /* SAH cost of the tree before & after the optimization. */
+        float sah_before = 0.0f, sah_after = 0.0f;
+        uint32_t reinsertions = 0u;
+        float ms = 0.0f;
+    };
+
+    /* Maximum depth of the tree, (the root is at depth 0) no tree is deeper than the traversal stacks. */
+    static constexpr uint32_t MAX_DEPTH = 64u;
+    /*
+     * Maximum depth of a tree after the build, every builder turns the nodes at the last level into leaves.
+     * The remaining levels are reserved for splitting leaves too large for the wide layout. (halving 2^32 primitives down to 255 takes 25 levels)
+     */
+    static constexpr uint32_t MAX_BUILD_DEPTH = MAX_DEPTH - 25u;
+
     Node* nodes = nullptr;
     /* Skip the second node, for better child node cache alignment. */
     uint32_t root_idx = 0, nodes_used = 2;
@@ -45,23 +124,226 @@ struct Bvh {
     Normals* norms = nullptr;
     uint32_t prim_count = 0;
 
+    /* Input primitive index of each primitive, used for refitting. */
+    uint32_t* prim_indices = nullptr;
+
+    /* Primitives pre-transformed for intersection, in the same order. (null unless using the transforms layout) */
+    TriangleTransform* gpu_tris = nullptr;
+
     /* Nodes parsed into a GPU optimized format. */
     GPUNode* gpu_nodes = nullptr;
+    /* GPU node index of each node, with the treelet node order. (null for depth first) */
+    uint32_t* gpu_indices = nullptr;
+
+    /* SAH cost of the tree after the last build, and its current SAH cost. */
+    float build_sah = 0.0f, sah = 0.0f;
+    /* Incremented every time the BVH is built or refit. */
+    uint32_t version = 0u;
+
+    /* GPU node order & primitive layout of the last build. */
+    NodeOrder node_order = NodeOrder::DEPTH_FIRST;
+    uint32_t treelet_size = 64u;
+    TriLayout tri_layout = TriLayout::VERTICES;
+
+    /* Result of the last optimization. */
+    OptimizeStats optimize_stats {};
+
+    /* File the arrays are memory mapped from, when loaded from a cache. (null if the BVH owns its arrays) */
+    MappedFile* mapping = nullptr;
 
     Bvh() = default;
-    Bvh(const Triangle* prims, const Normals* norms, const uint32_t prim_count);
+    Bvh(const Triangle* prims, const Normals* norms, const uint32_t prim_count, const BuildParams& params = {});
+    ~Bvh() { release(); }
+
+    /* Non-copyable, movable */
+    Bvh(const Bvh&) = delete;
+    Bvh& operator=(const Bvh&) = delete;
+    Bvh(Bvh&& other) noexcept { *this = std::move(other); }
+    Bvh& operator=(Bvh&& other) noexcept;
 
     /** @brief Evaluate the Surface Area Heuristic of a specific node split. */
     float eval_sah(const Node& node, const int axis, const float t) const;
 
     /** @brief Find the "optimal" axis & time along that axis to split a node. */
-    float find_best_split(const Node& node, int& axis, float& t) const;
+    float find_best_split(const Node& node, int& axis, float& t, ThreadPool* pool = nullptr) const;
+
+    /** @brief Split a given BVH node in two, returns false if the node should remain a leaf. */
+    bool split(Node& node, ThreadPool* pool = nullptr);
 
-    /** @brief Sub-divide a given BVH node. */
+    /** @brief Sub-divide a given BVH node, nodes at the maximum depth remain leaves. */
     void subdivide(Node& node, const uint32_t depth = 0);
 
+    /* State shared by the tasks of a parallel build, so the tasks only capture a reference, a node index & a depth. (small enough to not allocate) */
+    struct ParallelBuild {
+        Bvh& bvh;
+        const BuildParams& params;
+        ThreadPool::TaskGroup group {};
+    };
+
+    /** @brief Sub-divide a given BVH node, using the thread pool for large nodes & independent subtrees. */
+    void subdivide_parallel(Node& node, ParallelBuild& build, const uint32_t depth = 0);
+
     /** @brief Build the BVH based on a collection of primitives. */
-    void build(const Triangle* prims, const Normals* norms, const uint32_t prim_count);
+    void build(const Triangle* prims, const Normals* norms, const uint32_t prim_count, const BuildParams& params = {});
+
+    /**
+     * @brief Refit the BVH to moved primitives in O(n), without changing its topology.
+     * @param prims Primitives in the same order, and of the same count, as the last build input.
+     * @returns The new SAH cost of the tree.
+     */
+    float refit(const Triangle* prims, const Normals* norms, ThreadPool* pool = nullptr);
+
+    /**
+     * @brief Build the BVH over a collection of boxes, such as mesh instances. (without primitives)
+     * The primitive indices map the leaf primitives back to the boxes.
+     */
+    void build(const AABB* bounds, const uint32_t count, const BuildParams& params = {});
+
+    /** @brief Refit the BVH to moved boxes in O(n), in the same order as the last build input. */
+    float refit(const AABB* bounds, ThreadPool* pool = nullptr);
+
+    /**
+     * @brief Optimize the tree by removing the most inefficient nodes, and inserting them again where they cost the least.
+     * Runs until the SAH cost converges, or the time budget runs out. The build SAH cost is reset to the optimized cost.
+     * Meant for static geometry, a few hundred milliseconds buy a permanently cheaper tree to trace.
+     */
+    OptimizeStats optimize(const float budget_ms);
+
+    /** @brief Free all memory owned by the BVH. */
+    void release();
+
+    /**
+     * @brief Free the memory which is only used while building, keeping the BVH intact.
+     * Meant for BVHs which are rarely rebuilt, otherwise rebuilds keep reusing that memory.
+     */
+    void trim();
+
+    /** @returns The number of heap allocations made for the BVH arrays so far. (stops growing once rebuilds reuse the memory) */
+    inline uint64_t get_allocations() const { return arena.get_allocations(); }
+
+    /** @returns How much the SAH cost increased since the last build, refits degrade the tree quality. (1 = none) */
+    inline float sah_drift() const { return build_sah > 0.0f ? sah / build_sah : 1.0f; }
+
+   private:
+    /* Collapsing re-orders the primitives, and converts the nodes for the GPU again. */
+    template <uint32_t N>
+    friend struct WideBvh;
+    /* Loading points the arrays into a memory mapped cache file. */
+    friend class BvhCache;
+
+    /* Arrays owned by the BVH, each in a block of the arena. */
+    enum Array : uint32_t {
+        NODES, PRIMS, NORMS, PRIM_INDICES, GPU_NODES, GPU_INDICES, GPU_TRIS,
+        /* Double buffers of the primitive arrays, for re-ordering them. (free after the build) */
+        PRIMS_SCRATCH, NORMS_SCRATCH, PRIM_INDICES_SCRATCH,
+        ARRAY_COUNT
+    };
+    /* The arrays keep their capacity across rebuilds. */
+    Arena<ARRAY_COUNT> arena {};
+
+    /* Primitive references, in SoA layout. */
+    struct PrimRefs {
+        /* Primitive centroids, per axis. */
+        std::vector<float> centroid[3] {};
+        /* Primitive bounds, per axis. */
+        std::vector<float> bmin[3] {}, bmax[3] {};
+        /* Primitive indices, into the input primitives. */
+        std::vector<uint32_t> indices {};
+
+        /** @returns The number of references. */
+        inline uint32_t size() const { return (uint32_t)indices.size(); }
+        /** @brief Reserve space for a number of references. */
+        void reserve(const uint32_t count);
+        /** @brief Append a reference. */
+        void push(const AABB& aabb, const glm::vec3& centroid, const uint32_t index);
+        /** @brief Append a reference from another list of references. */
+        void push(const PrimRefs& refs, const uint32_t i);
+        /** @brief Swap two references. */
+        void swap(const uint32_t i, const uint32_t j);
+        /** @brief Free the references. */
+        void clear();
+    };
+
+    /* Build-time primitive data. (only valid during a build) */
+    struct BuildData : PrimRefs {
+        /* Scratch space & destinations, used for partitioning large nodes in parallel. */
+        std::vector<uint32_t> scratch {}, scratch_dst {};
+        /* Left & right primitive offsets of each chunk, used for partitioning large nodes in parallel. (only one node at a time) */
+        std::vector<uint32_t> left_offsets {}, right_offsets {};
+        /* Heaps of the treelet roots & the border of the current treelet, by surface area. (used by the treelet node order) */
+        std::vector<std::pair<float, uint32_t>> treelet_roots {}, treelet_border {};
+        /* Number of SAH bins per axis. */
+        uint32_t bins = 8u;
+        /* Input primitives, used for clipping spatial split references. */
+        const Triangle* input = nullptr;
+        /* Number of references which can still be duplicated by spatial splits. */
+        uint32_t spatial_budget = 0u;
+        /* Surface area of the root node, spatial splits are relative to it. */
+        float root_area = 0.0f;
+
+        /** @brief Free the build data. */
+        void clear();
+        /** @brief Empty the build data, keeping its memory for the next build. */
+        void reset();
+    } build_data {};
+
+    /** @brief Find the best object split of a range of references, using a fixed number of SAH bins. */
+    template <uint32_t BINS>
+    float find_best_split_binned(const BinInput& in, const uint32_t first, const uint32_t last, int& axis, float& t, ThreadPool* pool, AABB* children) const;
+
+    /** @brief Find the best object split of a list of references, and the bounds of the resulting children. */
+    float find_object_split(const PrimRefs& refs, int& axis, float& t, AABB (&children)[2]) const;
+
+    /** @brief Find the best spatial split of a node, references straddling the plane are split in two. */
+    float find_spatial_split(const Node& node, const PrimRefs& refs, int& axis, float& t) const;
+
+    /** @brief Sub-divide a given BVH node using object & spatial splits. (the references are consumed) */
+    void subdivide_spatial(Node& node, PrimRefs& refs, const uint32_t depth);
+
+    /** @brief Build the BVH hierarchy using spatial splits, from the build data. */
+    void build_spatial(const BuildParams& params);
+
+    /** @brief Build the BVH hierarchy by clustering the build data along a Morton curve. (LBVH or PLOC) */
+    void build_morton(const BuildParams& params);
+
+    /** @brief Allocate the nodes, and pre-compute the build data of a number of primitives. */
+    template <typename GetRef>
+    void prepare_build(const uint32_t count, const BuildParams& params, const GetRef& get_ref);
+
+    /** @brief Build the node hierarchy over the build data. (the input is only used by spatial splits) */
+    void build_hierarchy(const BuildParams& params, const Triangle* input);
+
+    /** @brief Keep the final primitive order, free the build data, convert the nodes for the GPU, and optimize the tree if requested. */
+    void finish_build(const BuildParams& params);
+
+    /** @brief Refit all nodes bottom-up, given the bounds of each leaf primitive. */
+    template <typename GetAABB>
+    float refit_nodes(ThreadPool* pool, const GetAABB& get_aabb);
+
+    /** @brief Refit the bounds of a node to the build data of its primitives. */
+    void refit_node(Node& node, ThreadPool* pool = nullptr) const;
+
+    /** @brief Evaluate the SAH cost of the whole tree, relative to the root. */
+    float eval_tree_sah() const;
+
+    /**
+     * @brief Order the GPU nodes in treelets, starting from the root.
+     * Each treelet grows by the children of the node with the largest surface area (the most likely to be visited) on its border,
+     * siblings stay adjacent, and the treelets are emitted in the same order, so the top levels of the tree stay together.
+     */
+    void order_treelets(const uint32_t treelet_size);
+
+    /** @brief Convert the CPU nodes into the GPU optimized format. */
+    void convert_gpu_nodes();
+
+    /** @brief Allocate the GPU nodes, for the current number of nodes. (zeroed) */
+    void alloc_gpu_nodes();
+
+    /** @brief Copy memory mapped arrays into owned memory, before anything re-allocates them. */
+    void own_arrays();
+
+    /** @brief Pre-transform the primitives for intersection, if using the transforms layout. */
+    void convert_gpu_tris(ThreadPool* pool = nullptr);
 };
 
 }  // namespace wyre
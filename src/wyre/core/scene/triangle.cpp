@@ -13,6 +13,22 @@ AABB Triangle::get_aabb() const {
     return aabb;
 }
 
+TriangleTransform::TriangleTransform(const Triangle& tri) {
+    const glm::vec3 edge1 = tri.v1 - tri.v0, edge2 = tri.v2 - tri.v0;
+    const glm::vec3 n = glm::cross(edge1, edge2);
+    const float nn = glm::dot(n, n);
+    if (nn < 1e-30f) {
+        w.w = 1.0f;
+        return;
+    }
+
+    /* The normal is perpendicular to both edges, so the inverse of [edge1 edge2 n] has a closed form */
+    const glm::vec3 row_u = glm::cross(edge2, n) / nn, row_v = glm::cross(n, edge1) / nn, row_w = n / nn;
+    u = glm::vec4(row_u, -glm::dot(row_u, tri.v0));
+    v = glm::vec4(row_v, -glm::dot(row_v, tri.v0));
+    w = glm::vec4(row_w, -glm::dot(row_w, tri.v0));
+}
+
 Normals::Normals(const glm::vec3 n0, const glm::vec3 n1, const glm::vec3 n2) : n0(n0), n1(n1), n2(n2) {}
 
 }  // namespace wyre
@@ -19,6 +19,21 @@ struct Triangle {
     inline glm::vec3 get_centroid() const { return (v0 + v1 + v2) / 3.0f; };
 };
 
+/**
+ * @brief A triangle pre-transformed for ray intersection, without any vertex or color data.
+ * The rows are an affine transform from world space into the space of the triangle edges & normal,
+ * giving the barycentric u & v, and the (scaled) distance to the triangle plane. (Baldwin & Weber 2016)
+ */
+struct TriangleTransform {
+    glm::vec4 u {};
+    glm::vec4 v {};
+    glm::vec4 w {};
+
+    TriangleTransform() = default;
+    /** @brief Degenerate triangles get a transform which is never intersected. */
+    explicit TriangleTransform(const Triangle& tri);
+};
+
 struct Normals {
     glm::vec3 n0 {}; float _0 = 0.0f;
     glm::vec3 n1 {}; float _1 = 0.0f;
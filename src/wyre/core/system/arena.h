@@ -0,0 +1,120 @@
+/**
+ * @file system/arena.h
+ * @brief Portable aligned allocation, and an arena of reusable aligned blocks.
+ */
+#pragma once
+
+#include <algorithm> /* std::max */
+#include <cstddef>   /* size_t */
+#include <cstdint>   /* uint32_t, uint64_t */
+#include <cstdlib>   /* posix_memalign, free */
+#include <cstring>   /* memcpy */
+#include <utility>   /* std::swap */
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <malloc.h> /* _aligned_malloc, _aligned_free */
+#endif
+
+namespace wyre {
+
+/** @returns Memory aligned to a power of two, which must be freed with `aligned_free`. (null on failure) */
+inline void* aligned_malloc(const size_t size, const size_t alignment) {
+#if defined(_WIN32) || defined(_WIN64)
+    return _aligned_malloc(size, alignment);
+#else
+    void* ptr = nullptr;
+    return posix_memalign(&ptr, std::max(alignment, sizeof(void*)), size) == 0 ? ptr : nullptr;
+#endif
+}
+
+/** @brief Free memory allocated with `aligned_malloc`. */
+inline void aligned_free(void* ptr) {
+#if defined(_WIN32) || defined(_WIN64)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+/**
+ * @brief Arena of cache line aligned memory blocks, one per array, which keep their capacity when reused.
+ * Re-allocating a block only reaches the heap when it has to grow, so rebuilding data of the same size never allocates.
+ * @tparam SLOTS Number of blocks.
+ */
+template <uint32_t SLOTS>
+class Arena {
+   public:
+    static constexpr size_t ALIGNMENT = 64u;
+
+    Arena() = default;
+    ~Arena() { release(); }
+
+    /* Non-copyable, movable */
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&& other) noexcept { swap(other); }
+    Arena& operator=(Arena&& other) noexcept {
+        if (this != &other) release(), swap(other);
+        return *this;
+    }
+
+    /**
+     * @returns A block with space for at least a number of elements, the contents are undefined.
+     * @param keep Keep the contents of the block if it has to grow.
+     */
+    template <typename T>
+    T* alloc(const uint32_t slot, const size_t count, const bool keep = false) {
+        Block& block = blocks[slot];
+        const size_t bytes = sizeof(T) * std::max<size_t>(count, 1u);
+        if (bytes > block.capacity) {
+            /* Grow with some slack, so sizes varying between rebuilds settle on a capacity */
+            const size_t capacity = std::max(bytes, block.capacity + block.capacity / 2u);
+            void* data = aligned_malloc(capacity, ALIGNMENT);
+            if (keep && block.data) memcpy(data, block.data, block.capacity);
+            aligned_free(block.data);
+            block.data = data, block.capacity = capacity;
+            allocations++;
+        }
+        return (T*)block.data;
+    }
+
+    /** @brief Swap the memory of two blocks, for double buffering an array. */
+    inline void swap(const uint32_t a, const uint32_t b) { std::swap(blocks[a], blocks[b]); }
+
+    /** @brief Free the memory of a single block. */
+    inline void release(const uint32_t slot) {
+        aligned_free(blocks[slot].data);
+        blocks[slot] = {};
+    }
+
+    /** @brief Free the memory of every block. */
+    inline void release() {
+        for (uint32_t s = 0u; s < SLOTS; ++s) release(s);
+    }
+
+    /** @returns The total capacity of all blocks, in bytes. */
+    inline size_t capacity() const {
+        size_t total = 0u;
+        for (const Block& block : blocks) total += block.capacity;
+        return total;
+    }
+
+    /** @returns The number of heap allocations made by the arena so far. */
+    inline uint64_t get_allocations() const { return allocations; }
+
+   private:
+    struct Block {
+        void* data = nullptr;
+        size_t capacity = 0u;
+    };
+
+    Block blocks[SLOTS] {};
+    uint64_t allocations = 0u;
+
+    inline void swap(Arena& other) noexcept {
+        for (uint32_t s = 0u; s < SLOTS; ++s) std::swap(blocks[s], other.blocks[s]);
+        std::swap(allocations, other.allocations);
+    }
+};
+
+}  // namespace wyre
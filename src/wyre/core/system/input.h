@@ -1,6 +1,7 @@
 #pragma once
 
-#if defined(_WIN32) || defined(_WIN64)
+/* Windows & Linux share the SDL & Vulkan platform layer */
+#if defined(_WIN32) || defined(_WIN64) || defined(__linux__)
 #include "wyre/platform/windows/input.h"
 #else
 #error "platform is not supported."
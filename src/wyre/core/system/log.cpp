@@ -48,7 +48,11 @@ void Logger::log_inner(const LogGroup group, const LogLevel level, const std::st
     /* Get the current time */
     time_t now = time(0);
     tm timeinfo;
+#if defined(_WIN32) || defined(_WIN64)
     localtime_s(&timeinfo, &now);
+#else
+    localtime_r(&now, &timeinfo);
+#endif
     char timestamp[80];
     strftime(timestamp, sizeof(timestamp), "(%d-%m-%Y|%H:%M:%S)", &timeinfo);
 
@@ -0,0 +1,80 @@
+#include "mapped-file.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>    /* open */
+#include <sys/mman.h> /* mmap, munmap */
+#include <sys/stat.h> /* fstat */
+#include <unistd.h>   /* close */
+#endif
+
+namespace wyre {
+
+#if defined(_WIN32) || defined(_WIN64)
+
+Result<void> MappedFile::open(const std::string& path) {
+    close();
+    const HANDLE file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE) return Err("file '%s' was not found.", path.c_str());
+    file = file_handle;
+
+    LARGE_INTEGER file_size {};
+    if (GetFileSizeEx(file_handle, &file_size) == FALSE || file_size.QuadPart == 0) {
+        close();
+        return Err("file '%s' is empty.", path.c_str());
+    }
+    size = (size_t)file_size.QuadPart;
+
+    /* Copy-on-write mapping, so the mapped memory can be written to */
+    mapping = CreateFileMappingA(file_handle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        close();
+        return Err("failed to map file '%s'.", path.c_str());
+    }
+    data = (std::byte*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (data == nullptr) {
+        close();
+        return Err("failed to map file '%s'.", path.c_str());
+    }
+    return Ok();
+}
+
+void MappedFile::close() {
+    if (data) UnmapViewOfFile(data), data = nullptr;
+    if (mapping) CloseHandle(mapping), mapping = nullptr;
+    if (file) CloseHandle(file), file = nullptr;
+    size = 0u;
+}
+
+#else
+
+Result<void> MappedFile::open(const std::string& path) {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return Err("file '%s' was not found.", path.c_str());
+
+    struct stat info {};
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return Err("file '%s' is empty.", path.c_str());
+    }
+
+    /* Private mapping, so the mapped memory can be written to (copy-on-write) */
+    void* ptr = mmap(nullptr, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd); /* (the mapping keeps the file open) */
+    if (ptr == MAP_FAILED) return Err("failed to map file '%s'.", path.c_str());
+    data = (std::byte*)ptr;
+    size = (size_t)info.st_size;
+    return Ok();
+}
+
+void MappedFile::close() {
+    if (data) munmap(data, size), data = nullptr;
+    size = 0u;
+}
+
+#endif
+
+}  // namespace wyre
@@ -0,0 +1,46 @@
+/**
+ * @file system/mapped-file.h
+ * @brief Memory mapped files.
+ */
+#pragma once
+
+#include <cstddef> /* std::byte, size_t */
+#include <string>  /* std::string */
+
+#include "wyre/result.h" /* Result<T> */
+
+namespace wyre {
+
+/**
+ * @brief Memory mapped file, its pages are only read from disk once they are touched.
+ * The mapping is copy-on-write, writes to the mapped memory never reach the file.
+ */
+class MappedFile {
+    std::byte* data = nullptr;
+    size_t size = 0u;
+
+    /* Platform file & mapping handles. */
+    void* file = nullptr;
+    void* mapping = nullptr;
+
+   public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    /* Non-copyable */
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /** @brief Map the whole contents of a file into memory. */
+    Result<void> open(const std::string& path);
+
+    /** @brief Unmap the file, all pointers into the mapped memory become invalid. */
+    void close();
+
+    /** @returns The mapped memory. (null if no file is mapped) */
+    inline std::byte* get_data() const { return data; }
+    /** @returns The size of the mapped file in bytes. */
+    inline size_t get_size() const { return size; }
+};
+
+}  // namespace wyre
@@ -0,0 +1,177 @@
+/**
+ * @file system/thread-pool.cpp
+ * @brief Work-stealing thread pool.
+ */
+#include "thread-pool.h"
+
+#include <utility> /* std::exchange */
+
+namespace wyre {
+
+/* Pool & queue index of the current thread, if it is a worker thread. */
+static thread_local const ThreadPool* tls_pool = nullptr;
+static thread_local uint32_t tls_index = 0u;
+/* Priority of the task running on the current thread. */
+static thread_local ThreadPool::Priority tls_priority = ThreadPool::Priority::HIGH;
+
+ThreadPool::Priority ThreadPool::current_priority() { return tls_priority; }
+
+ThreadPool::ThreadPool(uint32_t thread_count) {
+    if (thread_count == 0u) thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    /* The calling thread also executes tasks, so we need one less worker */
+    const uint32_t worker_count = thread_count - 1u;
+    for (uint32_t i = 0u; i < worker_count + 1u; ++i) {
+        queues.emplace_back(std::make_unique<Queue>());
+    }
+    workers.reserve(worker_count);
+    for (uint32_t i = 0u; i < worker_count; ++i) {
+        workers.emplace_back(&ThreadPool::worker_main, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        stop = true;
+    }
+    sleep_cv.notify_all();
+    for (std::thread& worker : workers) worker.join();
+}
+
+void ThreadPool::Queue::push_back(Entry&& entry) {
+    const uint32_t capacity = (uint32_t)tasks.size();
+    if (count == capacity) {
+        /* Grow the ring buffer, and unwrap the tasks to its start */
+        std::vector<Entry> grown(std::max(16u, capacity * 2u));
+        for (uint32_t i = 0u; i < count; ++i) grown[i] = std::move(tasks[(head + i) % capacity]);
+        tasks.swap(grown);
+        head = 0u;
+    }
+    tasks[(head + count++) % tasks.size()] = std::move(entry);
+}
+
+ThreadPool::Entry ThreadPool::Queue::pop_back() {
+    return std::move(tasks[(head + --count) % tasks.size()]);
+}
+
+ThreadPool::Entry ThreadPool::Queue::pop_front() {
+    Entry entry = std::move(tasks[head]);
+    head = (head + 1u) % (uint32_t)tasks.size(), count--;
+    return entry;
+}
+
+uint32_t ThreadPool::queue_index() const {
+    if (tls_pool == this) return tls_index;
+    return (uint32_t)workers.size(); /* External queue */
+}
+
+void ThreadPool::submit(TaskGroup& group, Task&& task) {
+    group.pending.fetch_add(1u, std::memory_order_relaxed);
+
+    /* Count the task before publishing it, so a worker which pops it can never decrement the count first */
+    const bool low = group.priority == Priority::LOW;
+    bool has_waiters = false;
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        (low ? queued_low : queued).fetch_add(1u, std::memory_order_relaxed);
+        has_waiters = waiters > 0u;
+    }
+
+    /* Push the task onto the queue of the calling thread, or the shared low priority queue */
+    Queue& queue = low ? low_queue : *queues[queue_index()];
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.push_back({std::move(task), &group});
+    }
+
+    /* Wake up a sleeping worker, and the waiting threads so they can help */
+    sleep_cv.notify_one();
+    if (has_waiters) done_cv.notify_all();
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+    const uint32_t index = queue_index();
+    const bool allow_low = group.priority == Priority::LOW;
+    while (group.pending.load(std::memory_order_acquire) > 0u) {
+        /* Help out while we wait */
+        if (run_one(index, allow_low)) continue;
+
+        /* Nothing left to help with, sleep until a task of the group finishes or new work arrives */
+        std::unique_lock<std::mutex> lock(sleep_lock);
+        waiters++;
+        done_cv.wait(lock, [this, &group, allow_low]() {
+            return group.pending.load(std::memory_order_acquire) == 0u || queued.load(std::memory_order_relaxed) > 0u ||
+                   (allow_low && queued_low.load(std::memory_order_relaxed) > 0u);
+        });
+        waiters--;
+    }
+}
+
+bool ThreadPool::run_one(const uint32_t index, const bool allow_low) {
+    Entry entry {};
+    bool found = false;
+
+    { /* Pop from the back of our own queue (most recent, best cache locality) */
+        Queue& queue = *queues[index];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.empty() == false) {
+            entry = queue.pop_back();
+            found = true;
+        }
+    }
+
+    /* Steal from the front of the other queues (oldest, likely the largest tasks) */
+    const uint32_t queue_count = (uint32_t)queues.size();
+    for (uint32_t i = 1u; i < queue_count && found == false; ++i) {
+        Queue& queue = *queues[(index + i) % queue_count];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.empty() == false) {
+            entry = queue.pop_front();
+            found = true;
+        }
+    }
+
+    /* Only run low priority tasks once there's no other work (most recent first, so nested work finishes first) */
+    bool low = false;
+    if (found == false && allow_low) {
+        std::lock_guard<std::mutex> guard(low_queue.lock);
+        if (low_queue.empty() == false) {
+            entry = low_queue.pop_back();
+            found = low = true;
+        }
+    }
+
+    if (found == false) return false;
+    (low ? queued_low : queued).fetch_sub(1u, std::memory_order_relaxed);
+
+    /* Run the task with the priority of its group, so groups it creates inherit it */
+    const Priority priority = std::exchange(tls_priority, entry.group->priority);
+    entry.task();
+    tls_priority = priority;
+
+    /* Wake up the threads waiting on the group once its last task finished */
+    if (entry.group->pending.fetch_sub(1u, std::memory_order_acq_rel) == 1u) {
+        { std::lock_guard<std::mutex> guard(sleep_lock); }
+        done_cv.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::worker_main(const uint32_t index) {
+    tls_pool = this;
+    tls_index = index;
+
+    for (;;) {
+        if (run_one(index, true)) continue;
+
+        /* Sleep until there's new work, or the pool is stopped */
+        std::unique_lock<std::mutex> lock(sleep_lock);
+        sleep_cv.wait(lock, [this]() {
+            return stop || queued.load(std::memory_order_relaxed) > 0u || queued_low.load(std::memory_order_relaxed) > 0u;
+        });
+        if (stop) return;
+    }
+}
+
+}  // namespace wyre
@@ -0,0 +1,145 @@
+/**
+ * @file system/thread-pool.h
+ * @brief Work-stealing thread pool.
+ */
+#pragma once
+
+#include <algorithm>          /* std::min, std::max */
+#include <atomic>             /* std::atomic */
+#include <condition_variable> /* std::condition_variable */
+#include <functional>         /* std::function */
+#include <memory>             /* std::unique_ptr */
+#include <mutex>              /* std::mutex */
+#include <thread>             /* std::thread */
+#include <vector>             /* std::vector */
+
+namespace wyre {
+
+/**
+ * @brief Work-stealing thread pool, used for task parallel CPU work. (e.g. BVH building)
+ *
+ * Each worker owns a task queue, it pops from the back of its own queue,
+ * and steals from the front of other queues once it runs out of work.
+ * Low priority tasks (e.g. background BVH builds) share one queue, workers only run them once there's no other work,
+ * and threads waiting on a high priority group never pick them up.
+ */
+class ThreadPool {
+   public:
+    using Task = std::function<void()>;
+
+    enum class Priority : uint8_t { HIGH, LOW };
+
+    /** @returns The priority of the task running on the calling thread. (high outside of tasks) */
+    static Priority current_priority();
+
+    /**
+     * @brief Group of tasks which can be waited on.
+     * Groups have the priority of the task they are created in by default, so the work split off by a task keeps its priority.
+     */
+    struct TaskGroup {
+        std::atomic<uint32_t> pending = 0u;
+        Priority priority = current_priority();
+
+        TaskGroup() = default;
+        explicit TaskGroup(const Priority priority) : priority(priority) {}
+    };
+
+    /**
+     * @param thread_count Total number of threads, including the thread calling `wait`.
+     * (0 = hardware concurrency)
+     */
+    explicit ThreadPool(uint32_t thread_count = 0u);
+    ~ThreadPool();
+
+    /* Non-copyable */
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /** @returns The total number of threads, including the thread calling `wait`. */
+    inline uint32_t size() const { return (uint32_t)workers.size() + 1u; }
+
+    /**
+     * @brief Submit a task to the pool as part of a task group, with the priority of the group.
+     */
+    void submit(TaskGroup& group, Task&& task);
+
+    /**
+     * @brief Wait for all the tasks in a group to finish.
+     * The calling thread will help execute tasks while waiting, low priority tasks only if the group is low priority.
+     */
+    void wait(TaskGroup& group);
+
+    /**
+     * @brief Execute `func(begin, end)` over a range, split into chunks of at least `grain` elements.
+     * Blocks until the entire range has been processed.
+     */
+    template <typename F>
+    void parallel_for(const uint32_t count, const uint32_t grain, F&& func);
+
+   private:
+    struct Entry {
+        Task task {};
+        TaskGroup* group = nullptr;
+    };
+
+    /* Task queue, a ring buffer which keeps its capacity, so submitting tasks doesn't allocate once it's warmed up. */
+    struct Queue {
+        std::mutex lock {};
+        std::vector<Entry> tasks {};
+        uint32_t head = 0u, count = 0u;
+
+        inline bool empty() const { return count == 0u; }
+        /** @brief Push a task onto the back of the queue, growing it if it's full. */
+        void push_back(Entry&& entry);
+        /** @brief Pop the task at the back of the queue. (most recent) */
+        Entry pop_back();
+        /** @brief Pop the task at the front of the queue. (oldest) */
+        Entry pop_front();
+    };
+
+    std::vector<std::thread> workers {};
+    /* One queue per worker, the last queue is shared by external threads. */
+    std::vector<std::unique_ptr<Queue>> queues {};
+    /* Queue of the low priority tasks, shared by all threads. */
+    Queue low_queue {};
+
+    /* Number of high & low priority tasks waiting in the queues, counted before a task is pushed & after it is popped. */
+    std::atomic<uint32_t> queued = 0u, queued_low = 0u;
+    std::mutex sleep_lock {};
+    /* Idle workers sleep on `sleep_cv`, threads in `wait` on `done_cv`. */
+    std::condition_variable sleep_cv {}, done_cv {};
+    /* Number of threads sleeping in `wait`. (guarded by `sleep_lock`) */
+    uint32_t waiters = 0u;
+    bool stop = false;
+
+    /** @returns The queue index owned by the calling thread. */
+    uint32_t queue_index() const;
+
+    /** @brief Try to execute a single task, starting with the given queue. (and the low priority queue last, if allowed) */
+    bool run_one(const uint32_t index, const bool allow_low);
+
+    /** @brief Worker thread main loop. */
+    void worker_main(const uint32_t index);
+};
+
+template <typename F>
+inline void ThreadPool::parallel_for(const uint32_t count, const uint32_t grain, F&& func) {
+    if (count == 0u) return;
+
+    /* Split the range into roughly 4 chunks per thread */
+    const uint32_t chunks = std::max(1u, std::min(size() * 4u, count / std::max(grain, 1u)));
+    const uint32_t chunk_size = (count + chunks - 1u) / chunks;
+    if (chunks == 1u) {
+        func(0u, count);
+        return;
+    }
+
+    TaskGroup group {};
+    for (uint32_t begin = 0u; begin < count; begin += chunk_size) {
+        const uint32_t end = std::min(begin + chunk_size, count);
+        submit(group, [&func, begin, end]() { func(begin, end); });
+    }
+    wait(group);
+}
+
+}  // namespace wyre
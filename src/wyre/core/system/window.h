@@ -12,7 +12,8 @@
  * TODO: Write out all Window functions.
  */
 
-#if defined(_WIN32) || defined(_WIN64)
+/* Windows & Linux share the SDL & Vulkan platform layer */
+#if defined(_WIN32) || defined(_WIN64) || defined(__linux__)
 #include "wyre/platform/windows/window.h"
 #else
 #error "platform is not supported."
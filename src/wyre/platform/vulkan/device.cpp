@@ -5,6 +5,8 @@
 #include "device.h"
 
 #include <algorithm> /* std::min, std::max */
+#include <array>     /* std::array */
+#include <cstring>   /* strcmp, memcmp */
 
 #define VMA_IMPLEMENTATION
 #include <vk_mem_alloc.h>
@@ -22,6 +24,9 @@
 
 namespace wyre {
 
+/* Colour the render target is cleared to at the start of every frame. */
+const std::array<float, 4> CLEAR_COLOR {1.0f, 0.0f, 0.0f, 1.0f};
+
 /* Custom vulkan debug msg callback */
 inline VKAPI_ATTR VkBool32 VKAPI_CALL vk_debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type,
     const VkDebugUtilsMessengerCallbackDataEXT* cb_data, void* logger) {
@@ -39,10 +44,13 @@ inline VKAPI_ATTR VkBool32 VKAPI_CALL vk_debug_callback(VkDebugUtilsMessageSever
 /**
  * @brief Device initialization.
  */
-Result<void> Device::init(Logger& logger, const Window& window) {
-    /* Instance creation information */
+Result<void> Device::init(Logger& logger, const Window& window, const bool headless) {
+    this->logger = &logger;
+    this->headless = headless;
+
+    /* Instance creation information (headless devices need no surface extensions) */
     const vk::ApplicationInfo app_info("wyre", 1, "wyre", 1, VK_API_VERSION_1_3);
-    std::vector<const char*> i_extensions = get_sdl_extensions();
+    std::vector<const char*> i_extensions = headless ? std::vector<const char*>{} : get_sdl_extensions();
 #if DEBUG
     i_extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 #endif
@@ -99,7 +107,7 @@ Result<void> Device::init(Logger& logger, const Window& window) {
     }
 
     /* Create the native video output surface */
-    if (window.create_surface(instance, surface) == false) {
+    if (headless == false && window.create_surface(instance, surface) == false) {
         return Err("failed to create native video output surface.");
     }
 
@@ -119,7 +127,7 @@ Result<void> Device::init(Logger& logger, const Window& window) {
         return Err("failed to find graphics queue family properties.");
     }
 
-    { /* Check if the graphics queue family also supports present */
+    if (headless == false) { /* Check if the graphics queue family also supports present */
         const vk::ResultValue result = phy_device.getSurfaceSupportKHR((uint32_t)qf_graphics, surface);
         if (result.result != vk::Result::eSuccess || !result.value) return Err("graphics queue doesn't support present.");
         qf_present = qf_graphics;
@@ -127,13 +135,28 @@ Result<void> Device::init(Logger& logger, const Window& window) {
 
     float queue_priority = 0.0f;
     const vk::DeviceQueueCreateInfo device_queue_ci(vk::DeviceQueueCreateFlags(), (uint32_t)qf_graphics, 1, &queue_priority);
+
+    /* Enable the memory budget extension if it's available, so the memory registry reports real heap budgets */
+    std::vector<const char*> device_ext = DEVICE_EXT;
+    if (headless) std::erase_if(device_ext, [](const char* ext) { return strcmp(ext, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0; });
+    bool memory_budget = false;
+    {
+        const vk::ResultValue result = phy_device.enumerateDeviceExtensionProperties();
+        if (result.result == vk::Result::eSuccess) {
+            for (const vk::ExtensionProperties& ext : result.value) {
+                if (strcmp(ext.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) memory_budget = true;
+            }
+        }
+        if (memory_budget) device_ext.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+
     { /* Create the logical device */
         vk::StructureChain<vk::DeviceCreateInfo, vk::PhysicalDeviceDynamicRenderingFeaturesKHR> chain;
 
         /* Device creation info */
         const std::vector<const char*> layers = i_layers;
         vk::DeviceCreateInfo& device_ci = chain.get<vk::DeviceCreateInfo>();
-        device_ci.setPEnabledExtensionNames(DEVICE_EXT);
+        device_ci.setPEnabledExtensionNames(device_ext);
         device_ci.setPEnabledLayerNames(layers);
         device_ci.setQueueCreateInfos(device_queue_ci);
 
@@ -171,93 +194,12 @@ Result<void> Device::init(Logger& logger, const Window& window) {
         imm_cmd = result.value.front();
     }
 
-    std::vector<vk::SurfaceFormatKHR> formats = {};
-    { /* Get the supported formats for our native video output surface */
-        const vk::ResultValue result = phy_device.getSurfaceFormatsKHR(surface);
-        if (result.result != vk::Result::eSuccess) return Err("failed to get formats for native video output surface.");
-        formats = result.value;
-    }
-
-    if (formats.empty()) {
-        return Err("no formats for native video output surface.");
-    }
-
-    /* Simply grab the first available format, if undefined choose RGBA8 unorm */
-    const vk::Format first_format = formats[0].format;
-    swapchain_fmt = (first_format == vk::Format::eUndefined) ? vk::Format::eB8G8R8A8Unorm : first_format;
-
-    vk::SurfaceCapabilitiesKHR capabilities = {};
-    { /* Get the native video output surface capabilities */
-        const vk::ResultValue result = phy_device.getSurfaceCapabilitiesKHR(surface);
-        if (result.result != vk::Result::eSuccess) return Err("failed to get native video output surface capabilities.");
-        capabilities = result.value;
-    }
-
-    /* Find the extent of the swapchain */
-    vk::Extent2D swapchain_extent = {};
-    const uint32_t max_val = std::numeric_limits<uint32_t>::max();
-    if (capabilities.currentExtent.width == max_val) {
-        /* If the surface size is undefined, we can pick our own preferred resolution */
-        const vk::Extent2D min = capabilities.minImageExtent;
-        const vk::Extent2D max = capabilities.maxImageExtent;
-        swapchain_extent.width = std::min(std::max(window.width, min.width), max.width);
-        swapchain_extent.height = std::min(std::max(window.height, min.height), max.height);
+    /* Create the swapchain, headless devices render into offscreen targets instead (created with the attachments) */
+    if (headless == false) {
+        const Result<void> result = create_swapchain(window);
+        if (result.is_err()) return Err(result.unwrap_err());
     } else {
-        /* If the surface size is defined, the swapchain size MUST match */
-        swapchain_extent = capabilities.currentExtent;
-        /* TODO: throw a warning here, I feel like this is usually not a good case... */
-    }
-
-    /* Swapchain image count */
-    if (capabilities.maxImageCount < BUFFERS) {
-        return Err("native video output surface does not support image count.");
-    }
-
-    /* Swapchain present mode */
-    const vk::PresentModeKHR present_mode = vk::PresentModeKHR::eFifo;
-
-    /* We want to present without any special transformations (identity) */
-    const vk::SurfaceTransformFlagBitsKHR preferred_transform = vk::SurfaceTransformFlagBitsKHR::eIdentity;
-    const bool transform_available = (bool)(capabilities.supportedTransforms & preferred_transform);
-    const vk::SurfaceTransformFlagBitsKHR transform = transform_available ? preferred_transform : capabilities.currentTransform;
-
-    /* No alpha blending between frames */
-    const vk::CompositeAlphaFlagBitsKHR comp_alpha = vk::CompositeAlphaFlagBitsKHR::eOpaque;
-    const vk::ColorSpaceKHR color_space = vk::ColorSpaceKHR::eSrgbNonlinear;
-
-    vk::SwapchainCreateInfoKHR swapchain_ci(vk::SwapchainCreateFlagsKHR(), surface, BUFFERS, swapchain_fmt, color_space, swapchain_extent, 1,
-        vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferDst, vk::SharingMode::eExclusive, {}, transform, comp_alpha,
-        present_mode, true, nullptr);
-
-    /* Catch the case where the graphics and present queue family aren't the same */
-    const uint32_t qf_indices[2] = {(uint32_t)qf_graphics, (uint32_t)qf_present};
-    if (qf_graphics != qf_present) {
-        /* Create the swapchain with image sharing mode as concurrent */
-        swapchain_ci.imageSharingMode = vk::SharingMode::eConcurrent;
-        swapchain_ci.queueFamilyIndexCount = 2;
-        swapchain_ci.pQueueFamilyIndices = qf_indices;
-    }
-
-    { /* Create the swapchain */
-        const vk::ResultValue result = device.createSwapchainKHR(swapchain_ci);
-        if (result.result != vk::Result::eSuccess) return Err("failed to create swapchain.");
-        swapchain = result.value;
-    }
-
-    { /* Retrieve the swapchain image resources */
-        const vk::ResultValue result = device.getSwapchainImagesKHR(swapchain);
-        if (result.result != vk::Result::eSuccess) return Err("failed retrieve swapchain images.");
-        const std::vector<vk::Image> target_images = result.value;
-
-        /* Create an image view (render target) for each frame buffer */
-        const vk::ImageSubresourceRange range = {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1};
-        vk::ImageViewCreateInfo target_view_ci({}, {}, vk::ImageViewType::e2D, swapchain_fmt, {}, range);
-        for (size_t i = 0; i < BUFFERS; ++i) {
-            target_view_ci.image = target_images[i];
-            const vk::ResultValue result = device.createImageView(target_view_ci);
-            if (result.result != vk::Result::eSuccess) return Err("failed to create swapchain image view.");
-            targets[i] = {result.value, target_images[i]};
-        }
+        swapchain_fmt = vk::Format::eR8G8B8A8Unorm;
     }
 
     { /* Create in sync primitives for each frame */
@@ -285,27 +227,37 @@ Result<void> Device::init(Logger& logger, const Window& window) {
     allocator_ci.physicalDevice = phy_device;
     allocator_ci.device = device;
     allocator_ci.instance = instance;
-    allocator_ci.flags = {};
+    allocator_ci.flags = memory_budget ? (VmaAllocatorCreateFlags)VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT : (VmaAllocatorCreateFlags)0u;
     if (vmaCreateAllocator(&allocator_ci, &allocator) != VK_SUCCESS) {
         return Err("failed to create vulkan memory allocator.");
     }
 
+    /* Create the readback slots */
+    if (!readbacks.init(*this)) return Err("failed to allocate readback slots.");
+
     /* Create the rendering attachments */
     const vk::Extent2D win_size{window.width, window.height};
     for (size_t i = 0; i < BUFFERS; ++i) {
-        /* Render view */
-        const buf::AllocParams alloc_ci{VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT};
-        if (!buf::alloc(*this, frames[i].render_view, {sizeof(RenderView), buf::Usage::eUniformBuffer | buf::Usage::eTransferDst}, alloc_ci)) {
+        /* Render view (GPU only, it's uploaded through the staging ring every frame) */
+        if (!buf::alloc(*this, frames[i].render_view, {sizeof(RenderView), buf::Usage::eUniformBuffer | buf::Usage::eTransferDst}, {buf::Placement::GPU_ONLY, MemoryCategory::GBUFFER, "render view"})) {
             return Err("failed to allocate render view buffer.");
         }
-        const RenderView default_renderview {};
-        buf::copy_raw(*this, frames[i].render_view, 0u, frames[i].render_view.size, &default_renderview);
+        /* Staging ring */
+        if (!frames[i].staging.init(*this)) return Err("failed to allocate staging ring.");
         /* Albedo attachment */
-        const bool r_albedo = img::RenderAttachment::make(*this, frames[i].albedo, win_size, vk::Format::eR8G8B8A8Unorm, img::Usage::eColorAttachment | img::Usage::eStorage);
+        const bool r_albedo = img::RenderAttachment::make(*this, frames[i].albedo, win_size, vk::Format::eR8G8B8A8Unorm, img::Usage::eColorAttachment | img::Usage::eStorage, "albedo");
         if (r_albedo == false) return Err("failed to create albedo render attachment.");
         /* Normal attachment */
-        const bool r_normal = img::RenderAttachment::make(*this, frames[i].normal_depth, win_size, vk::Format::eR32G32B32A32Sfloat, img::Usage::eColorAttachment | img::Usage::eStorage);
+        const bool r_normal = img::RenderAttachment::make(*this, frames[i].normal_depth, win_size, vk::Format::eR32G32B32A32Sfloat, img::Usage::eColorAttachment | img::Usage::eStorage, "normal depth");
         if (r_normal == false) return Err("failed to create normal render attachment.");
+        /* Offscreen render target (headless) */
+        if (headless) {
+            const img::UsageFlags usage = img::Usage::eColorAttachment | img::Usage::eTransferDst | img::Usage::eTransferSrc;
+            if (img::RenderAttachment::make(*this, offscreen[i], win_size, swapchain_fmt, usage, "offscreen target") == false) {
+                return Err("failed to create offscreen render target.");
+            }
+            targets[i] = {offscreen[i].view, offscreen[i].image};
+        }
     }
 
     { /* Create static descriptor pool */
@@ -363,6 +315,102 @@ Result<void> Device::init(Logger& logger, const Window& window) {
     return Ok();
 }
 
+/**
+ * @brief Create the swapchain & its render targets.
+ */
+Result<void> Device::create_swapchain(const Window& window) {
+    std::vector<vk::SurfaceFormatKHR> formats = {};
+    { /* Get the supported formats for our native video output surface */
+        const vk::ResultValue result = phy_device.getSurfaceFormatsKHR(surface);
+        if (result.result != vk::Result::eSuccess) return Err("failed to get formats for native video output surface.");
+        formats = result.value;
+    }
+
+    if (formats.empty()) {
+        return Err("no formats for native video output surface.");
+    }
+
+    /* Simply grab the first available format, if undefined choose RGBA8 unorm */
+    const vk::Format first_format = formats[0].format;
+    swapchain_fmt = (first_format == vk::Format::eUndefined) ? vk::Format::eB8G8R8A8Unorm : first_format;
+
+    vk::SurfaceCapabilitiesKHR capabilities = {};
+    { /* Get the native video output surface capabilities */
+        const vk::ResultValue result = phy_device.getSurfaceCapabilitiesKHR(surface);
+        if (result.result != vk::Result::eSuccess) return Err("failed to get native video output surface capabilities.");
+        capabilities = result.value;
+    }
+
+    /* Find the extent of the swapchain */
+    vk::Extent2D swapchain_extent = {};
+    const uint32_t max_val = std::numeric_limits<uint32_t>::max();
+    if (capabilities.currentExtent.width == max_val) {
+        /* If the surface size is undefined, we can pick our own preferred resolution */
+        const vk::Extent2D min = capabilities.minImageExtent;
+        const vk::Extent2D max = capabilities.maxImageExtent;
+        swapchain_extent.width = std::min(std::max(window.width, min.width), max.width);
+        swapchain_extent.height = std::min(std::max(window.height, min.height), max.height);
+    } else {
+        /* If the surface size is defined, the swapchain size MUST match */
+        swapchain_extent = capabilities.currentExtent;
+        /* TODO: throw a warning here, I feel like this is usually not a good case... */
+    }
+
+    /* Swapchain image count */
+    if (capabilities.maxImageCount < BUFFERS) {
+        return Err("native video output surface does not support image count.");
+    }
+
+    /* Swapchain present mode */
+    const vk::PresentModeKHR present_mode = vk::PresentModeKHR::eFifo;
+
+    /* We want to present without any special transformations (identity) */
+    const vk::SurfaceTransformFlagBitsKHR preferred_transform = vk::SurfaceTransformFlagBitsKHR::eIdentity;
+    const bool transform_available = (bool)(capabilities.supportedTransforms & preferred_transform);
+    const vk::SurfaceTransformFlagBitsKHR transform = transform_available ? preferred_transform : capabilities.currentTransform;
+
+    /* No alpha blending between frames */
+    const vk::CompositeAlphaFlagBitsKHR comp_alpha = vk::CompositeAlphaFlagBitsKHR::eOpaque;
+    const vk::ColorSpaceKHR color_space = vk::ColorSpaceKHR::eSrgbNonlinear;
+
+    vk::SwapchainCreateInfoKHR swapchain_ci(vk::SwapchainCreateFlagsKHR(), surface, BUFFERS, swapchain_fmt, color_space, swapchain_extent, 1,
+        vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferDst, vk::SharingMode::eExclusive, {}, transform, comp_alpha,
+        present_mode, true, nullptr);
+
+    /* Catch the case where the graphics and present queue family aren't the same */
+    const uint32_t qf_indices[2] = {(uint32_t)qf_graphics, (uint32_t)qf_present};
+    if (qf_graphics != qf_present) {
+        /* Create the swapchain with image sharing mode as concurrent */
+        swapchain_ci.imageSharingMode = vk::SharingMode::eConcurrent;
+        swapchain_ci.queueFamilyIndexCount = 2;
+        swapchain_ci.pQueueFamilyIndices = qf_indices;
+    }
+
+    { /* Create the swapchain */
+        const vk::ResultValue result = device.createSwapchainKHR(swapchain_ci);
+        if (result.result != vk::Result::eSuccess) return Err("failed to create swapchain.");
+        swapchain = result.value;
+    }
+
+    { /* Retrieve the swapchain image resources */
+        const vk::ResultValue result = device.getSwapchainImagesKHR(swapchain);
+        if (result.result != vk::Result::eSuccess) return Err("failed retrieve swapchain images.");
+        const std::vector<vk::Image> target_images = result.value;
+
+        /* Create an image view (render target) for each frame buffer */
+        const vk::ImageSubresourceRange range = {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1};
+        vk::ImageViewCreateInfo target_view_ci({}, {}, vk::ImageViewType::e2D, swapchain_fmt, {}, range);
+        for (size_t i = 0; i < BUFFERS; ++i) {
+            target_view_ci.image = target_images[i];
+            const vk::ResultValue result = device.createImageView(target_view_ci);
+            if (result.result != vk::Result::eSuccess) return Err("failed to create swapchain image view.");
+            targets[i] = {result.value, target_images[i]};
+        }
+    }
+
+    return Ok();
+}
+
 /**
  * @brief Setup the current frame for rendering.
  */
@@ -377,19 +425,29 @@ bool Device::start_frame() {
 
     /* Wait for the frame to be available */
     if (device.waitForFences(fence, true, UINT64_MAX) != vk::Result::eSuccess) return false;
-    if (device.resetFences(fence) != vk::Result::eSuccess) return false;
 
-    /* Acquire swapchain image */
-    const vk::ResultValue result = device.acquireNextImageKHR(swapchain, UINT64_MAX, image_acquired);
-    if (result.result != vk::Result::eSuccess) return false;
-    sci = result.value;
+    /* The uploads & readbacks of the previous use of this frame finished (both only happen once per frame, also when a failed start is retried) */
+    /* (losing readbacks only costs their results, it doesn't stop the frame) */
+    get_frame().staging.reset(*this);
+    if (!readbacks.begin_frame(*this)) logger->log(LogGroup::GRAPHICS_API, LogLevel::WARNING, "failed to resolve readbacks of frame %u.", fid);
+
+    /* Acquire swapchain image once per frame, a retry keeps the image whose semaphore is already signalled */
+    /* (headless devices have an offscreen target per frame) */
+    if (headless) {
+        sci = fbi;
+    } else if (acquired_fid != fid) {
+        const vk::ResultValue result = device.acquireNextImageKHR(swapchain, UINT64_MAX, image_acquired);
+        if (result.result != vk::Result::eSuccess && result.result != vk::Result::eSuboptimalKHR) return false;
+        sci = result.value;
+        acquired_fid = fid;
+    }
     const RenderTarget& rt = get_rt();
 
     /* Signal that this command buffer will only be submitted *once* */
     if (cmd.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit}) != vk::Result::eSuccess) return false;
 
     /* Clear color & range */
-    const vk::ClearColorValue clear_value = vk::ClearColorValue({1.0f, 0.0f, 0.0f, 1.0f});
+    const vk::ClearColorValue clear_value = vk::ClearColorValue(CLEAR_COLOR);
     const vk::ImageSubresourceRange clear_range = {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1};
 
     /* Transition image into transfer destination format */
@@ -399,6 +457,13 @@ bool Device::start_frame() {
 
     /* Queue a clear command */
     cmd.clearColorImage(rt.img, vk::ImageLayout::eTransferDstOptimal, clear_value, {clear_range});
+
+    /* Reset the fence last, so a frame which failed before this can be retried without waiting on the fence forever */
+    /* (the command buffer is ended, so the retry can begin it again) */
+    if (device.resetFences(fence) != vk::Result::eSuccess) {
+        (void)cmd.end();
+        return false;
+    }
     return true;
 }
 
@@ -413,13 +478,29 @@ void Device::end_frame() {
     const vk::Semaphore& render_complete = get_frame().render_complete;
     const RenderTarget& rt = get_rt();
 
-    /* Transition image into presentable format */
-    img::barrier(cmd, rt.img,
-        /* Src */ img::PStage::eTopOfPipe, img::Layout::eUndefined,
-        /* Dst */ img::PStage::eBottomOfPipe, img::Layout::ePresentSrcKHR);
+    if (headless) {
+        /* Keep the offscreen target contents, ready to be copied from */
+        img::barrier(cmd, rt.img,
+            /* Src */ img::PStage::eColorAttachmentOutput, img::Access::eColorAttachmentWrite, img::Layout::eColorAttachmentOptimal,
+            /* Dst */ img::PStage::eTransfer, img::Access::eTransferRead, img::Layout::eTransferSrcOptimal);
+    } else {
+        /* Transition image into presentable format */
+        img::barrier(cmd, rt.img,
+            /* Src */ img::PStage::eTopOfPipe, img::Layout::eUndefined,
+            /* Dst */ img::PStage::eBottomOfPipe, img::Layout::ePresentSrcKHR);
+    }
 
     if (cmd.end() != vk::Result::eSuccess) return; /* Stop recording commands */
 
+    /* Headless frames are only submitted, there is nothing to wait for or present to */
+    if (headless) {
+        vk::SubmitInfo info{};
+        info.setCommandBuffers(cmd);
+        if (queue.submit(info, fence) != vk::Result::eSuccess) return;
+        fid += 1;
+        return;
+    }
+
     /* Submit work to the GPU (waits for image acquired, signals when render is complete) */
     const vk::PipelineStageFlags wait_stage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
     const vk::SubmitInfo info = vk::SubmitInfo(image_acquired, wait_stage, cmd, render_complete);
@@ -433,6 +514,57 @@ void Device::end_frame() {
     fid += 1;
 }
 
+/**
+ * @brief Smoke test a headless device. (one frame, read back from its offscreen target)
+ */
+Result<void> Device::smoke_frame(const Window& window) {
+    if (headless == false) return Err("smoke frames need a headless device.");
+    if (start_frame() == false) return Err("failed to start the smoke frame.");
+
+    /* Nothing renders into the target, leave it in the layout the render stages leave it in */
+    img::barrier(get_frame().gcb, get_rt().img,
+        /* Src */ img::PStage::eTransfer, img::Access::eTransferWrite, img::Layout::eTransferDstOptimal,
+        /* Dst */ img::PStage::eColorAttachmentOutput, img::Access::eColorAttachmentWrite, img::Layout::eColorAttachmentOptimal);
+
+    /* The frame index only advances once the frame was submitted */
+    const uint32_t frame = fid;
+    end_frame();
+    if (fid == frame) return Err("failed to submit the smoke frame.");
+
+    /* Copy the target into host memory once the frame finished (headless targets are RGBA8) */
+    const RenderTarget& rt = get_rt();
+    const buf::Size size = (buf::Size)window.width * window.height * 4u;
+    buf::Buffer readback {};
+    if (!buf::alloc(*this, readback, {size, buf::Usage::eTransferDst}, {buf::Placement::READBACK, MemoryCategory::STAGING, "smoke readback"}, false)) {
+        return Err("failed to allocate the smoke readback buffer.");
+    }
+    const vk::BufferImageCopy region(0u, 0u, 0u, {vk::ImageAspectFlagBits::eColor, 0u, 0u, 1u}, {0, 0, 0}, {window.width, window.height, 1u});
+    const bool copied = wait_idle() && imm_submit([&](vk::CommandBuffer cmd) {
+        cmd.copyImageToBuffer(rt.img, vk::ImageLayout::eTransferSrcOptimal, readback.buffer, region);
+        buf::barrier(cmd, readback, 0u, size, buf::PStage::eTransfer, buf::Access::eTransferWrite, buf::PStage::eHost, buf::Access::eHostRead);
+    });
+    VmaAllocationInfo info {};
+    vmaGetAllocationInfo(allocator, readback.memory, &info);
+    const uint8_t* pixels = (const uint8_t*)info.pMappedData;
+    if (!copied || pixels == nullptr || vmaInvalidateAllocation(allocator, readback.memory, 0u, size) != VK_SUCCESS) {
+        readback.free(*this);
+        return Err("failed to read back the smoke frame.");
+    }
+
+    /* Every pixel should hold the clear colour */
+    uint8_t expected[4] {};
+    for (uint32_t c = 0u; c < 4u; ++c) expected[c] = (uint8_t)(CLEAR_COLOR[c] * 255.0f + 0.5f);
+    for (buf::Size p = 0u; p < size; p += 4u) {
+        if (memcmp(pixels + p, expected, 4u) == 0) continue;
+        const Result<void> mismatch = Err("smoke frame pixel %llu is (%u, %u, %u, %u), expected (%u, %u, %u, %u).", (unsigned long long)(p / 4u), pixels[p],
+                                          pixels[p + 1u], pixels[p + 2u], pixels[p + 3u], expected[0], expected[1], expected[2], expected[3]);
+        readback.free(*this);
+        return mismatch;
+    }
+    readback.free(*this);
+    return Ok();
+}
+
 /**
  * @brief Queue some commands on the GPU to be enqueued immediately.
  */
@@ -469,12 +601,15 @@ Result<void> Device::destroy() {
 
     /* Destroy the frame data & render targets */
     for (size_t i = 0; i < BUFFERS; ++i) {
-        device.destroyImageView(targets[i].view);
+        /* Render targets (offscreen targets own their views) */
+        if (headless) offscreen[i].free(*this);
+        else device.destroyImageView(targets[i].view);
         /* Sync primitives */
         device.destroyFence(frames[i].flight_fence);
         device.destroySemaphore(frames[i].image_acquired);
         device.destroySemaphore(frames[i].render_complete);
         frames[i].render_view.free(*this);
+        frames[i].staging.free(*this);
         /* Render attachments */
         frames[i].albedo.free(*this);
         frames[i].normal_depth.free(*this);
@@ -483,6 +618,8 @@ Result<void> Device::destroy() {
         frames[i].attach_store_desc.free(*this);
     }
 
+    readbacks.free(*this);
+
     /* Destroy the Vulkan Memory Allocator */
     vmaDestroyAllocator(allocator);
 
@@ -496,9 +633,9 @@ Result<void> Device::destroy() {
     /* Destroy immediate resources */
     device.destroyFence(imm_fence);
 
-    /* Destroy the swapchain and native video output surface */
-    device.destroySwapchainKHR(swapchain);
-    instance.destroySurfaceKHR(surface);
+    /* Destroy the swapchain and native video output surface (headless devices don't load their extensions, so there is nothing to call) */
+    if (swapchain) device.destroySwapchainKHR(swapchain);
+    if (surface) instance.destroySurfaceKHR(surface);
 
     /* Free the command buffer pool */
     device.destroyCommandPool(cmd_pool);
@@ -9,6 +9,8 @@
 #include "wyre/defines.h"
 #include "frame-data.h"
 #include "hardware/descriptor.h"
+#include "hardware/memory.h"   /* MemoryRegistry */
+#include "hardware/readback.h" /* ReadbackQueue */
 
 #include "wyre/result.h" /* Result<T> */
 
@@ -33,16 +35,26 @@ class Device {
     ~Device() = default;
 
     /* Engine required functions */
-    Result<void> init(Logger& logger, const Window& window);
+    Result<void> init(Logger& logger, const Window& window, const bool headless = false);
     bool start_frame();
     void end_frame();
     Result<void> destroy();
 
+    /**
+     * @brief Smoke test a headless device, one frame without any render stage is rendered & its offscreen target is read back.
+     * @return Err unless every pixel of the target holds the clear colour of the frame.
+     */
+    Result<void> smoke_frame(const Window& window);
+
     /** @brief Wait for the GPU to become idle, can be used before exiting the engine. */
     bool wait_idle() const { return queue.waitIdle() == vk::Result::eSuccess; };
 
+    /** @brief Create the swapchain & its render targets. (not used by headless devices) */
+    Result<void> create_swapchain(const Window& window);
+
    public:
     inline const FrameData& get_frame() const { return frames[fbi]; };
+    inline FrameData& get_frame() { return frames[fbi]; };
     inline const RenderTarget& get_rt() const { return targets[sci]; };
 
     /* Platform specific data */
@@ -59,6 +71,7 @@ class Device {
     VmaAllocator allocator = nullptr;        /* Vulkan memory allocator. */
     vk::Fence imm_fence = nullptr;           /* Immediate submit fence. */
     vk::CommandBuffer imm_cmd = nullptr;     /* Immediate command buffer. */
+    Logger* logger = nullptr;                /* Logger, for the memory audit log. */
 
     /* Descriptor pool with static lifetime. */
     vk::DescriptorPool static_desc_pool = nullptr;
@@ -67,9 +80,18 @@ class Device {
 
     FrameData frames[BUFFERS] = {};
     RenderTarget targets[BUFFERS] = {};
+    /* Offscreen render targets, which replace the swapchain of headless devices. */
+    img::RenderAttachment offscreen[BUFFERS] = {};
+    /* Headless devices have no surface or swapchain, and never present. */
+    bool headless = false;
+    /* Asynchronous GPU to CPU readbacks, resolved once their frame finished. */
+    ReadbackQueue readbacks = {};
+    /* Live GPU allocations per category. (mutable, resources are allocated & freed through const devices) */
+    mutable MemoryRegistry memory = {};
     uint32_t fid = 0; /* Frame index */
     uint32_t fbi = 0; /* Frame Buffer Index (FBI) */
     uint32_t sci = 0; /* Swapchain image index */
+    uint32_t acquired_fid = ~0u; /* Frame index the swapchain image was acquired for */
 
 #if DEBUG
     vk::DebugUtilsMessengerEXT debug_msgr = nullptr;
@@ -7,6 +7,7 @@
 #include "hardware/image.h"      /* RenderAttachment */
 #include "hardware/descriptor.h" /* DescriptorSet */
 #include "hardware/buffer.h"     /* Buffer */
+#include "hardware/staging.h"    /* StagingRing */
 
 namespace wyre {
 
@@ -41,6 +42,8 @@ struct FrameData {
     vk::CommandBuffer gcb = nullptr;
     /* Constant buffer for camera state. */
     buf::Buffer render_view{};
+    /* Staging memory for the uploads of this frame, reclaimed once the flight fence signalled. */
+    StagingRing staging{};
     /* Rendering attachments. */
     img::RenderAttachment albedo{};
     img::RenderAttachment normal_depth{}; /* rgb = normal, a = depth */
@@ -6,16 +6,63 @@
 
 #include "../device.h"
 
+#include "wyre/core/system/log.h"
+
 namespace wyre::buf {
 
 BufferParams::BufferParams(buf::Size size, buf::UsageFlags usage, buf::ShareMode share_mode)
     : size(size), usage(usage), share_mode(share_mode) {}
 
-AllocParams::AllocParams(VmaMemoryUsage usage) : usage(usage) {}
+AllocParams::AllocParams(Placement placement, MemoryCategory category, const char* name) : placement(placement), category(category), name(name) {
+    switch (placement) {
+        case Placement::GPU_ONLY:
+            usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+            break;
+        case Placement::UPLOAD:
+            flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+            usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+            break;
+        case Placement::READBACK:
+            flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+            usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+            break;
+    }
+}
 
-AllocParams::AllocParams(VmaAllocationCreateFlags flags, VmaMemoryUsage usage) : flags(flags), usage(usage) {}
+void Buffer::free(const Device& device) {
+    device.memory.untrack(memory);
+    vmaDestroyBuffer(device.get_allocator(), buffer, memory);
+}
 
-void Buffer::free(const Device& device) { vmaDestroyBuffer(device.get_allocator(), buffer, memory); }
+/** @returns The name of a placement, for the memory audit log. */
+static const char* placement_name(const Placement placement) {
+    switch (placement) {
+        case Placement::GPU_ONLY: return "gpu only";
+        case Placement::UPLOAD: return "upload";
+        case Placement::READBACK: return "readback";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Log the memory type a named buffer was placed in, warning about GPU buffers which didn't end up in device local memory.
+ * (shaders read those across the bus, e.g. PCIe on discrete GPUs)
+ */
+static void audit(const Device& device, const buf::Buffer& buffer, const AllocParams& alloc_params) {
+    VmaAllocationInfo info {};
+    vmaGetAllocationInfo(device.get_allocator(), buffer.memory, &info);
+    VkMemoryPropertyFlags props = 0u;
+    vmaGetMemoryTypeProperties(device.get_allocator(), info.memoryType, &props);
+
+    const bool device_local = props & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, host_visible = props & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    const bool cached = props & VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    const bool misplaced = (alloc_params.placement == Placement::GPU_ONLY && device_local == false) ||
+                           (alloc_params.placement != Placement::GPU_ONLY && host_visible == false);
+    device.logger->log(LogGroup::GRAPHICS_API, misplaced ? LogLevel::WARNING : LogLevel::INFO, "buffer '%s' (%.1f KB, %s) placed in memory type %u:%s%s%s%s",
+                       alloc_params.name, buffer.size / 1e3, placement_name(alloc_params.placement), info.memoryType,
+                       device_local ? " device local" : "", host_visible ? " host visible" : "", cached ? " host cached" : "",
+                       misplaced ? " (misplaced)" : "");
+}
 
 /**
  * @brief Allocate a new buffer.
@@ -25,7 +72,9 @@ bool alloc(const Device& device, buf::Buffer& buffer, const BufferParams buf_par
     const VkBufferCreateInfo buf_ci = vk::BufferCreateInfo({}, buf_params.size, buf_params.usage, buf_params.share_mode);
 
     /* Memory blueprint */
-    const VmaAllocationCreateInfo mem_ci{.flags = alloc_params.flags, .usage = alloc_params.usage};
+    VmaAllocationCreateInfo mem_ci{};
+    mem_ci.flags = alloc_params.flags;
+    mem_ci.usage = alloc_params.usage;
 
     /* Create the buffer & allocate it using VMA */
     VkBuffer buf;
@@ -34,6 +83,13 @@ bool alloc(const Device& device, buf::Buffer& buffer, const BufferParams buf_par
 
     /* Return the buffer with its allocation */
     buffer = buf::Buffer(buf, mem, buf_params.size);
+    VmaAllocationInfo info {};
+    vmaGetAllocationInfo(device.get_allocator(), mem, &info);
+    device.memory.track(mem, alloc_params.category, alloc_params.name, info.size);
+    if (alloc_params.name) {
+        vmaSetAllocationName(device.get_allocator(), mem, alloc_params.name);
+        if (device.logger) audit(device, buffer, alloc_params);
+    }
     if (fill && buf_params.usage & vk::BufferUsageFlagBits::eTransferDst) buf::fill(device, 0x00, buffer, buffer.size);
     return true;
 }
@@ -45,13 +101,16 @@ bool alloc(const Device& device, buf::Buffer& buffer, const BufferParams buf_par
  * @param usage Flags for how the buffer will be used.
  * @param data A pointer to the data.
  * @param size The size of the data in bytes.
+ * @param category Category the buffer is accounted under in the memory registry.
+ * @param name Debug name of the buffer.
  */
-bool alloc_upload(const Device& device, buf::Buffer& buffer, buf::UsageFlags usage, const void* data, const buf::Size size) {
+bool alloc_upload(const Device& device, buf::Buffer& buffer, buf::UsageFlags usage, const void* data, const buf::Size size, MemoryCategory category,
+                  const char* name) {
     const VmaAllocator allocator = device.get_allocator();
 
     /* Allocation parameters */
-    const buf::AllocParams stage_ci {VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT};
-    const buf::AllocParams buffer_ci {};
+    const buf::AllocParams stage_ci {Placement::UPLOAD, MemoryCategory::STAGING};
+    const buf::AllocParams buffer_ci {Placement::GPU_ONLY, category, name};
 
     /* Buffer usage flags */
     const vk::BufferUsageFlags stage_usage = buf::Usage::eTransferSrc;
@@ -113,8 +172,7 @@ bool upload(const Device& device, const buf::Buffer& dst, const void* data, cons
     const VmaAllocator allocator = device.get_allocator();
 
     /* Allocation parameters */
-    const buf::AllocParams stage_ci {VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT};
-    const buf::AllocParams buffer_ci {};
+    const buf::AllocParams stage_ci {Placement::UPLOAD, MemoryCategory::STAGING};
 
     /* Buffer usage flags */
     const vk::BufferUsageFlags stage_usage = buf::Usage::eTransferSrc;
@@ -131,16 +189,6 @@ bool upload(const Device& device, const buf::Buffer& dst, const void* data, cons
     return true;
 }
 
-/**
- * @brief Extract an unsigned 32 bit integer from a GPU buffer.
- * 
- * @param src Source buffer.
- * @param offset Byte offset in the source buffer.
- */
-bool extract_u32(const Device& device, const buf::Buffer& src, buf::Size offset, uint32_t& dst) { 
-    return vmaCopyAllocationToMemory(device.get_allocator(), src.memory, offset, &dst, sizeof(uint32_t)) == VK_SUCCESS; 
-}
-
 /**
  * @brief Set the memory of a GPU buffer to all zeros.
  */
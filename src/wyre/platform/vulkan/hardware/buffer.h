@@ -6,6 +6,8 @@
 
 #include "../api.h"
 
+#include "memory.h" /* MemoryCategory */
+
 namespace wyre {
 class Device;
 }
@@ -47,16 +49,32 @@ struct BufferParams {
     BufferParams(buf::Size size, buf::UsageFlags usage, buf::ShareMode share_mode = buf::ShareMode::eExclusive);
 };
 
+/**
+ * @brief Memory placement policy, where a buffer lives depending on how the CPU & GPU access it.
+ */
+enum class Placement {
+    /* Only accessed by the GPU, in device local memory. (written through copies, e.g. the staging ring) */
+    GPU_ONLY,
+    /* Written sequentially by the CPU & copied from by the GPU, in persistently mapped host memory. (staging) */
+    UPLOAD,
+    /* Copied into by the GPU & read by the CPU, in persistently mapped cached host memory. */
+    READBACK,
+};
+
 /**
  * @brief Buffer allocation parameters.
  */
 struct AllocParams {
     VmaAllocationCreateFlags flags{};
-    VmaMemoryUsage usage = VMA_MEMORY_USAGE_AUTO;
+    VmaMemoryUsage usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+    Placement placement = Placement::GPU_ONLY;
+    /* Category the buffer is accounted under in the memory registry. */
+    MemoryCategory category = MemoryCategory::OTHER;
+    /* Debug name of the buffer, shown in the memory audit log & registry. (optional) */
+    const char* name = nullptr;
 
     AllocParams() = default;
-    AllocParams(VmaMemoryUsage usage);
-    AllocParams(VmaAllocationCreateFlags flags, VmaMemoryUsage usage = VMA_MEMORY_USAGE_AUTO);
+    AllocParams(Placement placement, MemoryCategory category = MemoryCategory::OTHER, const char* name = nullptr);
 };
 
 /**
@@ -71,8 +89,11 @@ bool alloc(const Device& device, buf::Buffer& buffer, const BufferParams buf_par
  * @param usage Flags for how the buffer will be used.
  * @param data A pointer to the data.
  * @param size The size of the data in bytes.
+ * @param category Category the buffer is accounted under in the memory registry.
+ * @param name Debug name of the buffer.
  */
-bool alloc_upload(const Device& device, buf::Buffer& buffer, buf::UsageFlags usage, const void* data, const buf::Size size);
+bool alloc_upload(const Device& device, buf::Buffer& buffer, buf::UsageFlags usage, const void* data, const buf::Size size, MemoryCategory category,
+                  const char* name);
 
 /**
  * @brief Copy data from CPU memory directly into a buffer 1:1.
@@ -98,17 +119,10 @@ bool fill(const Device& device, const uint32_t val, const buf::Buffer& dst, buf:
 
 /**
  * @brief Upload data from the CPU to a GPU buffer using a staging buffer.
+ * @warning Waits for the upload to finish, per frame uploads should go through the frame's `StagingRing`.
  */
 bool upload(const Device& device, const buf::Buffer& dst, const void* data, const buf::Size size);
 
-/**
- * @brief Extract an unsigned 32 bit integer from a GPU buffer.
- * 
- * @param src Source buffer.
- * @param offset Byte offset in the source buffer.
- */
-bool extract_u32(const Device& device, const buf::Buffer& src, buf::Size offset, uint32_t& dst);
-
 /**
  * @brief Set the memory of a GPU buffer to all zeros.
  */
@@ -15,8 +15,15 @@ vk::ResultValue<vk::PipelineLayout> ComputeBuilder::build_layout(const vk::Devic
 }
 
 vk::ResultValue<vk::Pipeline> ComputeBuilder::build_pipeline(const vk::Device device, const vk::PipelineLayout layout) const {
+    /* Specialize the shader stage */
+    vk::PipelineShaderStageCreateInfo stage = compute_stage;
+    vk::SpecializationInfo spec_info {};
+    spec_info.setMapEntries(spec_entries);
+    spec_info.setDataSize(spec_data.size() * sizeof(uint32_t)).setPData(spec_data.data());
+    if (spec_entries.empty() == false) stage.setPSpecializationInfo(&spec_info);
+
     /* Pipeline blueprint */
-    vk::ComputePipelineCreateInfo pipeline_ci({}, compute_stage, layout);
+    vk::ComputePipelineCreateInfo pipeline_ci({}, stage, layout);
     vk::PipelineCache cache(nullptr);
 
     return device.createComputePipeline(VK_NULL_HANDLE, pipeline_ci, nullptr);
@@ -32,6 +39,11 @@ void ComputeBuilder::add_descriptor_set(const vk::DescriptorSetLayout layout) {
     desc_sets.push_back(layout);
 }
 
+void ComputeBuilder::add_specialization_constant(const uint32_t id, const uint32_t value) {
+    spec_entries.emplace_back(id, (uint32_t)(spec_data.size() * sizeof(uint32_t)), sizeof(uint32_t));
+    spec_data.push_back(value);
+}
+
 void ComputeBuilder::set_shader_entry(const vk::ShaderModule& module, const char* entry_point) {
     compute_stage = vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, module, entry_point);
 }
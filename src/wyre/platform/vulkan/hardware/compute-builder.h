@@ -17,6 +17,10 @@ class ComputeBuilder {
     std::vector<vk::PushConstantRange> push_constants {};
     std::vector<vk::DescriptorSetLayout> desc_sets {};
 
+    /* Specialization constants */
+    std::vector<vk::SpecializationMapEntry> spec_entries {};
+    std::vector<uint32_t> spec_data {};
+
    public:
     ComputeBuilder();
     
@@ -31,6 +35,8 @@ class ComputeBuilder {
     void add_push_constants(const size_t size, const size_t offset = 0);
     /** @brief Add a descriptor set layout into the pipeline layout. */
     void add_descriptor_set(const vk::DescriptorSetLayout layout);
+    /** @brief Add a 32 bit specialization constant to the shader stage. */
+    void add_specialization_constant(const uint32_t id, const uint32_t value);
 
     /** @brief Set shader entry point of the pipeline. */
     void set_shader_entry(const vk::ShaderModule& module, const char* entry_point);
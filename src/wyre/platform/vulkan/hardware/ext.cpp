@@ -17,8 +17,8 @@ const std::vector<const char*> DEVICE_EXT = {
     /* Dynamic Rendering */
     VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
     VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
-    VK_KHR_SHADER_DRAW_PARAMETERS_EXTENSION_NAME,
     VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME};
+/* (no shader uses draw parameters, their extension isn't required, e.g. SwiftShader doesn't support it) */
 
 bool validate_extensions(const std::vector<const char*>& required, const std::vector<vk::ExtensionProperties>& available) {
     /* Check if all required extensions are available */
@@ -53,7 +53,16 @@ void barrier(vk::CommandBuffer cmd, vk::Image image, img::PStage blocking, img::
     cmd.pipelineBarrier(blocking, blocked, vk::DependencyFlags{0}, {}, {}, barrier);
 }
 
+/** @brief Name an image allocation & account it in the memory registry. */
+static void track(const Device& device, VmaAllocation memory, const MemoryCategory category, const char* name) {
+    VmaAllocationInfo info {};
+    vmaGetAllocationInfo(device.get_allocator(), memory, &info);
+    if (name) vmaSetAllocationName(device.get_allocator(), memory, name);
+    device.memory.track(memory, category, name, info.size);
+}
+
 void RenderAttachment::free(const Device& device) {
+    device.memory.untrack(memory);
     device.device.destroyImageView(view);
     vmaDestroyImage(device.get_allocator(), image, memory);
 }
@@ -63,7 +72,7 @@ void RenderAttachment::free(const Device& device) {
  *
  * @param attachment The output attachment.
  */
-bool RenderAttachment::make(const Device& device, RenderAttachment& attachment, vk::Extent2D size, vk::Format format, UsageFlags usage) {
+bool RenderAttachment::make(const Device& device, RenderAttachment& attachment, vk::Extent2D size, vk::Format format, UsageFlags usage, const char* name) {
     /* Figure out the correct aspect flags & image layout based on format & usage */
     vk::ImageAspectFlags aspect_flags{};
     vk::ImageLayout layout{};
@@ -98,12 +107,14 @@ bool RenderAttachment::make(const Device& device, RenderAttachment& attachment,
     image_ci.usage = usage | vk::ImageUsageFlagBits::eSampled;
     const VkImageCreateInfo vma_image_ci = (VkImageCreateInfo)image_ci;
 
-    /* Attachment memory blueprint */
-    const VmaAllocationCreateInfo mem_ci{};
+    /* Attachment memory blueprint (only accessed by the GPU) */
+    VmaAllocationCreateInfo mem_ci{};
+    mem_ci.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
 
     VkImage out_image; /* Allocate the attachment */
     if (vmaCreateImage(device.get_allocator(), &vma_image_ci, &mem_ci, &out_image, &attachment.memory, nullptr) != VK_SUCCESS) return false;
     attachment.image = out_image;
+    track(device, attachment.memory, MemoryCategory::GBUFFER, name);
 
     /* Attachment image view blueprint */
     vk::ImageViewCreateInfo view_ci{};
@@ -125,11 +136,13 @@ bool RenderAttachment::make(const Device& device, RenderAttachment& attachment,
 }
 
 void Texture2D::free(const Device& device) {
+    device.memory.untrack(memory);
     device.device.destroyImageView(view);
     vmaDestroyImage(device.get_allocator(), image, memory);
 }
 
-bool Texture2D::make(const Device& device, Texture2D& out_texture, vk::Extent2D size, vk::Format format, vk::ImageAspectFlags aspect, vk::ImageLayout layout, vk::ImageUsageFlags usage) {
+bool Texture2D::make(const Device& device, Texture2D& out_texture, vk::Extent2D size, vk::Format format, vk::ImageAspectFlags aspect, vk::ImageLayout layout, vk::ImageUsageFlags usage,
+                     MemoryCategory category, const char* name) {
     out_texture.format = format;
     out_texture.width = size.width;
     out_texture.height = size.height;
@@ -146,12 +159,14 @@ bool Texture2D::make(const Device& device, Texture2D& out_texture, vk::Extent2D
     image_ci.usage = usage;
     const VkImageCreateInfo vma_image_ci = (VkImageCreateInfo)image_ci;
 
-    /* Texture memory blueprint */
-    const VmaAllocationCreateInfo mem_ci{};
+    /* Texture memory blueprint (only accessed by the GPU) */
+    VmaAllocationCreateInfo mem_ci{};
+    mem_ci.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
 
     VkImage out_image; /* Allocate */
     if (vmaCreateImage(device.get_allocator(), &vma_image_ci, &mem_ci, &out_image, &out_texture.memory, nullptr) != VK_SUCCESS) return false;
     out_texture.image = out_image;
+    track(device, out_texture.memory, category, name);
 
     /* Image view blueprint */
     vk::ImageViewCreateInfo view_ci{};
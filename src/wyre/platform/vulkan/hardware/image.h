@@ -6,6 +6,8 @@
 
 #include "../api.h"
 
+#include "memory.h" /* MemoryCategory */
+
 namespace wyre {
 class Device;
 }
@@ -64,8 +66,9 @@ struct RenderAttachment {
      * @brief Make a new rendering attachment, e.g. Albedo, Normal, Depth...
      * 
      * @param attachment The output attachment.
+     * @param name Debug name of the attachment, for the memory registry.
      */
-    static bool make(const Device& device, RenderAttachment& attachment, vk::Extent2D size, vk::Format format, UsageFlags usage);
+    static bool make(const Device& device, RenderAttachment& attachment, vk::Extent2D size, vk::Format format, UsageFlags usage, const char* name);
 };
 
 struct Texture2D {
@@ -82,8 +85,12 @@ struct Texture2D {
     
     /**
      * @brief Make a new texture.
+     * 
+     * @param category Category the texture is accounted under in the memory registry.
+     * @param name Debug name of the texture.
      */
-    static bool make(const Device& device, Texture2D& out_texture, vk::Extent2D size, vk::Format format, vk::ImageAspectFlags aspect, vk::ImageLayout layout, vk::ImageUsageFlags usage);
+    static bool make(const Device& device, Texture2D& out_texture, vk::Extent2D size, vk::Format format, vk::ImageAspectFlags aspect, vk::ImageLayout layout, vk::ImageUsageFlags usage,
+                     MemoryCategory category, const char* name);
 };
 
 }  // namespace wyre::img
@@ -0,0 +1,122 @@
+#include "memory.h"
+
+#include <cstdio>  /* snprintf */
+#include <cstring> /* strncmp, strlen */
+
+#include "../device.h"
+
+namespace wyre {
+
+const char* category_name(const MemoryCategory category) {
+    switch (category) {
+        case MemoryCategory::OTHER: return "other";
+        case MemoryCategory::BVH: return "bvh";
+        case MemoryCategory::SURFELS: return "surfels";
+        case MemoryCategory::RADIANCE: return "radiance";
+        case MemoryCategory::GBUFFER: return "gbuffer";
+        case MemoryCategory::STAGING: return "staging";
+        default: return "unknown";
+    }
+}
+
+void MemoryRegistry::track(VmaAllocation memory, const MemoryCategory category, const char* name, const uint64_t bytes) {
+    if (memory == nullptr) return;
+    untrack(memory);
+    if (name == nullptr) name = "unnamed";
+
+    /* Find the group of the allocation, allocations sharing a name are accounted together */
+    uint32_t group = 0u;
+    while (group < groups.size() && (groups[group].category != category || groups[group].name != name)) ++group;
+    if (group == groups.size()) groups.push_back({category, name});
+
+    groups[group].bytes += bytes;
+    groups[group].allocations++;
+    totals[(uint32_t)category] += bytes;
+    live[memory] = {group, bytes};
+}
+
+void MemoryRegistry::untrack(VmaAllocation memory) {
+    const auto it = live.find(memory);
+    if (it == live.end()) return;
+
+    Group& group = groups[it->second.group];
+    group.bytes -= it->second.bytes;
+    group.allocations--;
+    totals[(uint32_t)group.category] -= it->second.bytes;
+    live.erase(it);
+}
+
+uint64_t MemoryRegistry::bytes(const MemoryCategory category, const char* prefix) const {
+    const size_t length = strlen(prefix);
+    uint64_t bytes = 0u;
+    for (const Group& group : groups) {
+        if (group.category == category && strncmp(group.name.c_str(), prefix, length) == 0) bytes += group.bytes;
+    }
+    return bytes;
+}
+
+uint64_t MemoryRegistry::total() const {
+    uint64_t bytes = 0u;
+    for (const uint64_t category : totals) bytes += category;
+    return bytes;
+}
+
+std::vector<MemoryRegistry::Heap> MemoryRegistry::heaps(const Device& device) {
+    const VkPhysicalDeviceMemoryProperties* props = nullptr;
+    vmaGetMemoryProperties(device.get_allocator(), &props);
+
+    /* Budgets are estimated by VMA if the memory budget extension isn't available */
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS] {};
+    vmaGetHeapBudgets(device.get_allocator(), budgets);
+
+    std::vector<Heap> heaps(props->memoryHeapCount);
+    for (uint32_t i = 0u; i < props->memoryHeapCount; ++i) {
+        heaps[i].size = props->memoryHeaps[i].size;
+        heaps[i].budget = budgets[i].budget;
+        heaps[i].usage = budgets[i].usage;
+        heaps[i].device_local = props->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+    }
+    return heaps;
+}
+
+std::string MemoryRegistry::to_json(const Device& device) const {
+    std::string json = "{\n";
+    char line[512];
+
+    /* Live bytes per category */
+    json += "  \"categories\": {";
+    for (uint32_t c = 0u; c < (uint32_t)MemoryCategory::COUNT; ++c) {
+        snprintf(line, sizeof(line), "%s\n    \"%s\": %llu", c ? "," : "", category_name((MemoryCategory)c), (unsigned long long)totals[c]);
+        json += line;
+    }
+    snprintf(line, sizeof(line), "\n  },\n  \"total\": %llu,\n", (unsigned long long)total());
+    json += line;
+
+    /* Live bytes per debug name (names are plain identifiers, quotes are dropped) */
+    json += "  \"allocations\": [";
+    bool first = true;
+    for (const Group& group : groups) {
+        if (group.allocations == 0u) continue;
+        std::string name = group.name;
+        for (char& c : name) if (c == '"' || c == '\\') c = '\'';
+        snprintf(line, sizeof(line), "%s\n    {\"category\": \"%s\", \"name\": \"%s\", \"count\": %u, \"bytes\": %llu}", first ? "" : ",",
+                 category_name(group.category), name.c_str(), group.allocations, (unsigned long long)group.bytes);
+        json += line;
+        first = false;
+    }
+    json += "\n  ],\n";
+
+    /* Heap budgets */
+    json += "  \"heaps\": [";
+    const std::vector<Heap> device_heaps = heaps(device);
+    for (uint32_t i = 0u; i < device_heaps.size(); ++i) {
+        const Heap& heap = device_heaps[i];
+        snprintf(line, sizeof(line), "%s\n    {\"device_local\": %s, \"size\": %llu, \"budget\": %llu, \"usage\": %llu}", i ? "," : "",
+                 heap.device_local ? "true" : "false", (unsigned long long)heap.size, (unsigned long long)heap.budget, (unsigned long long)heap.usage);
+        json += line;
+    }
+    json += "\n  ]\n}\n";
+    return json;
+}
+
+}  // namespace wyre
@@ -0,0 +1,93 @@
+/**
+ * @file memory.h
+ * @brief Vulkan GPU memory accounting.
+ */
+#pragma once
+
+#include "../api.h"
+
+#include <string>        /* std::string */
+#include <unordered_map> /* std::unordered_map */
+#include <vector>        /* std::vector */
+
+namespace wyre {
+
+class Device;
+
+/**
+ * @brief Category of a GPU allocation, for memory accounting.
+ */
+enum class MemoryCategory : uint32_t {
+    OTHER,
+    /* Scene BVH buffers. */
+    BVH,
+    /* Surfel buffers of the cascades. (named per cascade) */
+    SURFELS,
+    /* Radiance caches of the cascades. (named per cascade) */
+    RADIANCE,
+    /* Rendering attachments. */
+    GBUFFER,
+    /* Staging & readback memory. */
+    STAGING,
+    COUNT
+};
+
+/** @returns The name of a memory category. */
+const char* category_name(const MemoryCategory category);
+
+/**
+ * @brief Registry of the live GPU allocations, which tracks their bytes per category & debug name.
+ * Allocations are tracked by `buf::alloc` & the image makers, and untracked when they are freed.
+ */
+class MemoryRegistry {
+   public:
+    /** @brief Live allocations of a category which share a debug name. */
+    struct Group {
+        MemoryCategory category = MemoryCategory::OTHER;
+        std::string name{};
+        uint64_t bytes = 0u;
+        uint32_t allocations = 0u;
+    };
+
+    /** @brief Budget & usage of a memory heap, as reported by VMA. */
+    struct Heap {
+        uint64_t size = 0u, budget = 0u, usage = 0u;
+        bool device_local = false;
+    };
+
+    /** @brief Start tracking an allocation. (the name is copied) */
+    void track(VmaAllocation memory, const MemoryCategory category, const char* name, const uint64_t bytes);
+
+    /** @brief Stop tracking an allocation, unknown allocations are ignored. */
+    void untrack(VmaAllocation memory);
+
+    /** @returns The live bytes of a category. */
+    inline uint64_t bytes(const MemoryCategory category) const { return totals[(uint32_t)category]; }
+
+    /** @returns The live bytes of the groups of a category whose name starts with a prefix. (e.g. "c0 ") */
+    uint64_t bytes(const MemoryCategory category, const char* prefix) const;
+
+    /** @returns The live bytes of all categories. */
+    uint64_t total() const;
+
+    /** @returns The groups of live allocations, empty groups are kept. */
+    inline const std::vector<Group>& get_groups() const { return groups; }
+
+    /** @returns The budget & usage of every memory heap of the device. */
+    static std::vector<Heap> heaps(const Device& device);
+
+    /** @returns The categories, groups & heap budgets as a JSON document. */
+    std::string to_json(const Device& device) const;
+
+   private:
+    struct Entry {
+        uint32_t group = 0u;
+        uint64_t bytes = 0u;
+    };
+
+    std::unordered_map<VmaAllocation, Entry> live{};
+    std::vector<Group> groups{};
+    uint64_t totals[(uint32_t)MemoryCategory::COUNT]{};
+};
+
+}  // namespace wyre
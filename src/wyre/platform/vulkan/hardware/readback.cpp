@@ -0,0 +1,91 @@
+#include "readback.h"
+
+#include <algorithm> /* std::max */
+#include <cstring>   /* memcpy */
+
+#include "../device.h"
+
+namespace wyre {
+
+bool ReadbackQueue::init(const Device& device) {
+    for (Slot& slot : slots) {
+        if (!alloc(device, slot, INITIAL_CAPACITY)) return false;
+    }
+    return true;
+}
+
+bool ReadbackQueue::alloc(const Device& device, Slot& slot, const buf::Size capacity) {
+    /* Persistently mapped host memory, read back in any order by the CPU */
+    if (!buf::alloc(device, slot.buffer, {capacity, buf::Usage::eTransferDst}, {buf::Placement::READBACK, MemoryCategory::STAGING, "readback slot"}, false)) return false;
+
+    VmaAllocationInfo info {};
+    vmaGetAllocationInfo(device.get_allocator(), slot.buffer.memory, &info);
+    slot.mapped = (const uint8_t*)info.pMappedData;
+    return slot.mapped != nullptr;
+}
+
+void ReadbackQueue::free(const Device& device) {
+    for (Slot& slot : slots) {
+        if (slot.buffer.buffer) slot.buffer.free(device);
+        slot = {};
+    }
+}
+
+bool ReadbackQueue::begin_frame(const Device& device) {
+    Slot& slot = slots[device.fbi];
+    bool resolved = true;
+
+    /* A retried frame start already resolved the slot, resolving it again would overwrite the results with this frame's empty slot */
+    if (slot.frame == device.fid) return true;
+
+    /* Resolve the readbacks of the previous use of this slot */
+    if (slot.frame != ~0u && slot.mapped != nullptr) {
+        const buf::Size used = std::min(slot.head, slot.buffer.size);
+        if (vmaInvalidateAllocation(device.get_allocator(), slot.buffer.memory, 0u, used) == VK_SUCCESS) {
+            slot.results.assign(slot.mapped, slot.mapped + used);
+            slot.results_frame = slot.frame;
+        } else {
+            resolved = false;
+        }
+    }
+
+    /* Grow the slot if its readbacks didn't fit (it's no longer in use) */
+    /* (if that fails the slot stays empty, its requests fail, and it tries to grow again next time) */
+    if (slot.head > slot.buffer.size) {
+        const buf::Size capacity = std::max(slot.head, slot.buffer.size * 2u);
+        if (slot.buffer.buffer) slot.buffer.free(device);
+        slot.buffer = {}, slot.mapped = nullptr;
+        if (!alloc(device, slot, capacity)) {
+            if (slot.buffer.buffer) slot.buffer.free(device);
+            slot.buffer = {}, slot.mapped = nullptr;
+            resolved = false;
+        }
+    }
+    slot.head = 0u;
+    slot.frame = device.fid;
+    return resolved;
+}
+
+ReadbackQueue::Handle ReadbackQueue::request(const Device& device, vk::CommandBuffer cmd, const buf::Buffer& src, const buf::Size offset,
+                                             const buf::Size size) {
+    Slot& slot = slots[device.fbi];
+    const buf::Size start = (slot.head + ALIGNMENT - 1u) & ~(ALIGNMENT - 1u);
+    slot.head = start + size;
+    if (start + size > slot.buffer.size) return {};
+
+    /* Wait for earlier writes, copy, and make the copy visible to the host */
+    buf::barrier(cmd, src, offset, size, buf::PStage::eAllCommands, buf::Access::eMemoryWrite, buf::PStage::eTransfer, buf::Access::eTransferRead);
+    cmd.copyBuffer(src.buffer, slot.buffer.buffer, vk::BufferCopy(offset, start, size));
+    buf::barrier(cmd, slot.buffer, start, size, buf::PStage::eTransfer, buf::Access::eTransferWrite, buf::PStage::eHost, buf::Access::eHostRead);
+    return {slot.frame, (uint32_t)start, (uint32_t)size};
+}
+
+bool ReadbackQueue::get(const Handle& handle, void* dst) const {
+    if (handle.is_valid() == false) return false;
+    const Slot& slot = slots[handle.frame % BUFFERS];
+    if (slot.results_frame != handle.frame) return false;
+    memcpy(dst, slot.results.data() + handle.offset, handle.size);
+    return true;
+}
+
+}  // namespace wyre
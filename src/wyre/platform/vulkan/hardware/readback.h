@@ -0,0 +1,86 @@
+/**
+ * @file readback.h
+ * @brief Vulkan asynchronous GPU to CPU readbacks.
+ */
+#pragma once
+
+#include "../api.h"
+
+#include <vector> /* std::vector */
+
+#include "wyre/defines.h" /* BUFFERS */
+#include "buffer.h"       /* buf:: */
+
+namespace wyre {
+
+class Device;
+
+/**
+ * @brief Queue of asynchronous GPU to CPU readbacks.
+ * Copies are recorded into the frame command buffer, into a small host visible slot owned by the frame in flight.
+ * Once the frame's flight fence signalled (BUFFERS frames later) the slot is read, so readbacks never stall or race the GPU.
+ */
+struct ReadbackQueue {
+    /* Initial capacity of a slot, in bytes. */
+    static constexpr buf::Size INITIAL_CAPACITY = 4u * 1024u;
+    /* Alignment of every readback in a slot, in bytes. */
+    static constexpr buf::Size ALIGNMENT = 16u;
+
+    /** @brief Handle of a readback, which resolves once the frame it was requested in finished. */
+    struct Handle {
+        /* Frame index the readback was requested in. (~0u for an invalid handle) */
+        uint32_t frame = ~0u;
+        /* Range of the readback in the slot. */
+        uint32_t offset = 0u, size = 0u;
+
+        inline bool is_valid() const { return frame != ~0u; }
+    };
+
+    /** @brief Readback memory of a frame in flight. */
+    struct Slot {
+        buf::Buffer buffer{};
+        /* Persistently mapped memory of the buffer. */
+        const uint8_t* mapped = nullptr;
+        /* Bytes requested this frame, which might be more than the capacity. (the slot grows to fit them) */
+        buf::Size head = 0u;
+        /* Frame index of the readbacks in the buffer. */
+        uint32_t frame = ~0u;
+        /* Resolved readbacks of the last frame which finished with this slot. */
+        std::vector<uint8_t> results{};
+        uint32_t results_frame = ~0u;
+    };
+
+    Slot slots[BUFFERS]{};
+
+    /** @brief Allocate the readback slots. */
+    bool init(const Device& device);
+
+    /** @brief Free the readback slots. */
+    void free(const Device& device);
+
+    /**
+     * @brief Resolve the readbacks of the current frame's slot, its flight fence must have signalled.
+     * Only the first call of a frame resolves the slot, so a retried frame start keeps the results.
+     * @returns False if the slot's readbacks were lost, or it failed to grow. (the slot stays usable, failures aren't fatal)
+     */
+    bool begin_frame(const Device& device);
+
+    /**
+     * @brief Request a readback of a range of a GPU buffer, recorded into the command buffer of the current frame.
+     * The copy waits for all earlier writes to the buffer.
+     * @returns An invalid handle if the slot of the frame is full. (it grows before its next use)
+     */
+    Handle request(const Device& device, vk::CommandBuffer cmd, const buf::Buffer& src, const buf::Size offset, const buf::Size size);
+
+    /**
+     * @brief Copy the result of a readback, results stay available for BUFFERS frames after they resolved.
+     * @returns False if the readback didn't resolve yet, or its result is no longer available.
+     */
+    bool get(const Handle& handle, void* dst) const;
+
+   private:
+    /** @brief Allocate the buffer of a slot. */
+    bool alloc(const Device& device, Slot& slot, const buf::Size capacity);
+};
+
+}  // namespace wyre
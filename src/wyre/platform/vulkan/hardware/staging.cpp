@@ -0,0 +1,106 @@
+#include "staging.h"
+
+#include <algorithm> /* std::min, std::max */
+#include <cassert>   /* assert */
+#include <cstring>   /* memcpy */
+
+#include "../device.h"
+
+namespace wyre {
+
+bool StagingRing::alloc(const Device& device, buf::Buffer& staging, uint8_t*& memory, const buf::Size capacity, const char* name) {
+    /* Persistently mapped host memory, only written sequentially by the CPU */
+    if (!buf::alloc(device, staging, {capacity, buf::Usage::eTransferSrc}, {buf::Placement::UPLOAD, MemoryCategory::STAGING, name}, false)) return false;
+
+    VmaAllocationInfo info {};
+    vmaGetAllocationInfo(device.get_allocator(), staging.memory, &info);
+    memory = (uint8_t*)info.pMappedData;
+    return memory != nullptr;
+}
+
+bool StagingRing::init(const Device& device, const buf::Size capacity) {
+    head = 0u;
+    return alloc(device, buffer, mapped, capacity, "staging ring");
+}
+
+void StagingRing::free(const Device& device) {
+    pending.clear();
+    reset(device);
+    if (buffer.buffer) buffer.free(device);
+    if (overflow.buffer) overflow.free(device);
+    buffer = {}, mapped = nullptr;
+    overflow = {}, overflow_mapped = nullptr;
+}
+
+void StagingRing::reset(const Device& device) {
+    /* Uploads which were never flushed would be lost, and their data overwritten by the next uploads */
+    assert(pending.empty() && "staging ring reset with unflushed uploads!");
+    for (buf::Buffer& old : retired) old.free(device);
+    retired.clear();
+    head = 0u, overflow_head = 0u;
+}
+
+bool StagingRing::upload(const Device& device, const buf::Buffer& dst, const buf::Size offset, const void* data, const buf::Size size) {
+    if (size == 0u) return true;
+
+    /* Uploads larger than the ring can ever be go through the overflow buffer, which is kept for the next frames */
+    if (size > MAX_CAPACITY) {
+        const buf::Size start = (overflow_head + ALIGNMENT - 1u) & ~(ALIGNMENT - 1u);
+        if (start + size > overflow.size) {
+            /* Grow the overflow buffer, the commands recorded so far still copy from the old buffer */
+            buf::Buffer grown {};
+            uint8_t* grown_mapped = nullptr;
+            if (!alloc(device, grown, grown_mapped, std::max(overflow.size * 2u, size), "staging overflow")) return false;
+            if (overflow.buffer) retired.push_back(overflow);
+            overflow = grown, overflow_mapped = grown_mapped, overflow_head = 0u;
+        }
+        return write(device, overflow, overflow_mapped, overflow_head, dst, offset, data, size);
+    }
+
+    const buf::Size start = (head + ALIGNMENT - 1u) & ~(ALIGNMENT - 1u);
+    if (start + size > buffer.size) {
+        /* Grow the ring, the commands recorded so far still copy from the old buffer (which is only retired once the new one exists) */
+        buf::Buffer grown {};
+        uint8_t* grown_mapped = nullptr;
+        if (!alloc(device, grown, grown_mapped, std::min(std::max(buffer.size * 2u, size), MAX_CAPACITY), "staging ring")) return false;
+        if (buffer.buffer) retired.push_back(buffer);
+        buffer = grown, mapped = grown_mapped, head = 0u;
+        return write(device, buffer, mapped, head, dst, offset, data, size);
+    }
+    return write(device, buffer, mapped, head, dst, offset, data, size);
+}
+
+bool StagingRing::write(const Device& device, const buf::Buffer& staging, uint8_t* memory, buf::Size& at, const buf::Buffer& dst,
+                        const buf::Size offset, const void* data, const buf::Size size) {
+    const buf::Size start = (at + ALIGNMENT - 1u) & ~(ALIGNMENT - 1u);
+
+    /* Write the data into the staging buffer (flushing is a no-op on coherent memory) */
+    memcpy(memory + start, data, size);
+    if (vmaFlushAllocation(device.get_allocator(), staging.memory, start, size) != VK_SUCCESS) return false;
+    at = start + size;
+    pending.push_back({staging.buffer, dst.buffer, vk::BufferCopy(start, offset, size)});
+    return true;
+}
+
+void StagingRing::flush(vk::CommandBuffer cmd) {
+    if (pending.empty()) return;
+
+    /* Earlier commands might still read or write the destinations, e.g. shaders of this frame or transfers (write after read & write after write) */
+    const vk::MemoryBarrier before(vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferWrite);
+    cmd.pipelineBarrier(buf::PStage::eAllCommands, buf::PStage::eTransfer, vk::DependencyFlags{0}, before, {}, {});
+
+    /* Record one copy per run of uploads between the same buffers */
+    for (size_t i = 0u; i < pending.size();) {
+        const Copy& first = pending[i];
+        regions.clear();
+        for (; i < pending.size() && pending[i].src == first.src && pending[i].dst == first.dst; ++i) regions.push_back(pending[i].region);
+        cmd.copyBuffer(first.src, first.dst, regions);
+    }
+    pending.clear();
+
+    /* Make the copies visible to later commands */
+    const vk::MemoryBarrier after(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eMemoryRead);
+    cmd.pipelineBarrier(buf::PStage::eTransfer, buf::PStage::eAllCommands, vk::DependencyFlags{0}, after, {}, {});
+}
+
+}  // namespace wyre
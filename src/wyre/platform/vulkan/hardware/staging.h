@@ -0,0 +1,85 @@
+/**
+ * @file staging.h
+ * @brief Vulkan per-frame staging ring, for uploads recorded into the frame command buffer.
+ */
+#pragma once
+
+#include "../api.h"
+
+#include <vector> /* std::vector */
+
+#include "buffer.h" /* buf:: */
+
+namespace wyre {
+
+class Device;
+
+/**
+ * @brief Persistently mapped ring of staging memory, owned by a frame in flight.
+ * Uploads are sub-allocated from the ring, and their copies are recorded into the frame's command buffer at once by `flush`.
+ * The ring is reclaimed once the frame's flight fence signalled, so steady state uploads never allocate or wait.
+ */
+struct StagingRing {
+    /* Initial capacity of a ring, in bytes. */
+    static constexpr buf::Size INITIAL_CAPACITY = 64u * 1024u;
+    /* Maximum capacity of a ring, in bytes. (larger uploads go through the overflow buffer) */
+    static constexpr buf::Size MAX_CAPACITY = 16u * 1024u * 1024u;
+    /* Alignment of every upload in the ring, in bytes. */
+    static constexpr buf::Size ALIGNMENT = 16u;
+
+    buf::Buffer buffer{};
+    /* Persistently mapped memory of the buffer. */
+    uint8_t* mapped = nullptr;
+    /* Bytes used by the uploads of this frame. */
+    buf::Size head = 0u;
+
+    /* Staging buffer of the uploads larger than the ring, kept for the next large uploads. (grows, but never shrinks) */
+    buf::Buffer overflow{};
+    uint8_t* overflow_mapped = nullptr;
+    buf::Size overflow_head = 0u;
+
+    /* Buffers outgrown this frame, which the frame's commands might still copy from. */
+    std::vector<buf::Buffer> retired{};
+
+    /** @brief Allocate the ring buffer. */
+    bool init(const Device& device, const buf::Size capacity = INITIAL_CAPACITY);
+
+    /** @brief Free the ring & overflow buffers. */
+    void free(const Device& device);
+
+    /** @brief Reclaim the whole ring, the frame's flight fence must have signalled and its uploads must have been flushed. */
+    void reset(const Device& device);
+
+    /**
+     * @brief Upload data into a GPU buffer, the copy is recorded by the next `flush`.
+     * If the ring is full it grows (up to `MAX_CAPACITY`), keeping the old buffer alive until the frame finished.
+     * @returns False if the data couldn't be staged, then no copy is recorded and the caller should retry it later.
+     * @warning The uploads between two flushes are copied without barriers in between, so they must not overlap.
+     */
+    bool upload(const Device& device, const buf::Buffer& dst, const buf::Size offset, const void* data, const buf::Size size);
+
+    /**
+     * @brief Record the copies of all pending uploads into a command buffer.
+     * One barrier makes the copies wait for earlier commands using their destinations, and one makes later commands wait for the copies.
+     */
+    void flush(vk::CommandBuffer cmd);
+
+   private:
+    /* Copy of an upload, waiting for the next flush. */
+    struct Copy {
+        vk::Buffer src {}, dst {};
+        vk::BufferCopy region {};
+    };
+    std::vector<Copy> pending{};
+    /* Regions of the copy being recorded, kept to avoid allocating every flush. */
+    std::vector<vk::BufferCopy> regions{};
+
+    /** @brief Allocate a persistently mapped staging buffer. */
+    static bool alloc(const Device& device, buf::Buffer& staging, uint8_t*& memory, const buf::Size capacity, const char* name);
+
+    /** @brief Write data into a staging buffer at its head, and queue the copy into the destination. */
+    bool write(const Device& device, const buf::Buffer& staging, uint8_t* memory, buf::Size& at, const buf::Buffer& dst, const buf::Size offset,
+               const void* data, const buf::Size size);
+};
+
+}  // namespace wyre
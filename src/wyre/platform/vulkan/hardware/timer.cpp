@@ -0,0 +1,59 @@
+#include "timer.h"
+
+#include <algorithm> /* std::min */
+
+#include "../device.h"
+
+namespace wyre {
+
+bool GpuTimer::init(const Device& device, const uint32_t scope_count) {
+    scopes = std::min(scope_count, 32u);
+    const vk::PhysicalDeviceLimits limits = device.phy_device.getProperties().limits;
+    if (limits.timestampComputeAndGraphics == false) return false;
+    period = limits.timestampPeriod;
+
+    /* Two timestamps per scope, for every frame in flight */
+    const vk::QueryPoolCreateInfo pool_ci({}, vk::QueryType::eTimestamp, scopes * 2u * BUFFERS);
+    const vk::ResultValue result = device.device.createQueryPool(pool_ci);
+    if (result.result != vk::Result::eSuccess) return false;
+    pool = result.value;
+
+    /* Queries have to be reset before their first use */
+    return device.imm_submit([&](vk::CommandBuffer cmd) { cmd.resetQueryPool(pool, 0u, scopes * 2u * BUFFERS); });
+}
+
+void GpuTimer::free(const Device& device) {
+    device.device.destroyQueryPool(pool);
+}
+
+void GpuTimer::begin_frame(const Device& device) {
+    if (!pool) return;
+    const vk::CommandBuffer& cmd = device.get_frame().gcb;
+    const uint32_t first = device.fbi * scopes * 2u;
+
+    /* The flight fence of this frame was waited on, so its previous timestamps are available */
+    for (uint32_t s = 0u; s < scopes; ++s) {
+        if (((written[device.fbi] >> s) & 1u) == 0u) continue;
+        uint64_t stamps[2] {};
+        const vk::Result result = device.device.getQueryPoolResults(pool, first + s * 2u, 2u, sizeof(stamps), stamps, sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+        if (result == vk::Result::eSuccess) durations[s] = (float)((double)(stamps[1] - stamps[0]) * period / 1e6);
+    }
+
+    cmd.resetQueryPool(pool, first, scopes * 2u);
+    written[device.fbi] = 0u;
+}
+
+void GpuTimer::begin(const Device& device, const uint32_t scope) {
+    if (!pool) return;
+    const uint32_t query = (device.fbi * scopes + scope) * 2u;
+    device.get_frame().gcb.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, pool, query);
+}
+
+void GpuTimer::end(const Device& device, const uint32_t scope) {
+    if (!pool) return;
+    const uint32_t query = (device.fbi * scopes + scope) * 2u;
+    device.get_frame().gcb.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, pool, query + 1u);
+    written[device.fbi] |= 1u << scope;
+}
+
+}  // namespace wyre
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../api.h"
+
+#include "wyre/defines.h" /* BUFFERS */
+
+namespace wyre {
+
+class Device;
+
+/**
+ * @brief Vulkan GPU timer, measures the duration of a number of scopes using timestamp queries.
+ * Every frame in flight has its own queries, which are only read back once that frame is reused. (never stalls)
+ */
+struct GpuTimer {
+    vk::QueryPool pool{};
+    /* Number of scopes per frame. (at most 32) */
+    uint32_t scopes = 0u;
+    /* Nanoseconds per timestamp tick, zero if the queue doesn't support timestamps. */
+    float period = 0.0f;
+    /* Last measured duration of each scope. (in milliseconds) */
+    float durations[32] {};
+    /* Bit mask of the scopes written in each frame in flight. */
+    uint32_t written[BUFFERS] {};
+
+    /** @brief Create the timestamp query pool, returns false if timestamps are not supported. */
+    bool init(const Device& device, const uint32_t scope_count);
+
+    /** @brief Free the query pool. */
+    void free(const Device& device);
+
+    /** @brief Read back the scopes of the previous use of this frame, and reset its queries. (before any scope) */
+    void begin_frame(const Device& device);
+
+    /** @brief Mark the start of a scope in the command buffer. */
+    void begin(const Device& device, const uint32_t scope);
+
+    /** @brief Mark the end of a scope in the command buffer. */
+    void end(const Device& device, const uint32_t scope);
+
+    /** @returns The last measured duration of a scope. (in milliseconds) */
+    inline float get_ms(const uint32_t scope) const { return durations[scope]; }
+};
+
+}  // namespace wyre
@@ -92,7 +92,7 @@ void FinalPipeline::enqueue(const Window& window, const Device& device) {
     attachment_info.imageLayout = vk::ImageLayout::eColorAttachmentOptimal;
     attachment_info.storeOp = vk::AttachmentStoreOp::eStore;
     attachment_info.loadOp = vk::AttachmentLoadOp::eClear;
-    attachment_info.clearValue.color = vk::ClearColorValue({0.05f, 0.05f, 0.05f, 1.0f});
+    attachment_info.clearValue.color = vk::ClearColorValue(std::array<float, 4>{0.05f, 0.05f, 0.05f, 1.0f});
     attachment_info.imageView = rt.view;
 
     /* Viewport & scissor */
@@ -117,11 +117,11 @@ GeometryPipeline::GeometryPipeline(Logger& logger, const Window& window, const D
 
     /* Create vertices & indices buffers */
     const VmaAllocator& vma = device.allocator;
-    if (!buf::alloc_upload(device, vertex_buffer, buf::Usage::eVertexBuffer, CUBE, sizeof(CUBE))) {
+    if (!buf::alloc_upload(device, vertex_buffer, buf::Usage::eVertexBuffer, CUBE, sizeof(CUBE), MemoryCategory::OTHER, "cube vertices")) {
         logger.log(LogGroup::GRAPHICS_API, LogLevel::CRITICAL, "failed to allocate vertex buffer.");
         return;
     }
-    if (!buf::alloc_upload(device, index_buffer, buf::Usage::eIndexBuffer, CUBE_IND, sizeof(CUBE_IND))) {
+    if (!buf::alloc_upload(device, index_buffer, buf::Usage::eIndexBuffer, CUBE_IND, sizeof(CUBE_IND), MemoryCategory::OTHER, "cube indices")) {
         logger.log(LogGroup::GRAPHICS_API, LogLevel::CRITICAL, "failed to allocate index buffer.");
         return;
     }
@@ -145,7 +145,7 @@ void GeometryPipeline::enqueue(const Window& window, const Device& device) {
     attachment_info.imageLayout = vk::ImageLayout::eColorAttachmentOptimal;
     attachment_info.storeOp = vk::AttachmentStoreOp::eStore;
     attachment_info.loadOp = vk::AttachmentLoadOp::eClear;
-    attachment_info.clearValue.color = vk::ClearColorValue({0.05f, 0.05f, 0.05f, 1.0f});
+    attachment_info.clearValue.color = vk::ClearColorValue(std::array<float, 4>{0.05f, 0.05f, 0.05f, 1.0f});
     attachment_info.imageView = albedo.view;
 
     /* Viewport & scissor */
@@ -28,7 +28,7 @@ struct PushConstants {
     glm::vec3 origin;
 };
 
-PrimaryPipeline::PrimaryPipeline(Logger& logger, const Device& device, const DescriptorSet& bvh) {
+PrimaryPipeline::PrimaryPipeline(Logger& logger, const Device& device, const DescriptorSet& bvh, const TriLayout tri_layout) {
     /* Load the primary compute shader module */
     primary_shader = shader::from_file(device.device, PRIMARY_SHADER).expect("failed to load primary shader.");
 
@@ -40,6 +40,8 @@ PrimaryPipeline::PrimaryPipeline(Logger& logger, const Device& device, const Des
     /* Descriptor sets */
     builder.add_descriptor_set(device.get_frame().attach_store_desc.layout);
     builder.add_descriptor_set(bvh.layout);
+    /* Specialize the BVH primitive layout */
+    builder.add_specialization_constant(0, (uint32_t)tri_layout);
     /* Add the push constants */
     builder.add_push_constants(sizeof(uint32_t));
 
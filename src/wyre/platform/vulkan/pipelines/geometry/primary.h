@@ -16,6 +16,10 @@ class Device;
 
 struct DescriptorSet;
 
+namespace scene {
+enum class TriLayout;
+}
+
 /**
  * @brief Vulkan primary pass pipeline.
  */
@@ -29,7 +33,7 @@ class PrimaryPipeline {
     vk::Pipeline pipeline = nullptr;
 
     PrimaryPipeline() = delete;
-    explicit PrimaryPipeline(Logger& logger, const Device& device, const DescriptorSet& bvh);
+    explicit PrimaryPipeline(Logger& logger, const Device& device, const DescriptorSet& bvh, const scene::TriLayout tri_layout);
     ~PrimaryPipeline() = default;
 
     /**
@@ -1,5 +1,7 @@
 #include "cascade.h"
 
+#include <string> /* std::to_string */
+
 #include "surfels.h" /* SAS_CELL_CAPACITY */
 
 #include "vulkan/device.h"
@@ -81,29 +83,30 @@ bool SurfelCascadeResources::alloc(const Device& device, const SurfelCascadePara
     const uint32_t grid_cap = params.get_grid_capacity(cascade_index);
     const uint32_t memory_width = params.get_memory_width(cascade_index);
 
-    const buf::AllocParams alloc_ci{VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT};
+    /* Debug names are prefixed with the cascade, so the memory registry accounts every cascade */
+    const auto name = [cascade_index](const char* resource) { return "c" + std::to_string(cascade_index) + " " + resource; };
 
     /* Allocate the Surfel parameters buffer */
     const uint32_t param_size = sizeof(SurfelCascadeParameters);
-    if (!buf::alloc(device, surfel_param, {param_size, buf::Usage::eUniformBuffer | buf::Usage::eTransferDst}, alloc_ci)) return false;
+    if (!buf::alloc(device, surfel_param, {param_size, buf::Usage::eUniformBuffer | buf::Usage::eTransferDst}, {buf::Placement::GPU_ONLY, MemoryCategory::SURFELS, name("surfel params").c_str()})) return false;
 
     /* Allocate the Surfel stack */
     const uint32_t stack_size = sizeof(uint32_t) * (1u + surfel_cap);
-    if (!buf::alloc(device, surfel_stack, {stack_size, buf::Usage::eStorageBuffer | buf::Usage::eTransferDst}, alloc_ci)) return false;
+    if (!buf::alloc(device, surfel_stack, {stack_size, buf::Usage::eStorageBuffer | buf::Usage::eTransferDst | buf::Usage::eTransferSrc}, {buf::Placement::GPU_ONLY, MemoryCategory::SURFELS, name("surfel stack").c_str()})) return false;
 
     /* Allocate the Surfel acceleration structure */
     const uint32_t hashgrid_size = sizeof(uint32_t) * (grid_cap + 1u); /* +1 because the last element has to be empty for prefix sum */
-    if (!buf::alloc(device, surfel_grid, {hashgrid_size, buf::Usage::eStorageBuffer | buf::Usage::eTransferDst}, alloc_ci)) return false;
+    if (!buf::alloc(device, surfel_grid, {hashgrid_size, buf::Usage::eStorageBuffer | buf::Usage::eTransferDst}, {buf::Placement::GPU_ONLY, MemoryCategory::SURFELS, name("surfel grid").c_str()})) return false;
     const uint32_t hashlist_size = sizeof(uint32_t) * surfel_cap * 16u;
-    if (!buf::alloc(device, surfel_list, {hashlist_size, buf::Usage::eStorageBuffer | buf::Usage::eTransferDst}, alloc_ci)) return false;
+    if (!buf::alloc(device, surfel_list, {hashlist_size, buf::Usage::eStorageBuffer | buf::Usage::eTransferDst}, {buf::Placement::GPU_ONLY, MemoryCategory::SURFELS, name("surfel list").c_str()})) return false;
 
     /* Allocate the Surfel positions & radius */
     const uint32_t posr_size = sizeof(float) * 4u * surfel_cap;
-    if (!buf::alloc(device, surfel_posr, {posr_size, buf::Usage::eStorageBuffer | buf::Usage::eTransferDst}, alloc_ci)) return false;
+    if (!buf::alloc(device, surfel_posr, {posr_size, buf::Usage::eStorageBuffer | buf::Usage::eTransferDst}, {buf::Placement::GPU_ONLY, MemoryCategory::SURFELS, name("surfel posr").c_str()})) return false;
 
     /* Allocate the Surfel normals */
     const uint32_t norw_size = sizeof(float) * 4u * surfel_cap;
-    if (!buf::alloc(device, surfel_norw, {norw_size, buf::Usage::eStorageBuffer | buf::Usage::eTransferDst}, alloc_ci)) return false;
+    if (!buf::alloc(device, surfel_norw, {norw_size, buf::Usage::eStorageBuffer | buf::Usage::eTransferDst}, {buf::Placement::GPU_ONLY, MemoryCategory::SURFELS, name("surfel norw").c_str()})) return false;
 
     /* Allocate the Surfel Radiance texture */
     const uint32_t cache_width = memory_width * (uint32_t)sqrt(surfel_cap);
@@ -113,7 +116,8 @@ bool SurfelCascadeResources::alloc(const Device& device, const SurfelCascadePara
         vk::Format::eR16G16B16A16Sfloat, // vk::Format::eR32G32B32A32Sfloat, // vk::Format::eA2B10G10R10UnormPack32, 
         vk::ImageAspectFlagBits::eColor, 
         vk::ImageLayout::eGeneral, 
-        vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc
+        vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc,
+        MemoryCategory::RADIANCE, name("radiance cache").c_str()
     ) == false) return false;
     if (img::Texture2D::make(device, surfel_merge, 
         {cache_width, cache_width}, 
@@ -121,7 +125,8 @@ bool SurfelCascadeResources::alloc(const Device& device, const SurfelCascadePara
         vk::Format::eR16G16B16A16Sfloat,
         vk::ImageAspectFlagBits::eColor, 
         vk::ImageLayout::eGeneral, 
-        vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferDst
+        vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferDst,
+        MemoryCategory::RADIANCE, name("merged radiance cache").c_str()
     ) == false) return false;
 
     /* Initialize the Surfel stack */
@@ -165,11 +170,15 @@ void SurfelCascadeResources::free(const Device& device) {
     device.device.destroySampler(surfel_rad_sampler);
 }
 
-bool SurfelCascadeResources::update_surfel_count(const Device& device, const SurfelCascadeParameters& params) {
-    uint32_t val = 0u;
-    const bool r = buf::extract_u32(device, surfel_stack, 0u, val);
-    surfel_count = val;
-    return r;
+bool SurfelCascadeResources::update_surfel_count(Device& device) {
+    /* The readback this frame requested last time resolved when the frame started */
+    ReadbackQueue::Handle& readback = count_readbacks[device.fbi];
+    const bool updated = device.readbacks.get(readback, &surfel_count);
+
+    /* Read back the stack pointer, once the Surfel passes so far are done with it */
+    /* (a failed request grows the readback slot for the next time, this frame only misses its update) */
+    readback = device.readbacks.request(device, device.get_frame().gcb, surfel_stack, 0u, sizeof(uint32_t));
+    return updated;
 }
 
 }  // namespace wyre
@@ -5,6 +5,7 @@
 #include "vulkan/hardware/buffer.h"
 #include "vulkan/hardware/image.h"
 #include "vulkan/hardware/descriptor.h"
+#include "vulkan/hardware/readback.h" /* ReadbackQueue */
 
 namespace wyre {
 
@@ -57,7 +58,12 @@ struct SurfelCascadeResources {
     vk::Sampler surfel_rad_sampler{};
 
     DescriptorSet desc_set{};
+    /* Number of live Surfels, as of a few frames ago. */
     uint32_t surfel_count = 0u;
+    /* Whether the last update failed to read back the live Surfel count, keeping an older count. */
+    bool surfel_count_stale = true;
+    /* Readbacks of the live Surfel count, requested by each frame in flight. */
+    ReadbackQueue::Handle count_readbacks[BUFFERS]{};
     uint32_t cascade_index = 0u;
 
     SurfelCascadeResources() = default;
@@ -72,8 +78,11 @@ struct SurfelCascadeResources {
     /** @brief Free the Surfel Cascade resources. */
     void free(const Device& device);
 
-    /** @brief Update the live Surfel count. */
-    bool update_surfel_count(const Device& device, const SurfelCascadeParameters& params);
+    /**
+     * @brief Update the live Surfel count with the latest resolved readback, and request a new readback.
+     * @returns False if the count wasn't updated. (the readback failed, or this frame requested none yet)
+     */
+    bool update_surfel_count(Device& device);
 };
 
 }  // namespace wyre
@@ -21,7 +21,7 @@ struct context_t {
     uint32_t frame_index;
 };
 
-GroundTruthPipeline::GroundTruthPipeline(Logger& logger, const Device& device, const Window& window, const DescriptorSet& bvh) {
+GroundTruthPipeline::GroundTruthPipeline(Logger& logger, const Device& device, const Window& window, const DescriptorSet& bvh, const scene::TriLayout tri_layout) {
     /* Load the compute shader module */
     shader_mod = shader::from_file(device.device, SURFEL_GT_SHADER).expect("failed to load ground truth shader.");
 
@@ -36,7 +36,8 @@ GroundTruthPipeline::GroundTruthPipeline(Logger& logger, const Device& device, c
         vk::Format::eR32G32B32A32Sfloat,
         vk::ImageAspectFlagBits::eColor, 
         vk::ImageLayout::eGeneral, 
-        vk::ImageUsageFlagBits::eStorage
+        vk::ImageUsageFlagBits::eStorage,
+        MemoryCategory::RADIANCE, "ground truth"
     );
     cache_set.attach_storage_image(device, 0, radiance_cache.view, device.nearest_sampler, vk::ImageLayout::eGeneral);
 
@@ -47,6 +48,8 @@ GroundTruthPipeline::GroundTruthPipeline(Logger& logger, const Device& device, c
     builder.add_descriptor_set(cache_set.layout);
     builder.add_descriptor_set(device.get_frame().attach_store_desc.layout);
     builder.add_descriptor_set(bvh.layout);
+    /* Specialize the BVH primitive layout */
+    builder.add_specialization_constant(0, (uint32_t)tri_layout);
     /* Add the push constants */
     builder.add_push_constants(sizeof(context_t));
 
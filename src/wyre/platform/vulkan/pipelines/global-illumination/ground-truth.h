@@ -16,6 +16,10 @@ class Window;
 
 struct DescriptorSet;
 
+namespace scene {
+enum class TriLayout;
+}
+
 /**
  * @brief Vulkan ground truth pass pipeline.
  */
@@ -32,7 +36,7 @@ class GroundTruthPipeline {
     DescriptorSet cache_set{};
 
     GroundTruthPipeline() = delete;
-    explicit GroundTruthPipeline(Logger& logger, const Device& device, const Window& window, const DescriptorSet& bvh);
+    explicit GroundTruthPipeline(Logger& logger, const Device& device, const Window& window, const DescriptorSet& bvh, const scene::TriLayout tri_layout);
     ~GroundTruthPipeline() = default;
 
     /**
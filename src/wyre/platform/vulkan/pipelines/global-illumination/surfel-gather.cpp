@@ -19,7 +19,7 @@ namespace wyre {
 /* SAS populate shader */
 const char* SURFEL_GATHER_SHADER = "assets/shaders/surfels/gather.slang.spv";
 
-SurfelGatherPipeline::SurfelGatherPipeline(Logger& logger, const Device& device, const DescriptorSet& bvh, const SurfelCascadeResources& cascade) {
+SurfelGatherPipeline::SurfelGatherPipeline(Logger& logger, const Device& device, const DescriptorSet& bvh, const scene::TriLayout tri_layout, const SurfelCascadeResources& cascade) {
     /* Load the surfel draw compute shader module */
     shader_mod = shader::from_file(device.device, SURFEL_GATHER_SHADER).expect("failed to load surfel gather shader.");
 
@@ -31,6 +31,8 @@ SurfelGatherPipeline::SurfelGatherPipeline(Logger& logger, const Device& device,
     /* Descriptor sets */
     builder.add_descriptor_set(cascade.desc_set.layout);
     builder.add_descriptor_set(bvh.layout);
+    /* Specialize the BVH primitive layout */
+    builder.add_specialization_constant(0, (uint32_t)tri_layout);
     /* Add the push constants */
     builder.add_push_constants(sizeof(uint32_t));
 
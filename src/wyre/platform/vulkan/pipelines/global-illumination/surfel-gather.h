@@ -15,6 +15,10 @@ class Window;
 struct SurfelCascadeResources;
 struct DescriptorSet;
 
+namespace scene {
+enum class TriLayout;
+}
+
 /**
  * @brief Vulkan Surfel gathering pass pipeline.
  */
@@ -28,7 +32,7 @@ class SurfelGatherPipeline {
     vk::Pipeline pipeline = nullptr;
 
     SurfelGatherPipeline() = delete;
-    explicit SurfelGatherPipeline(Logger& logger, const Device& device, const DescriptorSet& bvh, const SurfelCascadeResources& cascade);
+    explicit SurfelGatherPipeline(Logger& logger, const Device& device, const DescriptorSet& bvh, const scene::TriLayout tri_layout, const SurfelCascadeResources& cascade);
     ~SurfelGatherPipeline() = default;
 
     /**
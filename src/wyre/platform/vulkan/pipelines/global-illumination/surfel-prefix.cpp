@@ -81,11 +81,9 @@ SurfelPrefixPipeline::SurfelPrefixPipeline(Logger& logger, const Device& device,
     if (prefix_pipeline(logger, device, cascade, segments_set, shader_segments, layout_segments, pipeline_segments) == false) return;
     if (prefix_pipeline(logger, device, cascade, segments_set, shader_merge, layout_merge, pipeline_merge) == false) return;
 
-    const buf::AllocParams alloc_ci{VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT};
-
     /* Allocate the Segments buffer */
     const uint32_t segments_size = sizeof(uint32_t) * THREAD_GROUP_SIZE;
-    if (!buf::alloc(device, segments_buffer, {segments_size, buf::Usage::eStorageBuffer | buf::Usage::eTransferDst}, alloc_ci)) {
+    if (!buf::alloc(device, segments_buffer, {segments_size, buf::Usage::eStorageBuffer | buf::Usage::eTransferDst}, {buf::Placement::GPU_ONLY, MemoryCategory::SURFELS, "prefix segments"})) {
         logger.log(LogGroup::GRAPHICS_API, LogLevel::CRITICAL, "failed to create surfel prefix sum segments buffer.");
         return;
     }
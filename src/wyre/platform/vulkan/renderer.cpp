@@ -7,6 +7,9 @@
 #include <imgui_impl_vulkan.h>
 #include <imgui_impl_sdl3.h>
 
+#include <fstream> /* std::ofstream */
+#include <string>  /* std::to_string */
+
 #include "stages/geometry.h"            /* GeometryStage */
 #include "stages/global-illumination.h" /* GIStage */
 #include "stages/final.h"               /* FinalStage */
@@ -18,16 +21,25 @@
 #include "wyre/core/components/transform.h"
 #include "wyre/core/components/camera.h"
 #include "wyre/core/system/input.h"
+#include "wyre/core/system/log.h"
+#include "wyre/core/system/window.h"
 #include "wyre/wyre.h"
 
 namespace wyre {
 
+/* Primitive layout the BLASes are intersected with on the GPU. (transforms are emitted by every BLAS build, in that layout) */
+constexpr scene::TriLayout TRI_LAYOUT = scene::TriLayout::VERTICES;
+/* Directory the built BLASes are cached in, relative to the working directory like the assets. */
+constexpr const char* BVH_CACHE_DIR = "cache/bvh";
+/* File the GPU memory registry is dumped to from the overlay. */
+constexpr const char* MEMORY_DUMP_PATH = "gpu-memory.json";
+
 /* Initialize the renderer stages */
 Renderer::Renderer(Logger& logger, const wyre::Window& window, const wyre::Device& device)
-    : bvh_maintainer(*new SceneBvhMaintainer()), 
-      bvh_packer(*new SceneBvhPacker(logger, device)),
-      geometry_stage(*new GeometryStage(logger, device, bvh_packer.bvh_desc)),
-      gi_stage(*new GIStage(logger, window, device, bvh_packer.bvh_desc)),
+    : bvh_maintainer(*new SceneBvhMaintainer(logger, BVH_CACHE_DIR, TRI_LAYOUT)), 
+      bvh_packer(*new SceneBvhPacker(logger, device, TRI_LAYOUT)),
+      geometry_stage(*new GeometryStage(logger, device, bvh_packer.get_desc(), TRI_LAYOUT)),
+      gi_stage(*new GIStage(logger, window, device, bvh_packer.get_desc(), TRI_LAYOUT)),
       final_stage(*new FinalStage(logger, window, device)) {}
 
 void Renderer::destroy(const wyre::Device& device) {
@@ -54,13 +66,15 @@ void Renderer::update(wyre::WyreEngine& engine, const float dt) {
 
 void Renderer::render(wyre::WyreEngine& engine) {
     /* Fetch the command buffer & render target */
-    const vk::CommandBuffer& cmd = engine.device.get_frame().gcb;
-    const buf::Buffer& render_view = engine.device.get_frame().render_view;
+    FrameData& frame = engine.device.get_frame();
     
-    /* New ImGui frame */
-    ImGui_ImplVulkan_NewFrame();
-    ImGui_ImplSDL3_NewFrame();
-    ImGui::NewFrame();
+    /* New ImGui frame (headless devices have no overlay) */
+    const bool has_overlay = engine.device.headless == false;
+    if (has_overlay) {
+        ImGui_ImplVulkan_NewFrame();
+        ImGui_ImplSDL3_NewFrame();
+        ImGui::NewFrame();
+    }
 
     /* Get the render view data */
     const Entity& camera_entity = engine.active_camera;
@@ -81,16 +95,23 @@ void Renderer::render(wyre::WyreEngine& engine) {
         .origin = transform->position, 
         .fov = glm::radians(camera->fov)
     };
-    buf::upload(engine.device, render_view, &current_view, sizeof(RenderView));
+    /* The render view buffer of this frame still holds an old view if the upload failed, so nothing is rendered with it */
+    if (!frame.staging.upload(engine.device, frame.render_view, 0u, &current_view, sizeof(RenderView))) {
+        engine.logger.log(LogGroup::GRAPHICS_API, LogLevel::WARNING, "failed to upload the render view of frame %u.", engine.device.fid);
+        return;
+    }
 
     /* Maintain */
     bvh_maintainer.maintain(engine.ecs);
 
     /* Package the BVH and send it to the GPU */
-    bvh_packer.package(engine.device, bvh_maintainer.bvh);
-    const DescriptorSet& bvh = bvh_packer.bvh_desc;
+    bvh_packer.package(engine.device, bvh_maintainer);
+    const DescriptorSet& bvh = bvh_packer.get_desc();
+
+    /* Record the uploads of this frame, before the render stages which read them */
+    frame.staging.flush(frame.gcb);
 
-    overlay(engine); /* <- debug overlay */
+    if (has_overlay) overlay(engine); /* <- debug overlay */
 
     /* Queue the render stages in order */
     geometry_stage.enqueue(engine.window, engine.device, bvh);
@@ -117,6 +138,26 @@ void Renderer::overlay(wyre::WyreEngine& engine) {
 
     ImGui::Begin("Performance", nullptr, overlay_flags);
     ImGui::Text("FPS: %f", 1.0f / last_dt);
+
+    /* Ray tracing throughput of the primary & surfel gathering passes */
+    const float primary_ms = geometry_stage.timer.get_ms(0u), gather_ms = gi_stage.gather_timer.get_ms(0u);
+    const float merge_ms = gi_stage.gather_timer.get_ms(1u);
+    const double primary_rays = (double)engine.window.width * engine.window.height;
+    double gather_rays = 0.0;
+    for (uint32_t i = 0u; i < CASCADE_COUNT; ++i) gather_rays += (double)gi_stage.cascades[i].surfel_rad.width * gi_stage.cascades[i].surfel_rad.height;
+    ImGui::Text("BVH: %s", bvh_maintainer.tri_layout == scene::TriLayout::TRANSFORMS ? "tri transforms" : "tri vertices");
+    ImGui::Text("BVH memory: %.1f MB (%.1f KB uploaded)", bvh_packer.memory_size() / 1e6, bvh_packer.upload_bytes / 1e3);
+    if (primary_ms > 0.0f) ImGui::Text("Primary: %.2f ms (%.0f MRays/s)", primary_ms, primary_rays / (primary_ms * 1e3));
+    if (gather_ms > 0.0f) ImGui::Text("Gather: %.2f ms (%.0f MRays/s)", gather_ms, gather_rays / (gather_ms * 1e3));
+    if (merge_ms > 0.0f) ImGui::Text("Merge: %.2f ms", merge_ms);
+
+    /* GPU memory, against the budget of the device local heaps */
+    const MemoryRegistry& memory = engine.device.memory;
+    uint64_t local_usage = 0u, local_budget = 0u;
+    for (const MemoryRegistry::Heap& heap : MemoryRegistry::heaps(engine.device)) {
+        if (heap.device_local) local_usage += heap.usage, local_budget += heap.budget;
+    }
+    ImGui::Text("GPU memory: %.1f MB (%.1f / %.1f MB device local)", memory.total() / 1e6, local_usage / 1e6, local_budget / 1e6);
     ImGui::End();
     
     /* Surfel Overlay */
@@ -127,8 +168,9 @@ void Renderer::overlay(wyre::WyreEngine& engine) {
     ImGui::Begin("Surfels", nullptr, overlay_flags);
     ImGui::Text("Surfel Usage: ");
     ImGui::SameLine();
-    ImGui::Text("(%u)", gi_stage.cascades[gi_stage.debug_cascade_index].surfel_count);
-    ImGui::ProgressBar((float)gi_stage.cascades[gi_stage.debug_cascade_index].surfel_count / gi_stage.cascade_params.get_probe_capacity(gi_stage.debug_cascade_index));
+    const SurfelCascadeResources& debug_cascade = gi_stage.cascades[gi_stage.debug_cascade_index];
+    ImGui::Text("(%u%s)", debug_cascade.surfel_count, debug_cascade.surfel_count_stale ? ", stale" : "");
+    ImGui::ProgressBar((float)debug_cascade.surfel_count / gi_stage.cascade_params.get_probe_capacity(gi_stage.debug_cascade_index));
     if (ImGui::Button(show_surfel ? "Close Debugger" : "Open Debugger")) {
         show_surfel = !show_surfel;
     }
@@ -281,14 +323,44 @@ void Renderer::overlay(wyre::WyreEngine& engine) {
             ImGui::Text("Total Rays: %.2f GRays (%u)", (float)total_rays / 1'000'000'000.0f, total_rays);
             ImGui::Text("60FPS Rays: %.2f GRays/s", (float)total_rays / 1'000'000'000.0f * 60.0f);
 
-            /* Memory */
-            // const uint32_t radiance_mem = total_rays * sizeof(uint32_t) /* rgb9e5 */;
-            // ImGui::Text("Radiance Memory: %.2f MB (rgb9e5)", radiance_mem / 1'000'000.0f);
-            // const uint32_t surfel_mem = gi_stage.cascade.surfel_posr.size 
-            //     + gi_stage.cascade.surfel_norw.size
-            //     + gi_stage.cascade.surfel_stack.size
-            //     + gi_stage.cascade.surfel_accel.size;
-            // ImGui::Text("Surfel Memory: %.2f MB", surfel_mem / 1'000'000.0f);
+            /* Memory (live allocations of the cascades in the memory registry) */
+            for (uint32_t i = 0u; i < CASCADE_COUNT; ++i) {
+                const std::string prefix = "c" + std::to_string(i) + " ";
+                const uint64_t radiance_mem = memory.bytes(MemoryCategory::RADIANCE, prefix.c_str());
+                const uint64_t surfel_mem = memory.bytes(MemoryCategory::SURFELS, prefix.c_str());
+                ImGui::Text("[c%u] Radiance Memory: %.2f MB, Surfel Memory: %.2f MB", i, radiance_mem / 1e6, surfel_mem / 1e6);
+            }
+
+            ImGui::EndTabItem();
+        }
+
+        if (ImGui::BeginTabItem("GPU Memory")) {
+            ImGui::SeparatorText("Categories");
+
+            ImGui::BeginTable("Memory Categories", 2);
+            for (uint32_t c = 0u; c < (uint32_t)MemoryCategory::COUNT; ++c) {
+                ImGui::TableNextColumn();
+                ImGui::Text("%s", category_name((MemoryCategory)c));
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f MB", memory.bytes((MemoryCategory)c) / 1e6);
+                ImGui::TableNextRow();
+            }
+            ImGui::EndTable();
+
+            ImGui::SeparatorText("Heaps");
+            const std::vector<MemoryRegistry::Heap> heaps = MemoryRegistry::heaps(engine.device);
+            for (uint32_t i = 0u; i < heaps.size(); ++i) {
+                ImGui::Text("[%u] %s: %.1f / %.1f MB (%.1f MB heap)", i, heaps[i].device_local ? "device local" : "host", heaps[i].usage / 1e6,
+                            heaps[i].budget / 1e6, heaps[i].size / 1e6);
+                ImGui::ProgressBar(heaps[i].budget ? (float)heaps[i].usage / heaps[i].budget : 0.0f);
+            }
+
+            if (ImGui::Button("Dump JSON")) {
+                std::ofstream file(MEMORY_DUMP_PATH);
+                file << memory.to_json(engine.device);
+                if (file.good()) engine.logger.log(LogGroup::GRAPHICS_API, LogLevel::INFO, "dumped gpu memory to '%s'.", MEMORY_DUMP_PATH);
+                else engine.logger.log(LogGroup::GRAPHICS_API, LogLevel::WARNING, "failed to dump gpu memory to '%s'.", MEMORY_DUMP_PATH);
+            }
 
             ImGui::EndTabItem();
         }
@@ -1,77 +1,296 @@
 /**
- * @file stages/bvh-packer.cpp
+ * @file scene/bvh-packer.cpp
  * @brief Vulkan bvh packer stage. (sends BVH to the GPU)
  */
 #include "bvh-packer.h"
 
 #include "vulkan/device.h"
 
-#include "wyre/core/scene/bvh.h" /* scene::Bvh */
+#include <algorithm> /* std::max, std::find, std::find_if, std::upper_bound, std::copy */
+#include <cstring>   /* memcmp */
+#include <vector>    /* std::vector */
+
+#include "wyre/core/scene/bvh-maintainer.h" /* SceneBvhMaintainer */
 #include "wyre/core/system/log.h"
 
 namespace wyre {
 
 using namespace scene;
 
-const uint32_t BUF_SIZE = 1056818 * 2;
-
-SceneBvhPacker::SceneBvhPacker(Logger& logger, const Device& device) {
-    const buf::AllocParams alloc_ci {VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT};
-    /* Allocate the BVH nodes buffer */
-    if (!buf::alloc(device, bvh_nodes, {sizeof(Bvh::GPUNode) * BUF_SIZE, buf::Usage::eStorageBuffer | buf::Usage::eTransferDst}, alloc_ci)) {
-        logger.log(LogGroup::GRAPHICS_API, LogLevel::CRITICAL, "failed to allocate bvh nodes buffer.");
-        return;
-    }
-    /* Allocate the BVH primitives buffer */
-    if (!buf::alloc(device, bvh_prims, {sizeof(Triangle) * BUF_SIZE, buf::Usage::eStorageBuffer | buf::Usage::eTransferDst}, alloc_ci)) {
-        logger.log(LogGroup::GRAPHICS_API, LogLevel::CRITICAL, "failed to allocate bvh vertex buffer.");
-        return;
-    }
-    /* Allocate the BVH normals buffer */
-    if (!buf::alloc(device, bvh_norms, {sizeof(Normals) * BUF_SIZE, buf::Usage::eStorageBuffer | buf::Usage::eTransferDst}, alloc_ci)) {
-        logger.log(LogGroup::GRAPHICS_API, LogLevel::CRITICAL, "failed to allocate bvh normal buffer.");
-        return;
-    }
+/* Minimum capacity of the BVH buffers, in elements. */
+const uint32_t MIN_CAPACITY = 64u;
+/* Changed ranges closer together than this many elements are uploaded as one. */
+const uint32_t MERGE_DISTANCE = 16u;
+/* BLAS data uploaded per frame at most, in bytes. (larger scenes are uploaded over several frames, a BLAS is never split) */
+const uint64_t BLAS_UPLOAD_BUDGET = StagingRing::MAX_CAPACITY;
 
+SceneBvhPacker::SceneBvhPacker(Logger& logger, const Device& device, const TriLayout tri_layout)
+    : logger(logger), tri_layout(tri_layout) {
     DescriptorBuilder bvh_desc_builder {};
     /* Constant buffer(s) */
     bvh_desc_builder.add_binding(0, vk::DescriptorType::eStorageBuffer);
     bvh_desc_builder.add_binding(1, vk::DescriptorType::eStorageBuffer);
     bvh_desc_builder.add_binding(2, vk::DescriptorType::eStorageBuffer);
+    bvh_desc_builder.add_binding(3, vk::DescriptorType::eStorageBuffer);
+    bvh_desc_builder.add_binding(4, vk::DescriptorType::eStorageBuffer);
+    bvh_desc_builder.add_binding(5, vk::DescriptorType::eStorageBuffer);
+
+    /* Build the BVH descriptor sets, one per buffer set */
+    for (BufferSet& set : sets) {
+        set.desc = bvh_desc_builder.build(device, vk::ShaderStageFlagBits::eCompute);
+
+        /* Allocate small buffers, they grow with the scene once it's packaged */
+        set.bvh_nodes = {{}, 0u, sizeof(Bvh::GPUNode)};
+        set.bvh_prims = {{}, 1u, sizeof(Triangle)};
+        set.bvh_norms = {{}, 2u, sizeof(Normals)};
+        set.tlas_nodes = {{}, 3u, sizeof(Bvh::GPUNode)};
+        set.instances = {{}, 4u, sizeof(SceneBvhMaintainer::GPUInstance)};
+        set.tri_xforms = {{}, 5u, sizeof(TriangleTransform)};
+        bool grown = false;
+        for (SceneBuffer* buffer : {&set.bvh_nodes, &set.bvh_prims, &set.bvh_norms, &set.tlas_nodes, &set.instances, &set.tri_xforms}) {
+            if (!reserve(device, set, *buffer, 1u, grown)) {
+                logger.log(LogGroup::GRAPHICS_API, LogLevel::CRITICAL, "failed to allocate bvh buffer %u.", buffer->binding);
+                return;
+            }
+        }
+    }
+}
+
+bool SceneBvhPacker::reserve(const Device& device, BufferSet& set, SceneBuffer& buffer, const uint32_t count, bool& grown) {
+    if (count <= buffer.capacity) return true;
+
+    /* Grow geometrically, so a growing scene only re-allocates a few times */
+    const uint32_t capacity = std::max({count, buffer.capacity + buffer.capacity / 2u, MIN_CAPACITY});
+
+    /* The buffers of the active set are in use by the frames in flight, the inactive set isn't */
+    if (buffer.capacity > 0u) {
+        if (&set == &sets[active]) return false;
+        buffer.buffer.free(device);
+        buffer.capacity = 0u;
+    }
+    const buf::Size size = (buf::Size)buffer.stride * capacity;
+    const buf::UsageFlags usage = buf::Usage::eStorageBuffer | buf::Usage::eTransferDst | buf::Usage::eTransferSrc;
+    if (!buf::alloc(device, buffer.buffer, {size, usage}, {buf::Placement::GPU_ONLY, MemoryCategory::BVH, "scene bvh"}, false)) return false;
+    buffer.capacity = capacity;
+    set.desc.attach_storage_buffer(device, buffer.binding, buffer.buffer.buffer, (uint32_t)size);
+    grown = true;
+    return true;
+}
 
-    /* Build the BVH descriptor set */
-    bvh_desc = bvh_desc_builder.build(device, vk::ShaderStageFlagBits::eCompute);
-    bvh_desc.attach_storage_buffer(device, 0, bvh_nodes.buffer, sizeof(Bvh::GPUNode) * BUF_SIZE);
-    bvh_desc.attach_storage_buffer(device, 1, bvh_prims.buffer, sizeof(Triangle) * BUF_SIZE);
-    bvh_desc.attach_storage_buffer(device, 2, bvh_norms.buffer, sizeof(Normals) * BUF_SIZE);
+/** @brief Upload data into a BVH buffer, through the staging ring of the frame. (the GPU reads the buffers from device local memory) */
+static bool stage(Device& device, const buf::Buffer& dst, const buf::Size offset, const buf::Size size, const void* data) {
+    return device.get_frame().staging.upload(device, dst, offset, data, size);
+}
+
+template <typename T>
+bool SceneBvhPacker::upload_changes(Device& device, const SceneBuffer& buffer, const T* data, const uint32_t count, std::vector<T>& uploaded) {
+    /* Upload everything if the array changed size (if that fails, the array is uploaded whole again next time) */
+    if (uploaded.size() != count) {
+        if (!stage(device, buffer.buffer, 0u, sizeof(T) * count, data)) {
+            uploaded.clear();
+            return false;
+        }
+        uploaded.assign(data, data + count);
+        upload_bytes += sizeof(T) * count;
+        return true;
+    }
+
+    /* Find the changed ranges, merging ranges which are close together (ranges which failed to upload stay changed) */
+    uint32_t first = ~0u, last = 0u;
+    bool staged = true;
+    const auto flush = [&]() {
+        if (first == ~0u) return;
+        if (stage(device, buffer.buffer, sizeof(T) * first, sizeof(T) * (last - first), data + first)) {
+            std::copy(data + first, data + last, uploaded.begin() + first);
+            upload_bytes += sizeof(T) * (last - first);
+        } else {
+            staged = false;
+        }
+        first = ~0u;
+    };
+    for (uint32_t i = 0u; i < count; ++i) {
+        if (memcmp(&data[i], &uploaded[i], sizeof(T)) == 0) continue;
+        if (first != ~0u && i > last + MERGE_DISTANCE) flush();
+        if (first == ~0u) first = i;
+        last = i + 1u;
+    }
+    flush();
+    return staged;
 }
 
 /**
  * @brief Pack the scene BVH and upload it to the GPU buffer.
  */
-void SceneBvhPacker::package(const Device& device, const scene::Bvh& bvh) {
-    /* TEMP: only upload BVH once for now. */
-    static uint32_t pre_nodes_used = 0;
-    static uint32_t pre_prim_count = 0;
-
-    /* Update the BVH nodes buffer */
-    if (bvh.gpu_nodes && pre_nodes_used != bvh.nodes_used) { 
-        buf::upload(device, bvh_nodes, bvh.gpu_nodes, sizeof(Bvh::GPUNode) * bvh.nodes_used);
-        pre_nodes_used = bvh.nodes_used;
+void SceneBvhPacker::package(Device& device, const SceneBvhMaintainer& maintainer) {
+    upload_bytes = 0u;
+
+    /* The TLAS & instances of the active set follow the scene every frame, also while new BLASes are uploaded */
+    BufferSet& current = sets[active];
+    if (package_instances(device, current, maintainer) && current.blas_version == maintainer.blas_version) return;
+
+    /* New BLASes, and instances outgrowing the active set, go into the inactive set once no frame in flight uses it */
+    BufferSet& next = sets[active ^ 1u];
+    if (device.fid < next.free_frame) return;
+    if (next.blas_version != maintainer.blas_version) next.blas_version = maintainer.blas_version, next.instance_version = ~0u;
+    if (!package_blases(device, next, maintainer) || !package_instances(device, next, maintainer)) return;
+
+    /* The set only becomes active once its instances made it into the staging ring */
+    if (next.instance_version != maintainer.instance_version) return;
+
+    /* Swap the sets at this frame, the previous frames might still be using the old set */
+    current.free_frame = device.fid + BUFFERS - 1u;
+    active ^= 1u;
+}
+
+bool SceneBvhPacker::package_blases(Device& device, BufferSet& set, const SceneBvhMaintainer& maintainer) {
+    /* Size the buffers to the scene (only the primitive layout intersected by the GPU is filled) */
+    const bool transforms = tri_layout == TriLayout::TRANSFORMS;
+    bool grown = false;
+    if (!reserve(device, set, set.bvh_nodes, maintainer.blas_nodes, grown) || !reserve(device, set, set.bvh_prims, transforms ? 1u : maintainer.blas_prims, grown) ||
+        !reserve(device, set, set.bvh_norms, maintainer.blas_prims, grown) ||
+        !reserve(device, set, set.tri_xforms, transforms ? maintainer.blas_prims : 1u, grown)) {
+        logger.log(LogGroup::GRAPHICS_API, LogLevel::CRITICAL, "failed to grow the bvh buffers.");
+        return false;
+    }
+
+    /* Growing the buffers lost their contents, so every BLAS is uploaded again */
+    if (grown) set.uploaded_blases.clear();
+
+    /* Concatenate all BLASes, offsetting their child & primitive indices */
+    std::vector<UploadedBlas> placed {};
+    bool complete = true;
+    uint64_t blas_upload_bytes = 0u;
+    for (const SceneBvhMaintainer::Blas& blas : maintainer.blases) {
+        const Bvh& bvh = blas.bvh;
+        const UploadedBlas placement {blas.hash, blas.node_offset, blas.prim_offset, bvh.nodes_used, bvh.prim_count};
+
+        /* BLASes which are still in place were uploaded before */
+        if (std::find(set.uploaded_blases.begin(), set.uploaded_blases.end(), placement) != set.uploaded_blases.end()) {
+            placed.push_back(placement);
+            continue;
+        }
+
+        /* BLASes which don't fit in the upload budget of this frame are uploaded by the next frames */
+        const uint64_t blas_bytes = sizeof(Bvh::GPUNode) * bvh.nodes_used + (transforms ? sizeof(TriangleTransform) : sizeof(Triangle)) * bvh.prim_count +
+                                    sizeof(Normals) * bvh.prim_count;
+        if (blas_upload_bytes > 0u && blas_upload_bytes + blas_bytes > BLAS_UPLOAD_BUDGET) {
+            complete = false;
+            continue;
+        }
+
+        node_scratch.resize(bvh.nodes_used);
+        for (uint32_t i = 0u; i < bvh.nodes_used; ++i) {
+            Bvh::GPUNode node = bvh.gpu_nodes[i];
+            if (node.prim_count > 0u) {
+                node.prim_index += blas.prim_offset;
+            } else {
+                node.left += blas.node_offset;
+                node.right += blas.node_offset;
+            }
+            node_scratch[i] = node;
+        }
+        bool staged = stage(device, set.bvh_nodes.buffer, sizeof(Bvh::GPUNode) * blas.node_offset, sizeof(Bvh::GPUNode) * bvh.nodes_used, node_scratch.data());
+
+        /* Primitives need no patching, they are written straight from the BLAS arrays (which may be memory mapped from the BVH cache) */
+        if (transforms) staged &= stage(device, set.tri_xforms.buffer, sizeof(TriangleTransform) * blas.prim_offset, sizeof(TriangleTransform) * bvh.prim_count, bvh.gpu_tris);
+        else staged &= stage(device, set.bvh_prims.buffer, sizeof(Triangle) * blas.prim_offset, sizeof(Triangle) * bvh.prim_count, bvh.prims);
+        staged &= stage(device, set.bvh_norms.buffer, sizeof(Normals) * blas.prim_offset, sizeof(Normals) * bvh.prim_count, bvh.norms);
+        blas_upload_bytes += blas_bytes;
+
+        /* BLASes which failed to stage aren't placed, so the next frames upload them again */
+        if (!staged) {
+            complete = false;
+            continue;
+        }
+        placed.push_back(placement);
+    }
+    set.uploaded_blases = std::move(placed);
+    upload_bytes += blas_upload_bytes;
+    return complete;
+}
+
+bool SceneBvhPacker::package_instances(Device& device, BufferSet& set, const SceneBvhMaintainer& maintainer) {
+    const Bvh& tlas = maintainer.tlas;
+    if (set.instance_version == maintainer.instance_version) return true;
+    if (tlas.gpu_nodes == nullptr) {
+        set.instance_version = maintainer.instance_version;
+        return true;
+    }
+
+    /* A set without any BLAS has nothing for the instances to point at (the scene moves into the other set instead) */
+    const bool remap = set.blas_version != maintainer.blas_version;
+    if (remap && set.uploaded_blases.empty()) return false;
+
+    /* Size the buffers to the instances, growing loses the last upload (the active set can't grow, the scene moves into the other set instead) */
+    const bool in_use = &set == &sets[active];
+    if (in_use && (tlas.nodes_used > set.tlas_nodes.capacity || tlas.prim_count > set.instances.capacity)) return false;
+    bool grown = false;
+    if (!reserve(device, set, set.tlas_nodes, tlas.nodes_used, grown) || !reserve(device, set, set.instances, tlas.prim_count, grown)) {
+        logger.log(LogGroup::GRAPHICS_API, LogLevel::CRITICAL, "failed to grow the tlas buffers.");
+        return false;
     }
-    if (bvh.prims && pre_prim_count != bvh.prim_count) { 
-        buf::upload(device, bvh_prims, bvh.prims, sizeof(Triangle) * bvh.prim_count);
-        buf::upload(device, bvh_norms, bvh.norms, sizeof(Normals) * bvh.prim_count);
-        pre_prim_count = bvh.prim_count;
+    if (grown) set.uploaded_tlas.clear(), set.uploaded_instances.clear();
+
+    /* Until the set holds the BLAS layout of the maintainer, the instances point at the BLASes where the set holds them */
+    const SceneBvhMaintainer::GPUInstance* instances = maintainer.gpu_instances.data();
+    if (remap) {
+        remap_instances(set, maintainer);
+        instances = instance_scratch.data();
     }
+
+    /* Refits & moved instances only change a few ranges (if uploading fails, the version is left behind so the next package retries) */
+    const bool staged = upload_changes(device, set.tlas_nodes, tlas.gpu_nodes, tlas.nodes_used, set.uploaded_tlas);
+    if (upload_changes(device, set.instances, instances, tlas.prim_count, set.uploaded_instances) && staged) set.instance_version = maintainer.instance_version;
+    return true;
+}
+
+void SceneBvhPacker::remap_instances(const BufferSet& set, const SceneBvhMaintainer& maintainer) {
+    using Blas = SceneBvhMaintainer::Blas;
+    const std::vector<Blas>& blases = maintainer.blases;
+
+    /* Root of every BLAS of the maintainer in the set, found by its hash */
+    blas_roots.resize(blases.size());
+    for (size_t b = 0u; b < blases.size(); ++b) {
+        const uint64_t hash = blases[b].hash;
+        const auto held = std::find_if(set.uploaded_blases.begin(), set.uploaded_blases.end(), [hash](const UploadedBlas& u) { return u.hash == hash; });
+        blas_roots[b] = held != set.uploaded_blases.end() ? held->node_offset : ~0u;
+    }
+
+    instance_scratch.assign(maintainer.gpu_instances.begin(), maintainer.gpu_instances.end());
+    for (SceneBvhMaintainer::GPUInstance& instance : instance_scratch) {
+        /* The BLASes are laid out in order, so the BLAS of an instance is the last one starting at its root */
+        const auto blas = std::upper_bound(blases.begin(), blases.end(), instance.blas_root, [](const uint32_t root, const Blas& b) { return root < b.node_offset; });
+        const uint32_t root = blas != blases.begin() ? blas_roots[(blas - blases.begin()) - 1] : ~0u;
+        if (root != ~0u) {
+            instance.blas_root = root;
+            continue;
+        }
+
+        /* Move instances of BLASes the set doesn't hold yet far out of their object space, so no ray reaches their BLAS */
+        for (glm::vec4& row : instance.inv_model) row.w = 1e30f;
+        instance.blas_root = 0u;
+    }
+}
+
+buf::Size SceneBvhPacker::memory_size() const {
+    buf::Size size = 0u;
+    for (const BufferSet& set : sets) {
+        for (const SceneBuffer* buffer : {&set.bvh_nodes, &set.bvh_prims, &set.bvh_norms, &set.tlas_nodes, &set.instances, &set.tri_xforms}) {
+            size += (buf::Size)buffer->stride * buffer->capacity;
+        }
+    }
+    return size;
 }
 
 void SceneBvhPacker::destroy(const Device& device) {
     /* Free BVH data */
-    bvh_desc.free(device);
-    bvh_nodes.free(device);
-    bvh_prims.free(device);
-    bvh_norms.free(device);
+    for (BufferSet& set : sets) {
+        set.desc.free(device);
+        for (SceneBuffer* buffer : {&set.bvh_nodes, &set.bvh_prims, &set.bvh_norms, &set.tlas_nodes, &set.instances, &set.tri_xforms}) {
+            if (buffer->capacity > 0u) buffer->buffer.free(device);
+            buffer->capacity = 0u;
+        }
+    }
 }
 
 }  // namespace wyre
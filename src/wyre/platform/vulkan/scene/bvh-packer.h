@@ -1,3 +1,7 @@
+/**
+ * @file scene/bvh-packer.h
+ * @brief Vulkan bvh packer stage. (sends BVH to the GPU)
+ */
 #pragma once
 
 #include "vulkan/api.h"
@@ -5,11 +9,11 @@
 #include "vulkan/hardware/descriptor.h" /* DescriptorSet */
 #include "vulkan/hardware/buffer.h"     /* buf:: */
 
-namespace wyre {
+#include "wyre/core/scene/bvh-maintainer.h" /* SceneBvhMaintainer::GPUInstance */
 
-namespace scene {
-struct Bvh;
-}
+#include <vector> /* std::vector */
+
+namespace wyre {
 
 class Logger;
 class Device;
@@ -19,13 +23,72 @@ class Device;
  */
 class SceneBvhPacker {
     friend class Renderer;
-    
-    buf::Buffer bvh_nodes{}; /* AABB Nodes */
-    buf::Buffer bvh_prims{}; /* Vertices */
-    buf::Buffer bvh_norms{}; /* Normals */
+
+    /* GPU buffer of the BVH descriptor set, sized to the scene. */
+    struct SceneBuffer {
+        buf::Buffer buffer {};
+        /* Binding in the BVH descriptor set. */
+        uint32_t binding = 0u;
+        /* Element size in bytes, and capacity in elements. */
+        uint32_t stride = 0u, capacity = 0u;
+    };
+
+    /* BLAS placement in the buffers when it was uploaded, BLASes which are still in place aren't uploaded again. */
+    struct UploadedBlas {
+        uint64_t hash = 0u;
+        uint32_t node_offset = 0u, prim_offset = 0u;
+        uint32_t node_count = 0u, prim_count = 0u;
+
+        bool operator==(const UploadedBlas& other) const = default;
+    };
+
+    /**
+     * @brief Scene buffers & the descriptor set they are bound to.
+     * The scene is double buffered, new BLASes are uploaded into the set which isn't in use by any frame,
+     * and the sets are swapped at the start of the frame which first uses them.
+     */
+    struct BufferSet {
+        DescriptorSet desc {};
+
+        SceneBuffer bvh_nodes{}; /* BLAS AABB Nodes */
+        SceneBuffer bvh_prims{}; /* BLAS Vertices */
+        SceneBuffer bvh_norms{}; /* BLAS Normals */
+        SceneBuffer tlas_nodes{}; /* TLAS AABB Nodes */
+        SceneBuffer instances{};  /* Mesh instances */
+        SceneBuffer tri_xforms{}; /* BLAS pre-transformed triangles */
+
+        /* BLASes which are in the buffers. */
+        std::vector<UploadedBlas> uploaded_blases {};
+        /* Last uploaded TLAS nodes & instances, only the ranges which changed since are uploaded. */
+        std::vector<scene::Bvh::GPUNode> uploaded_tlas {};
+        std::vector<SceneBvhMaintainer::GPUInstance> uploaded_instances {};
+
+        /* First frame index on which the set may be written, once the frames which used it finished. */
+        uint32_t free_frame = 0u;
+        /* Maintainer BLAS version of the layout the set holds (or is being filled with), and instance version of its last instance upload. */
+        uint32_t blas_version = 0u, instance_version = 0u;
+    };
+
+    Logger& logger;
+
+    /* Scene buffer sets, the active set is the one frames are rendered with. */
+    BufferSet sets[2] {};
+    uint32_t active = 0u;
+
+    /* Layout of the primitives, the buffer of the other layout stays empty. */
+    scene::TriLayout tri_layout = scene::TriLayout::VERTICES;
+
+    /* Scratch space for offsetting the nodes of a BLAS. */
+    std::vector<scene::Bvh::GPUNode> node_scratch {};
+    /* Scratch space for pointing the instances at the BLASes of a set with an older layout. */
+    std::vector<SceneBvhMaintainer::GPUInstance> instance_scratch {};
+    std::vector<uint32_t> blas_roots {};
+
+    /* Number of bytes uploaded by the last package. */
+    uint64_t upload_bytes = 0u;
 
     SceneBvhPacker() = delete;
-    explicit SceneBvhPacker(Logger& logger, const Device& device);
+    explicit SceneBvhPacker(Logger& logger, const Device& device, const scene::TriLayout tri_layout);
     ~SceneBvhPacker() = default;
 
     /**
@@ -34,13 +97,50 @@ class SceneBvhPacker {
     void destroy(const Device& device);
 
     /**
-     * @brief Package the given BVH.
+     * @brief Package the scene BVH of the given maintainer, only uploading what changed since the last package.
+     * The TLAS & instances of the active set are uploaded every frame, new BLASes are uploaded into the inactive buffer set,
+     * which becomes active once it holds the whole scene. Until then, instances of new BLASes are left out of the active set.
+     * Large scenes are uploaded over several frames, only the BLASes are limited by the upload budget of a frame.
+     * Uploads are recorded into the frame command buffer through its staging ring, before the frame's render stages.
+     */
+    void package(Device& device, const SceneBvhMaintainer& maintainer);
+
+    /**
+     * @brief Upload the BLASes which aren't in the buffers of a set yet, within the upload budget of a frame.
+     * @returns False if the buffers couldn't grow, or if some BLASes are left for the next frames. (over budget, or failed to stage)
+     */
+    bool package_blases(Device& device, BufferSet& set, const SceneBvhMaintainer& maintainer);
+
+    /**
+     * @brief Upload the ranges of the TLAS nodes & instances which changed.
+     * If staging the uploads fails, the instance version of the set is left behind, so the next package uploads them again.
+     * @returns False if the buffers couldn't grow, the buffers of the active set never grow.
      */
-    void package(const Device& device, const scene::Bvh& bvh);
+    bool package_instances(Device& device, BufferSet& set, const SceneBvhMaintainer& maintainer);
+
+    /** @brief Point the instances at the BLASes of a set with an older layout (into the instance scratch), instances of BLASes the set doesn't hold are moved out of reach. */
+    void remap_instances(const BufferSet& set, const SceneBvhMaintainer& maintainer);
+
+    /**
+     * @brief Grow a buffer to hold at least a number of elements, the contents are lost when it grows.
+     * The buffers of the active set are in use by the frames in flight, so they never grow once allocated.
+     * @param grown Set if the buffer grew.
+     */
+    bool reserve(const Device& device, BufferSet& set, SceneBuffer& buffer, const uint32_t count, bool& grown);
+
+    /**
+     * @brief Upload the ranges of an array which differ from its last upload.
+     * @returns False if some ranges couldn't be staged, they still differ from the last upload so they are uploaded again next time.
+     */
+    template <typename T>
+    bool upload_changes(Device& device, const SceneBuffer& buffer, const T* data, const uint32_t count, std::vector<T>& uploaded);
+
+    /** @returns The total size of the BVH buffers, in bytes. */
+    buf::Size memory_size() const;
 
    public:
-    /* Descriptor set */
-    DescriptorSet bvh_desc{};
+    /** @returns The BVH descriptor set of the scene buffers frames are rendered with. */
+    inline const DescriptorSet& get_desc() const { return sets[active].desc; }
 };
 
 }  // namespace wyre
@@ -10,6 +10,9 @@ namespace wyre::shader {
 
 using Bytes = std::vector<std::byte>;
 
+/* First word of every SPIR-V module. */
+constexpr uint32_t SPIRV_MAGIC = 0x07230203u;
+
 /**
  * @brief Read the binary data of a file into a vector.
  */
@@ -36,6 +39,11 @@ Result<vk::ShaderModule> from_file(vk::Device device, std::string_view path) {
     if (r_bytes.is_err()) return Err(r_bytes.unwrap_err());
     const Bytes bytes = r_bytes.unwrap();
 
+    /* Drivers don't validate the code, an empty or truncated file (e.g. a failed shader compile) could crash them */
+    if (bytes.size() < 5u * sizeof(uint32_t) || bytes.size() % sizeof(uint32_t) != 0u || *(const uint32_t*)bytes.data() != SPIRV_MAGIC) {
+        return Err("invalid spir-v binary. '%s'", path.data());
+    }
+
     /* Shader module create info */
     vk::ShaderModuleCreateInfo create_info = {};
     create_info.codeSize = bytes.size();
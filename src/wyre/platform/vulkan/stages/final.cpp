@@ -6,12 +6,13 @@
 
 #include "vulkan/pipelines/final/final.h" /* FinalPipeline */
 #include "vulkan/pipelines/final/overlay.h" /* OverlayPipeline */
+#include "vulkan/device.h"
 
 namespace wyre {
 
 FinalStage::FinalStage(Logger& logger, const Window& window, const Device& device) 
     : final_pipeline(*new FinalPipeline(logger, window, device)),
-    overlay_pipeline(*new OverlayPipeline(logger, window, device)) {}
+    overlay_pipeline(device.headless ? nullptr : new OverlayPipeline(logger, window, device)) {}
 
 /**
  * @brief Push final stage commands into the graphics command buffer.
@@ -21,15 +22,17 @@ void FinalStage::enqueue(const Window& window, const Device& device) {
 
 #if 1
     /* TODO: Only include the overlay pass for development. */
-    overlay_pipeline.enqueue(window, device);
+    if (overlay_pipeline) overlay_pipeline->enqueue(window, device);
 #endif
 }
 
 void FinalStage::destroy(const Device& device) {
     final_pipeline.destroy(device);
     delete &final_pipeline;
-    overlay_pipeline.destroy(device);
-    delete &overlay_pipeline;
+    if (overlay_pipeline) {
+        overlay_pipeline->destroy(device);
+        delete overlay_pipeline;
+    }
 }
 
 }  // namespace wyre
@@ -23,7 +23,8 @@ class FinalStage {
 
     /* Pipelines */
     FinalPipeline& final_pipeline;
-    OverlayPipeline& overlay_pipeline;
+    /* Debug overlay, null on headless devices. (they have no window to draw it for) */
+    OverlayPipeline* overlay_pipeline = nullptr;
 
     FinalStage() = delete;
     explicit FinalStage(Logger& logger, const Window& window, const Device& device);
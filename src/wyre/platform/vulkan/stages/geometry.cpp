@@ -9,20 +9,27 @@
 
 namespace wyre {
 
-GeometryStage::GeometryStage(Logger& logger, const Device& device, const DescriptorSet& bvh) : primary_pipeline(*new PrimaryPipeline(logger, device, bvh)) {}
+GeometryStage::GeometryStage(Logger& logger, const Device& device, const DescriptorSet& bvh, const scene::TriLayout tri_layout)
+    : primary_pipeline(*new PrimaryPipeline(logger, device, bvh, tri_layout)) {
+    timer.init(device, 1u);
+}
 
 /**
  * @brief Push geometry stage commands into the graphics command buffer.
  */
 void GeometryStage::enqueue(const Window& window, const Device& device, const DescriptorSet& bvh) {
     debug::begin_label(device, "Geometry Pass", {0.659f, 0.988f, 0.192f});
+    timer.begin_frame(device);
+    timer.begin(device, 0u);
     primary_pipeline.enqueue(window, device, bvh);
+    timer.end(device, 0u);
     debug::end_label(device);
 }
 
 void GeometryStage::destroy(const Device& device) {
     primary_pipeline.destroy(device);
     delete &primary_pipeline;
+    timer.free(device);
 }
 
 }  // namespace wyre
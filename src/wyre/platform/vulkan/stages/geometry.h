@@ -6,6 +6,8 @@
 
 #include "vulkan/api.h"
 
+#include "vulkan/hardware/timer.h" /* GpuTimer */
+
 namespace wyre {
 
 class Window;
@@ -13,6 +15,10 @@ class Logger;
 class Device;
 struct DescriptorSet;
 
+namespace scene {
+enum class TriLayout;
+}
+
 class PrimaryPipeline;
 
 /**
@@ -24,8 +30,11 @@ class GeometryStage {
     /* Pipelines */
     PrimaryPipeline& primary_pipeline;
 
+    /* Times the primary ray tracing pass */
+    GpuTimer timer {};
+
     GeometryStage() = delete;
-    explicit GeometryStage(Logger& logger, const Device& device, const DescriptorSet& bvh);
+    explicit GeometryStage(Logger& logger, const Device& device, const DescriptorSet& bvh, const scene::TriLayout tri_layout);
     ~GeometryStage() = default;
 
     /**
@@ -27,24 +27,25 @@
 
 namespace wyre {
 
-GIStage::GIStage(Logger& logger, const Window& window, const Device& device, const DescriptorSet& bvh)
+GIStage::GIStage(Logger& logger, const Window& window, const Device& device, const DescriptorSet& bvh, const scene::TriLayout tri_layout)
     : cascade_dummy(device), /* <- This sucks... but whatever... */
       surfel_count_pipeline(*new SurfelCountPipeline(logger, device, cascade_dummy)),
       surfel_prefix_pipeline(*new SurfelPrefixPipeline(logger, device, cascade_dummy)),
       surfel_accel_pipeline(*new SurfelAccelerationPipeline(logger, device, cascade_dummy)),
       surfel_spawn_pipeline(*new SurfelSpawnPipeline(logger, device, cascade_dummy)),
-      surfel_gather_pipeline(*new SurfelGatherPipeline(logger, device, bvh, cascade_dummy)),
+      surfel_gather_pipeline(*new SurfelGatherPipeline(logger, device, bvh, tri_layout, cascade_dummy)),
       surfel_merge_pipeline(*new SurfelMergePipeline(logger, device, cascade_dummy)),
       surfel_composite_pipeline(*new SurfelCompositePipeline(logger, window, device, cascade_dummy)),
       surfel_recycle_pipeline(*new SurfelRecyclePipeline(logger, device, cascade_dummy)),
       surfel_debug_pipeline(*new SurfelDrawPipeline(logger, window, device, cascade_dummy)),
       surfel_heatmap_pipeline(*new SurfelHeatmapPipeline(logger, window, device, cascade_dummy)),
-      ground_truth_pipeline(*new GroundTruthPipeline(logger, device, window, bvh)) {
+      ground_truth_pipeline(*new GroundTruthPipeline(logger, device, window, bvh, tri_layout)) {
     for (uint32_t i = 0u; i < CASCADE_COUNT; ++i) {
         cascades[i] = SurfelCascadeResources(device);
     }
 
     init_resources(logger, device);
+    gather_timer.init(device, 2u);
 }
 
 void GIStage::init_resources(Logger& logger, const Device& device) {
@@ -60,7 +61,8 @@ void GIStage::init_resources(Logger& logger, const Device& device) {
 /**
  * @brief Push GI stage commands into the graphics command buffer.
  */
-void GIStage::enqueue(const Window& window, const Device& device, const DescriptorSet& bvh) {
+void GIStage::enqueue(const Window& window, Device& device, const DescriptorSet& bvh) {
+    gather_timer.begin_frame(device);
     if (ground_truth) {
         /* Ground truth pass */
         ground_truth_pipeline.enqueue(window, device, bvh);
@@ -149,8 +151,9 @@ void GIStage::enqueue(const Window& window, const Device& device, const Descript
             /* Src */ img::PStage::eComputeShader, img::Access::eShaderWrite,
             /* Dst */ img::PStage::eComputeShader, img::Access::eShaderRead);
             
-        /* Get the updated number of live Surfels from the GPU stack buffer */
-        cascade.update_surfel_count(device, cascade_params);
+        /* Read back the number of live Surfels from the GPU stack buffer (resolves a few frames later) */
+        /* (failures aren't fatal, the overlay shows the last count as stale) */
+        cascade.surfel_count_stale = cascade.update_surfel_count(device) == false;
     }
 
     for (uint32_t i = 0u; i < CASCADE_COUNT; ++i) {
@@ -177,6 +180,7 @@ void GIStage::enqueue(const Window& window, const Device& device, const Descript
     }
     
     debug::begin_label(device, "Surfel Gathering", {0.251f, 0.753f, 0.341f});
+    gather_timer.begin(device, 0u);
 
     for (uint32_t i = 0u; i < CASCADE_COUNT; ++i) {
         SurfelCascadeResources& cascade = cascades[i];
@@ -184,6 +188,7 @@ void GIStage::enqueue(const Window& window, const Device& device, const Descript
         /* Surfel gathering pass */
         surfel_gather_pipeline.enqueue(window, device, bvh, cascade);
     }
+    gather_timer.end(device, 0u);
 
     for (uint32_t i = 0u; i < CASCADE_COUNT; ++i) {
         /* Place a memory barrier on the surfel radiance cache */
@@ -208,6 +213,7 @@ void GIStage::enqueue(const Window& window, const Device& device, const Descript
 
     debug::end_label(device);
     debug::begin_label(device, "Surfel Merging", {0.302f, 0.671f, 0.969f});
+    gather_timer.begin(device, 1u);
 
     for (int i = CASCADE_COUNT - 2; i >= 0; --i) {
         SurfelCascadeResources& src_cascade = cascades[i + 1u];
@@ -216,6 +222,7 @@ void GIStage::enqueue(const Window& window, const Device& device, const Descript
         /* Surfel merge pass */
         surfel_merge_pipeline.enqueue(device, src_cascade, dst_cascade);
     }
+    gather_timer.end(device, 1u);
 
     debug::end_label(device);
     debug::begin_label(device, "Surfel Composite", {0.576f, 0.596f, 0.690f});
@@ -265,6 +272,7 @@ void GIStage::destroy(const Device& device) {
     delete &surfel_accel_pipeline;
     surfel_spawn_pipeline.destroy(device);
     delete &surfel_spawn_pipeline;
+    gather_timer.free(device);
     surfel_gather_pipeline.destroy(device);
     delete &surfel_gather_pipeline;
     surfel_merge_pipeline.destroy(device);
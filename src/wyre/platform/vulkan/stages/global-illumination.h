@@ -7,6 +7,7 @@
 #include "vulkan/api.h"
 
 #include "vulkan/pipelines/global-illumination/cascade.h" /* SurfelCascadeResources */
+#include "vulkan/hardware/timer.h"                         /* GpuTimer */
 
 namespace wyre {
 
@@ -28,6 +29,10 @@ class SurfelDrawPipeline;
 class SurfelHeatmapPipeline;
 class GroundTruthPipeline;
 
+namespace scene {
+enum class TriLayout;
+}
+
 /**
  * @brief Vulkan global illumination rendering stage.
  */
@@ -48,6 +53,9 @@ class GIStage {
     SurfelCompositePipeline& surfel_composite_pipeline;
     SurfelRecyclePipeline& surfel_recycle_pipeline;
 
+    /* Times the surfel gathering (ray tracing) pass (scope 0) & the surfel merging pass (scope 1) */
+    GpuTimer gather_timer {};
+
     /* Debug pipelines */
     SurfelDrawPipeline& surfel_debug_pipeline;
     bool direct_draw = false;
@@ -58,7 +66,7 @@ class GIStage {
     bool ground_truth = false;
 
     GIStage() = delete;
-    explicit GIStage(Logger& logger, const Window& window, const Device& device, const DescriptorSet& bvh);
+    explicit GIStage(Logger& logger, const Window& window, const Device& device, const DescriptorSet& bvh, const scene::TriLayout tri_layout);
     ~GIStage() = default;
 
     void init_resources(Logger& logger, const Device& device);
@@ -72,7 +80,7 @@ class GIStage {
     /**
      * @brief Execute the pipeline.
      */
-    void enqueue(const Window& window, const Device& device, const DescriptorSet& bvh);
+    void enqueue(const Window& window, Device& device, const DescriptorSet& bvh);
 
     /**
      * @brief Update the GI parameters.
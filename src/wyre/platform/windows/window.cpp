@@ -26,7 +26,13 @@ void Window::init(const char* title) {
     open = true;
 }
 
+void Window::init_headless() {
+    handle = nullptr;
+    open = true;
+}
+
 bool Window::init_imgui() const {
+    if (handle == nullptr) return false;
     return ImGui_ImplSDL3_InitForVulkan(handle);
 }
 
@@ -34,6 +40,7 @@ void Window::poll_events(Input& input) {
     /* SDL Input handling */
     SDL_Event event = {};
     input.clear_state(); /* Clear all input state */
+    if (handle == nullptr) return; /* Headless */
 
     while (SDL_PollEvent(&event)) {
         switch (event.type) {
@@ -23,6 +23,9 @@ class Window {
 
     void init(const char* title);
 
+    /** @brief Open without an OS window, for headless rendering. (no events are polled) */
+    void init_headless();
+
     /**
      * @brief Initialize ImGui backend.
      * (SDL3 in the case of Windows)
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <exception> /* std::terminate */
 #include <string>
 #include <stdarg.h> /* va_start, etc */
 
@@ -41,10 +41,11 @@ WyreEngine::~WyreEngine() {
 /**
  * @brief Engine setup.
  */
-bool WyreEngine::init() {
-    window.init("Wyre Engine (Vulkan)");
+bool WyreEngine::init(const bool headless) {
+    if (headless) window.init_headless();
+    else window.init("Wyre Engine (Vulkan)");
 
-    const Result<void> r_device = device.init(logger, window);
+    const Result<void> r_device = device.init(logger, window, headless);
     if (r_device.is_err()) {
         logger.log(LogGroup::GRAPHICS_API, LogLevel::CRITICAL, "failed to init device: %s", r_device.unwrap_err().c_str());
         return false;
@@ -62,10 +63,10 @@ bool WyreEngine::init() {
  * @brief Main engine loop.
  */
 bool WyreEngine::run() {
-    timepoint time = high_resolution_clock::now();
-    while (window.open) {
+    timepoint time = steady_clock::now();
+    for (uint32_t frame = 0u; window.open && (frame_limit == 0u || frame < frame_limit); ++frame) {
         /* Find the delta time */
-        const timepoint ctime = high_resolution_clock::now();
+        const timepoint ctime = steady_clock::now();
         const nanoseconds elapsed = ctime - time;
         time = ctime; /* Update time */
         const float dt = (float)((double)duration_cast<microseconds>(elapsed).count() / 1e6);
@@ -81,6 +82,20 @@ bool WyreEngine::run() {
     return true;
 }
 
+/**
+ * @brief Headless smoke test.
+ */
+bool WyreEngine::smoke() {
+    const Result<void> r_smoke = device.smoke_frame(window);
+    if (r_smoke.is_err()) {
+        logger.log(LogGroup::GRAPHICS_API, LogLevel::CRITICAL, "smoke test failed: %s", r_smoke.unwrap_err().c_str());
+        return false;
+    }
+
+    logger.log(LogGroup::GRAPHICS_API, LogLevel::INFO, "smoke test passed.");
+    return true;
+}
+
 /**
  * @brief Engine resources cleanup.
  */
@@ -13,6 +13,7 @@ class Window;
 class Input;
 class Files;
 class Logger;
+class Renderer;
 
 /**
  * @brief Wyre engine instance.
@@ -34,6 +35,9 @@ class WyreEngine final {
     /* Active camera entity. (has to be set by the game!) */
     Entity active_camera { entt::null };
 
+    /* Stop running after this many frames, zero runs until the window closes. (for automated benchmarks) */
+    uint32_t frame_limit = 0u;
+
     /* System modules */
     Window& window;
     Input& input;
@@ -46,9 +50,10 @@ class WyreEngine final {
 
     /**
      * @brief Initialize engine resources.
+     * @param headless Render into offscreen images, without a window, surface or presenting. (e.g. on machines without a display)
      * @return Boolean to indicate success or failure.
      */
-    [[nodiscard]] bool init();
+    [[nodiscard]] bool init(const bool headless = false);
 
     /**
      * @brief Execute the engine main loop. (will block the thread)
@@ -56,6 +61,12 @@ class WyreEngine final {
      */
     [[nodiscard]] bool run();
 
+    /**
+     * @brief Smoke test a headless engine, one frame is rendered without any system & its target is checked. (for automated runs)
+     * @return Boolean to indicate success or failure.
+     */
+    [[nodiscard]] bool smoke();
+
     /**
      * @brief Free engine resources.
      * @return Boolean to indicate success or failure.